@@ -0,0 +1,130 @@
+# FastCGI load test for server.clv
+#
+# Starts the server once per worker count and measures requests per second
+# with concurrent clients, each sending its requests over new connections
+# the way most web servers talk to FastCGI applications.
+#
+# Server CPU time per request is reported too; with latency 0 and a large
+# number of headers it shows the cost of receiving and parsing requests.
+#
+# usage: python3 loadtest.py [clever binary] [latency ms] [extra headers]
+
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+CLEVER = sys.argv[1] if len(sys.argv) > 1 else '../../clever'
+LATENCY = sys.argv[2] if len(sys.argv) > 2 else '5'
+HEADERS = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+PORT = 9123
+CLIENTS = 16
+REQUESTS = 100
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_RESPONDER = 1
+
+def record(kind, content, request_id=1):
+	pad = -len(content) % 8
+	return struct.pack('>BBHHBx', 1, kind, request_id, len(content), pad) \
+		+ content + b'\0' * pad
+
+def pair(name, value):
+	def length(n):
+		return struct.pack('>B', n) if n < 128 else struct.pack('>I', n | 0x80000000)
+	return length(len(name)) + length(len(value)) + name + value
+
+def request(query):
+	params = {
+		b'REQUEST_METHOD': b'GET',
+		b'SCRIPT_NAME': b'/hello',
+		b'QUERY_STRING': query,
+		b'HTTP_HOST': b'localhost',
+		b'HTTP_USER_AGENT': b'loadtest',
+		b'HTTP_COOKIE': b'session=8f14e45fceea167a5a36dedd4bea2543; theme=dark',
+	}
+	for i in range(HEADERS):
+		params[b'HTTP_X_LOADTEST_%d' % i] = b'value of a synthetic header %d' % i
+	body = b''.join(pair(k, v) for k, v in params.items())
+	return record(FCGI_BEGIN_REQUEST, struct.pack('>HB5x', FCGI_RESPONDER, 0)) \
+		+ record(FCGI_PARAMS, body) + record(FCGI_PARAMS, b'') \
+		+ record(FCGI_STDIN, b'')
+
+def fetch(payload):
+	conn = socket.create_connection(('127.0.0.1', PORT))
+	conn.sendall(payload)
+	chunks = []
+	while True:
+		chunk = conn.recv(65536)
+		if not chunk:
+			break
+		chunks.append(chunk)
+	conn.close()
+
+	data = b''.join(chunks)
+	out, pos = [], 0
+	while pos + 8 <= len(data):
+		_, kind, _, length, pad = struct.unpack('>BBHHBx', data[pos:pos + 8])
+		if kind == FCGI_STDOUT:
+			out.append(data[pos + 8:pos + 8 + length])
+		elif kind == FCGI_END_REQUEST:
+			return b''.join(out)
+		pos += 8 + length + pad
+	raise IOError('incomplete response')
+
+def client(errors):
+	payload = request(b'name=clever')
+	for _ in range(REQUESTS):
+		if b'Hello, clever' not in fetch(payload):
+			errors.append(1)
+
+def wait_listening():
+	for _ in range(100):
+		try:
+			socket.create_connection(('127.0.0.1', PORT)).close()
+			return
+		except socket.error:
+			time.sleep(0.05)
+	raise IOError('server did not start')
+
+def run(workers):
+	env = dict(os.environ,
+		CLEVER_FCGI_ADDRESS=':%d' % PORT,
+		CLEVER_FCGI_WORKERS=str(workers),
+		CLEVER_FCGI_LATENCY=LATENCY)
+	server = subprocess.Popen([CLEVER, 'server.clv'], env=env)
+	try:
+		wait_listening()
+		# The probe connection above is served as an empty request
+		errors = []
+		threads = [threading.Thread(target=client, args=(errors,))
+			for _ in range(CLIENTS)]
+		t0 = time.time()
+		for t in threads:
+			t.start()
+		for t in threads:
+			t.join()
+		elapsed = time.time() - t0
+	finally:
+		server.kill()
+		usage = os.wait4(server.pid, 0)[2]
+
+	total = CLIENTS * REQUESTS
+	cpu = (usage.ru_utime + usage.ru_stime) / total * 1e6
+	print('%d worker(s): %5d requests in %.2fs, %8.1f req/s, %6.1fus server CPU/request%s' % (
+		workers, total, elapsed, total / elapsed, cpu,
+		' (%d errors)' % len(errors) if errors else ''))
+
+if __name__ == '__main__':
+	os.chdir(os.path.dirname(os.path.abspath(__file__)))
+	print('%d clients, %sms simulated backend latency, %d extra headers' % (
+		CLIENTS, LATENCY, HEADERS))
+	for workers in (1, 2, 4, 8):
+		run(workers)
@@ -0,0 +1,98 @@
+# FastCGI upload/download benchmark for transfer.clv
+#
+# Uploads are sent as multipart forms (getForm), raw bodies read at once
+# (readBody) and raw bodies read in chunks (bodyStream); downloads are a
+# file sent with sendFile and a response made of many small prints with
+# different buffer sizes.
+#
+# usage: python3 transfer.py [clever binary]
+
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import loadtest
+
+CLEVER = sys.argv[1] if len(sys.argv) > 1 else '../../clever'
+MB = 1024 * 1024
+BOUNDARY = b'----clever-transfer-benchmark'
+
+def request(script, query=b'', body=b'', content_type=b''):
+	params = {
+		b'REQUEST_METHOD': b'POST' if body else b'GET',
+		b'SCRIPT_NAME': script,
+		b'QUERY_STRING': query,
+		b'CONTENT_LENGTH': str(len(body)).encode(),
+		b'CONTENT_TYPE': content_type,
+		b'HTTP_HOST': b'localhost',
+	}
+	payload = b''.join(loadtest.pair(k, v) for k, v in params.items())
+	records = [loadtest.record(loadtest.FCGI_BEGIN_REQUEST,
+			struct.pack('>HB5x', loadtest.FCGI_RESPONDER, 0)),
+		loadtest.record(loadtest.FCGI_PARAMS, payload),
+		loadtest.record(loadtest.FCGI_PARAMS, b'')]
+	for pos in range(0, len(body), 65535):
+		records.append(loadtest.record(loadtest.FCGI_STDIN, body[pos:pos + 65535]))
+	records.append(loadtest.record(loadtest.FCGI_STDIN, b''))
+	return b''.join(records)
+
+def multipart(data):
+	return b''.join([
+		b'--', BOUNDARY, b'\r\n',
+		b'Content-Disposition: form-data; name="field"\r\n\r\n',
+		b'hello\r\n',
+		b'--', BOUNDARY, b'\r\n',
+		b'Content-Disposition: form-data; name="upload"; filename="data.bin"\r\n',
+		b'Content-Type: application/octet-stream\r\n\r\n',
+		data, b'\r\n',
+		b'--', BOUNDARY, b'--\r\n'])
+
+def timed(name, payload, size, check, repeat=3):
+	best = None
+	for _ in range(repeat):
+		t0 = time.time()
+		out = loadtest.fetch(payload)
+		elapsed = time.time() - t0
+		best = elapsed if best is None else min(best, elapsed)
+	body = out.split(b'\r\n\r\n', 1)[1]
+	ok = check(body)
+	print('%-36s %8.1f MB/s%s' % (name, size / MB / best, '' if ok else ' (wrong response)'))
+
+def main():
+	os.chdir(os.path.dirname(os.path.abspath(__file__)))
+	data = os.urandom(16 * MB)
+	with tempfile.NamedTemporaryFile(delete=False) as f:
+		f.write(data)
+	env = dict(os.environ,
+		CLEVER_FCGI_ADDRESS=':%d' % loadtest.PORT,
+		CLEVER_FCGI_FILE=f.name)
+	server = subprocess.Popen([CLEVER, 'transfer.clv'], env=env)
+	try:
+		loadtest.wait_listening()
+		for size in (MB, 16 * MB):
+			part = data[:size]
+			label = '%dMB' % (size // MB)
+			timed('upload ' + label + ' getForm', request(b'/form', body=multipart(part),
+				content_type=b'multipart/form-data; boundary=' + BOUNDARY), size,
+				lambda out: out == b'hello data.bin %d' % size)
+			timed('upload ' + label + ' readBody', request(b'/body', body=part), size,
+				lambda out: out == b'%d' % size)
+			timed('upload ' + label + ' bodyStream', request(b'/stream', body=part), size,
+				lambda out: out == b'%d' % size)
+		timed('download 16MB sendFile', request(b'/file'), 16 * MB,
+			lambda out: out == data)
+		for buffer in (0, 8192, 65536):
+			query = b'size=100&count=100000&buffer=%d' % buffer
+			timed('download 10MB in 100B prints, buffer %d' % buffer,
+				request(b'/print', query), 100 * 100000,
+				lambda out: out == b'x' * 10000000)
+	finally:
+		server.kill()
+		server.wait()
+		os.unlink(f.name)
+
+if __name__ == '__main__':
+	main()
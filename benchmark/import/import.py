@@ -0,0 +1,101 @@
+# Startup time of scripts importing files
+#
+# Generates a script importing ten files of functions, classes and
+# closures, then reports the mean wall time per run with the compilation
+# cache disabled, starting empty (first run only) and warm.
+#
+# usage: python3 import.py [clever binary]
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+BINARY = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else '../../clever')
+RUNS = 100
+FILES = 10
+
+LIBRARY = '''import std.io.*;
+
+const LIMIT_%(n)d = 100;
+var counter_%(n)d = 0;
+
+function add_%(n)d(a, b) {
+	return a + b;
+}
+
+function counter_make_%(n)d() {
+	var count = 0;
+
+	return function() {
+		count = count + 1;
+		return count;
+	};
+}
+
+class Point_%(n)d {
+	var x;
+	var y;
+
+	function Point_%(n)d(x, y) {
+		this.x = x;
+		this.y = y;
+	}
+
+	function sum() {
+		return this.x + this.y;
+	}
+}
+
+function run_%(n)d() {
+	var total = 0;
+
+	for (var i = 0; i < LIMIT_%(n)d; ++i) {
+		if (i %% 2 == 0) {
+			total = add_%(n)d(total, i);
+		} else {
+			total = total - 1;
+		}
+	}
+	counter_%(n)d = counter_make_%(n)d()();
+
+	return total + Point_%(n)d.new(1, 2).sum();
+}
+'''
+
+def measure(root, cache, runs):
+	env = dict(os.environ, CLEVER_CACHE_DIR=cache)
+	start = time.time()
+
+	for i in range(runs):
+		if cache and runs == 1:
+			shutil.rmtree(cache, ignore_errors=True)
+		subprocess.run([BINARY, 'main.clv'], cwd=root, env=env,
+			stdout=subprocess.DEVNULL, check=True)
+
+	return (time.time() - start) / runs * 1000
+
+root = tempfile.mkdtemp()
+cache = os.path.join(root, 'cache')
+
+try:
+	os.mkdir(os.path.join(root, 'lib'))
+
+	for n in range(FILES):
+		with open(os.path.join(root, 'lib', 'mod%d.clv' % n), 'w') as f:
+			f.write(LIBRARY % {'n': n})
+
+	with open(os.path.join(root, 'main.clv'), 'w') as f:
+		f.write(''.join('import lib.mod%d.*;\n' % n for n in range(FILES)))
+		f.write('import std.io.*;\n')
+		f.write('println(%s);\n' % ' + '.join('run_%d()' % n
+			for n in range(FILES)))
+
+	print('%-14s%14s' % ('cache', 'ms/run'))
+	print('%-14s%14.3f' % ('disabled', measure(root, '', RUNS)))
+	print('%-14s%14.3f' % ('cold', measure(root, cache, 1)))
+	print('%-14s%14.3f' % ('warm', measure(root, cache, RUNS)))
+finally:
+	shutil.rmtree(root)
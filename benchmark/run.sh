@@ -7,6 +7,14 @@ echo "threads/threads_001.clv:"
 ../../clever threads_001.clv
 echo "[OK]"
 
+echo "threads/parallel_001.clv:"
+../../clever parallel_001.clv
+echo "[OK]"
+
+echo "threads/parallel_001.py: [python version]"
+python parallel_001.py
+echo "[OK]"
+
 echo "threads/threads_001.py: [python version]"
 python threads_001.py
 echo "[OK]"
@@ -0,0 +1,36 @@
+# Startup time of short scripts
+#
+# Runs each script many times and reports the mean wall time per run;
+# with a second binary the two are compared. Use --startup-profile to
+# see where the time of a single run goes.
+#
+# usage: python3 startup.py [clever binary] [other clever binary]
+
+import subprocess
+import sys
+import time
+
+BINARIES = sys.argv[1:] or ['../../clever']
+RUNS = 200
+
+SCRIPTS = [
+	('hello', ['-r', 'import std.io.*; println(1);']),
+	('import std.*', ['-qr', 'io:println(1);']),
+	('types', ['-r', 'import std.io.*; import std.collection.*; '
+		'var s = Stack.new(); s.push(1); println([1, 2].size());']),
+]
+
+def measure(binary, args):
+	start = time.time()
+
+	for i in range(RUNS):
+		subprocess.run([binary] + args, stdout=subprocess.DEVNULL, check=True)
+
+	return (time.time() - start) / RUNS * 1000
+
+print('%-14s' % 'script' + ''.join('%14s' % ('ms/run (%d)' % (i + 1))
+	for i in range(len(BINARIES))))
+
+for name, args in SCRIPTS:
+	print('%-14s' % name + ''.join('%14.3f' % measure(binary, args)
+		for binary in BINARIES))
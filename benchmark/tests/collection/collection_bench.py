@@ -0,0 +1,20 @@
+import heapq
+import time
+
+n = 200000
+
+start = time.time()
+s = set()
+for i in range(n):
+    s.add((i * 7919) % n)
+print("set:                     %fs" % (time.time() - start))
+
+start = time.time()
+q = []
+for i in range(n):
+    heapq.heappush(q, (i * 7919) % n)
+while q:
+    heapq.heappop(q)
+print("heapq:                   %fs" % (time.time() - start))
+
+print("Python")
@@ -0,0 +1,26 @@
+import base64
+import hashlib
+import time
+
+data = b"0123456789abcdef"
+while len(data) < 16000000:
+    data = data + data
+mb = len(data) / 1000000.0
+
+for algorithm in ["md5", "sha256"]:
+    start = time.time()
+    h = hashlib.new(algorithm)
+    h.update(data)
+    h.hexdigest()
+    print("%s: %f MB/s" % (algorithm, mb / (time.time() - start)))
+
+start = time.time()
+encoded = base64.b64encode(data)
+print("base64_encode: %f MB/s" % (mb / (time.time() - start)))
+
+start = time.time()
+decoded = base64.b64decode(encoded)
+print("base64_decode: %f MB/s" % (mb / (time.time() - start)))
+
+print("Python")
+print(decoded == data)
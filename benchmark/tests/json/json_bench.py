@@ -0,0 +1,30 @@
+import json
+import time
+
+records = []
+
+for i in range(40000):
+    records.append({
+        "id": i,
+        "name": "user %d" % i,
+        "email": "user%d@example.com" % i,
+        "score": i * 0.25,
+        "active": i % 2 == 0,
+        "tags": ["alpha", "beta", "gamma"]
+    })
+
+text = json.dumps(records, separators=(",", ":"))
+mb = len(text) / 1000000.0
+
+start = time.time()
+for i in range(5):
+    text = json.dumps(records, separators=(",", ":"))
+print("stringify: %f MB/s" % (mb * 5 / (time.time() - start)))
+
+start = time.time()
+for i in range(5):
+    parsed = json.loads(text)
+print("parse:     %f MB/s" % (mb * 5 / (time.time() - start)))
+
+print("Python")
+print(len(parsed))
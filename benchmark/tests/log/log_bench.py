@@ -0,0 +1,36 @@
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# The sink takes 64KB, then stalls for 50ms, as a disk under pressure would
+
+CLEVER = sys.argv[1] if len(sys.argv) > 1 else "./clever"
+SCRIPT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "log_bench.clv")
+
+def slow_reader(path):
+    with open(path, "rb") as fifo:
+        read = 0
+        while True:
+            data = fifo.read(4096)
+            if not data:
+                break
+            read += len(data)
+            if read >= 65536:
+                read = 0
+                time.sleep(0.05)
+
+for mode in ("script", "native"):
+    path = os.path.join(tempfile.mkdtemp(), "sink")
+    os.mkfifo(path)
+
+    reader = threading.Thread(target=slow_reader, args=(path,))
+    reader.start()
+
+    subprocess.call([CLEVER, SCRIPT, mode, path])
+
+    reader.join()
+    os.unlink(path)
+    os.rmdir(os.path.dirname(path))
@@ -0,0 +1,37 @@
+import mmap
+import os
+import time
+
+path = "mappedfile_bench.tmp"
+line = "2013-01-01 12:00:00 INFO request served in 12ms, status=200\n"
+with open(path, "w") as f:
+    f.write(line * (100000000 // len(line)))
+
+mb = os.path.getsize(path) / 1000000.0
+count = 0
+
+start = time.time()
+with open(path) as f:
+    for l in f:
+        count += 1
+print("readline:  %f MB/s" % (mb / (time.time() - start)))
+
+with open(path, "rb") as f:
+    m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+    start = time.time()
+    for l in iter(m.readline, b""):
+        count += 1
+    print("mmap:      %f MB/s" % (mb / (time.time() - start)))
+
+    m.seek(0)
+    start = time.time()
+    for chunk in iter(lambda: m.read(1000000), b""):
+        count += 1
+    print("readChunk: %f MB/s" % (mb / (time.time() - start)))
+    m.close()
+
+os.remove(path)
+
+print("Python")
+print(count)
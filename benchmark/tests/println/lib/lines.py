@@ -0,0 +1,7 @@
+import sys
+
+write = sys.stdout.write
+
+for i in range(5000000):
+    write("line " + str(i) + " of the output\n")
+    write("line %d of %s\n" % (i, "the output"))
@@ -0,0 +1,38 @@
+import json
+import pickle
+import time
+
+records = []
+
+for i in range(40000):
+    records.append({
+        "id": i,
+        "name": "user %d" % i,
+        "email": "user%d@example.com" % i,
+        "score": i * 0.25,
+        "active": i % 2 == 0,
+        "tags": ["alpha", "beta", "gamma"]
+    })
+
+start = time.time()
+for i in range(5):
+    data = pickle.dumps(records)
+print("serialize:   %fs (%d bytes)" % (time.time() - start, len(data)))
+
+start = time.time()
+for i in range(5):
+    copy = pickle.loads(data)
+print("unserialize: %fs" % (time.time() - start))
+
+start = time.time()
+for i in range(5):
+    data = json.dumps(records, separators=(",", ":"))
+print("stringify:   %fs (%d bytes)" % (time.time() - start, len(data)))
+
+start = time.time()
+for i in range(5):
+    copy = json.loads(data)
+print("parse:       %fs" % (time.time() - start))
+
+print("Python")
+print(len(copy))
@@ -0,0 +1,24 @@
+import sqlite3
+
+n = 1000000
+conn = sqlite3.connect(":memory:")
+
+conn.execute("CREATE TABLE bench (id INTEGER, name TEXT, score REAL)")
+
+with conn:
+	for i in range(n):
+		conn.execute("INSERT INTO bench VALUES (?, ?, ?)", (i, "row", 0.5))
+
+total = 0
+cur = conn.execute("SELECT id, name, score FROM bench")
+
+while True:
+	rows = cur.fetchmany(1000)
+	if not rows:
+		break
+	total += len(rows)
+
+print("Python")
+print(total)
+
+conn.close()
@@ -0,0 +1,14 @@
+n = 100000
+piece = "0123456789" * 10
+html = ""
+
+for i in range(n):
+	html = html + piece
+
+parts = []
+
+for i in range(n):
+	parts.append(piece)
+
+print("Python")
+print(len(html) + len("".join(parts)))
@@ -0,0 +1,24 @@
+import time
+
+line = "2013-01-01 12:00:00 INFO request served in 12ms, status=200\n"
+text = line * (20000000 // len(line))
+mb = len(text) / 1000000.0
+
+start = time.time()
+lines = text.splitlines()
+print("splitLines: %f MB/s" % (mb / (time.time() - start)))
+
+start = time.time()
+fields = text.split(" ")
+print("split:      %f MB/s" % (mb / (time.time() - start)))
+
+start = time.time()
+joined = "\n".join(lines)
+print("join:       %f MB/s" % (mb / (time.time() - start)))
+
+start = time.time()
+replaced = text.replace(", ", "; ")
+print("replaceAll: %f MB/s" % (mb / (time.time() - start)))
+
+print("Python")
+print(len(lines) + len(fields))
@@ -0,0 +1,30 @@
+import time
+
+n = 100000
+x = 0.2
+
+pol = []
+mu = 10.0
+for j in range(100):
+    mu = (mu + 2.0) / 2.0
+    pol.append(mu)
+
+start = time.time()
+pu = 0.0
+for i in range(n):
+    s = 0.0
+    for j in range(100):
+        s = x * s + pol[j]
+    pu = pu + s
+print("list polynomial:         %fs" % (time.time() - start))
+
+size = 1000000
+values = [i * 0.5 for i in range(size)]
+
+start = time.time()
+total = 0.0
+for v in values:
+    total += v * v
+print("list dot product:        %fs" % (time.time() - start))
+
+print("Python")
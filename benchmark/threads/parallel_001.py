@@ -0,0 +1,33 @@
+import timeit
+from multiprocessing import Pool
+
+def work(x):
+	steps = 0
+	n = x
+	while n > 1:
+		if n % 2 == 0:
+			n = n // 2
+		else:
+			n = 3 * n + 1
+		steps += 1
+	return steps
+
+if __name__ == '__main__':
+	N = 200000
+	data = range(1, N + 1)
+
+	t0 = timeit.default_timer()
+	expected = list(map(work, data))
+	tseq = timeit.default_timer() - t0
+	print("map:                   %fs" % tseq)
+
+	threads = 1
+	while threads <= 8:
+		pool = Pool(threads)
+		t0 = timeit.default_timer()
+		steps = pool.map(work, data, 1000)
+		elapsed = timeit.default_timer() - t0
+		pool.close()
+		pool.join()
+		print("Pool.map, %d process(es): %fs (speedup %f)" % (threads, elapsed, tseq / elapsed))
+		threads *= 2
@@ -8,9 +8,16 @@
 #include "core/ast.h"
 #include "core/astvisitor.h"
 #include "core/asttransformer.h"
+#include "core/compunit.h"
 
 namespace clever { namespace ast {
 
+ModuleUnit::~ModuleUnit()
+{
+	clever_delref(m_tree);
+	delete m_unit;
+}
+
 // Visitors
 
 void Node::accept(Visitor& visitor) { visitor.visit(this); }
@@ -65,6 +72,8 @@ void Bitwise::accept(Visitor& visitor) { visitor.visit(this); }
 
 void Import::accept(Visitor& visitor) { visitor.visit(this); }
 
+void ModuleUnit::accept(Visitor& visitor) { visitor.visit(this); }
+
 void IncDec::accept(Visitor& visitor) { visitor.visit(this); }
 
 void Boolean::accept(Visitor& visitor) { visitor.visit(this); }
@@ -151,6 +160,8 @@ Node* Bitwise::accept(Transformer& transformer) { return transformer.transform(t
 
 Node* Import::accept(Transformer& transformer) { return transformer.transform(this); }
 
+Node* ModuleUnit::accept(Transformer& transformer) { return transformer.transform(this); }
+
 Node* IncDec::accept(Transformer& transformer) { return transformer.transform(this); }
 
 Node* Boolean::accept(Transformer& transformer) { return transformer.transform(this); }
@@ -14,6 +14,10 @@
 #include "core/clever.h"
 #include "core/scope.h"
 
+namespace clever {
+class CompiledUnit;
+}
+
 namespace clever { namespace ast {
 
 class Node;
@@ -37,6 +41,7 @@ class Return;
 class Logic;
 class Bitwise;
 class Import;
+class ModuleUnit;
 class Boolean;
 class NullLit;
 class MethodCall;
@@ -406,6 +411,31 @@ private:
 	DISALLOW_COPY_AND_ASSIGN(Import);
 };
 
+/// File imported into the global scope; its code either comes from the
+/// parsed tree or from the compilation cache (see CompiledUnit)
+class ModuleUnit: public Node {
+public:
+	ModuleUnit(CompiledUnit* unit, Node* tree, const location& location)
+		: Node(location), m_unit(unit), m_tree(tree) {
+		clever_addref(m_tree);
+	}
+
+	~ModuleUnit();
+
+	CompiledUnit* getUnit() const { return m_unit; }
+
+	bool hasTree() const { return m_tree != NULL; }
+	Node* getTree() const { return m_tree; }
+
+	virtual void accept(Visitor& visitor);
+	virtual Node* accept(Transformer& transformer);
+private:
+	CompiledUnit* m_unit;
+	Node* m_tree;
+
+	DISALLOW_COPY_AND_ASSIGN(ModuleUnit);
+};
+
 class VariableDecl: public Node {
 public:
 	VariableDecl(Ident* ident, Assignment* assignment, bool is_const,
@@ -176,6 +176,13 @@ void Visitor::visit(Import* node)
 	}
 }
 
+void Visitor::visit(ModuleUnit* node)
+{
+	if (node->hasTree()) {
+		Visitor::visit(static_cast<NodeArray*>(node->getTree()));
+	}
+}
+
 void Visitor::visit(IncDec* node)
 {
 	node->getVar()->accept(*this);
@@ -54,6 +54,7 @@ public:
 	virtual void visit(Boolean* node);
 	virtual void visit(Comparison* node);
 	virtual void visit(Import* node);
+	virtual void visit(ModuleUnit* node);
 	virtual void visit(Instantiation* node);
 	virtual void visit(Property* node);
 	virtual void visit(Try* node);
@@ -12,6 +12,7 @@
 #include "core/cstring.h"
 #include "core/value.h"
 #include "core/cexception.h"
+#include "core/output.h"
 
 namespace clever {
 
@@ -139,8 +140,9 @@ void vprintfln(const char* format, va_list args) {
 	std::ostringstream out;
 
 	vsprintf(out, format, args);
+	out << '\n';
 
-	std::cout << out.str() << std::endl;
+	OutputBuffer::getStdout().write(out.str());
 }
 
 void printfln(const char* format, ...) {
@@ -171,7 +173,7 @@ void printf(const char* format, ...) {
 
 	vsprintf(out, format, args);
 
-	std::cout << out.str();
+	OutputBuffer::getStdout().write(out.str());
 
 	va_end(args);
 }
@@ -197,7 +199,7 @@ void printf(const char* format, ...) {
 //	clever_check_args("sdi") - check that the first arg is a string, the second
 //								a double and the third an integer
 //	clever_check_args("*si") - ignore the first arg, verify the second and third
-bool check_args(const ::std::vector<Value*>& args, const char* typespec,
+bool check_args(ValueSpan args, const char* typespec,
 	CException* exception, const Type* type)
 {
 	size_t argslen = args.size();
@@ -34,6 +34,38 @@ struct Clever {
 		: vm(vm_), exception(exception_) {}
 };
 
+/**
+ * Arguments of a native function call
+ *
+ * A (pointer, count) view of Value pointers owned by the caller, usually the
+ * argument stack of the VM; it is only valid during the call.
+ */
+class ValueSpan {
+public:
+	typedef Value* const* const_iterator;
+
+	ValueSpan()
+		: m_data(NULL), m_size(0) {}
+
+	ValueSpan(Value* const* data, size_t size)
+		: m_data(data), m_size(size) {}
+
+	ValueSpan(const ::std::vector<Value*>& vec)
+		: m_data(vec.empty() ? NULL : &vec[0]), m_size(vec.size()) {}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	Value* operator[](size_t index) const { return m_data[index]; }
+	Value* at(size_t index) const { return m_data[index]; }
+
+	const_iterator begin() const { return m_data; }
+	const_iterator end() const { return m_data + m_size; }
+private:
+	Value* const* m_data;
+	size_t m_size;
+};
+
 // Version macros
 #define CLEVER_VERSION 100    // 0.1.0
 #define CLEVER_VERSION_STRING "0.1.0-dev"
@@ -158,7 +190,7 @@ void printfln(const char*, ...);
 #define clever_check_no_args()  clever_check_args(NULL)
 #define clever_static_check_no_args()  clever_static_check_args(NULL)
 
-bool check_args(const ::std::vector<Value*>&, const char*, CException*, const Type* = NULL);
+bool check_args(ValueSpan, const char*, CException*, const Type* = NULL);
 
 #define clever_this()           obj
 #define clever_get_object(t, n) static_cast<t>((n)->getObj())
@@ -8,6 +8,7 @@
 #include "core/compiler.h"
 #include "core/codegen.h"
 #include "core/irbuilder.h"
+#include "core/compunit.h"
 #include "modules/std/core/function.h"
 
 namespace clever { namespace ast {
@@ -728,6 +729,20 @@ void Codegen::visit(Import* node)
 	}
 }
 
+void Codegen::visit(ModuleUnit* node)
+{
+	CompiledUnit* unit = node->getUnit();
+
+	if (!node->hasTree()) {
+		unit->codegen(m_builder);
+		return;
+	}
+
+	unit->beginCodegen(m_builder);
+	Visitor::visit(static_cast<NodeArray*>(node->getTree()));
+	unit->endCodegen(m_builder);
+}
+
 void Codegen::visit(Subscript* node)
 {
 	node->getVar()->accept(*this);
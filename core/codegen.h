@@ -59,6 +59,7 @@ public:
 	void visit(Arithmetic*);
 	void visit(Comparison*);
 	void visit(Import*);
+	void visit(ModuleUnit*);
 	void visit(If*);
 	void visit(Logic*);
 	void visit(Boolean*);
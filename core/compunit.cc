@@ -0,0 +1,1600 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stack>
+#ifdef CLEVER_MSVC
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
+#ifdef CLEVER_WIN32
+# include <direct.h>
+# include <process.h>
+# include <windows.h>
+#else
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+#include "core/compunit.h"
+#include "core/value.h"
+#include "core/scope.h"
+#include "core/irbuilder.h"
+#include "core/modmanager.h"
+#include "core/resolver.h"
+#include "core/user.h"
+#include "modules/std/core/function.h"
+
+namespace clever {
+
+/// Bumped whenever the layout of the cache files changes
+#define CLEVER_UNIT_FORMAT 2
+
+/// Cache files are only read by the build that wrote them, as the
+/// instructions generated for a file change between builds
+static const char* const _unit_build = CLEVER_VERSION_STRING " " __DATE__ " " __TIME__;
+
+static const char _unit_magic[] = "CLVC";
+
+// FNV-1a
+static unsigned long long _hash(const char* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool _read_file(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+
+	if (!file) {
+		return false;
+	}
+
+	std::ostringstream buf;
+
+	buf << file.rdbuf();
+	contents = buf.str();
+
+	return true;
+}
+
+static std::string _absolute_path(const std::string& path)
+{
+#ifdef CLEVER_WIN32
+	char buf[MAX_PATH];
+
+	return _fullpath(buf, path.c_str(), MAX_PATH) ? buf : path;
+#else
+	char* real = ::realpath(path.c_str(), NULL);
+
+	if (!real) {
+		return path;
+	}
+
+	std::string result(real);
+
+	::free(real);
+
+	return result;
+#endif
+}
+
+/// Creates the directory and its parents
+static void _make_dirs(const std::string& dir)
+{
+	for (size_t pos = 1; pos <= dir.size(); ++pos) {
+		if (pos == dir.size() || dir[pos] == '/' || dir[pos] == '\\') {
+#ifdef CLEVER_WIN32
+			_mkdir(dir.substr(0, pos).c_str());
+#else
+			::mkdir(dir.substr(0, pos).c_str(), 0777);
+#endif
+		}
+	}
+}
+
+/// Cache file encoding; integers are written as base 128 varints and
+/// references (which may be -1) as ref + 1
+class UnitWriter {
+public:
+	void putInt(unsigned long long n) {
+		while (n >= 0x80) {
+			m_buf += static_cast<char>((n & 0x7f) | 0x80);
+			n >>= 7;
+		}
+		m_buf += static_cast<char>(n);
+	}
+
+	void putRef(long ref) { putInt(static_cast<unsigned long long>(ref + 1)); }
+
+	void putSigned(long n) {
+		putInt(n < 0 ? (~static_cast<unsigned long long>(n) << 1) | 1
+			: static_cast<unsigned long long>(n) << 1);
+	}
+
+	void putDouble(double n) {
+		char bytes[sizeof(double)];
+
+		::memcpy(bytes, &n, sizeof(double));
+		m_buf.append(bytes, sizeof(double));
+	}
+
+	void putString(const std::string& str) {
+		putInt(str.size());
+		m_buf += str;
+	}
+
+	void putName(const CString* name) { putString(name ? *name : ""); }
+
+	const std::string& getBuffer() const { return m_buf; }
+private:
+	std::string m_buf;
+};
+
+class UnitReader {
+public:
+	UnitReader(const std::string& buf)
+		: m_pos(buf.data()), m_end(buf.data() + buf.size()), m_valid(true) {}
+
+	unsigned long long getInt() {
+		unsigned long long n = 0;
+
+		for (size_t shift = 0; m_pos < m_end && shift < 64; shift += 7) {
+			unsigned char c = *m_pos++;
+
+			n |= static_cast<unsigned long long>(c & 0x7f) << shift;
+
+			if (!(c & 0x80)) {
+				return n;
+			}
+		}
+
+		m_valid = false;
+		return 0;
+	}
+
+	size_t getSize() { return static_cast<size_t>(getInt()); }
+
+	long getRef() { return static_cast<long>(getInt()) - 1; }
+
+	long getSigned() {
+		unsigned long long n = getInt();
+
+		return static_cast<long>(n & 1 ? ~(n >> 1) : n >> 1);
+	}
+
+	double getDouble() {
+		double n = 0;
+
+		if (m_end - m_pos < long(sizeof(double))) {
+			m_valid = false;
+		} else {
+			::memcpy(&n, m_pos, sizeof(double));
+			m_pos += sizeof(double);
+		}
+		return n;
+	}
+
+	std::string getString() {
+		size_t size = getSize();
+
+		if (size_t(m_end - m_pos) < size) {
+			m_valid = false;
+			return "";
+		}
+
+		std::string str(m_pos, size);
+
+		m_pos += size;
+
+		return str;
+	}
+
+	const CString* getName() {
+		std::string str = getString();
+
+		return str.empty() ? NULL : CSTRING(str);
+	}
+
+	/// Reads a count of items, each taking at least a byte
+	size_t getCount() {
+		size_t count = getSize();
+
+		if (count > size_t(m_end - m_pos)) {
+			m_valid = false;
+			return 0;
+		}
+		return count;
+	}
+
+	/// Hash of the bytes not read yet
+	unsigned long long hashRest() const { return _hash(m_pos, m_end - m_pos); }
+
+	bool isValid() const { return m_valid; }
+	bool atEnd() const { return m_pos == m_end; }
+private:
+	const char* m_pos;
+	const char* m_end;
+	bool m_valid;
+};
+
+/// Objects met while recording a unit
+struct CompiledUnit::Recorder {
+	typedef std::tr1::unordered_map<const void*, long> IndexMap;
+
+	Recorder(Environment* global_)
+		: global(global_), valid(true) {}
+
+	Environment* global;
+	IndexMap envs;
+	IndexMap funcs;
+	IndexMap classes;
+	std::tr1::unordered_map<size_t, long> externs;
+	std::vector<Environment*> env_list;
+	std::vector<const Function*> func_list;
+	size_t last_ir;
+	size_t last_const;
+	size_t last_temp;
+	bool valid;
+};
+
+CompiledUnit::CompiledUnit(const std::string& file, const std::string& cache_dir)
+	: m_file(file), m_hash(0), m_cacheable(false), m_temps(0), m_scope(NULL),
+	  m_first_value(0), m_last_value(0), m_first_symbol(0), m_first_ir(0),
+	  m_first_const(0), m_first_temp(0), m_global_base(0), m_const_base(0),
+	  m_temp_base(0), m_ir_base(0)
+{
+	const std::string& path = _absolute_path(file);
+	char name[32];
+
+	::sprintf(name, "%016llx.clvc", _hash(path.data(), path.size()));
+
+	m_path = cache_dir + "/" + name;
+}
+
+std::string CompiledUnit::getCacheDir()
+{
+	if (const char* dir = getenv("CLEVER_CACHE_DIR")) {
+		return dir;
+	}
+#ifdef CLEVER_WIN32
+	if (const char* dir = getenv("LOCALAPPDATA")) {
+		return std::string(dir) + "\\clever";
+	}
+#else
+	const char* dir = getenv("XDG_CACHE_HOME");
+
+	if (dir && *dir) {
+		return std::string(dir) + "/clever";
+	}
+	if ((dir = getenv("HOME")) && *dir) {
+		return std::string(dir) + "/.cache/clever";
+	}
+#endif
+	return "";
+}
+
+bool CompiledUnit::load()
+{
+	std::string source, buf;
+
+	if (!_read_file(m_file, source)) {
+		return false;
+	}
+
+	m_hash = _hash(source.data(), source.size());
+	m_cacheable = true;
+
+	if (!_read_file(m_path, buf) || buf.compare(0, 4, _unit_magic) != 0) {
+		return false;
+	}
+
+	const std::string& data = buf.substr(4);
+	UnitReader in(data);
+
+	if (in.getInt() != CLEVER_UNIT_FORMAT || in.getString() != _unit_build
+		|| in.getInt() != m_hash) {
+		return false;
+	}
+
+	// The rest of the file is checked against its hash, so that a damaged
+	// file is compiled again instead of producing wrong code
+	unsigned long long payload_hash = in.getInt();
+
+	if (!in.isValid() || in.hashRest() != payload_hash) {
+		return false;
+	}
+
+	m_consts.resize(in.getCount());
+
+	for (size_t i = 0; i < m_consts.size(); ++i) {
+		Const& value = m_consts[i];
+
+		value.type = static_cast<ConstType>(in.getInt());
+
+		switch (value.type) {
+			case INT_CONST:    value.lval = in.getSigned();  break;
+			case DOUBLE_CONST: value.dval = in.getDouble();  break;
+			case STR_CONST:    value.sval = CSTRING(in.getString()); break;
+			default:           return false;
+		}
+	}
+
+	m_temps = in.getSize();
+
+	m_envs.resize(in.getCount());
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		Env& env = m_envs[i];
+
+		env.outer = in.getRef();
+		env.temps = in.getRef();
+		env.slots.resize(in.getCount());
+
+		for (size_t j = 0; j < env.slots.size(); ++j) {
+			Slot& slot = env.slots[j];
+
+			slot.kind = static_cast<SlotKind>(in.getInt());
+			slot.is_const = in.getInt();
+			slot.ref = in.getRef();
+		}
+	}
+
+	m_funcs.resize(in.getCount());
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		Func& func = m_funcs[i];
+
+		func.name = in.getName();
+		func.env = in.getRef();
+		func.context = in.getRef();
+		func.addr = in.getSize();
+		func.num_args = in.getSize();
+		func.num_rargs = in.getSize();
+		func.flags = in.getSize();
+	}
+
+	m_classes.resize(in.getCount());
+
+	for (size_t i = 0; i < m_classes.size(); ++i) {
+		Class& type = m_classes[i];
+
+		type.name = in.getName();
+		type.env = in.getRef();
+		type.ctor = in.getRef();
+		type.dtor = in.getRef();
+		type.members.resize(in.getCount());
+
+		for (size_t j = 0; j < type.members.size(); ++j) {
+			Member& member = type.members[j];
+
+			member.name = in.getName();
+			member.flags = in.getSize();
+			member.func = in.getRef();
+			member.is_const = in.getInt();
+		}
+	}
+
+	m_imports.resize(in.getCount());
+
+	for (size_t i = 0; i < m_imports.size(); ++i) {
+		Import& import = m_imports[i];
+
+		import.module = in.getName();
+		import.kind = in.getSize();
+		import.name = in.getName();
+		import.loaded = in.getInt();
+		import.count = in.getSize();
+	}
+
+	m_globals.resize(in.getCount());
+
+	for (size_t i = 0; i < m_globals.size(); ++i) {
+		Slot& slot = m_globals[i];
+
+		slot.kind = static_cast<SlotKind>(in.getInt());
+		slot.is_const = in.getInt();
+		slot.ref = in.getRef();
+		slot.name = in.getName();
+	}
+
+	m_externs.resize(in.getCount());
+
+	for (size_t i = 0; i < m_externs.size(); ++i) {
+		m_externs[i] = in.getName();
+	}
+
+	m_code.resize(in.getCount());
+
+	for (size_t i = 0; i < m_code.size(); ++i) {
+		Instr& instr = m_code[i];
+
+		instr.opcode = static_cast<Opcode>(in.getInt());
+
+		for (size_t j = 0; j < 3; ++j) {
+			Op& op = instr.ops[j];
+
+			op.type = static_cast<OperandType>(in.getInt());
+			op.kind = static_cast<OperandKind>(in.getInt());
+			op.depth = in.getSize();
+			op.index = in.getSize();
+		}
+
+		instr.has_file = in.getInt();
+
+		for (size_t j = 0; j < 2; ++j) {
+			instr.lines[j] = in.getSize();
+			instr.columns[j] = in.getSize();
+		}
+	}
+
+	if (!in.isValid() || !in.atEnd() || !isConsistent()) {
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+// Orders functions by address, so that nested ones come after the
+// function containing them
+static bool _addr_less(const std::pair<size_t, size_t>& a,
+	const std::pair<size_t, size_t>& b)
+{
+	return a.first < b.first;
+}
+
+/// Checks the references between the parts of a unit read from a file
+bool CompiledUnit::isConsistent() const
+{
+	long nenvs = m_envs.size(), nfuncs = m_funcs.size(),
+		nclasses = m_classes.size();
+	size_t nglobals = 0;
+
+	for (size_t i = 0; i < m_globals.size(); ++i) {
+		const Slot& slot = m_globals[i];
+
+		if (slot.kind == IMPORT_SLOT) {
+			if (slot.ref < 0 || slot.ref >= long(m_imports.size())) {
+				return false;
+			}
+			nglobals += m_imports[slot.ref].count;
+			continue;
+		}
+
+		if ((slot.kind == FUNCTION_SLOT && (slot.ref < 0 || slot.ref >= nfuncs))
+			|| (slot.kind == CLASS_SLOT && (slot.ref < 0 || slot.ref >= nclasses))
+			|| slot.kind > IMPORT_SLOT) {
+			return false;
+		}
+		++nglobals;
+	}
+
+	// Number of environments from each one to the global one
+	std::vector<size_t> env_depths(m_envs.size());
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		const Env& env = m_envs[i];
+
+		if (env.outer < -1 || env.outer >= nenvs || env.temps < -1) {
+			return false;
+		}
+
+		// The chain of outer environments must reach the global one
+		long outer = env.outer;
+		long depth = 1;
+
+		for (; outer >= 0; ++depth) {
+			if (depth > nenvs) {
+				return false;
+			}
+			outer = m_envs[outer].outer;
+		}
+		env_depths[i] = depth;
+
+		for (size_t j = 0; j < env.slots.size(); ++j) {
+			const Slot& slot = env.slots[j];
+
+			if ((slot.kind == FUNCTION_SLOT && (slot.ref < 0 || slot.ref >= nfuncs))
+				|| (slot.kind == CLASS_SLOT && (slot.ref < 0 || slot.ref >= nclasses))
+				|| slot.kind >= IMPORT_SLOT) {
+				return false;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		const Func& func = m_funcs[i];
+
+		if (!func.name || func.env < 0 || func.env >= nenvs
+			|| func.context < -1 || func.context >= nclasses
+			|| func.addr >= m_code.size()) {
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_classes.size(); ++i) {
+		const Class& type = m_classes[i];
+
+		if (!type.name || type.env < 0 || type.env >= nenvs
+			|| type.ctor < -1 || type.ctor >= nfuncs
+			|| type.dtor < -1 || type.dtor >= nfuncs) {
+			return false;
+		}
+
+		for (size_t j = 0; j < type.members.size(); ++j) {
+			if (!type.members[j].name || type.members[j].func < -1
+				|| type.members[j].func >= nfuncs) {
+				return false;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < m_imports.size(); ++i) {
+		if (!m_imports[i].module) {
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < m_externs.size(); ++i) {
+		if (!m_externs[i]) {
+			return false;
+		}
+	}
+
+	// The environment each instruction runs in, as in record(): the one of
+	// the innermost function containing it, or -1 for the global code
+	std::vector<long> code_envs(m_code.size(), -1);
+	std::vector<std::pair<size_t, size_t> > funcs;
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		funcs.push_back(std::pair<size_t, size_t>(m_funcs[i].addr, i));
+	}
+
+	std::sort(funcs.begin(), funcs.end(), _addr_less);
+
+	for (size_t i = 0; i < funcs.size(); ++i) {
+		size_t addr = funcs[i].first;
+
+		if (addr == 0) {
+			return false;
+		}
+
+		// The body is jumped over by the instruction before it
+		const Op& end = m_code[addr - 1].ops[0];
+
+		if (m_code[addr - 1].opcode != OP_JMP || end.type != JMP_ADDR
+			|| end.kind != ADDRESS_OP || end.index < addr || end.index > m_code.size()) {
+			return false;
+		}
+
+		std::fill(code_envs.begin() + addr, code_envs.begin() + end.index,
+			m_funcs[funcs[i].second].env);
+	}
+
+	for (size_t i = 0; i < m_code.size(); ++i) {
+		const Instr& instr = m_code[i];
+		long env = code_envs[i];
+		size_t depth = env < 0 ? 0 : env_depths[env];
+
+		if (instr.opcode >= NUM_OPCODES) {
+			return false;
+		}
+
+		for (size_t j = 0; j < 3; ++j) {
+			const Op& op = instr.ops[j];
+			size_t limit;
+			bool valid;
+
+			switch (op.kind) {
+				case ABSOLUTE_OP: limit = size_t(-1);        break;
+				case GLOBAL_OP:   limit = nglobals;          break;
+				case EXTERN_OP:   limit = m_externs.size();  break;
+				case CONST_OP:    limit = m_consts.size();   break;
+				case TEMP_OP:     limit = m_temps;           break;
+				case ADDRESS_OP:  limit = m_code.size() + 1; break;
+				default:          return false;
+			}
+
+			if (op.index >= limit) {
+				return false;
+			}
+
+			// The operand must be in the environments the instruction can
+			// reach, as the VM reads them unchecked
+			switch (op.type) {
+				case FETCH_VAR:
+					if (op.kind == GLOBAL_OP || op.kind == EXTERN_OP) {
+						valid = op.depth == depth;
+					} else if (op.kind == ABSOLUTE_OP && op.depth < depth) {
+						long outer = env;
+
+						for (size_t k = 0; k < op.depth; ++k) {
+							outer = m_envs[outer].outer;
+						}
+						valid = op.index < m_envs[outer].slots.size();
+					} else {
+						valid = false;
+					}
+					break;
+
+				case FETCH_CONST:
+					valid = op.depth == 0 && (op.kind == CONST_OP
+						|| (op.kind == ABSOLUTE_OP && op.index <= 2));
+					break;
+
+				case FETCH_TMP:
+					if (env < 0) {
+						valid = op.depth == 0 && op.kind == TEMP_OP;
+					} else {
+						valid = op.depth == 0 && op.kind == ABSOLUTE_OP
+							&& long(op.index) < m_envs[env].temps;
+					}
+					break;
+
+				case JMP_ADDR:
+					valid = op.kind == ADDRESS_OP;
+					break;
+
+				case UNUSED:
+					valid = op.kind == ABSOLUTE_OP;
+					break;
+
+				default:
+					valid = false;
+					break;
+			}
+
+			if (!valid) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void CompiledUnit::clear()
+{
+	m_consts.clear();
+	m_temps = 0;
+	m_envs.clear();
+	m_funcs.clear();
+	m_classes.clear();
+	m_imports.clear();
+	m_globals.clear();
+	m_externs.clear();
+	m_code.clear();
+}
+
+void CompiledUnit::save() const
+{
+	UnitWriter out;
+
+	out.putInt(m_consts.size());
+
+	for (size_t i = 0; i < m_consts.size(); ++i) {
+		const Const& value = m_consts[i];
+
+		out.putInt(value.type);
+
+		switch (value.type) {
+			case INT_CONST:    out.putSigned(value.lval); break;
+			case DOUBLE_CONST: out.putDouble(value.dval); break;
+			case STR_CONST:    out.putString(*value.sval); break;
+		}
+	}
+
+	out.putInt(m_temps);
+
+	out.putInt(m_envs.size());
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		const Env& env = m_envs[i];
+
+		out.putRef(env.outer);
+		out.putRef(env.temps);
+		out.putInt(env.slots.size());
+
+		for (size_t j = 0; j < env.slots.size(); ++j) {
+			out.putInt(env.slots[j].kind);
+			out.putInt(env.slots[j].is_const);
+			out.putRef(env.slots[j].ref);
+		}
+	}
+
+	out.putInt(m_funcs.size());
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		const Func& func = m_funcs[i];
+
+		out.putName(func.name);
+		out.putRef(func.env);
+		out.putRef(func.context);
+		out.putInt(func.addr);
+		out.putInt(func.num_args);
+		out.putInt(func.num_rargs);
+		out.putInt(func.flags);
+	}
+
+	out.putInt(m_classes.size());
+
+	for (size_t i = 0; i < m_classes.size(); ++i) {
+		const Class& type = m_classes[i];
+
+		out.putName(type.name);
+		out.putRef(type.env);
+		out.putRef(type.ctor);
+		out.putRef(type.dtor);
+		out.putInt(type.members.size());
+
+		for (size_t j = 0; j < type.members.size(); ++j) {
+			const Member& member = type.members[j];
+
+			out.putName(member.name);
+			out.putInt(member.flags);
+			out.putRef(member.func);
+			out.putInt(member.is_const);
+		}
+	}
+
+	out.putInt(m_imports.size());
+
+	for (size_t i = 0; i < m_imports.size(); ++i) {
+		const Import& import = m_imports[i];
+
+		out.putName(import.module);
+		out.putInt(import.kind);
+		out.putName(import.name);
+		out.putInt(import.loaded);
+		out.putInt(import.count);
+	}
+
+	out.putInt(m_globals.size());
+
+	for (size_t i = 0; i < m_globals.size(); ++i) {
+		const Slot& slot = m_globals[i];
+
+		out.putInt(slot.kind);
+		out.putInt(slot.is_const);
+		out.putRef(slot.ref);
+		out.putName(slot.name);
+	}
+
+	out.putInt(m_externs.size());
+
+	for (size_t i = 0; i < m_externs.size(); ++i) {
+		out.putName(m_externs[i]);
+	}
+
+	out.putInt(m_code.size());
+
+	for (size_t i = 0; i < m_code.size(); ++i) {
+		const Instr& instr = m_code[i];
+
+		out.putInt(instr.opcode);
+
+		for (size_t j = 0; j < 3; ++j) {
+			out.putInt(instr.ops[j].type);
+			out.putInt(instr.ops[j].kind);
+			out.putInt(instr.ops[j].depth);
+			out.putInt(instr.ops[j].index);
+		}
+
+		out.putInt(instr.has_file);
+
+		for (size_t j = 0; j < 2; ++j) {
+			out.putInt(instr.lines[j]);
+			out.putInt(instr.columns[j]);
+		}
+	}
+
+	// Written aside and renamed, so that other processes never read a
+	// partial file
+	std::ostringstream tmp;
+
+#ifdef CLEVER_WIN32
+	tmp << m_path << "." << _getpid() << ".tmp";
+#else
+	tmp << m_path << "." << ::getpid() << ".tmp";
+#endif
+
+	_make_dirs(m_path.substr(0, m_path.find_last_of('/')));
+
+	std::ofstream file(tmp.str().c_str(), std::ios::out | std::ios::binary);
+
+	if (!file) {
+		return;
+	}
+
+	UnitWriter header;
+
+	header.putInt(CLEVER_UNIT_FORMAT);
+	header.putString(_unit_build);
+	header.putInt(m_hash);
+	header.putInt(_hash(out.getBuffer().data(), out.getBuffer().size()));
+
+	file << _unit_magic << header.getBuffer() << out.getBuffer();
+	file.close();
+
+	if (!file) {
+		::remove(tmp.str().c_str());
+		return;
+	}
+
+#ifdef CLEVER_WIN32
+	::remove(m_path.c_str());
+#endif
+	if (::rename(tmp.str().c_str(), m_path.c_str()) != 0) {
+		::remove(tmp.str().c_str());
+	}
+}
+
+bool CompiledUnit::canResolve(Scope* scope, const ModManager& modmanager)
+{
+	std::set<const CString*> imported;
+
+	// The imports must push the same values as when the unit was recorded
+	for (size_t i = 0; i < m_imports.size(); ++i) {
+		const Import& import = m_imports[i];
+		Module* module = modmanager.getModule(*import.module);
+
+		if (!module || module->hasModules()
+			|| (module->isLoaded() || imported.count(import.module)) != import.loaded) {
+			return false;
+		}
+		imported.insert(import.module);
+	}
+
+	// Redeclarations are reported by compiling the file
+	for (size_t i = 0; i < m_globals.size(); ++i) {
+		const Slot& slot = m_globals[i];
+
+		if (slot.name && (slot.kind == VALUE_SLOT
+			|| (slot.kind == FUNCTION_SLOT && !(m_funcs[slot.ref].flags & CLOSURE_FUNC)))
+			&& scope->getLocal(slot.name)) {
+			return false;
+		}
+	}
+
+	m_extern_values.clear();
+
+	for (size_t i = 0; i < m_externs.size(); ++i) {
+		Symbol* sym = scope->getLocal(m_externs[i]);
+
+		if (!sym) {
+			return false;
+		}
+		m_extern_values.push_back(sym->voffset.second);
+	}
+
+	return true;
+}
+
+Value* CompiledUnit::createValue(const Slot& slot, const std::vector<Function*>& funcs,
+	const std::vector<UserType*>& types) const
+{
+	Value* value;
+
+	switch (slot.kind) {
+		case FUNCTION_SLOT:
+			value = new Value;
+			value->setObj(CLEVER_FUNC_TYPE, funcs[slot.ref]);
+			break;
+
+		case CLASS_SLOT:
+			value = new Value(types[slot.ref]);
+			break;
+
+		default:
+			value = new Value;
+			break;
+	}
+
+	value->setConst(slot.is_const);
+
+	return value;
+}
+
+// Anonymous functions are numbered as the resolver meets them
+static bool _anonymous_less(const std::pair<unsigned long, size_t>& a,
+	const std::pair<unsigned long, size_t>& b)
+{
+	return a.first < b.first;
+}
+
+void CompiledUnit::resolve(Scope* scope, ModManager& modmanager)
+{
+	Environment* global = scope->getEnvironment();
+	Module* user = modmanager.getUserModule();
+	std::vector<UserType*> types;
+
+	// Environments are owned by scopes, as the ones created by the resolver
+	m_env_ptrs.clear();
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		Environment* env = new Environment;
+
+		scope->enter()->setEnvironment(env);
+		m_env_ptrs.push_back(env);
+	}
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		m_env_ptrs[i]->setOuter(m_envs[i].outer < 0 ? global : m_env_ptrs[m_envs[i].outer]);
+	}
+
+	for (size_t i = 0; i < m_classes.size(); ++i) {
+		UserType* type = new UserType(m_classes[i].name);
+
+		user->addType(type);
+		type->setEnvironment(m_env_ptrs[m_classes[i].env]);
+		types.push_back(type);
+	}
+
+	std::vector<std::pair<unsigned long, size_t> > anonymous;
+
+	m_func_ptrs.clear();
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		const Func& data = m_funcs[i];
+		Function* func = new Function;
+
+		func->setUserDefined();
+		func->setName(*data.name);
+
+		if (data.flags & PRIVATE_FUNC) {
+			func->setPrivate();
+		} else {
+			func->setPublic();
+		}
+		if (data.flags & STATIC_FUNC) {
+			func->setStatic();
+		}
+		if (data.flags & VARIADIC_FUNC) {
+			func->setVariadic();
+		}
+		if (data.flags & CLOSURE_FUNC) {
+			func->setClosure();
+
+			if (data.name->compare(0, 11, "<anonymous ") == 0) {
+				anonymous.push_back(std::pair<unsigned long, size_t>(
+					::strtoul(data.name->c_str() + 11, NULL, 10), i));
+			}
+		}
+		if (data.context >= 0) {
+			func->setContext(types[data.context]);
+		}
+
+		func->setNumArgs(data.num_args);
+		func->setNumRequiredArgs(data.num_rargs);
+		func->setEnvironment(m_env_ptrs[data.env]);
+
+		m_func_ptrs.push_back(func);
+	}
+
+	// Renamed, as their names must not clash with the ones given to the
+	// anonymous functions of the importing script
+	std::sort(anonymous.begin(), anonymous.end(), _anonymous_less);
+
+	for (size_t i = 0; i < anonymous.size(); ++i) {
+		m_func_ptrs[anonymous[i].second]->setName(*ast::Resolver::getAnonymousName());
+	}
+
+	for (size_t i = 0; i < m_classes.size(); ++i) {
+		const Class& data = m_classes[i];
+		UserType* type = types[i];
+
+		for (size_t j = 0; j < data.members.size(); ++j) {
+			const Member& member = data.members[j];
+			Value* value = new Value;
+
+			if (member.func >= 0) {
+				value->setObj(CLEVER_FUNC_TYPE, m_func_ptrs[member.func]);
+			}
+			value->setConst(member.is_const);
+
+			type->addMember(member.name, MemberData(value, member.flags));
+		}
+
+		if (data.ctor >= 0) {
+			type->setUserConstructor(m_func_ptrs[data.ctor]);
+		}
+		if (data.dtor >= 0) {
+			type->setUserDestructor(m_func_ptrs[data.dtor]);
+		}
+	}
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		const std::vector<Slot>& slots = m_envs[i].slots;
+
+		for (size_t j = 0; j < slots.size(); ++j) {
+			m_env_ptrs[i]->pushValue(createValue(slots[j], m_func_ptrs, types));
+		}
+	}
+
+	m_global_base = global->getSize();
+
+	for (size_t i = 0; i < m_globals.size(); ++i) {
+		const Slot& slot = m_globals[i];
+
+		if (slot.kind == IMPORT_SLOT) {
+			const Import& import = m_imports[slot.ref];
+#ifdef CLEVER_DEBUG
+			size_t first = global->getSize();
+#endif
+
+			modmanager.importModule(scope, *import.module, import.kind, import.name);
+
+			clever_assert(global->getSize() - first == import.count,
+				"Import of module `%s' did not push the recorded values",
+				import.module->c_str());
+			continue;
+		}
+
+		Value* value = createValue(slot, m_func_ptrs, types);
+
+		if (!slot.name) {
+			global->pushValue(value);
+		} else if (slot.kind == FUNCTION_SLOT && (m_funcs[slot.ref].flags & CLOSURE_FUNC)) {
+			scope->pushValue(CSTRING(m_func_ptrs[slot.ref]->getName()), value);
+		} else {
+			scope->pushValue(slot.name, value);
+		}
+	}
+}
+
+Operand CompiledUnit::relocate(const Op& op) const
+{
+	Operand operand(op.type, ValueOffset(op.depth, op.index));
+
+	switch (op.kind) {
+		case GLOBAL_OP: operand.voffset.second = m_global_base + op.index;    break;
+		case EXTERN_OP: operand.voffset.second = m_extern_values[op.index];   break;
+		case CONST_OP:  operand.voffset.second = m_const_base + op.index;     break;
+		case TEMP_OP:   operand.voffset.second = m_temp_base + op.index;      break;
+		case ADDRESS_OP:
+			operand.voffset = ValueOffset(0, 0);
+			operand.jmp_addr = m_ir_base + op.index;
+			break;
+		default:
+			break;
+	}
+
+	return operand;
+}
+
+void CompiledUnit::codegen(IRBuilder* builder)
+{
+	m_const_base = builder->getConstEnv()->getSize();
+
+	for (size_t i = 0; i < m_consts.size(); ++i) {
+		const Const& value = m_consts[i];
+
+		switch (value.type) {
+			case INT_CONST:    builder->getInt(value.lval);    break;
+			case DOUBLE_CONST: builder->getDouble(value.dval); break;
+			case STR_CONST:    builder->getString(value.sval); break;
+		}
+	}
+
+	m_temp_base = builder->getTempEnv()->getSize();
+
+	for (size_t i = 0; i < m_temps; ++i) {
+		builder->getTemp();
+	}
+
+	Environment* save_temp = builder->getTempEnv();
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		if (m_envs[i].temps < 0) {
+			continue;
+		}
+
+		Environment* temp_env = builder->getNewTempEnv();
+
+		for (long j = 0; j < m_envs[i].temps; ++j) {
+			builder->getTemp();
+		}
+		m_env_ptrs[i]->setTempEnv(temp_env);
+	}
+
+	builder->setTempEnv(save_temp);
+
+	m_ir_base = builder->getSize();
+
+	for (size_t i = 0; i < m_funcs.size(); ++i) {
+		m_func_ptrs[i]->setAddr(m_ir_base + m_funcs[i].addr);
+	}
+
+	CString* file = const_cast<CString*>(CSTRING(m_file));
+
+	for (size_t i = 0; i < m_code.size(); ++i) {
+		const Instr& instr = m_code[i];
+		IR& ir = builder->push(instr.opcode);
+
+		ir.op1 = relocate(instr.ops[0]);
+		ir.op2 = relocate(instr.ops[1]);
+		ir.result = relocate(instr.ops[2]);
+
+		ir.loc.begin.filename = ir.loc.end.filename = instr.has_file ? file : NULL;
+		ir.loc.begin.line = instr.lines[0];
+		ir.loc.begin.column = instr.columns[0];
+		ir.loc.end.line = instr.lines[1];
+		ir.loc.end.column = instr.columns[1];
+	}
+}
+
+void CompiledUnit::beginResolve(Scope* scope)
+{
+	m_scope = scope;
+	m_first_value = scope->getEnvironment()->getSize();
+	m_first_symbol = scope->getSymbols().size();
+
+	if (scope->getParent()) {
+		m_cacheable = false;
+	}
+}
+
+void CompiledUnit::endResolve()
+{
+	m_last_value = m_scope->getEnvironment()->getSize();
+}
+
+void CompiledUnit::addImport(Scope* scope, const std::string& name, Module* module,
+	size_t kind, const CString* func, bool loaded, size_t first)
+{
+	if (scope != m_scope || module->hasModules()) {
+		m_cacheable = false;
+		return;
+	}
+
+	Import import;
+
+	import.module = CSTRING(name);
+	import.kind = kind;
+	import.name = func;
+	import.loaded = loaded;
+	import.count = scope->getEnvironment()->getSize() - first;
+
+	m_imports.push_back(import);
+	m_import_values.push_back(first);
+}
+
+void CompiledUnit::beginCodegen(IRBuilder* builder)
+{
+	m_first_ir = builder->getSize();
+	m_first_const = builder->getConstEnv()->getSize();
+	m_first_temp = builder->getTempEnv()->getSize();
+}
+
+void CompiledUnit::endCodegen(IRBuilder* builder)
+{
+	if (m_cacheable && record(builder)) {
+		save();
+	}
+	clear();
+}
+
+void CompiledUnit::recordSlot(Recorder& rec, const Value* value, Slot& slot)
+{
+	slot.is_const = value->isConst();
+
+	if (value->isNull()) {
+		slot.kind = VALUE_SLOT;
+	} else if (value->isFunction()) {
+		slot.kind = FUNCTION_SLOT;
+		slot.ref = recordFunction(rec, static_cast<const Function*>(value->getObj()));
+	} else if (value->getType()->isUserDefined() && !value->getObj()) {
+		slot.kind = CLASS_SLOT;
+		slot.ref = recordClass(rec, value->getType());
+	} else {
+		rec.valid = false;
+	}
+}
+
+long CompiledUnit::recordEnv(Recorder& rec, Environment* env)
+{
+	Recorder::IndexMap::const_iterator it = rec.envs.find(env);
+
+	if (it != rec.envs.end()) {
+		return it->second;
+	}
+
+	if (!env || env == rec.global) {
+		rec.valid = false;
+		return 0;
+	}
+
+	long id = m_envs.size();
+
+	rec.envs.insert(Recorder::IndexMap::value_type(env, id));
+	rec.env_list.push_back(env);
+
+	m_envs.push_back(Env());
+	m_envs[id].outer = -1;
+	m_envs[id].temps = env->getTempEnv() ? long(env->getTempEnv()->getSize()) : -1;
+
+	for (size_t i = 0; i < env->getSize(); ++i) {
+		Slot slot;
+
+		recordSlot(rec, env->getValue(ValueOffset(0, i)), slot);
+
+		m_envs[id].slots.push_back(slot);
+	}
+
+	return id;
+}
+
+long CompiledUnit::recordFunction(Recorder& rec, const Function* func)
+{
+	Recorder::IndexMap::const_iterator it = rec.funcs.find(func);
+
+	if (it != rec.funcs.end()) {
+		return it->second;
+	}
+
+	if (!func->isUserDefined()) {
+		rec.valid = false;
+		return 0;
+	}
+
+	long id = m_funcs.size();
+
+	rec.funcs.insert(Recorder::IndexMap::value_type(func, id));
+	rec.func_list.push_back(func);
+
+	m_funcs.push_back(Func());
+
+	Func data;
+
+	data.name = CSTRING(func->getName());
+	data.addr = func->getAddr();
+	data.num_args = func->getNumArgs();
+	data.num_rargs = func->getNumRequiredArgs();
+	data.flags = (func->isStatic() ? STATIC_FUNC : 0)
+		| (func->isVariadic() ? VARIADIC_FUNC : 0)
+		| (func->isClosure() ? CLOSURE_FUNC : 0)
+		| (func->isPrivate() ? PRIVATE_FUNC : 0);
+	data.context = func->hasContext() ? recordClass(rec, func->getContext()) : -1;
+	data.env = recordEnv(rec, func->getEnvironment());
+
+	m_funcs[id] = data;
+
+	return id;
+}
+
+long CompiledUnit::recordClass(Recorder& rec, const Type* type)
+{
+	Recorder::IndexMap::const_iterator it = rec.classes.find(type);
+
+	if (it != rec.classes.end()) {
+		return it->second;
+	}
+
+	if (!type->isUserDefined()) {
+		rec.valid = false;
+		return 0;
+	}
+
+	const UserType* utype = static_cast<const UserType*>(type);
+	long id = m_classes.size();
+
+	rec.classes.insert(Recorder::IndexMap::value_type(type, id));
+
+	m_classes.push_back(Class());
+
+	Class data;
+
+	data.name = CSTRING(type->getName());
+	data.env = recordEnv(rec, utype->getEnvironment());
+
+	const MemberMap& members = type->getMembers();
+	MemberMap::const_iterator mit(members.begin()), end(members.end());
+
+	for (; mit != end; ++mit) {
+		const Value* value = mit->second.value;
+		Member member;
+
+		member.name = mit->first;
+		member.flags = mit->second.flags;
+		member.is_const = value->isConst();
+		member.func = -1;
+
+		if (value->isFunction()) {
+			const Function* func = static_cast<const Function*>(value->getObj());
+
+			// Added by the type initialization
+			if (func->isInternal()) {
+				continue;
+			}
+			member.func = recordFunction(rec, func);
+		} else if (!value->isNull()) {
+			rec.valid = false;
+		}
+
+		data.members.push_back(member);
+	}
+
+	data.ctor = type->getUserConstructor()
+		? recordFunction(rec, type->getUserConstructor()) : -1;
+	data.dtor = type->getUserDestructor()
+		? recordFunction(rec, type->getUserDestructor()) : -1;
+
+	m_classes[id] = data;
+
+	return id;
+}
+
+long CompiledUnit::recordExtern(Recorder& rec, size_t index)
+{
+	std::tr1::unordered_map<size_t, long>::const_iterator it = rec.externs.find(index);
+
+	if (it != rec.externs.end()) {
+		return it->second;
+	}
+
+	// The name of a global value declared before the import
+	const Scope::SymbolMap& symbols = m_scope->getSymbols();
+
+	for (size_t i = 0; i < m_first_symbol; ++i) {
+		if (symbols[i]->voffset.second != index) {
+			continue;
+		}
+
+		Symbol* sym = m_scope->getLocal(symbols[i]->name);
+
+		if (!sym || sym->voffset.second != index) {
+			break;
+		}
+
+		long id = m_externs.size();
+
+		m_externs.push_back(sym->name);
+		rec.externs.insert(std::pair<size_t, long>(index, id));
+
+		return id;
+	}
+
+	rec.valid = false;
+	return 0;
+}
+
+void CompiledUnit::recordOperand(Recorder& rec, const Operand& operand, size_t depth, Op& op)
+{
+	op.type = operand.op_type;
+	op.kind = ABSOLUTE_OP;
+	op.depth = operand.voffset.first;
+	op.index = operand.voffset.second;
+
+	// The address of other operands is never read (though the code of the
+	// loops sets it on their first instruction)
+	switch (operand.op_type) {
+		case FETCH_VAR:
+			if (op.depth > depth) {
+				rec.valid = false;
+			} else if (op.depth == depth) {
+				if (op.index >= m_first_value && op.index < m_last_value) {
+					op.kind = GLOBAL_OP;
+					op.index -= m_first_value;
+				} else if (op.index < m_first_value) {
+					op.kind = EXTERN_OP;
+					op.index = recordExtern(rec, op.index);
+				} else {
+					rec.valid = false;
+				}
+			}
+			break;
+
+		case FETCH_CONST:
+			if (op.index >= m_first_const && op.index < rec.last_const) {
+				op.kind = CONST_OP;
+				op.index -= m_first_const;
+			} else if (op.depth != 0 || op.index > 2) {
+				rec.valid = false;
+			}
+			break;
+
+		case FETCH_TMP:
+			if (depth > 0) {
+				break;
+			}
+			if (op.index >= m_first_temp && op.index < rec.last_temp) {
+				op.kind = TEMP_OP;
+				op.index -= m_first_temp;
+			} else {
+				rec.valid = false;
+			}
+			break;
+
+		case JMP_ADDR:
+			if (operand.jmp_addr >= m_first_ir && operand.jmp_addr <= rec.last_ir) {
+				op.kind = ADDRESS_OP;
+				op.depth = 0;
+				op.index = operand.jmp_addr - m_first_ir;
+			} else {
+				rec.valid = false;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/// Builds the unit from what the compilation of the file produced
+/// \returns false when it cannot be relocated
+bool CompiledUnit::record(IRBuilder* builder)
+{
+	Environment* global = m_scope->getEnvironment();
+	Recorder rec(global);
+
+	rec.last_ir = builder->getSize();
+	rec.last_const = builder->getConstEnv()->getSize();
+	rec.last_temp = builder->getTempEnv()->getSize();
+
+	// Global values, by name
+	std::tr1::unordered_map<size_t, const CString*> names;
+	const Scope::SymbolMap& symbols = m_scope->getSymbols();
+
+	for (size_t i = m_first_symbol; i < symbols.size(); ++i) {
+		names.insert(std::pair<size_t, const CString*>(
+			symbols[i]->voffset.second, symbols[i]->name));
+	}
+
+	size_t next_import = 0;
+
+	for (size_t i = m_first_value; i < m_last_value || next_import < m_imports.size(); ) {
+		Slot slot;
+
+		if (next_import < m_imports.size() && m_import_values[next_import] == i) {
+			slot.kind = IMPORT_SLOT;
+			slot.ref = next_import;
+
+			m_globals.push_back(slot);
+
+			i += m_imports[next_import++].count;
+			continue;
+		}
+
+		if (i >= m_last_value) {
+			return false;
+		}
+
+		recordSlot(rec, global->getValue(ValueOffset(0, i)), slot);
+
+		std::tr1::unordered_map<size_t, const CString*>::const_iterator it = names.find(i);
+
+		if (it != names.end()) {
+			slot.name = it->second;
+		}
+
+		m_globals.push_back(slot);
+		++i;
+	}
+
+	for (size_t i = 0; i < m_envs.size(); ++i) {
+		Environment* outer = rec.env_list[i]->getOuter();
+
+		if (outer != global) {
+			Recorder::IndexMap::const_iterator it = rec.envs.find(outer);
+
+			if (it == rec.envs.end()) {
+				return false;
+			}
+			m_envs[i].outer = it->second;
+		}
+	}
+
+	if (!rec.valid) {
+		return false;
+	}
+
+	// The environment depth of each instruction, to tell the global values
+	// from the ones of the functions
+	std::vector<size_t> depths(rec.last_ir - m_first_ir, 0);
+	std::vector<std::pair<size_t, size_t> > funcs;
+
+	for (size_t i = 0; i < rec.func_list.size(); ++i) {
+		size_t addr = rec.func_list[i]->getAddr();
+
+		if (addr <= m_first_ir || addr >= rec.last_ir) {
+			return false;
+		}
+
+		const IR& start = builder->getAt(addr - 1);
+
+		if (start.opcode != OP_JMP || start.op1.op_type != JMP_ADDR
+			|| start.op1.jmp_addr < addr || start.op1.jmp_addr > rec.last_ir) {
+			return false;
+		}
+
+		funcs.push_back(std::pair<size_t, size_t>(addr, i));
+
+		m_funcs[i].addr = addr - m_first_ir;
+	}
+
+	std::sort(funcs.begin(), funcs.end(), _addr_less);
+
+	for (size_t i = 0; i < funcs.size(); ++i) {
+		size_t addr = funcs[i].first;
+		size_t end = builder->getAt(addr - 1).op1.jmp_addr;
+		size_t depth = 0;
+
+		for (Environment* env = rec.func_list[funcs[i].second]->getEnvironment();
+			env != global; env = env->getOuter()) {
+			if (!env) {
+				return false;
+			}
+			++depth;
+		}
+
+		std::fill(depths.begin() + (addr - m_first_ir), depths.begin() + (end - m_first_ir), depth);
+	}
+
+	for (size_t i = m_first_ir; i < rec.last_ir; ++i) {
+		const IR& ir = builder->getAt(i);
+		Instr instr;
+		size_t depth = depths[i - m_first_ir];
+
+		instr.opcode = ir.opcode;
+
+		recordOperand(rec, ir.op1, depth, instr.ops[0]);
+		recordOperand(rec, ir.op2, depth, instr.ops[1]);
+		recordOperand(rec, ir.result, depth, instr.ops[2]);
+
+		if (ir.loc.begin.filename && *ir.loc.begin.filename != m_file) {
+			return false;
+		}
+
+		instr.has_file = ir.loc.begin.filename != NULL;
+		instr.lines[0] = ir.loc.begin.line;
+		instr.columns[0] = ir.loc.begin.column;
+		instr.lines[1] = ir.loc.end.line;
+		instr.columns[1] = ir.loc.end.column;
+
+		m_code.push_back(instr);
+	}
+
+	Environment* consts = builder->getConstEnv();
+
+	for (size_t i = m_first_const; i < rec.last_const; ++i) {
+		const Value* value = consts->getValue(ValueOffset(0, i));
+		Const data;
+
+		if (value->isInt()) {
+			data.type = INT_CONST;
+			data.lval = value->getInt();
+		} else if (value->isDouble()) {
+			data.type = DOUBLE_CONST;
+			data.dval = value->getDouble();
+		} else if (value->isStr()) {
+			data.type = STR_CONST;
+			data.sval = value->getStr();
+		} else {
+			return false;
+		}
+
+		m_consts.push_back(data);
+	}
+
+	m_temps = rec.last_temp - m_first_temp;
+
+	return rec.valid;
+}
+
+} // clever
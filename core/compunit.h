@@ -0,0 +1,240 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_COMPUNIT_H
+#define CLEVER_COMPUNIT_H
+
+#include <string>
+#include <vector>
+#include "core/clever.h"
+#include "core/cstring.h"
+#include "core/ir.h"
+
+namespace clever {
+
+class Environment;
+class Function;
+class IRBuilder;
+class ModManager;
+class Module;
+class Scope;
+class Type;
+class UserType;
+class Value;
+
+/**
+ * Compiled form of a file imported into the global scope
+ *
+ * The first time a file is compiled its unit records what the compilation
+ * produced: the values added to the global environment, the functions and
+ * classes with their environments, the constants and the instructions, each
+ * operand being tagged with what it refers to. The unit is written to the
+ * compilation cache, and later runs rebuild those objects and relocate the
+ * instructions instead of parsing, resolving and generating code for the
+ * file again.
+ *
+ * A cached unit is used when the file contents and the interpreter build
+ * are the same, the names it takes from the global scope are there, the
+ * names it declares are not, and the modules it imports are in the same
+ * state as when it was recorded; otherwise the file is compiled and the
+ * cache entry replaced. Files importing other files, or importing modules
+ * anywhere but in the global scope, are not cached.
+ *
+ * The cache lives in CLEVER_CACHE_DIR, $XDG_CACHE_HOME/clever or
+ * ~/.cache/clever; setting CLEVER_CACHE_DIR to an empty string disables it.
+ */
+class CompiledUnit {
+public:
+	CompiledUnit(const std::string& file, const std::string& cache_dir);
+
+	~CompiledUnit() {}
+
+	/// Returns the cache directory, or an empty string when disabled
+	static std::string getCacheDir();
+
+	/// Reads the cached unit of the file
+	/// \returns false when there is none or it is stale
+	bool load();
+
+	/// Discards what load() read, so that the unit is recorded again
+	void clear();
+
+	/// Checks whether the loaded unit can be imported into the scope
+	bool canResolve(Scope*, const ModManager&);
+
+	/// Creates the values of the loaded unit
+	void resolve(Scope*, ModManager&);
+
+	/// Emits the instructions of the loaded unit
+	void codegen(IRBuilder*);
+
+	/// Recording of the unit while the parsed file is compiled
+	void beginResolve(Scope*);
+	void endResolve();
+	void beginCodegen(IRBuilder*);
+	void endCodegen(IRBuilder*);
+
+	/// Records a module imported by the file, whose values were pushed
+	/// into the scope from the index first on
+	void addImport(Scope*, const std::string&, Module*, size_t,
+		const CString*, bool, size_t);
+
+	void setCacheable(bool cacheable) { m_cacheable = cacheable; }
+private:
+	enum SlotKind { VALUE_SLOT, FUNCTION_SLOT, CLASS_SLOT, IMPORT_SLOT };
+
+	/// What an operand refers to, i.e. how it is relocated
+	enum OperandKind {
+		ABSOLUTE_OP, // Unchanged (locals, null, true and false)
+		GLOBAL_OP,   // A global value of the unit
+		EXTERN_OP,   // A global value declared before the import
+		CONST_OP,    // A constant of the unit
+		TEMP_OP,     // A temporary value of the global environment
+		ADDRESS_OP   // An instruction of the unit
+	};
+
+	enum FunctionFlag {
+		STATIC_FUNC   = 1<<0,
+		VARIADIC_FUNC = 1<<1,
+		CLOSURE_FUNC  = 1<<2,
+		PRIVATE_FUNC  = 1<<3
+	};
+
+	enum ConstType { INT_CONST, DOUBLE_CONST, STR_CONST };
+
+	/// A value of an environment; ref is the function, class or import
+	struct Slot {
+		Slot()
+			: kind(VALUE_SLOT), is_const(false), ref(0), name(NULL) {}
+
+		SlotKind kind;
+		bool is_const;
+		long ref;
+		const CString* name;
+	};
+
+	/// Environment of a function or class; outer is -1 for the global one
+	struct Env {
+		long outer;
+		long temps;
+		std::vector<Slot> slots;
+	};
+
+	struct Func {
+		const CString* name;
+		long env;
+		long context;
+		size_t addr;
+		size_t num_args;
+		size_t num_rargs;
+		size_t flags;
+	};
+
+	struct Member {
+		const CString* name;
+		size_t flags;
+		long func;
+		bool is_const;
+	};
+
+	struct Class {
+		const CString* name;
+		long env;
+		long ctor;
+		long dtor;
+		std::vector<Member> members;
+	};
+
+	struct Import {
+		const CString* module;
+		size_t kind;
+		const CString* name;
+		bool loaded;
+		size_t count;
+	};
+
+	struct Const {
+		ConstType type;
+		long lval;
+		double dval;
+		const CString* sval;
+	};
+
+	struct Op {
+		OperandType type;
+		OperandKind kind;
+		size_t depth;
+		size_t index;
+	};
+
+	struct Instr {
+		Opcode opcode;
+		Op ops[3];
+		bool has_file;
+		unsigned lines[2];
+		unsigned columns[2];
+	};
+
+	struct Recorder;
+
+	bool record(IRBuilder*);
+	void recordSlot(Recorder&, const Value*, Slot&);
+	long recordEnv(Recorder&, Environment*);
+	long recordFunction(Recorder&, const Function*);
+	long recordClass(Recorder&, const Type*);
+	long recordExtern(Recorder&, size_t);
+	void recordOperand(Recorder&, const Operand&, size_t, Op&);
+
+	void save() const;
+	bool isConsistent() const;
+
+	Value* createValue(const Slot&, const std::vector<Function*>&,
+		const std::vector<UserType*>&) const;
+	Operand relocate(const Op&) const;
+
+	std::string m_file;
+	std::string m_path;
+	unsigned long long m_hash;
+	bool m_cacheable;
+
+	// The unit
+	std::vector<Const> m_consts;
+	size_t m_temps;
+	std::vector<Env> m_envs;
+	std::vector<Func> m_funcs;
+	std::vector<Class> m_classes;
+	std::vector<Import> m_imports;
+	std::vector<Slot> m_globals;
+	std::vector<const CString*> m_externs;
+	std::vector<Instr> m_code;
+
+	// Where the file starts in the global scope and in the code, while
+	// recording
+	Scope* m_scope;
+	size_t m_first_value;
+	size_t m_last_value;
+	size_t m_first_symbol;
+	size_t m_first_ir;
+	size_t m_first_const;
+	size_t m_first_temp;
+	std::vector<size_t> m_import_values;
+
+	// Where the loaded unit was placed
+	std::vector<size_t> m_extern_values;
+	std::vector<Environment*> m_env_ptrs;
+	std::vector<Function*> m_func_ptrs;
+	size_t m_global_base;
+	size_t m_const_base;
+	size_t m_temp_base;
+	size_t m_ir_base;
+
+	DISALLOW_COPY_AND_ASSIGN(CompiledUnit);
+};
+
+} // clever
+
+#endif // CLEVER_COMPUNIT_H
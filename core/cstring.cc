@@ -5,10 +5,41 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include <cstdio>
 #include "core/cstring.h"
 
 namespace clever {
 
 CStringTable* g_cstring_tbl = new CStringTable;
 
+void append_number(CString& str, long n)
+{
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p = end;
+	unsigned long u = n < 0 ? 0UL - static_cast<unsigned long>(n)
+		: static_cast<unsigned long>(n);
+
+	do {
+		*--p = static_cast<char>('0' + u % 10);
+		u /= 10;
+	} while (u);
+
+	if (n < 0) {
+		*--p = '-';
+	}
+
+	str.append(p, end - p);
+}
+
+void append_number(CString& str, double n)
+{
+	char buf[32];
+	int len = ::snprintf(buf, sizeof(buf), "%.6g", n);
+
+	if (len > 0) {
+		str.append(buf, len);
+	}
+}
+
 } // clever
@@ -113,6 +113,16 @@ inline const CString* CSTRINGT(const std::string& str, bool interned = false) {
 	return new CString(str);
 }
 
+/**
+ * Appends the decimal representation of n to str, bypassing iostreams
+ */
+void append_number(CString& str, long n);
+
+/**
+ * Appends n to str using the same notation as std::ostream (%g, precision 6)
+ */
+void append_number(CString& str, double n);
+
 } // clever
 
 #endif /* CLEVER_CSTRING_H */
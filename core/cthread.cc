@@ -5,6 +5,10 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#ifndef CLEVER_WIN32
+# include <sched.h>
+# include <unistd.h>
+#endif
 #include "core/cthread.h"
 
 namespace clever {
@@ -120,4 +124,28 @@ int CThread::wait()
 #endif
 }
 
+size_t CThread::getNumCPUs()
+{
+#ifndef CLEVER_WIN32
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return num > 0 ? size_t(num) : 1;
+#else
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#endif
+}
+
+void CThread::yield()
+{
+#ifndef CLEVER_WIN32
+	sched_yield();
+#else
+	SwitchToThread();
+#endif
+}
+
 } // clever
@@ -63,6 +63,12 @@ public:
 
 	int wait();
 
+	/// Number of processors available to run threads, at least 1
+	static size_t getNumCPUs();
+
+	/// Lets other threads run before the calling one goes on
+	static void yield();
+
 private:
 	bool m_is_running;
 #ifndef CLEVER_WIN32
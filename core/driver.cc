@@ -6,13 +6,17 @@
  */
 
 #include <fstream>
+#include <sstream>
 #include <setjmp.h>
 #include "core/cstring.h"
 #include "core/driver.h"
 #include "core/parser.hh"
 #include "core/position.hh"
 #include "core/vm.h"
+#include "core/profiler.h"
 #include "core/scanner.h"
+#include "core/startup.h"
+#include "core/vmstats.h"
 
 namespace clever {
 
@@ -36,46 +40,93 @@ void Interpreter::execute(bool interactive)
 	int status = setjmp(fatal_error);
 
 	if (status == 0) {
+		double start = g_startup_profile ? StartupProfile::now() : 0;
+
 		m_compiler.genCode();
 
+		if (g_startup_profile) {
+			g_startup_profile->record("compile", start);
+		}
+
 		VM vm(m_compiler.getIR());
 
 		vm.setConstEnv(m_compiler.getConstEnv());
 		vm.setGlobalEnv(m_compiler.getGlobalEnv());
 
+#ifdef CLEVER_VM_STATS
+		VMStats::setProgram(m_compiler.getIR());
+#endif
 #ifdef CLEVER_DEBUG
 		if (m_dump_opcode) {
 			vm.dumpOpcodes();
 		}
 #endif
+		if (g_startup_profile) {
+			g_startup_profile->setRunning();
+		}
+
+		if (g_profiler && !g_profiler->start()) {
+			std::cerr << "Profiling is not supported on this platform" << std::endl;
+		}
+
 		vm.run();
 	}
+
+	if (g_profiler) {
+		g_profiler->stop();
+	}
 }
 
 /// Frees the resource used to load and execute the script
 void Interpreter::shutdown()
 {
 	m_compiler.shutdown();
+
+	if (g_startup_profile) {
+		g_startup_profile->dump(std::cerr);
+		delete g_startup_profile;
+		g_startup_profile = NULL;
+	}
+
+	if (g_profiler) {
+		g_profiler->dump(std::cerr);
+		delete g_profiler;
+		g_profiler = NULL;
+	}
 }
 
 /// Read the file defined in file property
 void Driver::readFile(std::string& source) const
 {
-	std::string line;
-	std::fstream filep(m_file->c_str());
+	std::ifstream filep(m_file->c_str());
 
 	if (!filep) {
 		std::cerr << "Couldn't open file " << *m_file << std::endl;
 		exit(1);
 	}
-	source = "";
 
-	while (!filep.eof()) {
-		getline(filep, line);
-		source += line + '\n';
+	// Reads the whole file at once instead of line by line
+	filep.seekg(0, std::ios::end);
+	std::streamoff size = filep.tellg();
+	filep.seekg(0, std::ios::beg);
+
+	source.resize(size > 0 ? static_cast<size_t>(size) : 0);
+
+	if (size > 0) {
+		filep.read(&source[0], size);
+		source.resize(static_cast<size_t>(filep.gcount()));
+	} else {
+		// Pipes and FIFOs cannot seek, so they are read until the end
+		std::ostringstream contents;
+
+		filep.clear();
+		contents << filep.rdbuf();
+		source = contents.str();
 	}
 
-	filep.clear();
+	// The scanner expects the source to end with a newline
+	source += '\n';
+
 	filep.close();
 }
 
@@ -105,8 +156,14 @@ int Driver::loadFile(const std::string& filename, const std::string& ns_name)
 	// Bison debug option
 	parser.set_debug_level(m_trace_parsing);
 
+	double start = g_startup_profile ? StartupProfile::now() : 0;
+
 	int result = parser.parse();
 
+	if (g_startup_profile) {
+		g_startup_profile->record("parse " + filename, start);
+	}
+
 	delete new_scanner;
 	m_scanners.pop();
 
@@ -142,8 +199,14 @@ int Driver::loadStr(const std::string& code, bool importStd)
 	// Bison debug option
 	parser.set_debug_level(m_trace_parsing);
 
+	double start = g_startup_profile ? StartupProfile::now() : 0;
+
 	int result = parser.parse();
 
+	if (g_startup_profile) {
+		g_startup_profile->record("parse", start);
+	}
+
 	delete new_scanner;
 	m_scanners.pop();
 
@@ -39,11 +39,14 @@ class Environment: public RefCounted {
 public:
 	Environment()
 		: m_outer(NULL), m_temp(NULL), m_ret_val(NULL),
-		m_ret_addr(0), m_scoped(true) {}
+		m_ret_addr(0), m_scoped(true) {
+		CLEVER_STAT(ENVIRONMENTS);
+	}
 
 	explicit Environment(Environment* outer_, bool is_scoped = true)
 		: m_outer(outer_), m_temp(NULL), m_ret_val(NULL),
 		m_ret_addr(0), m_scoped(is_scoped) {
+		CLEVER_STAT(ENVIRONMENTS);
 		clever_addref(m_outer);
 	}
 
@@ -105,6 +108,9 @@ public:
 
 	void setData(size_t pos, Value* value) { m_data[pos] = value; }
 
+	/// Returns the number of values in the environment
+	size_t getSize() const { return m_data.size(); }
+
 	void setTempEnv(Environment* env) { m_temp = env; }
 	Environment* getTempEnv() const { return m_temp; }
 
@@ -0,0 +1,100 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_EXTENSION_H
+#define CLEVER_EXTENSION_H
+
+#include <string>
+#include "core/clever.h"
+#include "core/module.h"
+
+/**
+ * Native extension modules
+ *
+ * An extension is a shared library providing one module; importing a
+ * module that is not built in looks for <name>.so (dots in the name being
+ * directory separators) in the directory of the script, then in the
+ * directories listed in CLEVER_MODULE_PATH and finally in the installed
+ * module directory.
+ *
+ * Extensions use the core classes directly, so they must be compiled
+ * against the headers of the interpreter loading them: the library
+ * exports clever_module_info(), checked before anything else is called,
+ * and clever_module_entry(), which returns the module. Both are defined
+ * by CLEVER_EXTENSION():
+ *
+ *   class Hash : public Module { ... };
+ *   CLEVER_EXTENSION(Hash)
+ */
+
+/// Version of the extension interface; bumped whenever a change to the
+/// core classes breaks compiled extensions
+#define CLEVER_EXTENSION_API 1
+
+/// Build options changing the layout of the core classes
+#define CLEVER_EXTENSION_BUILD_THREADS  (1 << 0)
+#define CLEVER_EXTENSION_BUILD_CXX11ABI (1 << 1)
+#define CLEVER_EXTENSION_BUILD_64BIT    (1 << 2)
+
+#if defined(CLEVER_THREADS) && !(CLEVER_GCC_VERSION >= 4010 || defined(__clang__))
+# define CLEVER_EXTENSION_THREADS CLEVER_EXTENSION_BUILD_THREADS
+#else
+# define CLEVER_EXTENSION_THREADS 0
+#endif
+
+#if defined(_GLIBCXX_USE_CXX11_ABI) && _GLIBCXX_USE_CXX11_ABI
+# define CLEVER_EXTENSION_CXX11ABI CLEVER_EXTENSION_BUILD_CXX11ABI
+#else
+# define CLEVER_EXTENSION_CXX11ABI 0
+#endif
+
+#define CLEVER_EXTENSION_BUILD (CLEVER_EXTENSION_THREADS | CLEVER_EXTENSION_CXX11ABI \
+	| (sizeof(void*) == 8 ? CLEVER_EXTENSION_BUILD_64BIT : 0))
+
+#ifdef CLEVER_WIN32
+# define CLEVER_EXTENSION_EXPORT __declspec(dllexport)
+# define CLEVER_EXTENSION_SUFFIX ".dll"
+#else
+# define CLEVER_EXTENSION_EXPORT __attribute__((visibility("default")))
+# ifdef CLEVER_APPLE
+#  define CLEVER_EXTENSION_SUFFIX ".dylib"
+# else
+#  define CLEVER_EXTENSION_SUFFIX ".so"
+# endif
+#endif
+
+#define CLEVER_EXTENSION_INFO_SYMBOL  "clever_module_info"
+#define CLEVER_EXTENSION_ENTRY_SYMBOL "clever_module_entry"
+
+/// Defines the entry points of an extension providing module_class
+#define CLEVER_EXTENSION(module_class)                                           \
+	extern "C" CLEVER_EXTENSION_EXPORT const ::clever::ExtensionInfo*            \
+	clever_module_info() {                                                       \
+		static const ::clever::ExtensionInfo info = {                            \
+			CLEVER_EXTENSION_API, CLEVER_EXTENSION_BUILD, CLEVER_VERSION_STRING  \
+		};                                                                       \
+		return &info;                                                            \
+	}                                                                            \
+	extern "C" CLEVER_EXTENSION_EXPORT ::clever::Module* clever_module_entry() { \
+		return new module_class;                                                 \
+	}
+
+namespace clever {
+
+/// What an extension was compiled against
+struct ExtensionInfo {
+	unsigned api;
+	unsigned build;
+	const char* version;
+};
+
+typedef const ExtensionInfo* (*ExtensionInfoFunc)();
+typedef Module* (*ExtensionEntryFunc)();
+
+} // clever
+
+#endif // CLEVER_EXTENSION_H
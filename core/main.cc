@@ -5,10 +5,14 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include <cstdlib>
 #include <iostream>
 #include "core/compiler.h"
 #include "core/clever.h"
 #include "core/driver.h"
+#include "core/profiler.h"
+#include "core/startup.h"
+#include "core/vmstats.h"
 #ifdef _WIN32
 #include "win32/win32.h"
 #endif
@@ -30,7 +34,14 @@ static void show_usage()
 
 	std::cout << "\t-h\tHelp\n"
 				 "\t-v\tShow version\n"
-				 "\n";
+				 "\t--startup-profile\tPrint the time spent loading modules, parsing and compiling\n"
+				 "\t--profile <file>\tSample the script, writing folded stacks to file\n"
+				 "\t--profile-interval <us>\tCPU time between samples (default: 1000)\n";
+
+#ifdef CLEVER_VM_STATS
+	std::cout << "\t--vm-stats\tPrint the VM statistics on exit\n";
+#endif
+	std::cout << "\n";
 
 	std::cout << "Code options (must be the last one and unique):\n"
 				 "\t-i\tRun the interative mode\n"
@@ -62,6 +73,7 @@ int main(int argc, char **argv)
 	}
 
 	int inc_arg = 0;
+	size_t profile_interval = CLEVER_PROFILE_INTERVAL;
 
 	for (int i = 1; i < argc; ++i) {
 		// Look for general options, then code options and finally debug options.
@@ -93,6 +105,33 @@ int main(int argc, char **argv)
 				CreateBackgroundProcess(cline);
 				return 0;
 			}
+#endif
+		} else if (argv[i] == std::string("--startup-profile")) {
+			inc_arg++;
+			if (!clever::g_startup_profile) {
+				clever::g_startup_profile = new clever::StartupProfile;
+			}
+		} else if (argv[i] == std::string("--profile")) {
+			MORE_ARG();
+			inc_arg += 2;
+			if (!clever::g_profiler) {
+				clever::g_profiler = new clever::Profiler(argv[i], profile_interval);
+			}
+		} else if (argv[i] == std::string("--profile-interval")) {
+			MORE_ARG();
+			inc_arg += 2;
+			profile_interval = std::strtoul(argv[i], NULL, 10);
+			if (profile_interval == 0) {
+				std::cerr << "Invalid profile interval " << argv[i] << std::endl;
+				exit(1);
+			}
+			if (clever::g_profiler) {
+				clever::g_profiler->setInterval(profile_interval);
+			}
+#ifdef CLEVER_VM_STATS
+		} else if (argv[i] == std::string("--vm-stats")) {
+			inc_arg++;
+			clever::VMStats::reportAtExit();
 #endif
 		} else if (argv[i] == std::string("-i")) {
 			std::string input_line;
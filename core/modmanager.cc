@@ -5,7 +5,14 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include <cstdlib>
 #include <iostream>
+#ifdef CLEVER_WIN32
+# include <windows.h>
+#else
+# include <dlfcn.h>
+# include <sys/stat.h>
+#endif
 #include "core/driver.h"
 #include "core/modmanager.h"
 #include "core/value.h"
@@ -15,16 +22,130 @@
 #include "modules/db/db_pkg.h"
 #include "modules/gui/gui_pkg.h"
 #include "core/user.h"
+#include "core/startup.h"
+#include "core/extension.h"
+#include "core/compunit.h"
 
 namespace clever {
 
+/// Initializes a module, recording its time when profiling the startup
+static void _init_module(Module* module)
+{
+	double start = g_startup_profile ? StartupProfile::now() : 0;
+
+	module->init();
+	module->setLoaded();
+
+	if (g_startup_profile) {
+		g_startup_profile->record("module " + module->getName(), start);
+	}
+}
+
+#ifdef CLEVER_WIN32
+# define CLEVER_PATH_SEPARATOR ';'
+
+static void* _dl_open(const std::string& path)
+{
+	return LoadLibraryA(path.c_str());
+}
+
+static void* _dl_sym(void* handle, const char* name)
+{
+	return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(handle), name));
+}
+
+static std::string _dl_error()
+{
+	std::ostringstream error;
+
+	error << "error " << GetLastError();
+
+	return error.str();
+}
+
+static bool _file_exists(const std::string& path)
+{
+	return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+#else
+# define CLEVER_PATH_SEPARATOR ':'
+
+static void* _dl_open(const std::string& path)
+{
+	return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+}
+
+static void* _dl_sym(void* handle, const char* name)
+{
+	return dlsym(handle, name);
+}
+
+static std::string _dl_error()
+{
+	const char* error = dlerror();
+
+	return error ? error : "unknown error";
+}
+
+static bool _file_exists(const std::string& path)
+{
+	struct stat st;
+
+	return ::stat(path.c_str(), &st) == 0;
+}
+#endif
+
+/// Prints an error about the extension at path and stops
+static void _extension_error(const std::string& path, const std::string& msg)
+{
+	std::cerr << "Extension `" << path << "': " << msg << std::endl;
+	CLEVER_EXIT_FATAL();
+}
+
+/// Wraps the unit of an imported file, as the tree of an import is expected
+/// to be a node array
+static ast::Node* _module_unit(CompiledUnit* unit, ast::Node* tree)
+{
+	ast::NodeArray* nodes = new ast::NodeArray(location());
+
+	nodes->append(new ast::ModuleUnit(unit, tree, location()));
+
+	return nodes;
+}
+
 /// Adds the available packages to be imported
 void ModManager::init()
 {
+	double start = g_startup_profile ? StartupProfile::now() : 0;
+
+	if (const char* path = getenv("CLEVER_MODULE_PATH")) {
+		std::string paths(path);
+		size_t begin = 0, end;
+
+		do {
+			end = paths.find(CLEVER_PATH_SEPARATOR, begin);
+
+			if (end != begin) {
+				m_module_path.push_back(paths.substr(begin, end - begin));
+			}
+			begin = end + 1;
+		} while (end != std::string::npos);
+	}
+
+#ifdef CLEVER_MODULE_DIR
+	m_module_path.push_back(CLEVER_MODULE_DIR);
+#endif
+
+	m_cache_dir = CompiledUnit::getCacheDir();
+
 	addModule("std",   new modules::Std);
 	addModule("db",    new modules::Db);
 	addModule("gui",   new modules::Gui);
 	addModule("_user", m_user = new UserModule);
+
+	if (g_startup_profile) {
+		g_startup_profile->record("register packages", start);
+	}
 }
 
 /// Performs shutdown operation
@@ -58,8 +179,7 @@ void ModManager::addModule(const std::string& name, Module* module)
 	}
 
 	m_mods.insert(ModuleMap::value_type(name, module));
-	module->init();
-	module->setLoaded();
+	_init_module(module);
 
 	if (module->hasModules()) {
 		ModuleMap& mods = module->getModules();
@@ -77,9 +197,8 @@ void ModManager::loadType(Scope* scope, const std::string& name, Type* type) con
 {
 	Value* tmp = new Value(type, true);
 
+	// The type is initialized on its first use (see Type::ensureInit())
 	scope->pushValue(CSTRING(name), tmp);
-
-	type->init();
 }
 
 /// Loads an specific module function
@@ -175,8 +294,7 @@ void ModManager::loadModule(Scope* scope, Module* module,
 				++it;
 				continue;
 			}
-			it->second->init();
-			it->second->setLoaded();
+			_init_module(it->second);
 
 			std::string prefix = it->second->getName() + ":";
 
@@ -195,8 +313,7 @@ void ModManager::loadModule(Scope* scope, Module* module,
 		return;
 	}
 
-	module->init();
-	module->setLoaded();
+	_init_module(module);
 
 	std::string ns_prefix = "";
 
@@ -214,8 +331,11 @@ void ModManager::loadModule(Scope* scope, Module* module,
 }
 
 /// Imports an userland module
+///
+/// Like a module, a file is imported into the global scope only once; its
+/// compiled form is kept in the compilation cache (see CompiledUnit)
 ast::Node* ModManager::importFile(Scope* scope,
-	const std::string& module, size_t kind, const CString* name) const
+	const std::string& module, size_t kind, const CString* name)
 {
 	std::string mod_name = module;
 	std::string ns_name  = kind & ModManager::NAMESPACE ? module : "";
@@ -224,18 +344,119 @@ ast::Node* ModManager::importFile(Scope* scope,
 
 	const std::string& fname = m_include_path + mod_name + ".clv";
 
-	if (!m_driver->loadFile(fname, ns_name)) {
-		return m_driver->getCompiler().getAST();
-	} else {
+	// The importing file would depend on this one
+	if (m_recording) {
+		m_recording->setCacheable(false);
+	}
+
+	bool global = !scope->getParent() && ns_name.empty();
+
+	if (global && m_files.find(fname) != m_files.end()) {
+		return new ast::NodeArray(location());
+	}
+
+	CompiledUnit* unit = NULL;
+
+	if (global && !m_cache_dir.empty()) {
+		double start = g_startup_profile ? StartupProfile::now() : 0;
+
+		unit = new CompiledUnit(fname, m_cache_dir);
+
+		if (unit->load() && unit->canResolve(scope, *this)) {
+			if (g_startup_profile) {
+				g_startup_profile->record("load cached " + fname, start);
+			}
+
+			m_files.insert(fname);
+
+			return _module_unit(unit, NULL);
+		}
+
+		unit->clear();
+	}
+
+	if (m_driver->loadFile(fname, ns_name)) {
 		CLEVER_EXIT_FATAL();
 	}
 
-	return NULL;
+	ast::Node* tree = m_driver->getCompiler().getAST();
+
+	if (global) {
+		m_files.insert(fname);
+	}
+
+	return unit ? _module_unit(unit, tree) : tree;
+}
+
+/// Loads the extension providing module (e.g. foo/bar.so for foo.bar)
+/// from the script directory or the module path
+/// \returns NULL when there is no such extension
+Module* ModManager::loadExtension(const std::string& module)
+{
+	std::string file = module;
+
+	std::replace(file.begin(), file.end(), '.', '/');
+	file += CLEVER_EXTENSION_SUFFIX;
+
+	std::string path = m_include_path + file;
+
+	for (size_t i = 0; !_file_exists(path); ++i) {
+		if (i == m_module_path.size()) {
+			return NULL;
+		}
+		path = m_module_path[i] + "/" + file;
+	}
+
+	double start = g_startup_profile ? StartupProfile::now() : 0;
+
+	// Extensions are never unloaded, as objects of their types may outlive
+	// the module manager
+	void* handle = _dl_open(path);
+
+	if (!handle) {
+		_extension_error(path, _dl_error());
+	}
+
+	ExtensionInfoFunc info_func = reinterpret_cast<ExtensionInfoFunc>(
+		_dl_sym(handle, CLEVER_EXTENSION_INFO_SYMBOL));
+	ExtensionEntryFunc entry_func = reinterpret_cast<ExtensionEntryFunc>(
+		_dl_sym(handle, CLEVER_EXTENSION_ENTRY_SYMBOL));
+
+	if (!info_func || !entry_func) {
+		_extension_error(path, "not a Clever extension");
+	}
+
+	const ExtensionInfo* info = info_func();
+
+	if (info->api != CLEVER_EXTENSION_API || info->build != CLEVER_EXTENSION_BUILD) {
+		std::ostringstream msg;
+
+		msg << "built for Clever " << info->version << " (API " << info->api
+			<< ", build " << info->build << "), this is Clever "
+			<< CLEVER_VERSION_STRING << " (API " << CLEVER_EXTENSION_API
+			<< ", build " << CLEVER_EXTENSION_BUILD << ")";
+
+		_extension_error(path, msg.str());
+	}
+
+	Module* mod = entry_func();
+
+	if (!mod || mod->getName() != module) {
+		_extension_error(path, "does not provide module `" + module + "'");
+	}
+
+	m_mods.insert(ModuleMap::value_type(module, mod));
+
+	if (g_startup_profile) {
+		g_startup_profile->record("load " + path, start);
+	}
+
+	return mod;
 }
 
 /// Imports a module
 ast::Node* ModManager::importModule(Scope* scope,
-	const std::string& module, size_t kind, const CString* name) const
+	const std::string& module, size_t kind, const CString* name)
 {
 	ModuleMap::const_iterator it(m_mods.find(module));
 
@@ -243,6 +464,15 @@ ast::Node* ModManager::importModule(Scope* scope,
 
 	if (it == m_mods.end()) {
 		ast::Node* tree;
+		Module* extension = loadExtension(module);
+
+		if (extension) {
+			if (m_recording) {
+				m_recording->setCacheable(false);
+			}
+			loadModule(scope, extension, kind, name);
+			return NULL;
+		}
 
 		if ((tree = importFile(scope, module, kind, name)) == NULL) {
 			std::cerr << "Module `" << module << "' not found!" << std::endl;
@@ -251,9 +481,25 @@ ast::Node* ModManager::importModule(Scope* scope,
 		return tree;
 	}
 
-	loadModule(scope, it->second, kind, name);
+	if (m_recording) {
+		size_t first = scope->getEnvironment()->getSize();
+		bool loaded = it->second->isLoaded();
+
+		loadModule(scope, it->second, kind, name);
+
+		m_recording->addImport(scope, module, it->second, kind, name, loaded, first);
+	} else {
+		loadModule(scope, it->second, kind, name);
+	}
 
 	return NULL;
 }
 
+Module* ModManager::getModule(const std::string& name) const
+{
+	ModuleMap::const_iterator it(m_mods.find(name));
+
+	return it == m_mods.end() ? NULL : it->second;
+}
+
 } // clever
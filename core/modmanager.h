@@ -13,6 +13,7 @@
 #else
 #include <tr1/unordered_map>
 #endif
+#include <set>
 #include <vector>
 #include "core/module.h"
 #include "core/ast.h"
@@ -22,6 +23,7 @@ namespace clever {
 class Value;
 class Environment;
 class Driver;
+class CompiledUnit;
 
 /// Package manager
 class ModManager {
@@ -35,7 +37,7 @@ public:
 	};
 
 	ModManager(Driver* driver)
-		: m_driver(driver), m_user(NULL) {}
+		: m_driver(driver), m_user(NULL), m_recording(NULL) {}
 
 	~ModManager() {}
 
@@ -54,10 +56,21 @@ public:
 
 	/// Imports the module to the current scope
 	ast::Node* importModule(Scope*, const std::string&,
-		size_t = ModManager::ALL, const CString* = NULL) const;
+		size_t = ModManager::ALL, const CString* = NULL);
 
 	ast::Node* importFile(Scope*, const std::string&,
-		size_t = ModManager::ALL, const CString* = NULL) const;
+		size_t = ModManager::ALL, const CString* = NULL);
+
+	/// Loads the native extension providing the module, if any
+	Module* loadExtension(const std::string&);
+
+	/// Returns the registered module, or NULL
+	Module* getModule(const std::string&) const;
+
+	/// The unit of the file being compiled, which records the modules
+	/// it imports
+	void setRecordingUnit(CompiledUnit* unit) { m_recording = unit; }
+	CompiledUnit* getRecordingUnit() const { return m_recording; }
 
 	void loadVar(Scope*, const CString*, Value*) const;
 	void loadModule(Scope*, Module*, size_t, const CString*) const;
@@ -69,6 +82,17 @@ private:
 	ModuleMap m_mods;
 	Module* m_user;
 	std::string m_include_path;
+
+	/// Directories searched for extensions after the script directory
+	std::vector<std::string> m_module_path;
+
+	/// Files imported into the global scope
+	std::set<std::string> m_files;
+
+	/// Compilation cache directory (empty when disabled)
+	std::string m_cache_dir;
+
+	CompiledUnit* m_recording;
 };
 
 } // clever
@@ -10,7 +10,7 @@
 
 namespace clever {
 
-#ifdef CLEVER_DEBUG
+#if defined(CLEVER_DEBUG) || defined(CLEVER_VM_STATS)
 const char* get_opcode_name(Opcode opnum)
 {
 	switch (opnum) {
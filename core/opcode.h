@@ -121,7 +121,7 @@ enum Opcode {
 	NUM_OPCODES
 };
 
-#ifdef CLEVER_DEBUG
+#if defined(CLEVER_DEBUG) || defined(CLEVER_VM_STATS)
 const char* get_opcode_name(Opcode);
 #endif
 
@@ -0,0 +1,82 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cerrno>
+#ifdef CLEVER_WIN32
+# include <io.h>
+# define isatty _isatty
+#else
+# include <unistd.h>
+#endif
+#include "core/output.h"
+
+namespace clever {
+
+OutputBuffer::OutputBuffer(int fd)
+	: m_fd(fd), m_policy(isatty(fd) ? FLUSH_LINE : FLUSH_FULL),
+		m_has_newline(false)
+{
+	m_buffer.reserve(CLEVER_OUTPUT_BUFFER_SIZE);
+}
+
+OutputBuffer& OutputBuffer::getStdout()
+{
+	// Destroyed, and thus flushed, when the process exits
+	static OutputBuffer out(1);
+
+	return out;
+}
+
+void OutputBuffer::write(const char* data, size_t len)
+{
+	OutputLock guard(*this);
+
+	append(data, len);
+}
+
+void OutputBuffer::flush()
+{
+	lock();
+	flushUnlocked();
+	unlock();
+}
+
+void OutputBuffer::setPolicy(FlushPolicy policy)
+{
+	lock();
+	m_policy = policy;
+	flushUnlocked();
+	unlock();
+}
+
+void OutputBuffer::flushUnlocked()
+{
+	const char* data = m_buffer.data();
+	size_t left = m_buffer.size();
+
+	while (left) {
+#ifdef CLEVER_WIN32
+		int written = ::_write(m_fd, data, static_cast<unsigned int>(left));
+#else
+		ssize_t written = ::write(m_fd, data, left);
+#endif
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// Nowhere to report it; the data is dropped
+			break;
+		}
+		data += written;
+		left -= written;
+	}
+
+	m_buffer.clear();
+	m_has_newline = false;
+}
+
+} // clever
@@ -0,0 +1,120 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_OUTPUT_H
+#define CLEVER_OUTPUT_H
+
+#include <cstring>
+#include "core/cstring.h"
+#include "core/cthread.h"
+
+namespace clever {
+
+// Bytes kept before a fully buffered output is written out
+#define CLEVER_OUTPUT_BUFFER_SIZE 65536
+
+/**
+ * Output buffer written straight to a file descriptor, bypassing iostreams
+ *
+ * Writers that produce several pieces (e.g. println with many arguments)
+ * hold the lock while appending, so output from concurrent threads is never
+ * interleaved within a single call.
+ */
+class OutputBuffer {
+public:
+	enum FlushPolicy {
+		FLUSH_NONE, // Written on every call
+		FLUSH_LINE, // Written when a newline is appended
+		FLUSH_FULL  // Written when the buffer is full
+	};
+
+	OutputBuffer(int fd);
+
+	~OutputBuffer() {
+		flush();
+	}
+
+	/// Buffer for the process standard output, shared by every VM
+	static OutputBuffer& getStdout();
+
+	void lock() { m_mutex.lock(); }
+	void unlock() { m_mutex.unlock(); }
+
+	/// Appends data; the caller must hold the lock and call commit() after
+	void append(const char* data, size_t len) {
+		if (m_policy == FLUSH_LINE && !m_has_newline) {
+			m_has_newline = std::memchr(data, '\n', len) != NULL;
+		}
+		m_buffer.append(data, len);
+	}
+
+	void append(const CString& str) { append(str.data(), str.size()); }
+
+	void append(char c) {
+		if (c == '\n') {
+			m_has_newline = true;
+		}
+		m_buffer.push_back(c);
+	}
+
+	CString& getBuffer() { return m_buffer; }
+
+	/// Writes the buffered data out according to the flush policy
+	void commit() {
+		if (m_policy == FLUSH_NONE
+			|| (m_policy == FLUSH_LINE && m_has_newline)
+			|| m_buffer.size() >= CLEVER_OUTPUT_BUFFER_SIZE) {
+			flushUnlocked();
+		}
+	}
+
+	/// Appends and commits data as a single locked operation
+	void write(const char* data, size_t len);
+
+	void write(const CString& str) { write(str.data(), str.size()); }
+
+	/// Writes out any buffered data
+	void flush();
+
+	void setPolicy(FlushPolicy policy);
+	FlushPolicy getPolicy() const { return m_policy; }
+private:
+	void flushUnlocked();
+
+	int m_fd;
+	FlushPolicy m_policy;
+	bool m_has_newline;
+	CString m_buffer;
+	CMutex m_mutex;
+
+	DISALLOW_COPY_AND_ASSIGN(OutputBuffer);
+};
+
+/**
+ * Holds the lock of an OutputBuffer for the current scope, committing the
+ * appended data on release
+ */
+class OutputLock {
+public:
+	OutputLock(OutputBuffer& out)
+		: m_out(out) {
+		m_out.lock();
+	}
+
+	~OutputLock() {
+		m_out.commit();
+		m_out.unlock();
+	}
+private:
+	OutputBuffer& m_out;
+
+	DISALLOW_COPY_AND_ASSIGN(OutputLock);
+};
+
+} // clever
+
+#endif // CLEVER_OUTPUT_H
@@ -0,0 +1,239 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <vector>
+#ifndef CLEVER_WIN32
+# include <signal.h>
+# include <sys/time.h>
+#endif
+#include "core/location.hh"
+#include "core/type.h"
+#include "core/profiler.h"
+#include "modules/std/core/function.h"
+
+namespace clever {
+
+// Rows shown in each table
+#define CLEVER_PROFILE_ROWS 20
+
+Profiler* g_profiler;
+
+#ifndef CLEVER_WIN32
+static void _on_sigprof(int)
+{
+	VM::profileTick();
+}
+#endif
+
+bool Profiler::start()
+{
+#ifdef CLEVER_WIN32
+	return false;
+#else
+	struct sigaction action;
+
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = _on_sigprof;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(SIGPROF, &action, NULL) != 0) {
+		return false;
+	}
+
+	struct itimerval timer;
+
+	timer.it_interval.tv_sec = m_interval / 1000000;
+	timer.it_interval.tv_usec = m_interval % 1000000;
+	timer.it_value = timer.it_interval;
+
+	if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+		return false;
+	}
+
+	m_running = true;
+	m_cpu_start = std::clock();
+
+	return true;
+#endif
+}
+
+void Profiler::stop()
+{
+#ifndef CLEVER_WIN32
+	if (!m_running) {
+		return;
+	}
+
+	struct itimerval timer;
+
+	std::memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+
+	m_running = false;
+	m_cpu_time += std::clock() - m_cpu_start;
+#endif
+}
+
+static std::string _function_name(const Function* func)
+{
+	if (func == NULL) {
+		return "<main>";
+	}
+	if (func->getContext()) {
+		return func->getContext()->getName() + "." + func->getName();
+	}
+	return func->getName();
+}
+
+static std::string _line_name(const location* loc)
+{
+	if (loc == NULL) {
+		return "?";
+	}
+
+	char line[32];
+
+	std::sprintf(line, ":%u", loc->begin.line);
+
+	return (loc->begin.filename ? *loc->begin.filename : "?") + line;
+}
+
+void Profiler::addSample(const CallStack& stack, const location& loc,
+	size_t ticks)
+{
+	const CallStack::container_type& entries = stack.getEntries();
+	std::vector<std::string> functions, lines;
+	std::string folded;
+
+	// Each frame is at the call made by the next one, the top one at loc
+	for (size_t i = 0, n = entries.size(); i < n; ++i) {
+		functions.push_back(_function_name(entries[i].func));
+		lines.push_back(_line_name(i + 1 < n ? entries[i + 1].loc : &loc));
+
+		if (i) {
+			folded += ';';
+		}
+		folded += functions.back();
+	}
+
+	if (functions.empty()) {
+		return;
+	}
+
+	// Recursive calls count once in the totals
+	std::set<std::string> seen_functions(functions.begin(), functions.end());
+	std::set<std::string> seen_lines(lines.begin(), lines.end());
+
+	m_mutex.lock();
+
+	m_samples += ticks;
+	m_stacks[folded] += ticks;
+
+	m_functions[functions.back()].self += ticks;
+	m_lines[lines.back()].self += ticks;
+
+	for (std::set<std::string>::const_iterator it = seen_functions.begin();
+		it != seen_functions.end(); ++it) {
+		m_functions[*it].total += ticks;
+	}
+	for (std::set<std::string>::const_iterator it = seen_lines.begin();
+		it != seen_lines.end(); ++it) {
+		m_lines[*it].total += ticks;
+	}
+
+	m_mutex.unlock();
+}
+
+bool Profiler::bySelf(const CountMap::value_type* a,
+	const CountMap::value_type* b)
+{
+	if (a->second.self != b->second.self) {
+		return a->second.self > b->second.self;
+	}
+	if (a->second.total != b->second.total) {
+		return a->second.total > b->second.total;
+	}
+	return a->first < b->first;
+}
+
+void Profiler::dumpTable(std::ostream& out, const char* what,
+	const CountMap& counts) const
+{
+	std::vector<const CountMap::value_type*> rows;
+	double sample_ms = m_cpu_time * 1000.0 / CLOCKS_PER_SEC / m_samples;
+
+	for (CountMap::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+		rows.push_back(&*it);
+	}
+
+	std::sort(rows.begin(), rows.end(), bySelf);
+
+	out << std::setw(10) << "self ms" << std::setw(8) << "%"
+		<< std::setw(10) << "total ms" << std::setw(8) << "%" << "  " << what << "\n";
+
+	for (size_t i = 0; i < rows.size() && i < CLEVER_PROFILE_ROWS; ++i) {
+		const Counts& row = rows[i]->second;
+
+		out << std::setw(10) << row.self * sample_ms
+			<< std::setw(8) << row.self * 100.0 / m_samples
+			<< std::setw(10) << row.total * sample_ms
+			<< std::setw(8) << row.total * 100.0 / m_samples
+			<< "  " << rows[i]->first << "\n";
+	}
+
+	if (rows.size() > CLEVER_PROFILE_ROWS) {
+		out << "  (" << rows.size() - CLEVER_PROFILE_ROWS << " more)\n";
+	}
+}
+
+void Profiler::dump(std::ostream& out) const
+{
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	if (!m_output.empty()) {
+		std::ofstream file(m_output.c_str());
+
+		for (std::map<std::string, size_t>::const_iterator it = m_stacks.begin();
+			it != m_stacks.end(); ++it) {
+			file << it->first << ' ' << it->second << '\n';
+		}
+
+		if (!file) {
+			out << "Cannot write the profile to " << m_output << "\n";
+		}
+	}
+
+	out << std::fixed << std::setprecision(1) << "Profile: " << m_samples
+		<< " samples in " << m_cpu_time * 1000.0 / CLOCKS_PER_SEC
+		<< "ms of CPU time (interval " << m_interval << "us)";
+
+	if (!m_output.empty()) {
+		out << ", stacks written to " << m_output;
+	}
+	out << "\n";
+
+	if (m_samples) {
+		out << "\n";
+		dumpTable(out, "function", m_functions);
+		out << "\n";
+		dumpTable(out, "line", m_lines);
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+} // clever
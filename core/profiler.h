@@ -0,0 +1,95 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_PROFILER_H
+#define CLEVER_PROFILER_H
+
+#include <ctime>
+#include <map>
+#include <ostream>
+#include <string>
+#include "core/clever.h"
+#include "core/cthread.h"
+#include "core/vm.h"
+
+namespace clever {
+
+// Default sampling interval, in microseconds of CPU time
+#define CLEVER_PROFILE_INTERVAL 1000
+
+/**
+ * Sampling profiler (--profile)
+ *
+ * A SIGPROF timer interrupts the process every interval of CPU time; the
+ * signal handler only notes the instruction being run by the VM of the
+ * interrupted thread. The VM takes the sample at its next call, return or
+ * jump, where its call stack is consistent, and the profiler counts it
+ * per call stack (written in the folded format of flamegraph.pl), per
+ * function and per line. Timers are rounded to the clock tick of the
+ * system, so times are the CPU time of the run split among the samples.
+ */
+class Profiler {
+public:
+	Profiler(const std::string& output, size_t interval)
+		: m_output(output), m_interval(interval), m_samples(0), m_running(false),
+			m_cpu_start(0), m_cpu_time(0) {}
+
+	~Profiler() {}
+
+	void setInterval(size_t interval) { m_interval = interval; }
+
+	/// Starts the timer
+	/// \returns false when profiling is not supported
+	bool start();
+
+	/// Stops the timer
+	void stop();
+
+	/// Counts ticks samples of the stack, whose top frame was at loc
+	void addSample(const CallStack&, const location& loc, size_t ticks);
+
+	/// Writes the folded stacks to the output file and the tables to out
+	void dump(std::ostream& out) const;
+private:
+	struct Counts {
+		Counts()
+			: self(0), total(0) {}
+
+		size_t self;
+		size_t total;
+	};
+
+	typedef std::map<std::string, Counts> CountMap;
+
+	/// Orders the rows of a table by self time, then by total time
+	static bool bySelf(const CountMap::value_type*, const CountMap::value_type*);
+
+	void dumpTable(std::ostream&, const char*, const CountMap&) const;
+
+	std::string m_output;
+	size_t m_interval;
+	size_t m_samples;
+	bool m_running;
+	clock_t m_cpu_start;
+	clock_t m_cpu_time;
+
+	std::map<std::string, size_t> m_stacks;
+	CountMap m_functions;
+	CountMap m_lines;
+
+	// Samples come from the thread of each VM
+	CMutex m_mutex;
+
+	DISALLOW_COPY_AND_ASSIGN(Profiler);
+};
+
+/// The active profiler, or NULL
+extern Profiler* g_profiler;
+
+} // clever
+
+#endif // CLEVER_PROFILER_H
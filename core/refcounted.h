@@ -10,6 +10,7 @@
 
 #include "core/clever.h"
 #include "core/cthread.h"
+#include "core/vmstats.h"
 
 namespace clever {
 
@@ -30,6 +31,7 @@ public:
 	size_t refCount() const { return m_reference; }
 
 	void addRef() {
+		CLEVER_STAT(REFCOUNT_OPS);
 #if CLEVER_GCC_VERSION >= 4010 || defined(__clang__)
 		__sync_add_and_fetch(&m_reference, 1);
 #else
@@ -45,6 +47,7 @@ public:
 
 	void delRef() {
 		clever_assert(m_reference > 0, "This object has been free'd before.");
+		CLEVER_STAT(REFCOUNT_OPS);
 #if CLEVER_GCC_VERSION >= 4010 || defined(__clang__)
 		if (__sync_sub_and_fetch(&m_reference, 1) == 0) {
 			clever_delete(this);
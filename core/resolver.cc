@@ -10,10 +10,11 @@
 #include "core/native_types.h"
 #include "core/module.h"
 #include "core/user.h"
+#include "core/compunit.h"
 
 namespace clever { namespace ast {
 
-Resolver::Resolver(const ModManager& ModManager, const std::string& ns_name)
+Resolver::Resolver(ModManager& ModManager, const std::string& ns_name)
 	: Visitor(), m_modmanager(ModManager), m_ns_name(ns_name), m_symtable(NULL),
 	  m_scope(NULL), m_mod(NULL), m_class(NULL), m_func(NULL)
 {
@@ -71,18 +72,23 @@ void Resolver::visit(VariableDecl* node)
 	val->setConst(node->isConst());
 }
 
-void Resolver::visit(FunctionDecl* node)
+/// Creates an user-unusable symbol name for an anonymous function
+const CString* Resolver::getAnonymousName()
 {
 	static size_t anon_fdecls = 0;
 
+	std::stringstream buf;
+	buf << "<anonymous " << anon_fdecls++ << ">";
+
+	return CSTRING(buf.str());
+}
+
+void Resolver::visit(FunctionDecl* node)
+{
 	const CString* name;
 
-	// Create an user-unusable symbol name for anonymous functions
 	if (!node->hasIdent() && !node->hasType()) {
-		std::stringstream buf;
-		buf << "<anonymous " << anon_fdecls++ << ">";
-
-		name = CSTRING(buf.str());
+		name = getAnonymousName();
 
 		node->setIdent(new Ident(name, node->getLocation()));
 	} else if (node->isCtor()) {
@@ -262,6 +268,27 @@ void Resolver::visit(Import* node)
 	}
 }
 
+void Resolver::visit(ModuleUnit* node)
+{
+	CompiledUnit* unit = node->getUnit();
+
+	if (!node->hasTree()) {
+		unit->resolve(m_scope, m_modmanager);
+		return;
+	}
+
+	// Modules imported by the file are recorded in its unit
+	CompiledUnit* outer = m_modmanager.getRecordingUnit();
+
+	m_modmanager.setRecordingUnit(unit);
+
+	unit->beginResolve(m_scope);
+	Visitor::visit(static_cast<NodeArray*>(node->getTree()));
+	unit->endResolve();
+
+	m_modmanager.setRecordingUnit(outer);
+}
+
 void Resolver::visit(Catch* node)
 {
 	m_scope = m_scope->enter();
@@ -287,7 +314,6 @@ void Resolver::visit(ClassDef* node)
 	UserType* type = new UserType(name);
 
 	m_mod->addType(type);
-	type->init();
 
 	Value* tmp = new Value(type);
 	m_scope->pushValue(name, tmp);
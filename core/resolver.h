@@ -22,12 +22,14 @@ namespace clever { namespace ast {
 
 class Resolver: public Visitor {
 public:
-	Resolver(const ModManager&, const std::string&);
+	Resolver(ModManager&, const std::string&);
 
 	~Resolver() {}
 
 	void initGlobalScope();
 
+	static const CString* getAnonymousName();
+
 	Scope* getSymTable() const { return m_symtable; }
 
 	Environment* getGlobalEnv() const {
@@ -43,13 +45,14 @@ public:
 	virtual void visit(Ident*);
 	virtual void visit(Type*);
 	virtual void visit(Import*);
+	virtual void visit(ModuleUnit*);
 	virtual void visit(Catch*);
 	virtual void visit(ClassDef*);
 	virtual void visit(AttrDecl*);
 	virtual void visit(For*);
 	virtual void visit(ForEach*);
 private:
-	const ModManager& m_modmanager;
+	ModManager& m_modmanager;
 	const std::string& m_ns_name;
 	Scope* m_symtable;
 	Scope* m_scope;
@@ -92,6 +92,9 @@ public:
 	std::pair<size_t, size_t> getOffset(const Symbol* sym) const;
 
 	const ScopeVector& getChildren() const { return m_children; }
+
+	/// Returns the symbols in declaration order
+	const SymbolMap& getSymbols() const { return m_symbols; }
 private:
 	Scope* m_parent;
 	ScopeVector m_children;
@@ -0,0 +1,76 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <iomanip>
+#ifdef CLEVER_WIN32
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif
+#include "core/startup.h"
+
+namespace clever {
+
+StartupProfile* g_startup_profile;
+
+double StartupProfile::now()
+{
+#ifdef CLEVER_WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return count.QuadPart * 1000000.0 / freq.QuadPart;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+
+	return tp.tv_sec * 1000000.0 + tp.tv_usec;
+#endif
+}
+
+void StartupProfile::record(const std::string& what, double start)
+{
+	double elapsed = now() - start;
+
+	// Types may be initialized by any thread
+	m_mutex.lock();
+	m_entries.push_back(Entry(what, start - m_start, elapsed));
+	m_mutex.unlock();
+}
+
+void StartupProfile::dump(std::ostream& out) const
+{
+	std::ios::fmtflags flags = out.flags();
+
+	out << "Startup profile (microseconds)\n"
+		<< std::setw(10) << "start" << std::setw(10) << "time" << "  event\n";
+
+	out << std::fixed << std::setprecision(0);
+
+	for (size_t i = 0; i < m_entries.size(); ++i) {
+		const Entry& entry = m_entries[i];
+
+		out << std::setw(10) << entry.start << std::setw(10) << entry.elapsed
+			<< "  " << entry.what;
+
+		if (m_run && entry.start >= m_run - m_start) {
+			out << " (during execution)";
+		}
+		out << "\n";
+	}
+
+	if (m_run) {
+		out << "Execution started after " << (m_run - m_start) << "us\n";
+	}
+
+	out.flags(flags);
+}
+
+} // clever
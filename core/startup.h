@@ -0,0 +1,66 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STARTUP_H
+#define CLEVER_STARTUP_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "core/clever.h"
+#include "core/cthread.h"
+
+namespace clever {
+
+/**
+ * Startup profile (--startup-profile)
+ *
+ * Records how long the interpreter takes to register and initialize
+ * modules and types, to parse and to compile; nothing is timed unless
+ * g_startup_profile is set.
+ */
+class StartupProfile {
+public:
+	struct Entry {
+		Entry(const std::string& what_, double start_, double elapsed_)
+			: what(what_), start(start_), elapsed(elapsed_) {}
+
+		std::string what;
+		double start;
+		double elapsed;
+	};
+
+	StartupProfile()
+		: m_start(now()), m_run(0) {}
+
+	~StartupProfile() {}
+
+	/// Returns a timestamp in microseconds
+	static double now();
+
+	/// Records an event that started at start (a timestamp from now())
+	void record(const std::string& what, double start);
+
+	/// Marks the start of the script execution
+	void setRunning() { m_run = now(); }
+
+	void dump(std::ostream&) const;
+private:
+	double m_start;
+	double m_run;
+	std::vector<Entry> m_entries;
+	CMutex m_mutex;
+
+	DISALLOW_COPY_AND_ASSIGN(StartupProfile);
+};
+
+/// The active profile, or NULL
+extern StartupProfile* g_startup_profile;
+
+} // clever
+
+#endif // CLEVER_STARTUP_H
@@ -11,91 +11,98 @@
 #include "core/value.h"
 #include "core/cexception.h"
 #include "core/native_types.h"
+#include "core/startup.h"
 
 namespace clever {
 
-TypeObject::~TypeObject()
+static void _delete_members(MemberMap* members)
 {
-	MemberMap::const_iterator it(m_members.begin()), end(m_members.end());
+	MemberMap::const_iterator it(members->begin()), end(members->end());
 
 	for (; it != end; ++it) {
 		clever_delref(it->second.value);
 	}
+
+	delete members;
+}
+
+TypeObject::~TypeObject()
+{
+	if (m_members) {
+		_delete_members(m_members);
+	}
+}
+
+const MemberMap& TypeObject::getMembers() const
+{
+	static const MemberMap empty;
+
+	return m_members ? *m_members : empty;
 }
 
 /// Copy the type members to the object instance
+///
+/// Objects shared by threads can be initialized by several of them at
+/// once, so the members are copied to a new map and the first one
+/// published is kept
 void TypeObject::copyMembers(const Type* type)
 {
-	clever_assert(m_members.empty(), "m_members must be empty");
-
 	const MemberMap& members = type->getMembers();
 
-	MemberMap::const_iterator it(members.begin()), end(members.end());
+	if (!members.empty()) {
+		MemberMap* copy = new MemberMap;
 
-	for (; it != end; ++it) {
-		if (it->second.value->isConst()) {
-			addMember(it->first, it->second);
-			clever_addref(it->second.value);
-		} else {
-			addMember(it->first, MemberData(it->second.value->clone(), it->second.flags));
+		MemberMap::const_iterator it(members.begin()), end(members.end());
+
+		for (; it != end; ++it) {
+			if (it->second.value->isConst()) {
+				copy->insert(*it);
+				clever_addref(it->second.value);
+			} else {
+				copy->insert(MemberMap::value_type(it->first,
+					MemberData(it->second.value->clone(), it->second.flags)));
+			}
+		}
+
+		if (!__sync_bool_compare_and_swap(&m_members, NULL, copy)) {
+			_delete_members(copy);
 		}
 	}
 
-	m_initialized = 1;
+	__atomic_store_n(&m_initialized, true, __ATOMIC_RELEASE);
 }
 
-/// Deallocs memory used by type members
-void Type::deallocMembers()
+/// Initializes the type on its first use
+void Type::runInit()
 {
-	MemberMap::iterator it(m_members.begin()), end(m_members.end());
+	double start = g_startup_profile ? StartupProfile::now() : 0;
 
-	for (; it != end; ++it) {
-		clever_delref(it->second.value);
-	}
-}
+	// Types can be first used by several threads at once
+	m_init_lock.lock();
 
-/// Serialization interface
-std::pair<size_t, TypeObject*> Type::serialize(const Value* value) const
-{
-	clever_assert_not_null(value);
+	if (m_init_state == UNINITIALIZED) {
+		m_init_state = INITIALIZING;
+		init();
+		// The members are published before the state, as ensureInit()
+		// reads it without the lock
+		__atomic_store_n(&m_init_state, INITIALIZED, __ATOMIC_RELEASE);
+	}
 
-	size_t size;
+	m_init_lock.unlock();
 
-	if (value->isInt()) {
-		size = sizeof(IntObject);
-	} else if (value->isDouble()) {
-		size = sizeof(DoubleObject);
-	} else if (value->isBool()) {
-		size = sizeof(BoolObject);
-	} else if (value->isStr()) {
-		size = sizeof(StrObject);
-	} else if (value->isArray()) {
-		size = sizeof(ArrayObject);
-	} else if (value->isMap()) {
-		size = sizeof(MapObject);
-	} else {
-		size = sizeof(TypeObject);
+	if (g_startup_profile) {
+		g_startup_profile->record("type " + getName(), start);
 	}
-
-	return std::pair<size_t, TypeObject*>(size, value->getObj());
 }
 
-/// Unserialization interface
-Value* Type::unserialize(const Type* type, const std::pair<size_t, TypeObject*>& data) const
+/// Deallocs memory used by type members
+void Type::deallocMembers()
 {
-	Value* value = new Value;
+	MemberMap::iterator it(m_members.begin()), end(m_members.end());
 
-	if (type == CLEVER_INT_TYPE) {
-		value->setInt(static_cast<IntObject*>(data.second)->value);
-	} else if (type == CLEVER_DOUBLE_TYPE) {
-		value->setDouble(static_cast<DoubleObject*>(data.second)->value);
-	} else if (type == CLEVER_BOOL_TYPE) {
-		value->setBool(static_cast<BoolObject*>(data.second)->value);
-	} else if (type == CLEVER_STR_TYPE) {
-		value->setStr(static_cast<StrObject*>(data.second)->value);
+	for (; it != end; ++it) {
+		clever_delref(it->second.value);
 	}
-
-	return value;
 }
 
 /// Add a new method to the type
@@ -132,6 +139,8 @@ MemberData Type::getProperty(const CString* name) const
 /// Returns all the type methods
 const MethodMap Type::getMethods() const
 {
+	ensureInit();
+
 	MemberMap::const_iterator it(m_members.begin()), end(m_members.end());
 	MethodMap mm;
 
@@ -149,6 +158,8 @@ const MethodMap Type::getMethods() const
 /// Returns all the type properties
 const PropertyMap Type::getProperties() const
 {
+	ensureInit();
+
 	MemberMap::const_iterator it(m_members.begin()), end(m_members.end());
 	PropertyMap pm;
 
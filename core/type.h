@@ -56,7 +56,7 @@ class Function;
 
 #define CLEVER_TYPE_INIT(name) void name()
 
-#define CLEVER_METHOD_ARGS Value* result, const Value* obj, const ::std::vector<Value*>& args, Clever* clever
+#define CLEVER_METHOD_ARGS Value* result, const Value* obj, ValueSpan args, Clever* clever
 #define CLEVER_METHOD_PASS_ARGS result, obj, args, clever
 #define CLEVER_METHOD(name) void name(CLEVER_METHOD_ARGS) const
 
@@ -80,37 +80,49 @@ typedef std::tr1::unordered_map<const CString*, Function*> MethodMap;
 class TypeObject : public RefCounted {
 public:
 	TypeObject()
-		: m_initialized(false) {}
+		: m_members(NULL), m_initialized(false) {
+		CLEVER_STAT(TYPE_OBJECTS);
+	}
 
 	virtual ~TypeObject();
 
 	void copyMembers(const Type*);
 
 	void addMember(const CString* name, MemberData data) {
-		m_members.insert(MemberMap::value_type(name, data));
+		if (!m_members) {
+			m_members = new MemberMap;
+		}
+		m_members->insert(MemberMap::value_type(name, data));
 	}
 
 	virtual MemberData getMember(const CString* name) const {
-		MemberMap::const_iterator it = m_members.find(name);
+		CLEVER_STAT(MEMBER_LOOKUPS);
 
-		if (it != m_members.end()) {
-			return it->second;
+		if (m_members) {
+			MemberMap::const_iterator it = m_members->find(name);
+
+			if (it != m_members->end()) {
+				return it->second;
+			}
 		}
 
+		CLEVER_STAT(MEMBER_MISSES);
 		return MemberData(NULL, 0);
 	}
 
-	const MemberMap& getMembers() const { return m_members; }
+	const MemberMap& getMembers() const;
 
 	virtual TypeObject* clone() const { return NULL; }
 
 	void initialize(const Type* type) {
-		if (!m_initialized) {
+		if (!__atomic_load_n(&m_initialized, __ATOMIC_ACQUIRE)) {
 			copyMembers(type);
 		}
 	}
 private:
-	MemberMap m_members;
+	/// Allocated on the first member, as most instances (strings, numbers,
+	/// containers) never have any
+	MemberMap* m_members;
 
 	/// Flag to indicate if the members were loaded into the instance
 	bool m_initialized;
@@ -139,11 +151,11 @@ public:
 	enum TypeFlag { INTERNAL_TYPE, USER_TYPE };
 
 	Type()
-		: m_flags(INTERNAL_TYPE) {}
+		: m_flags(INTERNAL_TYPE), m_init_state(UNINITIALIZED) {}
 
 	Type(const std::string& name, TypeFlag flags = INTERNAL_TYPE)
 		: m_name(name), m_ctor(NULL), m_dtor(NULL), m_user_ctor(NULL),
-			m_user_dtor(NULL), m_flags(flags) {}
+			m_user_dtor(NULL), m_flags(flags), m_init_state(UNINITIALIZED) {}
 
 	virtual ~Type() {}
 
@@ -157,12 +169,16 @@ public:
 	}
 
 	MemberData getMember(const CString* name) const {
+		ensureInit();
+		CLEVER_STAT(MEMBER_LOOKUPS);
+
 		MemberMap::const_iterator it = m_members.find(name);
 
 		if (it != m_members.end()) {
 			return it->second;
 		}
 
+		CLEVER_STAT(MEMBER_MISSES);
 		return MemberData(NULL, 0);
 	}
 
@@ -170,8 +186,8 @@ public:
 		return getMember(name).value != NULL;
 	}
 
-	bool hasMembers() const { return !m_members.empty(); }
-	const MemberMap& getMembers() const { return m_members; }
+	bool hasMembers() const { ensureInit(); return !m_members.empty(); }
+	const MemberMap& getMembers() const { ensureInit(); return m_members; }
 
 	Function* addMethod(Function*, size_t = MemberData::PUBLIC);
 
@@ -195,18 +211,31 @@ public:
 	void setConstructor(MethodPtr method);
 	void setDestructor(MethodPtr method);
 
-	const Function* getConstructor() const { return m_ctor; }
-	const Function* getDestructor() const { return m_dtor; }
+	const Function* getConstructor() const { ensureInit(); return m_ctor; }
+	const Function* getDestructor() const { ensureInit(); return m_dtor; }
 
 	void setUserConstructor(Function* func) { m_user_ctor = func; }
 	const Function* getUserConstructor() const { return m_user_ctor; }
 	bool hasUserConstructor() const { return m_user_ctor != NULL; }
 
 	void setUserDestructor(Function* func) { m_user_dtor = func; }
+	const Function* getUserDestructor() const { return m_user_dtor; }
 
 	/// Virtual method for type initialization
 	virtual void init() {}
 
+	/// Runs init() unless it already ran; types are initialized on the
+	/// first use of their members, so the ones a script never uses do not
+	/// build their methods
+	void ensureInit() const {
+		// Acquire load, paired with the release store in runInit(), so
+		// that the members are not read before the state saying they
+		// are built
+		if (UNEXPECTED(__atomic_load_n(&m_init_state, __ATOMIC_ACQUIRE) != INITIALIZED)) {
+			const_cast<Type*>(this)->runInit();
+		}
+	}
+
 	/// Virtual method for debug purpose
 	virtual void dump(TypeObject* data) const { dump(data, std::cout); }
 	virtual void dump(TypeObject* data, std::ostream& out) const { out << toString(data); }
@@ -236,11 +265,11 @@ public:
 	virtual Value* CLEVER_FASTCALL at_op(CLEVER_TYPE_AT_OPERATOR_ARGS)    const;
 	virtual void increment(Value*, Clever*) const;
 	virtual void decrement(Value*, Clever*) const;
-
-	/// Virtual methods for serialization interface
-	virtual std::pair<size_t, TypeObject*> serialize(const Value*) const;
-	virtual Value* unserialize(const Type*, const std::pair<size_t, TypeObject*>&) const;
 private:
+	enum InitState { UNINITIALIZED, INITIALIZING, INITIALIZED };
+
+	void runInit();
+
 	MemberMap m_members;
 	std::string m_name;
 	const Function* m_ctor;
@@ -248,6 +277,8 @@ private:
 	const Function* m_user_ctor;
 	const Function* m_user_dtor;
 	TypeFlag m_flags;
+	InitState m_init_state;
+	CMutex m_init_lock;
 
 	DISALLOW_COPY_AND_ASSIGN(Type);
 };
@@ -78,9 +78,8 @@ void Value::setStr(StrObject* str)
 
 void Value::setStr(const std::string& str)
 {
-	if (m_data && isStr() && m_data->refCount() == 1
-		&& static_cast<StrObject*>(m_data)->interned == false) {
-		*const_cast<CString*>(static_cast<StrObject*>(m_data)->value) = str;
+	if (m_data && isStr() && static_cast<StrObject*>(m_data)->isMutable()) {
+		static_cast<StrObject*>(m_data)->getBuffer() = str;
 	} else {
 		setObj(CLEVER_STR_TYPE, new StrObject(str));
 	}
@@ -88,7 +87,7 @@ void Value::setStr(const std::string& str)
 
 const CString* Value::getStr() const
 {
-	return static_cast<StrObject*>(m_data)->value;
+	return static_cast<StrObject*>(m_data)->getStr();
 }
 
 void Value::setBool(bool n)
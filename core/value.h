@@ -41,30 +41,39 @@ typedef std::vector  <Value*>               ValueVector;
 class Value : public RefCounted {
 public:
 	Value()
-		: m_type(NULL), m_data(NULL), m_is_const(false) {}
+		: m_type(NULL), m_data(NULL), m_is_const(false) {
+		CLEVER_STAT(VALUES);
+	}
 
 	explicit Value(bool n, bool is_const = false)
 		: m_type(CLEVER_BOOL_TYPE), m_data(NULL), m_is_const(is_const) {
+		CLEVER_STAT(VALUES);
 		setBool(n);
 	}
 
 	explicit Value(long n, bool is_const = false)
 		: m_type(CLEVER_INT_TYPE), m_data(NULL), m_is_const(is_const) {
+		CLEVER_STAT(VALUES);
 		setInt(n);
 	}
 
 	explicit Value(double n, bool is_const = false)
 		: m_type(CLEVER_DOUBLE_TYPE), m_data(NULL), m_is_const(is_const) {
+		CLEVER_STAT(VALUES);
 		setDouble(n);
 	}
 
+	/// value must be interned (CSTRING()), as it is shared, not copied
 	explicit Value(const CString* value, bool is_const = false)
 		: m_type(CLEVER_STR_TYPE), m_data(NULL), m_is_const(is_const) {
+		CLEVER_STAT(VALUES);
 		setObj(m_type, new StrObject(value));
 	}
 
 	explicit Value(const Type* type, bool is_const = false)
-		: m_type(type), m_data(NULL), m_is_const(is_const) {}
+		: m_type(type), m_data(NULL), m_is_const(is_const) {
+		CLEVER_STAT(VALUES);
+	}
 
 	~Value() {
 		clever_delref(m_data);
@@ -105,6 +114,8 @@ public:
 	void setDouble(double);
 	double getDouble() const;
 
+	/// Shares an interned string (CSTRING()); use the std::string overload
+	/// to copy any other
 	void setStr(const CString*);
 	void setStr(StrObject*);
 	void setStr(const std::string&);
@@ -14,33 +14,81 @@
 #include "core/location.hh"
 #include "core/user.h"
 #include "core/type.h"
+#include "core/output.h"
+#include "core/profiler.h"
+#include "core/vmstats.h"
 #include "modules/std/core/function.h"
 #include "modules/std/core/array.h"
 
 #define OPCODE    m_inst[m_pc]
 
+// Counts the instruction about to run, with -DVM_STATS=1
+#ifdef CLEVER_VM_STATS
+# define COUNT_INST() ++inst_counts[m_pc]
+#else
+# define COUNT_INST()
+#endif
+
 #if CLEVER_GCC_VERSION > 0 && !defined(CLEVER_NOGNU)
 # define OP(name)    name
-# define OPCODES     const static void* labels[] = { OP_LABELS }; goto *labels[m_inst[m_pc].opcode]
-# define DISPATCH    ++m_pc; goto *labels[m_inst[m_pc].opcode]
+# define OPCODES     const static void* labels[] = { OP_LABELS }; COUNT_INST(); goto *labels[m_inst[m_pc].opcode]
+# define DISPATCH    ++m_pc; COUNT_INST(); goto *labels[m_inst[m_pc].opcode]
 # define END_OPCODES
-# define VM_GOTO(n)  m_pc = n; goto *labels[m_inst[m_pc].opcode]
+# define VM_GOTO(n)  m_pc = n; COUNT_INST(); goto *labels[m_inst[m_pc].opcode]
 #else
 # define OP(name)    case name
-# define OPCODES     for (;;) { switch (m_inst[m_pc].opcode) {
+# define OPCODES     for (;;) { COUNT_INST(); switch (m_inst[m_pc].opcode) {
 # define DISPATCH    ++m_pc; break
 # define END_OPCODES EMPTY_SWITCH_DEFAULT_CASE(); } }
 # define VM_GOTO(n)  m_pc = n; break
 #endif
 
+// Takes the samples noted by the profiler at calls, returns and jumps, where
+// the call stack matches the instruction being run
+#define PROFILE_POINT() if (UNEXPECTED(m_profile_ticks)) { takeSample(); }
+
 namespace clever {
 
+// VM running on the current thread, when profiling
+static THREAD_TLS VM* t_profiled_vm;
+
+void VM::profileTick()
+{
+	VM* vm = t_profiled_vm;
+
+	if (vm) {
+		vm->m_profile_pc = vm->m_pc;
+		++vm->m_profile_ticks;
+	}
+}
+
+void VM::takeSample()
+{
+	sig_atomic_t ticks = m_profile_ticks;
+	size_t pc = m_profile_pc < m_inst.size() ? m_profile_pc : m_pc;
+
+	// A single instruction, so a tick arriving meanwhile is kept
+	__sync_sub_and_fetch(&m_profile_ticks, ticks);
+
+	// Jumps and such have no location; the line is the one before
+	while (pc > 0 && m_inst[pc].loc.begin.filename == NULL) {
+		--pc;
+	}
+
+	if (g_profiler) {
+		g_profiler->addSample(m_call_stack, m_inst[pc].loc, ticks);
+	}
+}
+
 /// Displays an error message
 void VM::error(const location& loc, const char* format, ...)
 {
 	std::ostringstream out;
 	va_list args;
 
+	// Keeps the script output written so far ahead of the message
+	OutputBuffer::getStdout().flush();
+
 	out << "Fatal error: ";
 
 	va_start(args, format);
@@ -175,7 +223,7 @@ void VM::dumpOpcodes() const
 
 // Function parameter binding
 CLEVER_FORCE_INLINE void VM::paramBinding(const Function* func,
-	const Environment* fenv, const ValueVector& args)
+	const Environment* fenv, ValueSpan args)
 {
 	size_t nargs = 0;
 	size_t args_count = args.size();
@@ -212,6 +260,8 @@ CLEVER_FORCE_INLINE void VM::paramBinding(const Function* func,
 // Prepares an user function/method call
 CLEVER_FORCE_INLINE void VM::prepareCall(const Function* func, Environment* env)
 {
+	CLEVER_STAT_CALL(func);
+
 	getMutex()->lock();
 	Environment* fenv = func->getEnvironment()->activate(env);
 
@@ -220,16 +270,16 @@ CLEVER_FORCE_INLINE void VM::prepareCall(const Function* func, Environment* env)
 
 	m_call_stack.push(CallStackEntry(fenv, func, &OPCODE.loc));
 
-	size_t args_count = m_call_args.size();
+	size_t args_count = m_call_args->size();
 
 	if (args_count < func->getNumRequiredArgs()
 		|| (args_count > func->getNumArgs()	&& !func->isVariadic())) {
 		error(OPCODE.loc, "Wrong number of parameters");
 	}
 
-	paramBinding(func, fenv, m_call_args);
+	paramBinding(func, fenv, *m_call_args);
 
-	m_call_args.clear();
+	m_call_args->clear();
 	getMutex()->unlock();
 }
 
@@ -253,31 +303,53 @@ CLEVER_FORCE_INLINE void VM::createInstance(const Type* type, Value* instance)
 }
 
 // Executes the supplied function
-Value* VM::runFunction(const Function* func, const ValueVector& args)
+Value* VM::runFunction(const Function* func, ValueSpan args)
 {
 	Value* result = new Value;
 
+	runFunction(func, args, result);
+
+	return result;
+}
+
+// Executes the supplied function, reusing result to store the return value
+void VM::runFunction(const Function* func, ValueSpan args, Value* result)
+{
+	result->setNull();
+
+	CLEVER_STAT_CALL(func);
+
 	if (UNEXPECTED(func->isInternal())) {
 		func->getFuncPtr()(result, args, &m_clever);
-	} else {
-		Environment* fenv = func->getEnvironment()->activate();
-		fenv->setRetVal(result);
-		fenv->setRetAddr(m_inst.size()-1);
+		return;
+	}
 
-		m_call_stack.push(CallStackEntry(fenv, func, &OPCODE.loc));
-		m_call_args.clear();
+	Environment* fenv = func->getEnvironment()->activate();
+	fenv->setRetVal(result);
+	fenv->setRetAddr(m_inst.size()-1);
 
-		paramBinding(func, fenv, args);
+	m_call_stack.push(CallStackEntry(fenv, func, &OPCODE.loc));
 
-		m_obj_store.push(std::vector<Environment*>());
+	paramBinding(func, fenv, args);
 
-		size_t saved_pc = m_pc;
-		m_pc = func->getAddr();
-		run();
-		m_pc = saved_pc;
+	// args may point into the current argument vector
+	ValueVector* saved_args = m_call_args;
+
+	if (++m_arg_depth == m_arg_frames.size()) {
+		m_arg_frames.push_back(new ValueVector);
 	}
+	m_call_args = m_arg_frames[m_arg_depth];
 
-	return result;
+	m_obj_store.push(std::vector<Environment*>());
+
+	size_t saved_pc = m_pc;
+	m_pc = func->getAddr();
+	run();
+	m_pc = saved_pc;
+
+	m_call_args->clear();
+	m_call_args = saved_args;
+	--m_arg_depth;
 }
 
 // Performs binary operation
@@ -384,8 +456,19 @@ void VM::run()
 	}
 	getMutex()->unlock();
 
+	VM* profiled_vm = t_profiled_vm;
+
+	if (g_profiler) {
+		t_profiled_vm = this;
+	}
+
+#ifdef CLEVER_VM_STATS
+	size_t* inst_counts = VMStats::instructions(m_inst.size());
+#endif
+
 	OPCODES;
 	OP(OP_RET):
+	PROFILE_POINT();
 	if (EXPECTED(m_call_stack.top().env != m_global_env)) {
 		Environment* env = m_call_stack.top().env;
 		size_t ret_addr = env->getRetAddr();
@@ -467,9 +550,10 @@ out:
 	}
 	DISPATCH;
 
-	OP(OP_JMP): VM_GOTO(OPCODE.op1.jmp_addr);
+	OP(OP_JMP): PROFILE_POINT(); VM_GOTO(OPCODE.op1.jmp_addr);
 
 	OP(OP_FCALL):
+	PROFILE_POINT();
 	{
 		const Value* fval = getValue(OPCODE.op1);
 
@@ -488,8 +572,10 @@ out:
 
 			VM_GOTO(func->getAddr());
 		} else {
-			func->getFuncPtr()(getValue(OPCODE.result), m_call_args, &m_clever);
-			m_call_args.clear();
+			CLEVER_STAT_CALL(func);
+
+			func->getFuncPtr()(getValue(OPCODE.result), *m_call_args, &m_clever);
+			m_call_args->clear();
 
 			if (UNEXPECTED(m_exception.hasException())) {
 				goto throw_exception;
@@ -500,6 +586,7 @@ out:
 
 
 	OP(OP_LEAVE):
+	PROFILE_POINT();
 	{
 		Environment* env = m_call_stack.top().env;
 		size_t ret_addr = env->getRetAddr();
@@ -510,7 +597,7 @@ out:
 		VM_GOTO(ret_addr);
 	}
 
-	OP(OP_SEND_VAL): m_call_args.push_back(getValue(OPCODE.op1)); DISPATCH;
+	OP(OP_SEND_VAL): m_call_args->push_back(getValue(OPCODE.op1)); DISPATCH;
 
 	OP(OP_JMPZ):
 	{
@@ -651,6 +738,7 @@ out:
 	OP(OP_UNLOCK): getMutex()->unlock(); DISPATCH;
 
 	OP(OP_NEW):
+	PROFILE_POINT();
 	{
 		const Type* type = getValue(OPCODE.op1)->getType();
 		const Function* ctor = type->getConstructor();
@@ -658,11 +746,13 @@ out:
 		if (EXPECTED(ctor != NULL)) {
 			Value* instance = getValue(OPCODE.result);
 
+			CLEVER_STAT_CALL(ctor);
+
 			(type->*ctor->getMethodPtr())(instance,
-				NULL, m_call_args, &m_clever);
+				NULL, *m_call_args, &m_clever);
 
 			if (UNEXPECTED(m_exception.hasException())) {
-				m_call_args.clear();
+				m_call_args->clear();
 				goto throw_exception;
 			}
 
@@ -677,7 +767,7 @@ out:
 
 					VM_GOTO(type->getUserConstructor()->getAddr());
 				}
-				m_call_args.clear();
+				m_call_args->clear();
 			}
 		} else {
 			error(OPCODE.loc, "Constructor for %T not found", type);
@@ -686,6 +776,7 @@ out:
 	DISPATCH;
 
 	OP(OP_MCALL):
+	PROFILE_POINT();
 	{
 		const Value* callee = getValue(OPCODE.op1);
 		const Value* method = getValue(OPCODE.op2);
@@ -738,14 +829,16 @@ out:
 
 			VM_GOTO(func->getAddr());
 		} else {
+			CLEVER_STAT_CALL(func);
+
 			if (func->hasContext()) {
 				(type->*func->getMethodPtr())(getValue(OPCODE.result),
-					callee, m_call_args, &m_clever);
+					callee, *m_call_args, &m_clever);
 			} else {
-				func->getFuncPtr()(getValue(OPCODE.result), m_call_args, &m_clever);
+				func->getFuncPtr()(getValue(OPCODE.result), *m_call_args, &m_clever);
 			}
 
-			m_call_args.clear();
+			m_call_args->clear();
 			if (UNEXPECTED(m_exception.hasException())) {
 				goto throw_exception;
 			}
@@ -754,6 +847,7 @@ out:
 	DISPATCH;
 
 	OP(OP_SMCALL):
+	PROFILE_POINT();
 	{
 		const Value* valtype = getValue(OPCODE.op1);
 		const Type* type = valtype->getType();
@@ -778,10 +872,12 @@ out:
 
 				VM_GOTO(func->getAddr());
 			} else {
+				CLEVER_STAT_CALL(func);
+
 				(type->*func->getMethodPtr())(getValue(OPCODE.result),
-					NULL, m_call_args, &m_clever);
+					NULL, *m_call_args, &m_clever);
 
-				m_call_args.clear();
+				m_call_args->clear();
 
 				if (UNEXPECTED(m_exception.hasException())) {
 					goto throw_exception;
@@ -993,6 +1089,8 @@ throw_exception:
 exit_exception:
 	throwUncaughtException(OPCODE);
 exit:
+	t_profiled_vm = profiled_vm;
+
 	if (!m_obj_store.empty()) {
 		std::for_each(m_obj_store.top().begin(), m_obj_store.top().end(), clever_delref);
 		m_obj_store.pop();
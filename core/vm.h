@@ -8,6 +8,8 @@
 #ifndef CLEVER_VM_H
 #define CLEVER_VM_H
 
+#include <algorithm>
+#include <csignal>
 #include <stack>
 #include <vector>
 #include "core/ir.h"
@@ -33,24 +35,31 @@ struct CallStackEntry {
 		: env(env_), func(func_), loc(loc_) {}
 };
 
-typedef std::stack<CallStackEntry> CallStack;
+/// Call stack whose entries can be walked from the bottom (by the profiler)
+class CallStack : public std::stack<CallStackEntry> {
+public:
+	const container_type& getEntries() const { return c; }
+};
 
 /// VM representation
 class VM {
 public:
 	VM()
 		: m_pc(0), m_const_env(NULL), m_global_env(NULL), m_mutex(NULL), m_main(true),
-			m_clever(this, &m_exception) {}
+			m_profile_ticks(0), m_profile_pc(0), m_clever(this, &m_exception) {
+		initArgFrames();
+	}
 
 	explicit VM(const IRVector& inst)
 		: m_pc(0), m_const_env(NULL), m_global_env(NULL), m_mutex(NULL), m_main(true),
-			m_clever(this, &m_exception) {
+			m_profile_ticks(0), m_profile_pc(0), m_clever(this, &m_exception) {
 		m_inst.resize(inst.size());
 		std::copy(inst.begin(), inst.end(), m_inst.begin());
+		initArgFrames();
 	}
 
 	VM(const VM& vm)
-		: m_clever(this, &m_exception) {
+		: m_profile_ticks(0), m_profile_pc(0), m_clever(this, &m_exception) {
 		m_mutex      = vm.m_mutex;
 		m_main       = false;
 		m_pc         = vm.m_pc;
@@ -59,12 +68,14 @@ public:
 		m_global_env = vm.m_global_env;
 		m_call_stack = vm.m_call_stack;
 		m_const_env  = vm.m_const_env;
+		initArgFrames();
 	}
 
 	~VM() {
 		if (m_main && m_mutex) {
 			delete m_mutex;
 		}
+		std::for_each(m_arg_frames.begin(), m_arg_frames.end(), deleteArgFrame);
 	}
 
 	void setGlobalEnv(Environment* globals) { m_global_env = globals; }
@@ -88,8 +99,15 @@ public:
 	/// Start the VM execution
 	void run();
 
-	/// Executes an specific function
-	Value* runFunction(const Function*, const ValueVector&);
+	/// Executes an specific function, returning a new value with its result
+	Value* runFunction(const Function*, ValueSpan);
+
+	/// Executes an specific function, storing its result in the supplied value
+	void runFunction(const Function*, ValueSpan, Value*);
+
+	/// Notes a profiler sample for the VM running on the current thread;
+	/// called from the SIGPROF handler
+	static void profileTick();
 
 	/// Methods for dumping opcodes
 #ifdef CLEVER_DEBUG
@@ -98,7 +116,16 @@ public:
 #endif
 private:
 	/// Helper to bind function/method parameter
-	static void paramBinding(const Function*, const Environment*, const ValueVector&);
+	static void paramBinding(const Function*, const Environment*, ValueSpan);
+
+	/// Helpers to manage the call argument vectors
+	void initArgFrames() {
+		m_arg_frames.push_back(new ValueVector);
+		m_call_args = m_arg_frames.back();
+		m_arg_depth = 0;
+	}
+
+	static void deleteArgFrame(ValueVector* frame) { delete frame; }
 
 	CallStack& getCallStack() { return m_call_stack; }
 
@@ -124,6 +151,9 @@ private:
 	void binOp(const IR&);
 	void logicOp(const IR&);
 
+	/// Passes the samples noted by profileTick() to the profiler
+	void takeSample();
+
 	/// Dumps the stack trace
 	void dumpStackTrace(std::ostringstream&);
 
@@ -143,8 +173,12 @@ private:
 	/// Globals
 	Environment* m_global_env;
 
-	/// Call arguments
-	ValueVector m_call_args;
+	/// Call arguments; each runFunction() nesting level sends arguments to a
+	/// vector of its own, so the ones of the native function that called it
+	/// stay valid, and the vectors are kept to reuse their storage
+	ValueVector* m_call_args;
+	std::vector<ValueVector*> m_arg_frames;
+	size_t m_arg_depth;
 
 	/// Exception handling
 	CException m_exception;
@@ -162,6 +196,10 @@ private:
 
 	bool m_main;
 
+	/// Profiler samples pending, and the instruction of the last one
+	volatile sig_atomic_t m_profile_ticks;
+	volatile size_t m_profile_pc;
+
 	Clever m_clever;
 };
 
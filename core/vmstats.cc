@@ -0,0 +1,255 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifdef CLEVER_VM_STATS
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "core/ir.h"
+#include "core/type.h"
+#include "core/vmstats.h"
+#include "modules/std/core/function.h"
+
+namespace clever {
+
+THREAD_TLS VMStats::Thread* VMStats::s_local;
+VMStats::Thread* volatile VMStats::s_threads;
+
+// Opcode and location of each instruction, noted before running
+struct ProgramEntry {
+	ProgramEntry(Opcode opcode_, const std::string& where_)
+		: opcode(opcode_), where(where_) {}
+
+	Opcode opcode;
+	std::string where;
+};
+
+static std::vector<ProgramEntry> s_program;
+
+typedef std::pair<std::string, size_t> Row;
+
+static std::string _function_name(const Function* func)
+{
+	if (func->getContext()) {
+		return func->getContext()->getName() + "." + func->getName();
+	}
+	return func->getName();
+}
+
+static bool _by_count(const Row& a, const Row& b)
+{
+	if (a.second != b.second) {
+		return a.second > b.second;
+	}
+	return a.first < b.first;
+}
+
+static void _write_rows(std::ostream& out, const char* section,
+	std::vector<Row>& rows)
+{
+	std::sort(rows.begin(), rows.end(), _by_count);
+
+	for (size_t i = 0, n = rows.size(); i < n; ++i) {
+		if (rows[i].second) {
+			out << section << '\t' << rows[i].first << '\t' << rows[i].second << '\n';
+		}
+	}
+}
+
+static void _report_at_exit()
+{
+	VMStats::report(std::cerr);
+}
+
+VMStats::Thread* VMStats::create()
+{
+	Thread* thread = new Thread;
+
+	do {
+		thread->next = s_threads;
+	} while (!__sync_bool_compare_and_swap(&s_threads, thread->next, thread));
+
+	s_local = thread;
+
+	return thread;
+}
+
+void VMStats::countCall(const Function* func)
+{
+	Thread* thread = local();
+
+	thread->mutex.lock();
+
+	Call& call = thread->calls[func];
+
+	if (call.count++ == 0) {
+		call.name = _function_name(func);
+	}
+
+	thread->mutex.unlock();
+}
+
+size_t* VMStats::instructions(size_t size)
+{
+	Thread* thread = local();
+
+	if (thread->instructions.size() < size || thread->instructions.empty()) {
+		thread->mutex.lock();
+		thread->instructions.resize(std::max(size, static_cast<size_t>(1)));
+		thread->mutex.unlock();
+	}
+
+	return &thread->instructions[0];
+}
+
+void VMStats::setProgram(const IRVector& inst)
+{
+	s_program.clear();
+
+	for (size_t i = 0, n = inst.size(); i < n; ++i) {
+		const location& loc = inst[i].loc;
+		std::ostringstream where;
+
+		where << "0x" << std::hex << std::setw(4) << std::setfill('0') << i
+			<< std::dec << ' ' << get_opcode_name(inst[i].opcode);
+
+		if (loc.begin.filename) {
+			where << ' ' << *loc.begin.filename << ':' << loc.begin.line;
+		}
+
+		s_program.push_back(ProgramEntry(inst[i].opcode, where.str()));
+	}
+}
+
+VMStats::Totals VMStats::getTotals()
+{
+	Totals totals;
+
+	for (Thread* thread = s_threads; thread; thread = thread->next) {
+		for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+			totals.counters[i] += thread->counters[i];
+		}
+
+		thread->mutex.lock();
+
+		for (size_t i = 0, n = thread->instructions.size(); i < n; ++i) {
+			totals.instructions += thread->instructions[i];
+		}
+		for (CallMap::const_iterator it = thread->calls.begin();
+			it != thread->calls.end(); ++it) {
+			totals.calls += it->second.count;
+		}
+
+		thread->mutex.unlock();
+	}
+
+	return totals;
+}
+
+void VMStats::report(std::ostream& out)
+{
+	Totals totals = getTotals();
+	std::vector<size_t> instructions;
+	std::map<std::string, size_t> calls;
+
+	for (Thread* thread = s_threads; thread; thread = thread->next) {
+		thread->mutex.lock();
+
+		if (instructions.size() < thread->instructions.size()) {
+			instructions.resize(thread->instructions.size());
+		}
+		for (size_t i = 0, n = thread->instructions.size(); i < n; ++i) {
+			instructions[i] += thread->instructions[i];
+		}
+		for (CallMap::const_iterator it = thread->calls.begin();
+			it != thread->calls.end(); ++it) {
+			calls[it->second.name] += it->second.count;
+		}
+
+		thread->mutex.unlock();
+	}
+
+	std::vector<Row> rows;
+
+	rows.push_back(Row("instructions", totals.instructions));
+	rows.push_back(Row("calls", totals.calls));
+
+	for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+		rows.push_back(Row(getCounterName(static_cast<Counter>(i)),
+			totals.counters[i]));
+	}
+	_write_rows(out, "counter", rows);
+
+	// Instructions of another program (e.g. a cleared one) are left out
+	size_t size = std::min(instructions.size(), s_program.size());
+	std::vector<size_t> opcodes(NUM_OPCODES);
+
+	rows.clear();
+	for (size_t i = 0; i < size; ++i) {
+		opcodes[s_program[i].opcode] += instructions[i];
+		rows.push_back(Row(s_program[i].where, instructions[i]));
+	}
+
+	std::vector<Row> opcode_rows;
+
+	for (size_t i = 0; i < NUM_OPCODES; ++i) {
+		opcode_rows.push_back(Row(get_opcode_name(static_cast<Opcode>(i)),
+			opcodes[i]));
+	}
+	_write_rows(out, "opcode", opcode_rows);
+	_write_rows(out, "instruction", rows);
+
+	rows.assign(calls.begin(), calls.end());
+	_write_rows(out, "call", rows);
+
+	out.flush();
+}
+
+void VMStats::reset()
+{
+	for (Thread* thread = s_threads; thread; thread = thread->next) {
+		for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+			thread->counters[i] = 0;
+		}
+
+		thread->mutex.lock();
+		std::fill(thread->instructions.begin(), thread->instructions.end(), 0);
+		thread->calls.clear();
+		thread->mutex.unlock();
+	}
+}
+
+void VMStats::reportAtExit()
+{
+	static bool registered = false;
+
+	if (!registered) {
+		registered = true;
+		std::atexit(_report_at_exit);
+	}
+}
+
+const char* VMStats::getCounterName(Counter counter)
+{
+	switch (counter) {
+		case VALUES:         return "values";
+		case TYPE_OBJECTS:   return "type_objects";
+		case ENVIRONMENTS:   return "environments";
+		case REFCOUNT_OPS:   return "refcount_ops";
+		case MEMBER_LOOKUPS: return "member_lookups";
+		case MEMBER_MISSES:  return "member_misses";
+		case NUM_COUNTERS:   break;
+	}
+	return NULL;
+}
+
+} // clever
+
+#endif // CLEVER_VM_STATS
@@ -0,0 +1,146 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_VMSTATS_H
+#define CLEVER_VMSTATS_H
+
+#include "core/clever.h"
+
+#ifdef CLEVER_VM_STATS
+# include <deque>
+# include <map>
+# include <ostream>
+# include <string>
+# include <vector>
+# include "core/cthread.h"
+#endif
+
+// Counts an event of the VM statistics; nothing is compiled in unless the
+// interpreter is built with -DVM_STATS=1
+#ifdef CLEVER_VM_STATS
+# define CLEVER_STAT(counter)   ::clever::VMStats::count(::clever::VMStats::counter)
+# define CLEVER_STAT_CALL(func) ::clever::VMStats::countCall(func)
+#else
+# define CLEVER_STAT(counter)
+# define CLEVER_STAT_CALL(func)
+#endif
+
+#ifdef CLEVER_VM_STATS
+
+namespace clever {
+
+class Function;
+struct IR;
+
+/**
+ * VM statistics (-DVM_STATS=1)
+ *
+ * Counts the instructions run per IR index (and so per opcode), the calls
+ * per function, the allocations of values, objects and environments, the
+ * reference count operations and the member lookups. Each thread counts
+ * into counters of its own, without locking, which are added up for the
+ * report; totals read while other threads run are approximate.
+ */
+class VMStats {
+public:
+	enum Counter {
+		VALUES,
+		TYPE_OBJECTS,
+		ENVIRONMENTS,
+		REFCOUNT_OPS,
+		MEMBER_LOOKUPS,
+		MEMBER_MISSES,
+		NUM_COUNTERS
+	};
+
+	struct Totals {
+		Totals()
+			: instructions(0), calls(0) {
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				counters[i] = 0;
+			}
+		}
+
+		size_t counters[NUM_COUNTERS];
+		size_t instructions;
+		size_t calls;
+	};
+
+	static void count(Counter counter) { ++local()->counters[counter]; }
+
+	static void countCall(const Function*);
+
+	/// Counters of the instructions of the current thread, by IR index
+	static size_t* instructions(size_t size);
+
+	/// Notes the opcode and the location of each instruction for the report
+	static void setProgram(const std::deque<IR>&);
+
+	static Totals getTotals();
+
+	/// Writes the report, a tab-separated "section name count" row per
+	/// counter, opcode, instruction and function, sorted by count
+	static void report(std::ostream&);
+
+	static void reset();
+
+	/// Writes the report to the standard error when the process exits
+	static void reportAtExit();
+
+	static const char* getCounterName(Counter);
+private:
+	struct Call {
+		Call()
+			: count(0) {}
+
+		std::string name;
+		size_t count;
+	};
+
+	typedef std::map<const Function*, Call> CallMap;
+
+	struct Thread {
+		Thread()
+			: next(NULL) {
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				counters[i] = 0;
+			}
+		}
+
+		size_t counters[NUM_COUNTERS];
+		std::vector<size_t> instructions;
+		CallMap calls;
+
+		// Guards the instruction vector and the call map, which the
+		// report walks from another thread
+		CMutex mutex;
+
+		Thread* next;
+	};
+
+	static Thread* local() {
+		Thread* thread = s_local;
+
+		if (UNEXPECTED(thread == NULL)) {
+			thread = create();
+		}
+		return thread;
+	}
+
+	static Thread* create();
+
+	static THREAD_TLS Thread* s_local;
+
+	// Counters of every thread so far, as they outlive their thread
+	static Thread* volatile s_threads;
+};
+
+} // clever
+
+#endif // CLEVER_VM_STATS
+
+#endif // CLEVER_VMSTATS_H
@@ -0,0 +1,457 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "benchmark.h"
+
+static double _now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static double _ms(const struct timeval& tv)
+{
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static std::string _escape(const std::string& str)
+{
+	std::string out;
+
+	for (size_t i = 0; i < str.size(); ++i) {
+		if (str[i] == '"' || str[i] == '\\') {
+			out += '\\';
+		}
+		out += str[i];
+	}
+	return out;
+}
+
+// Benchmarks are named after the script, without the directory and the
+// extension
+static std::string _name(const std::string& path)
+{
+	size_t slash = path.rfind('/');
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+Summary::Summary(std::vector<double> values)
+	: median(0), p95(0), mean(0), stddev(0), min(0)
+{
+	size_t n = values.size();
+
+	if (n == 0) {
+		return;
+	}
+
+	std::sort(values.begin(), values.end());
+
+	median = n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+	p95 = values[static_cast<size_t>(std::ceil(n * 0.95)) - 1];
+	min = values[0];
+
+	for (size_t i = 0; i < n; ++i) {
+		mean += values[i];
+	}
+	mean /= n;
+
+	if (n > 1) {
+		for (size_t i = 0; i < n; ++i) {
+			stddev += (values[i] - mean) * (values[i] - mean);
+		}
+		stddev = std::sqrt(stddev / (n - 1));
+	}
+}
+
+void BenchmarkRunner::find(const std::string& path)
+{
+	struct stat st;
+
+	if (stat(path.c_str(), &st) != 0) {
+		std::cerr << "Cannot find " << path << std::endl;
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		m_scripts.push_back(path);
+		return;
+	}
+
+	DIR* dp = opendir(path.c_str());
+	std::vector<std::string> scripts;
+
+	if (dp == NULL) {
+		std::cerr << "Cannot read " << path << std::endl;
+		return;
+	}
+
+	while (struct dirent* entry = readdir(dp)) {
+		std::string file(entry->d_name);
+
+		if (file.size() > 4 && file.compare(file.size() - 4, 4, ".clv") == 0) {
+			scripts.push_back(path + "/" + file);
+		}
+	}
+	closedir(dp);
+
+	// The order of the directory entries is not defined
+	std::sort(scripts.begin(), scripts.end());
+
+	m_scripts.insert(m_scripts.end(), scripts.begin(), scripts.end());
+}
+
+bool BenchmarkRunner::runOnce(const std::string& script, double& wall,
+	double& cpu, long& max_rss, std::string& output) const
+{
+	int fds[2];
+
+	if (pipe(fds) != 0) {
+		return false;
+	}
+
+	double start = _now();
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+
+		execl(m_clever.c_str(), m_clever.c_str(), script.c_str(),
+			static_cast<char*>(NULL));
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	if (pid < 0) {
+		close(fds[0]);
+		return false;
+	}
+
+	char buffer[4096];
+	ssize_t len;
+
+	output.clear();
+
+	while ((len = read(fds[0], buffer, sizeof(buffer))) != 0) {
+		if (len > 0) {
+			output.append(buffer, len);
+		} else if (errno != EINTR) {
+			break;
+		}
+	}
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+
+	if (wait4(pid, &status, 0, &usage) != pid) {
+		return false;
+	}
+
+	wall = _now() - start;
+	cpu = _ms(usage.ru_utime) + _ms(usage.ru_stime);
+
+	// Kilobytes on Linux, bytes on OS X
+	max_rss = std::max(max_rss, static_cast<long>(usage.ru_maxrss));
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void BenchmarkRunner::run()
+{
+	for (size_t i = 0; i < m_scripts.size(); ++i) {
+		const std::string& script = m_scripts[i];
+		Result result;
+		std::string expected, output;
+		double wall, cpu;
+
+		result.name = _name(script);
+
+		std::cerr << result.name << " " << std::flush;
+
+		for (size_t run = 0; run < m_warmup + m_runs && !result.failed; ++run) {
+			if (!runOnce(script, wall, cpu, result.max_rss, output)) {
+				std::cerr << "failed";
+				result.failed = true;
+			} else if (run > 0 && output != expected) {
+				std::cerr << "output differs from the first run";
+				result.failed = true;
+			} else if (run >= m_warmup) {
+				result.wall.push_back(wall);
+				result.cpu.push_back(cpu);
+			}
+
+			if (run == 0) {
+				expected = output;
+			}
+			std::cerr << '.' << std::flush;
+		}
+		std::cerr << std::endl;
+
+		m_results.push_back(result);
+	}
+}
+
+void BenchmarkRunner::showResults(std::ostream& out) const
+{
+	out << std::fixed << std::setprecision(2)
+		<< std::left << std::setw(16) << "benchmark" << std::right
+		<< std::setw(12) << "wall med" << std::setw(10) << "p95" << std::setw(10) << "stddev"
+		<< std::setw(12) << "cpu med" << std::setw(10) << "p95" << std::setw(10) << "stddev"
+		<< std::setw(12) << "max rss" << "\n";
+
+	for (size_t i = 0; i < m_results.size(); ++i) {
+		const Result& result = m_results[i];
+
+		out << std::left << std::setw(16) << result.name << std::right;
+
+		if (result.failed) {
+			out << "  FAILED\n";
+			continue;
+		}
+
+		Summary wall(result.wall), cpu(result.cpu);
+
+		out << std::setw(12) << wall.median << std::setw(10) << wall.p95
+			<< std::setw(10) << wall.stddev
+			<< std::setw(12) << cpu.median << std::setw(10) << cpu.p95
+			<< std::setw(10) << cpu.stddev
+			<< std::setw(12) << result.max_rss << "\n";
+	}
+
+	out << "(times in ms of " << m_runs << " runs after " << m_warmup
+		<< " warmup; max rss in KB)\n";
+}
+
+static void _write_summary(std::ostream& out, const Summary& summary)
+{
+	out << "{\"median\": " << summary.median << ", \"p95\": " << summary.p95
+		<< ", \"mean\": " << summary.mean << ", \"stddev\": " << summary.stddev
+		<< ", \"min\": " << summary.min << "}";
+}
+
+bool BenchmarkRunner::writeJson(const std::string& file) const
+{
+	std::ofstream out(file.c_str());
+
+	out << std::fixed << std::setprecision(3)
+		<< "{\n"
+		<< "  \"clever\": \"" << _escape(m_clever) << "\",\n"
+		<< "  \"warmup\": " << m_warmup << ",\n"
+		<< "  \"runs\": " << m_runs << ",\n"
+		<< "  \"benchmarks\": [\n";
+
+	// One benchmark per line, which is what readBaseline() expects
+	for (size_t i = 0; i < m_results.size(); ++i) {
+		const Result& result = m_results[i];
+
+		out << "    {\"name\": \"" << _escape(result.name) << "\", \"failed\": "
+			<< (result.failed ? "true" : "false") << ", \"wall_ms\": ";
+		_write_summary(out, Summary(result.wall));
+		out << ", \"cpu_ms\": ";
+		_write_summary(out, Summary(result.cpu));
+		out << ", \"max_rss_kb\": " << result.max_rss << "}"
+			<< (i + 1 < m_results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+
+	return out.good();
+}
+
+std::map<std::string, double> BenchmarkRunner::readBaseline(const std::string& file)
+{
+	static const char name_key[] = "{\"name\": \"";
+	static const char cpu_key[] = "\"cpu_ms\": {\"median\": ";
+	std::map<std::string, double> medians;
+	std::ifstream in(file.c_str());
+	std::string line;
+
+	while (std::getline(in, line)) {
+		size_t name = line.find(name_key);
+		size_t cpu = line.find(cpu_key);
+
+		if (name == std::string::npos || cpu == std::string::npos
+			|| line.find("\"failed\": true") != std::string::npos) {
+			continue;
+		}
+
+		name += sizeof(name_key) - 1;
+
+		size_t end = line.find('"', name);
+
+		if (end != std::string::npos) {
+			medians[line.substr(name, end - name)] =
+				std::strtod(line.c_str() + cpu + sizeof(cpu_key) - 1, NULL);
+		}
+	}
+
+	return medians;
+}
+
+int BenchmarkRunner::compare(const std::string& file, double threshold,
+	std::ostream& out) const
+{
+	std::ifstream in(file.c_str());
+
+	if (!in) {
+		return -1;
+	}
+	in.close();
+
+	std::map<std::string, double> baseline = readBaseline(file);
+	int regressions = 0;
+
+	out << std::fixed << std::setprecision(2)
+		<< "\n" << std::left << std::setw(16) << "benchmark" << std::right
+		<< std::setw(12) << "baseline" << std::setw(12) << "current"
+		<< std::setw(10) << "change" << "\n";
+
+	for (size_t i = 0; i < m_results.size(); ++i) {
+		const Result& result = m_results[i];
+		std::map<std::string, double>::const_iterator it = baseline.find(result.name);
+
+		if (result.failed || it == baseline.end()) {
+			continue;
+		}
+
+		double current = Summary(result.cpu).median;
+		double change = it->second > 0 ? (current / it->second - 1) * 100 : 0;
+
+		out << std::left << std::setw(16) << result.name << std::right
+			<< std::setw(12) << it->second << std::setw(12) << current
+			<< std::setw(9) << std::showpos << change << std::noshowpos << "%";
+
+		if (change > threshold) {
+			out << "  REGRESSION";
+			++regressions;
+		}
+		out << "\n";
+	}
+
+	out << "(median cpu ms; threshold " << threshold << "%)\n";
+
+	return regressions;
+}
+
+bool BenchmarkRunner::hasFailures() const
+{
+	for (size_t i = 0; i < m_results.size(); ++i) {
+		if (m_results[i].failed) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void show_usage()
+{
+	std::cout << "Usage: clever-bench <options> <clever binary> <script or directory>...\n\n"
+				 "\t-w <n>\tWarmup runs, not measured (default: 1)\n"
+				 "\t-n <n>\tMeasured runs (default: 10)\n"
+				 "\t-o <file>\tWrite the results as JSON\n"
+				 "\t-b <file>\tCompare with the results of a previous -o\n"
+				 "\t-t <pct>\tSlowdown reported as a regression (default: 5)\n"
+				 "\nExits with 1 when a script fails or a benchmark regresses.\n";
+}
+
+int main(int argc, char** argv)
+{
+	size_t warmup = 1, runs = 10;
+	double threshold = 5;
+	std::string json, baseline;
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; ++i) {
+		std::string option(argv[i]);
+
+		if (option == "-h") {
+			show_usage();
+			return 0;
+		}
+		if (i + 1 >= argc) {
+			std::cerr << "Missing parameter for option " << option << std::endl;
+			return 1;
+		}
+
+		const char* value = argv[++i];
+
+		if (option == "-w") {
+			warmup = std::strtoul(value, NULL, 10);
+		} else if (option == "-n") {
+			runs = std::strtoul(value, NULL, 10);
+		} else if (option == "-o") {
+			json = value;
+		} else if (option == "-b") {
+			baseline = value;
+		} else if (option == "-t") {
+			threshold = std::strtod(value, NULL);
+		} else {
+			std::cerr << "Unknown option '" << option << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	if (argc - i < 2 || runs == 0) {
+		show_usage();
+		return 1;
+	}
+
+	BenchmarkRunner runner(argv[i], warmup, runs);
+
+	for (++i; i < argc; ++i) {
+		runner.find(argv[i]);
+	}
+
+	runner.run();
+	runner.showResults(std::cout);
+
+	int status = runner.hasFailures() ? 1 : 0;
+
+	if (!baseline.empty()) {
+		int regressions = runner.compare(baseline, threshold, std::cout);
+
+		if (regressions < 0) {
+			std::cerr << "Cannot read the baseline " << baseline << std::endl;
+			status = 1;
+		} else if (regressions > 0) {
+			status = 1;
+		}
+	}
+
+	if (!json.empty() && !runner.writeJson(json)) {
+		std::cerr << "Cannot write " << json << std::endl;
+		status = 1;
+	}
+
+	return status;
+}
@@ -0,0 +1,84 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_BENCHMARK_H
+#define CLEVER_BENCHMARK_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Summary of the measures of a benchmark, in milliseconds
+struct Summary {
+	Summary()
+		: median(0), p95(0), mean(0), stddev(0), min(0) {}
+
+	explicit Summary(std::vector<double>);
+
+	double median;
+	double p95;
+	double mean;
+	double stddev;
+	double min;
+};
+
+struct Result {
+	Result()
+		: failed(false), max_rss(0) {}
+
+	std::string name;
+	bool failed;
+	std::vector<double> wall;
+	std::vector<double> cpu;
+	long max_rss;
+};
+
+/**
+ * Runs each script with the interpreter, discarding the warmup runs and
+ * timing the others, so that the results only depend on the script and
+ * the binary. A script fails when it exits with an error or when its
+ * output changes from a run to another.
+ */
+class BenchmarkRunner {
+public:
+	BenchmarkRunner(const std::string& clever, size_t warmup, size_t runs)
+		: m_clever(clever), m_warmup(warmup), m_runs(runs) {}
+
+	~BenchmarkRunner() {}
+
+	/// Adds a script, or the .clv scripts of a directory
+	void find(const std::string& path);
+
+	void run();
+
+	/// Writes the table of the results
+	void showResults(std::ostream&) const;
+
+	/// Writes the results as JSON
+	bool writeJson(const std::string& file) const;
+
+	/// Compares the median CPU time with the one of a JSON file written
+	/// before; more than threshold percent slower is a regression
+	/// \returns the number of regressions, or -1 when it cannot be read
+	int compare(const std::string& file, double threshold, std::ostream&) const;
+
+	bool hasFailures() const;
+private:
+	bool runOnce(const std::string& script, double& wall, double& cpu,
+		long& max_rss, std::string& output) const;
+
+	static std::map<std::string, double> readBaseline(const std::string& file);
+
+	std::string m_clever;
+	size_t m_warmup;
+	size_t m_runs;
+	std::vector<std::string> m_scripts;
+	std::vector<Result> m_results;
+};
+
+#endif // CLEVER_BENCHMARK_H
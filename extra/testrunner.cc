@@ -449,6 +449,11 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	// Imported files are cached in the build tree, not in the user's cache,
+	// and the modules built for the tests are found there
+	putenv(const_cast<char*>("CLEVER_CACHE_DIR=test-cache"));
+	putenv(const_cast<char*>("CLEVER_MODULE_PATH=test-modules"));
+
 	for (; start_paths < argc; start_paths++) {
 		testrunner.find(argv[start_paths]);
 	}
@@ -48,6 +48,10 @@ clever_new_module(std.events ON
 	DOC	"enable the event module"
 	MODS std.concurrent)
 
+clever_new_module(std.log ON
+	DOC	"enable the log module"
+	MODS std.concurrent)
+
 clever_new_module(db.mysql ON
 	DOC	"enable the mysql module"
 	LIBS MYSQLC)
@@ -5,134 +5,413 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
-#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include <mysql/mysql.h>
 #include "modules/db/mysql/cmysql.h"
 #include "modules/std/core/map.h"
+#include "modules/std/core/str.h"
+
+// Initial buffer size for string columns fetched by prepared statements
+#define CLEVER_MYSQL_STR_BUFFER 256
 
 namespace clever {
 
-void CMysql::init()
+static bool _mysql_column_less(const MysqlColumn& a, const MysqlColumn& b)
 {
-	m_connection = mysql_init(m_connection);
+	return a.first < b.first;
 }
 
-bool CMysql::connect()
+static bool _mysql_column_equal(const MysqlColumn& a, const MysqlColumn& b)
 {
-	MYSQL* conn;
+	return a.first == b.first;
+}
 
-	conn = mysql_real_connect(m_connection, m_host.c_str(), m_user.c_str(),
-		m_passwd.c_str(), m_db.c_str(), m_port, NULL, 0);
+// Sorts the column names once per result, so each row Map is built by
+// inserting at the end of the tree
+static void _mysql_sort_columns(const MYSQL_FIELD* fields, unsigned int count,
+	std::vector<MysqlColumn>& columns)
+{
+	columns.clear();
+	columns.reserve(count);
 
-	// Clean the password as we do not want to keep this in memory
-	m_passwd = "";
+	for (unsigned int i = 0; i < count; ++i) {
+		columns.push_back(MysqlColumn(fields[i].name, i));
+	}
 
-	return conn != NULL;
+	// The first column wins when names are repeated
+	std::stable_sort(columns.begin(), columns.end(), _mysql_column_less);
+	columns.erase(std::unique(columns.begin(), columns.end(),
+		_mysql_column_equal), columns.end());
 }
 
-bool CMysql::query(const char *stmt)
+static Value* _mysql_text_value(const MYSQL_FIELD& field, const char* data,
+	unsigned long length)
 {
+	Value* value = new Value;
 
-	int ret = mysql_query(m_connection, stmt);
+	if (data == NULL) {
+		return value;
+	}
+
+	switch (field.type) {
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_YEAR:
+			value->setInt(strtoll(data, NULL, 10));
+			break;
+
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+			value->setDouble(strtod(data, NULL));
+			break;
+
+		default:
+			{
+				StrObject* str = new StrObject;
+
+				str->getBuffer().assign(data, length);
+				value->setStr(str);
+			}
+			break;
+	}
+
+	return value;
+}
 
-	m_resultset = mysql_use_result(m_connection);
-	if(m_resultset == NULL) {
+CMysqlResult::CMysqlResult(MYSQL_RES* result)
+	: m_result(result), m_fields(mysql_fetch_fields(result)), m_done(false)
+{
+	_mysql_sort_columns(m_fields, mysql_num_fields(result), m_columns);
+}
+
+MapObject* CMysqlResult::fetchRow()
+{
+	MYSQL_ROW row = mysql_fetch_row(m_result);
+
+	// No more data or no data at all!
+	if (row == NULL) {
+		m_done = true;
+		return NULL;
+	}
+
+	unsigned long* lengths = mysql_fetch_lengths(m_result);
+	MapObject* map = new MapObject;
+	std::map<std::string, Value*>& data = map->getData();
+
+	for (size_t i = 0, n = m_columns.size(); i < n; ++i) {
+		unsigned int col = m_columns[i].second;
+
+		data.insert(data.end(), std::map<std::string, Value*>::value_type(
+			m_columns[i].first,
+			_mysql_text_value(m_fields[col], row[col], lengths[col])));
+	}
+
+	return map;
+}
+
+bool CMysqlStmt::execute(ValueSpan params)
+{
+	freeResult();
+
+	size_t count = params.size();
+	std::vector<MYSQL_BIND> binds(count);
+	std::vector<long long> ints(count);
+	std::vector<double> doubles(count);
+
+	for (size_t i = 0; i < count; ++i) {
+		MYSQL_BIND& bind = binds[i];
+		const Value* param = params[i];
+
+		if (param->isInt()) {
+			ints[i] = param->getInt();
+			bind.buffer_type = MYSQL_TYPE_LONGLONG;
+			bind.buffer = &ints[i];
+		} else if (param->isDouble()) {
+			doubles[i] = param->getDouble();
+			bind.buffer_type = MYSQL_TYPE_DOUBLE;
+			bind.buffer = &doubles[i];
+		} else if (param->isStr()) {
+			bind.buffer_type = MYSQL_TYPE_STRING;
+			bind.buffer = const_cast<char*>(param->getStr()->data());
+			bind.buffer_length = param->getStr()->size();
+		} else if (param->isBool()) {
+			ints[i] = param->getBool();
+			bind.buffer_type = MYSQL_TYPE_LONGLONG;
+			bind.buffer = &ints[i];
+		} else {
+			bind.buffer_type = MYSQL_TYPE_NULL;
+		}
+	}
 
-		// TODO : Show warning message saying something is wrong
-		//        with the query?
+	if (count && mysql_stmt_bind_param(m_stmt, &binds[0])) {
 		return false;
 	}
 
-	if(ret != 0) {
+	if (mysql_stmt_execute(m_stmt)) {
 		return false;
 	}
 
-	return true;
+	return bindResult();
 }
 
-MapObject* CMysql::fetchRow()
+bool CMysqlStmt::bindResult()
 {
-	MYSQL_ROW row = mysql_fetch_row(m_resultset);
+	m_meta = mysql_stmt_result_metadata(m_stmt);
 
-	// No more data or no data at all!
-	if(row == NULL) {
-		m_resultset = NULL;
-		return NULL;
+	// Statements like INSERT and UPDATE have no result set
+	if (m_meta == NULL) {
+		return true;
 	}
 
-	unsigned int   cnt_cols = mysql_num_fields(m_resultset);
-	unsigned long* lengths  = mysql_fetch_lengths(m_resultset);
-	MYSQL_FIELD*   fields   = mysql_fetch_fields(m_resultset);
+	unsigned int count = mysql_num_fields(m_meta);
+	MYSQL_FIELD* fields = mysql_fetch_fields(m_meta);
 
-	MapObject* map = new MapObject;
-	char* str;
+	m_binds.assign(count, MYSQL_BIND());
+	m_buffers.resize(count);
 
-	for (unsigned int i = 0; i < cnt_cols; i++) {
-		Value* value = NULL;
-		str = new char[lengths[i]+1];
-		snprintf(str, lengths[i]+1, "%.*s", (int)lengths[i], row[i]);
+	for (unsigned int i = 0; i < count; ++i) {
+		MYSQL_BIND& bind = m_binds[i];
 
-		switch(fields[i].type) {
+		switch (fields[i].type) {
 			case MYSQL_TYPE_TINY:
 			case MYSQL_TYPE_SHORT:
 			case MYSQL_TYPE_LONG:
 			case MYSQL_TYPE_INT24:
-			case MYSQL_TYPE_TIMESTAMP:
-				value = new Value(long(strtol(str, NULL, 10)), false);
-				break;
-
-			case MYSQL_TYPE_DATE:
-			case MYSQL_TYPE_TIME:
-			case MYSQL_TYPE_DATETIME:
-			case MYSQL_TYPE_YEAR:
-			case MYSQL_TYPE_BLOB:
-			case MYSQL_TYPE_SET:
-			case MYSQL_TYPE_ENUM:
-			case MYSQL_TYPE_GEOMETRY:
-			case MYSQL_TYPE_NULL:
-			case MYSQL_TYPE_NEWDATE:
-			case MYSQL_TYPE_VARCHAR:
-			case MYSQL_TYPE_STRING:
-			case MYSQL_TYPE_VAR_STRING:
-				value = new Value(CSTRING(str), false);
-				break;
-
 			case MYSQL_TYPE_LONGLONG:
-				// handle as long long
+			case MYSQL_TYPE_YEAR:
+				bind.buffer_type = MYSQL_TYPE_LONGLONG;
+				bind.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+				m_buffers[i].resize(sizeof(long long));
 				break;
-
-			case MYSQL_TYPE_DECIMAL:
-			case MYSQL_TYPE_NEWDECIMAL:
 			case MYSQL_TYPE_FLOAT:
 			case MYSQL_TYPE_DOUBLE:
-				// handle as double
+				bind.buffer_type = MYSQL_TYPE_DOUBLE;
+				m_buffers[i].resize(sizeof(double));
 				break;
-
-			case MYSQL_TYPE_BIT:
-				// handle as bool
+			default:
+				bind.buffer_type = MYSQL_TYPE_STRING;
+				m_buffers[i].resize(CLEVER_MYSQL_STR_BUFFER);
 				break;
+		}
 
-			case MYSQL_TYPE_TINY_BLOB:
-			case MYSQL_TYPE_MEDIUM_BLOB:
-			case MYSQL_TYPE_LONG_BLOB:
-				// handle as byte array?
-				break;
+		bind.buffer = &m_buffers[i][0];
+		bind.buffer_length = m_buffers[i].size();
+		bind.length = &bind.length_value;
+		bind.is_null = &bind.is_null_value;
+		bind.error = &bind.error_value;
+	}
+
+	_mysql_sort_columns(fields, count, m_columns);
+
+	return mysql_stmt_bind_result(m_stmt, &m_binds[0]) == 0;
+}
+
+MapObject* CMysqlStmt::fetchRow()
+{
+	if (m_meta == NULL) {
+		return NULL;
+	}
+
+	int ret = mysql_stmt_fetch(m_stmt);
+
+	if (ret == 1 || ret == MYSQL_NO_DATA) {
+		return NULL;
+	}
+
+	// Strings longer than their buffer are fetched again after growing it
+	if (ret == MYSQL_DATA_TRUNCATED) {
+		bool rebind = false;
+
+		for (size_t i = 0, n = m_binds.size(); i < n; ++i) {
+			MYSQL_BIND& bind = m_binds[i];
+
+			if (bind.buffer_type != MYSQL_TYPE_STRING
+				|| bind.length_value <= bind.buffer_length) {
+				continue;
+			}
+
+			m_buffers[i].resize(bind.length_value);
+			bind.buffer = &m_buffers[i][0];
+			bind.buffer_length = m_buffers[i].size();
+
+			mysql_stmt_fetch_column(m_stmt, &bind, i, 0);
+			rebind = true;
 		}
 
-		if (value != NULL) {
-			map->getData().insert(MapObjectPair(fields[i].name, value));
+		if (rebind) {
+			mysql_stmt_bind_result(m_stmt, &m_binds[0]);
+		}
+	}
+
+	MapObject* map = new MapObject;
+	std::map<std::string, Value*>& data = map->getData();
+
+	for (size_t i = 0, n = m_columns.size(); i < n; ++i) {
+		const MYSQL_BIND& bind = m_binds[m_columns[i].second];
+		Value* value = new Value;
+
+		if (!bind.is_null_value) {
+			switch (bind.buffer_type) {
+				case MYSQL_TYPE_LONGLONG:
+					{
+						long long num;
+
+						std::memcpy(&num, bind.buffer, sizeof(num));
+						value->setInt(num);
+					}
+					break;
+				case MYSQL_TYPE_DOUBLE:
+					{
+						double num;
+
+						std::memcpy(&num, bind.buffer, sizeof(num));
+						value->setDouble(num);
+					}
+					break;
+				default:
+					{
+						StrObject* str = new StrObject;
+
+						str->getBuffer().assign(
+							static_cast<const char*>(bind.buffer), bind.length_value);
+						value->setStr(str);
+					}
+					break;
+			}
 		}
 
-		value = NULL;
-		delete [] str;
+		data.insert(data.end(), std::map<std::string, Value*>::value_type(
+			m_columns[i].first, value));
 	}
 
 	return map;
 }
 
-unsigned int CMysql::errno()
+void CMysqlStmt::freeResult()
+{
+	if (m_meta == NULL) {
+		return;
+	}
+
+	mysql_stmt_free_result(m_stmt);
+	mysql_free_result(m_meta);
+
+	m_meta = NULL;
+	m_binds.clear();
+	m_buffers.clear();
+	m_columns.clear();
+}
+
+void CMysql::init()
+{
+	m_connection = mysql_init(m_connection);
+}
+
+bool CMysql::connect()
+{
+	MYSQL* conn;
+
+	if (m_connection == NULL) {
+		init();
+	}
+
+	conn = mysql_real_connect(m_connection, m_host.c_str(), m_user.c_str(),
+		m_passwd.c_str(), m_db.c_str(), m_port, NULL, 0);
+
+	// Clean the password as we do not want to keep this in memory
+	m_passwd = "";
+
+	return conn != NULL;
+}
+
+void CMysql::close()
+{
+	freeResult();
+
+	if (m_connection) {
+		mysql_close(m_connection);
+		m_connection = NULL;
+	}
+}
+
+void CMysql::freeResult()
+{
+	delete m_resultset;
+	m_resultset = NULL;
+}
+
+bool CMysql::query(const char *stmt)
+{
+	bool ok;
+
+	freeResult();
+	m_resultset = execute(stmt, ok);
+
+	// TODO : Show warning message saying something is wrong
+	//        with the query?
+	return m_resultset != NULL;
+}
+
+MapObject* CMysql::fetchRow()
+{
+	if (m_resultset == NULL) {
+		return NULL;
+	}
+
+	MapObject* map = m_resultset->fetchRow();
+
+	// No more data or no data at all!
+	if (map == NULL) {
+		freeResult();
+	}
+
+	return map;
+}
+
+CMysqlResult* CMysql::execute(const std::string& sql, bool& ok)
+{
+	ok = mysql_real_query(m_connection, sql.data(), sql.size()) == 0;
+
+	if (!ok) {
+		return NULL;
+	}
+
+	// Rows are streamed from the server as they are fetched
+	MYSQL_RES* result = mysql_use_result(m_connection);
+
+	if (result == NULL) {
+		ok = mysql_field_count(m_connection) == 0;
+		return NULL;
+	}
+
+	return new CMysqlResult(result);
+}
+
+CMysqlStmt* CMysql::prepare(const std::string& sql)
+{
+	MYSQL_STMT* stmt = mysql_stmt_init(m_connection);
+
+	if (stmt == NULL) {
+		return NULL;
+	}
+
+	if (mysql_stmt_prepare(stmt, sql.data(), sql.size())) {
+		mysql_stmt_close(stmt);
+		return NULL;
+	}
+
+	return new CMysqlStmt(stmt);
+}
+
+unsigned int CMysql::getErrno()
 {
 	return mysql_errno(m_connection);
 }
@@ -9,6 +9,8 @@
 #define CLEVER_DB_CMYSQL_H
 
 #include <iostream>
+#include <utility>
+#include <vector>
 
 #include <mysql/mysql.h>
 
@@ -20,13 +22,83 @@
 
 namespace clever {
 
+// Column name and index, sorted by name so rows can be built in order
+typedef std::pair<std::string, unsigned int> MysqlColumn;
+
+/**
+ * Result set read through the text protocol
+ */
+class CMysqlResult {
+public:
+	CMysqlResult(MYSQL_RES* result);
+
+	~CMysqlResult() {
+		mysql_free_result(m_result);
+	}
+
+	/// Returns the next row, or NULL when there are no more rows
+	MapObject* fetchRow();
+
+	/// Whether every row has been read, so the connection is free again
+	bool isDone() const { return m_done; }
+private:
+	MYSQL_RES* m_result;
+	MYSQL_FIELD* m_fields;
+	std::vector<MysqlColumn> m_columns;
+	bool m_done;
+
+	DISALLOW_COPY_AND_ASSIGN(CMysqlResult);
+};
+
+/**
+ * Server-side prepared statement using the binary protocol
+ */
+class CMysqlStmt {
+public:
+	CMysqlStmt(MYSQL_STMT* stmt)
+		: m_stmt(stmt), m_meta(NULL) {}
+
+	~CMysqlStmt() {
+		freeResult();
+		mysql_stmt_close(m_stmt);
+	}
+
+	/// Binds the values to the parameters in order and runs the statement
+	bool execute(ValueSpan params);
+
+	/// Returns the next row, or NULL when there are no more rows
+	MapObject* fetchRow();
+
+	/// Discards the pending rows, releasing the connection
+	void freeResult();
+
+	unsigned long paramCount() { return mysql_stmt_param_count(m_stmt); }
+
+	unsigned long long affectedRows() { return mysql_stmt_affected_rows(m_stmt); }
+	unsigned long long insertId() { return mysql_stmt_insert_id(m_stmt); }
+
+	unsigned int getErrno() { return mysql_stmt_errno(m_stmt); }
+	const char* error() { return mysql_stmt_error(m_stmt); }
+private:
+	bool bindResult();
+
+	MYSQL_STMT* m_stmt;
+	MYSQL_RES* m_meta;
+	std::vector<MYSQL_BIND> m_binds;
+	std::vector<std::vector<char> > m_buffers;
+	std::vector<MysqlColumn> m_columns;
+
+	DISALLOW_COPY_AND_ASSIGN(CMysqlStmt);
+};
 
 class CMysql {
 public:
 	CMysql()
 		: m_connection(NULL), m_port(3306), m_resultset(NULL) { init(); }
 
-	~CMysql() {}
+	~CMysql() {
+		close();
+	}
 
 	void setHost(const std::string& host)     { m_host = host;     }
 	void setUser(const std::string& user)     { m_user = user;     }
@@ -34,12 +106,27 @@ public:
 	void setDb(const std::string& db)         { m_db = db;         }
 	void setPort(int port)                    { m_port = port;     }
 
+	/// Connects, opening the client handle again after close()
 	bool connect();
+	void close();
+	bool isClosed() const { return m_connection == NULL; }
 	bool query(const char* stmt);
 	MapObject* fetchRow();
-	unsigned int errno();
+	unsigned int getErrno();
+
+	/// Discards the rows left by query(), releasing the connection
+	void freeResult();
 	const char* error();
 
+	/// Runs sql and returns its rows unbuffered, or NULL when it has none
+	CMysqlResult* execute(const std::string& sql, bool& ok);
+
+	/// Prepares sql on the server, returning NULL on failure
+	CMysqlStmt* prepare(const std::string& sql);
+
+	unsigned long long affectedRows() { return mysql_affected_rows(m_connection); }
+	unsigned long long insertId() { return mysql_insert_id(m_connection); }
+
 	std::string dump();
 private:
 
@@ -54,7 +141,7 @@ private:
 
 	int m_port;
 
-	MYSQL_RES* m_resultset;
+	CMysqlResult* m_resultset;
 
 	DISALLOW_COPY_AND_ASSIGN(CMysql);
 };
@@ -13,7 +13,20 @@ namespace clever { namespace modules { namespace db {
 /// Initializes Mysql module
 CLEVER_MODULE_INIT(MysqlModule)
 {
-	addType(new Mysql);
+	// Must run before connections are opened from several threads
+	mysql_library_init(0, NULL, NULL);
+
+	Mysql* mysql_type        = new Mysql;
+	MysqlResult* result_type = new MysqlResult;
+	MysqlStmt* stmt_type     = new MysqlStmt;
+
+	addType(mysql_type);
+	addType(result_type);
+	addType(stmt_type);
+	addType(new MysqlPool(mysql_type));
+
+	mysql_type->result_type = result_type;
+	mysql_type->stmt_type = stmt_type;
 }
 
 }}} // clever::modules::db
@@ -5,13 +5,95 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include "core/cexception.h"
 #include "core/value.h"
 #include "core/native_types.h"
 #include "modules/db/mysql/mysql.h"
 #include "modules/db/mysql/cmysql.h"
+#include "modules/std/core/array.h"
+#include "modules/std/core/str.h"
 
 namespace clever { namespace modules { namespace db {
 
+#ifndef CLEVER_WIN32
+static pthread_key_t s_thread_key;
+static pthread_once_t s_thread_once = PTHREAD_ONCE_INIT;
+
+static void _mysql_thread_end(void*)
+{
+	mysql_thread_end();
+}
+
+static void _mysql_create_thread_key()
+{
+	pthread_key_create(&s_thread_key, _mysql_thread_end);
+}
+#endif
+
+// The client library keeps per-thread state, which is set up the first time
+// a thread acquires a connection and released when the thread exits
+static void _mysql_thread_init()
+{
+#ifndef CLEVER_WIN32
+	pthread_once(&s_thread_once, _mysql_create_thread_key);
+
+	if (pthread_getspecific(s_thread_key) == NULL) {
+		mysql_thread_init();
+		pthread_setspecific(s_thread_key, &s_thread_key);
+	}
+#else
+	static THREAD_TLS bool initialized = false;
+
+	if (!initialized) {
+		mysql_thread_init();
+		initialized = true;
+	}
+#endif
+}
+
+// Returns the client of the connection, or NULL (throwing) once it has
+// been closed, as the client handle is gone
+static CMysql* _mysql_client(MysqlObject* mo, Clever* clever)
+{
+	if (mo->getMysql().isClosed()) {
+		clever_throw("Connection is closed");
+		return NULL;
+	}
+	return &mo->getMysql();
+}
+
+// Collects up to limit rows (all of them when limit is 0) into an Array
+template <typename T>
+static ArrayObject* _mysql_fetch_rows(T* source, long limit)
+{
+	ArrayObject* array = new ArrayObject;
+	std::vector<Value*>& data = array->getData();
+	MapObject* map;
+
+	while ((limit == 0 || long(data.size()) < limit)
+		&& (map = source->fetchRow()) != NULL) {
+		Value* row = new Value;
+
+		row->setObj(CLEVER_MAP_TYPE, map);
+		data.push_back(row);
+	}
+
+	return array;
+}
+
+template <typename T>
+static void _mysql_fetch_batch(T* source, long limit, Value* result)
+{
+	ArrayObject* array = _mysql_fetch_rows(source, limit);
+
+	if (array->getData().empty()) {
+		clever_delref(array);
+		result->setBool(false);
+	} else {
+		result->setObj(CLEVER_ARRAY_TYPE, array);
+	}
+}
+
 CLEVER_METHOD(Mysql::ctor)
 {
 	result->setObj(this, new MysqlObject);
@@ -49,10 +131,11 @@ CLEVER_METHOD(Mysql::query)
 		return;
 	}
 
-	MysqlObject* mo = clever_get_this(MysqlObject*);
-	CMysql& cmysql = mo->getMysql();
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
 
-	result->setBool(cmysql.query(args[0]->getStr()->c_str()));
+	if (cmysql) {
+		result->setBool(cmysql->query(args[0]->getStr()->c_str()));
+	}
 }
 
 CLEVER_METHOD(Mysql::fetchRow)
@@ -61,10 +144,13 @@ CLEVER_METHOD(Mysql::fetchRow)
 		return;
 	}
 
-	MysqlObject* mo = clever_get_this(MysqlObject*);
-	CMysql& cmysql = mo->getMysql();
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
+
+	if (cmysql == NULL) {
+		return;
+	}
 
-	MapObject* data = cmysql.fetchRow();
+	MapObject* data = cmysql->fetchRow();
 
 	if(data != NULL) {
 		result->setObj(CLEVER_MAP_TYPE, data);
@@ -73,16 +159,94 @@ CLEVER_METHOD(Mysql::fetchRow)
 	}
 }
 
+// Mysql.execute(String query)
+// Returns a MysqlResult streaming the rows, or true for statements without
+// a result set
+CLEVER_METHOD(Mysql::execute)
+{
+	if (!clever_check_args("s")) {
+		return;
+	}
+
+	MysqlObject* mo = clever_get_this(MysqlObject*);
+	CMysql* cmysql = _mysql_client(mo, clever);
+
+	if (cmysql == NULL) {
+		return;
+	}
+
+	bool ok;
+	CMysqlResult* res = cmysql->execute(*args[0]->getStr(), ok);
+
+	if (res) {
+		result->setObj(result_type, new MysqlResultObject(mo, res));
+	} else {
+		result->setBool(ok);
+	}
+}
+
+// Mysql.prepare(String query)
+CLEVER_METHOD(Mysql::prepare)
+{
+	if (!clever_check_args("s")) {
+		return;
+	}
+
+	MysqlObject* mo = clever_get_this(MysqlObject*);
+	CMysql* cmysql = _mysql_client(mo, clever);
+
+	if (cmysql == NULL) {
+		return;
+	}
+
+	CMysqlStmt* stmt = cmysql->prepare(*args[0]->getStr());
+
+	if (stmt == NULL) {
+		clever_throw("An error occurred when preparing query: %s",
+			cmysql->error());
+		return;
+	}
+
+	result->setObj(stmt_type, new MysqlStmtObject(mo, stmt));
+}
+
+CLEVER_METHOD(Mysql::getAffectedRows)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
+
+	if (cmysql) {
+		result->setInt(cmysql->affectedRows());
+	}
+}
+
+CLEVER_METHOD(Mysql::getLastId)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
+
+	if (cmysql) {
+		result->setInt(cmysql->insertId());
+	}
+}
+
 CLEVER_METHOD(Mysql::getErrorNumber)
 {
 	if (!clever_check_no_args()) {
 		return;
 	}
 
-	MysqlObject* mo = clever_get_this(MysqlObject*);
-	CMysql& cmysql = mo->getMysql();
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
 
-	result->setInt(cmysql.errno());
+	if (cmysql) {
+		result->setInt(cmysql->getErrno());
+	}
 }
 
 CLEVER_METHOD(Mysql::getError)
@@ -91,10 +255,375 @@ CLEVER_METHOD(Mysql::getError)
 		return;
 	}
 
+	CMysql* cmysql = _mysql_client(clever_get_this(MysqlObject*), clever);
+
+	if (cmysql) {
+		result->setStr(new StrObject(cmysql->error()));
+	}
+}
+
+CLEVER_METHOD(Mysql::close)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
 	MysqlObject* mo = clever_get_this(MysqlObject*);
-	CMysql& cmysql = mo->getMysql();
 
-	result->setStr(CSTRING(cmysql.error()));
+	// Their handles would be left pointing to the closed connection
+	if (mo->hasHandles()) {
+		clever_throw("Connection has open results or statements");
+		return;
+	}
+
+	mo->getMysql().close();
+}
+
+// MysqlResult.fetch()
+CLEVER_METHOD(MysqlResult::fetch)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlResultObject* res = clever_get_this(MysqlResultObject*);
+	MapObject* map = res->result ? res->result->fetchRow() : NULL;
+
+	if (map) {
+		result->setObj(CLEVER_MAP_TYPE, map);
+	} else {
+		res->free();
+		result->setBool(false);
+	}
+}
+
+// MysqlResult.fetchBatch(Int size)
+CLEVER_METHOD(MysqlResult::fetchBatch)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() <= 0) {
+		clever_throw("Batch size must be a positive number");
+		return;
+	}
+
+	MysqlResultObject* res = clever_get_this(MysqlResultObject*);
+
+	if (res->result == NULL) {
+		result->setBool(false);
+		return;
+	}
+
+	_mysql_fetch_batch(res->result, args[0]->getInt(), result);
+
+	if (res->result->isDone()) {
+		res->free();
+	}
+}
+
+// MysqlResult.fetchAll()
+CLEVER_METHOD(MysqlResult::fetchAll)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlResultObject* res = clever_get_this(MysqlResultObject*);
+
+	if (res->result == NULL) {
+		result->setObj(CLEVER_ARRAY_TYPE, new ArrayObject);
+		return;
+	}
+
+	result->setObj(CLEVER_ARRAY_TYPE, _mysql_fetch_rows(res->result, 0));
+
+	res->free();
+}
+
+// MysqlResult.free()
+CLEVER_METHOD(MysqlResult::free)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlResultObject* res = clever_get_this(MysqlResultObject*);
+
+	res->free();
+}
+
+// MysqlStmt.execute(...)
+// Arguments are bound to the statement placeholders in order
+CLEVER_METHOD(MysqlStmt::execute)
+{
+	if (!clever_check_args("*")) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	if (so->stmt == NULL) {
+		clever_throw("Statement has been closed");
+		return;
+	}
+
+	if (args.size() != so->stmt->paramCount()) {
+		clever_throw("Statement expects %N parameter(s), but %N were supplied",
+			size_t(so->stmt->paramCount()), args.size());
+		return;
+	}
+
+	for (size_t i = 0, n = args.size(); i < n; ++i) {
+		if (!args[i]->isNull() && !args[i]->isInt() && !args[i]->isDouble()
+			&& !args[i]->isStr() && !args[i]->isBool()) {
+			clever_throw("Unknown parameter type `%T'", args[i]->getType());
+			return;
+		}
+	}
+
+	result->setBool(so->stmt->execute(args));
+}
+
+// MysqlStmt.fetch()
+CLEVER_METHOD(MysqlStmt::fetch)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+	MapObject* map = so->stmt ? so->stmt->fetchRow() : NULL;
+
+	if (map) {
+		result->setObj(CLEVER_MAP_TYPE, map);
+	} else {
+		result->setBool(false);
+	}
+}
+
+// MysqlStmt.fetchBatch(Int size)
+CLEVER_METHOD(MysqlStmt::fetchBatch)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() <= 0) {
+		clever_throw("Batch size must be a positive number");
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	if (so->stmt == NULL) {
+		result->setBool(false);
+		return;
+	}
+
+	_mysql_fetch_batch(so->stmt, args[0]->getInt(), result);
+}
+
+// MysqlStmt.fetchAll()
+CLEVER_METHOD(MysqlStmt::fetchAll)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	if (so->stmt == NULL) {
+		result->setObj(CLEVER_ARRAY_TYPE, new ArrayObject);
+		return;
+	}
+
+	result->setObj(CLEVER_ARRAY_TYPE, _mysql_fetch_rows(so->stmt, 0));
+}
+
+CLEVER_METHOD(MysqlStmt::getAffectedRows)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	result->setInt(so->stmt ? so->stmt->affectedRows() : 0);
+}
+
+CLEVER_METHOD(MysqlStmt::getLastId)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	result->setInt(so->stmt ? so->stmt->insertId() : 0);
+}
+
+CLEVER_METHOD(MysqlStmt::getError)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	result->setStr(new StrObject(so->stmt ? so->stmt->error() : ""));
+}
+
+CLEVER_METHOD(MysqlStmt::close)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlStmtObject* so = clever_get_this(MysqlStmtObject*);
+
+	so->close();
+}
+
+// MysqlPool.new(String host, String user, String passwd, String db
+//               [, Int port [, Int size]])
+CLEVER_METHOD(MysqlPool::ctor)
+{
+	if (!clever_check_args("ssss|ii")) {
+		return;
+	}
+
+	long size = args.size() > 5 ? args[5]->getInt() : 4;
+
+	if (size <= 0) {
+		clever_throw("Pool size must be a positive number");
+		return;
+	}
+
+	MysqlPoolObject* pool = new MysqlPoolObject;
+
+	// All connections are opened upfront, so the password is not kept
+	for (long i = 0; i < size; ++i) {
+		MysqlObject* mo = new MysqlObject;
+		CMysql& cmysql = mo->getMysql();
+
+		pool->conns.push_back(mo);
+
+		if (args.size() > 4) {
+			cmysql.setPort(args[4]->getInt());
+		}
+		cmysql.setHost(*args[0]->getStr());
+		cmysql.setUser(*args[1]->getStr());
+		cmysql.setPasswd(*args[2]->getStr());
+		cmysql.setDb(*args[3]->getStr());
+
+		if (!cmysql.connect()) {
+			clever_throw("An error occurred when connecting: %s", cmysql.error());
+			clever_delref(pool);
+			return;
+		}
+
+		pool->idle.push_back(mo);
+	}
+
+	result->setObj(this, pool);
+}
+
+// MysqlPool.acquire()
+// Blocks until a connection is available
+CLEVER_METHOD(MysqlPool::acquire)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlPoolObject* pool = clever_get_this(MysqlPoolObject*);
+
+	pool->mutex.lock();
+
+	while (pool->idle.empty()) {
+		pool->available.wait(pool->mutex);
+	}
+
+	MysqlObject* mo = pool->idle.back();
+	pool->idle.pop_back();
+
+	pool->mutex.unlock();
+
+	_mysql_thread_init();
+
+	clever_addref(mo);
+	result->setObj(m_mysql_type, mo);
+}
+
+// MysqlPool.release(Mysql conn)
+CLEVER_METHOD(MysqlPool::release)
+{
+	if (!clever_check_args(".")) {
+		return;
+	}
+
+	MysqlPoolObject* pool = clever_get_this(MysqlPoolObject*);
+	MysqlObject* mo = static_cast<MysqlObject*>(args[0]->getObj());
+
+	pool->mutex.lock();
+
+	if (args[0]->getType() != m_mysql_type
+		|| std::find(pool->conns.begin(), pool->conns.end(), mo) == pool->conns.end()
+		|| std::find(pool->idle.begin(), pool->idle.end(), mo) != pool->idle.end()) {
+		pool->mutex.unlock();
+		clever_throw("Connection was not acquired from this pool");
+		return;
+	}
+
+	// The next thread could not use it (connect() opens it again)
+	if (mo->getMysql().isClosed()) {
+		pool->mutex.unlock();
+		clever_throw("Connection is closed");
+		return;
+	}
+
+	// The next thread could not use it, and would share the handles
+	if (mo->hasHandles()) {
+		pool->mutex.unlock();
+		clever_throw("Connection has open results or statements");
+		return;
+	}
+
+	// Rows left unread by query() would keep the connection busy
+	mo->getMysql().freeResult();
+
+	pool->idle.push_back(mo);
+	pool->available.signal();
+
+	pool->mutex.unlock();
+}
+
+// MysqlPool.size()
+CLEVER_METHOD(MysqlPool::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlPoolObject* pool = clever_get_this(MysqlPoolObject*);
+
+	result->setInt(pool->conns.size());
+}
+
+// MysqlPool.available()
+CLEVER_METHOD(MysqlPool::available)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MysqlPoolObject* pool = clever_get_this(MysqlPoolObject*);
+
+	pool->mutex.lock();
+	result->setInt(pool->idle.size());
+	pool->mutex.unlock();
 }
 
 // Type initialization
@@ -102,11 +631,46 @@ CLEVER_TYPE_INIT(Mysql::init)
 {
 	setConstructor((MethodPtr) &Mysql::ctor);
 
-	addMethod(new Function("connect",        (MethodPtr) &Mysql::connect));
-	addMethod(new Function("query",          (MethodPtr) &Mysql::query));
-	addMethod(new Function("fetchRow",       (MethodPtr) &Mysql::fetchRow));
-	addMethod(new Function("getErrorNumber", (MethodPtr) &Mysql::getErrorNumber));
-	addMethod(new Function("getError",       (MethodPtr) &Mysql::getError));
+	addMethod(new Function("connect",         (MethodPtr) &Mysql::connect));
+	addMethod(new Function("query",           (MethodPtr) &Mysql::query));
+	addMethod(new Function("fetchRow",        (MethodPtr) &Mysql::fetchRow));
+	addMethod(new Function("execute",         (MethodPtr) &Mysql::execute));
+	addMethod(new Function("prepare",         (MethodPtr) &Mysql::prepare));
+	addMethod(new Function("getAffectedRows", (MethodPtr) &Mysql::getAffectedRows));
+	addMethod(new Function("getLastId",       (MethodPtr) &Mysql::getLastId));
+	addMethod(new Function("getErrorNumber",  (MethodPtr) &Mysql::getErrorNumber));
+	addMethod(new Function("getError",        (MethodPtr) &Mysql::getError));
+	addMethod(new Function("close",           (MethodPtr) &Mysql::close));
+}
+
+CLEVER_TYPE_INIT(MysqlResult::init)
+{
+	addMethod(new Function("fetch",      (MethodPtr) &MysqlResult::fetch));
+	addMethod(new Function("fetchBatch", (MethodPtr) &MysqlResult::fetchBatch));
+	addMethod(new Function("fetchAll",   (MethodPtr) &MysqlResult::fetchAll));
+	addMethod(new Function("free",       (MethodPtr) &MysqlResult::free));
+}
+
+CLEVER_TYPE_INIT(MysqlStmt::init)
+{
+	addMethod(new Function("execute",         (MethodPtr) &MysqlStmt::execute));
+	addMethod(new Function("fetch",           (MethodPtr) &MysqlStmt::fetch));
+	addMethod(new Function("fetchBatch",      (MethodPtr) &MysqlStmt::fetchBatch));
+	addMethod(new Function("fetchAll",        (MethodPtr) &MysqlStmt::fetchAll));
+	addMethod(new Function("getAffectedRows", (MethodPtr) &MysqlStmt::getAffectedRows));
+	addMethod(new Function("getLastId",       (MethodPtr) &MysqlStmt::getLastId));
+	addMethod(new Function("getError",        (MethodPtr) &MysqlStmt::getError));
+	addMethod(new Function("close",           (MethodPtr) &MysqlStmt::close));
+}
+
+CLEVER_TYPE_INIT(MysqlPool::init)
+{
+	setConstructor((MethodPtr) &MysqlPool::ctor);
+
+	addMethod(new Function("acquire",   (MethodPtr) &MysqlPool::acquire));
+	addMethod(new Function("release",   (MethodPtr) &MysqlPool::release));
+	addMethod(new Function("size",      (MethodPtr) &MysqlPool::size));
+	addMethod(new Function("available", (MethodPtr) &MysqlPool::available));
 }
 
 }}} // clever::modules::db
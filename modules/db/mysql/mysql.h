@@ -8,48 +8,193 @@
 #ifndef CLEVER_DB_MYSQL_H
 #define CLEVER_DB_MYSQL_H
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 #include "core/cstring.h"
 #include "core/value.h"
 #include "core/type.h"
+#include "core/cthread.h"
 #include "modules/db/mysql/cmysql.h"
 
 namespace clever { namespace modules { namespace db {
 
 class MysqlObject : public TypeObject {
 public:
-	MysqlObject() {}
+	MysqlObject()
+		: m_handles(0) {}
 
 	~MysqlObject() {}
 
 	CMysql& getMysql() { return m_mysql; }
 
+	// Results and statements still using the connection, which cannot be
+	// closed or returned to a pool until they are freed
+	void addHandle() { __sync_add_and_fetch(&m_handles, 1); }
+	void delHandle() { __sync_sub_and_fetch(&m_handles, 1); }
+	bool hasHandles() const { return m_handles != 0; }
+
 private:
 	CMysql m_mysql;
+	size_t m_handles;
 
 	DISALLOW_COPY_AND_ASSIGN(MysqlObject);
 };
 
+// Streamed result set; the connection is busy until it is fully read or freed
+struct MysqlResultObject : public TypeObject {
+	MysqlResultObject(MysqlObject* conn_, CMysqlResult* result_)
+		: conn(conn_), result(result_) {
+		clever_addref(conn);
+		conn->addHandle();
+	}
+
+	~MysqlResultObject() {
+		free();
+		clever_delref(conn);
+	}
+
+	void free() {
+		if (result) {
+			delete result;
+			result = NULL;
+			conn->delHandle();
+		}
+	}
+
+	MysqlObject* conn;
+	CMysqlResult* result;
+};
+
+struct MysqlStmtObject : public TypeObject {
+	MysqlStmtObject(MysqlObject* conn_, CMysqlStmt* stmt_)
+		: conn(conn_), stmt(stmt_) {
+		clever_addref(conn);
+		conn->addHandle();
+	}
+
+	~MysqlStmtObject() {
+		close();
+		clever_delref(conn);
+	}
+
+	void close() {
+		if (stmt) {
+			delete stmt;
+			stmt = NULL;
+			conn->delHandle();
+		}
+	}
+
+	MysqlObject* conn;
+	CMysqlStmt* stmt;
+};
+
+// Fixed set of connections shared between threads
+struct MysqlPoolObject : public TypeObject {
+	MysqlPoolObject() {}
+
+	~MysqlPoolObject() {
+		std::for_each(conns.begin(), conns.end(), clever_delref);
+	}
+
+	CMutex mutex;
+	CCondition available;
+	// Every connection of the pool, holding a reference
+	std::vector<MysqlObject*> conns;
+	// Connections not acquired by anyone
+	std::vector<MysqlObject*> idle;
+};
+
+class MysqlResult : public Type {
+public:
+	MysqlResult()
+		: Type("MysqlResult") {}
+
+	~MysqlResult() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(fetch);
+	CLEVER_METHOD(fetchBatch);
+	CLEVER_METHOD(fetchAll);
+	CLEVER_METHOD(free);
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(MysqlResult);
+};
+
+class MysqlStmt : public Type {
+public:
+	MysqlStmt()
+		: Type("MysqlStmt") {}
+
+	~MysqlStmt() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(execute);
+	CLEVER_METHOD(fetch);
+	CLEVER_METHOD(fetchBatch);
+	CLEVER_METHOD(fetchAll);
+	CLEVER_METHOD(getAffectedRows);
+	CLEVER_METHOD(getLastId);
+	CLEVER_METHOD(getError);
+	CLEVER_METHOD(close);
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(MysqlStmt);
+};
+
 class Mysql : public Type {
 public:
 	Mysql()
-		: Type("Mysql") {}
+		: Type("Mysql"), result_type(NULL), stmt_type(NULL) {}
 
 	~Mysql() {}
 
 	virtual void init();
 
+	const MysqlResult* result_type;
+	const MysqlStmt* stmt_type;
+
 	CLEVER_METHOD(ctor);
 	CLEVER_METHOD(connect);
 	CLEVER_METHOD(query);
 	CLEVER_METHOD(fetchRow);
+	CLEVER_METHOD(execute);
+	CLEVER_METHOD(prepare);
+	CLEVER_METHOD(getAffectedRows);
+	CLEVER_METHOD(getLastId);
 	CLEVER_METHOD(getErrorNumber);
 	CLEVER_METHOD(getError);
+	CLEVER_METHOD(close);
 
 private:
 	DISALLOW_COPY_AND_ASSIGN(Mysql);
 };
 
+class MysqlPool : public Type {
+public:
+	MysqlPool(const Mysql* mysql_type)
+		: Type("MysqlPool"), m_mysql_type(mysql_type) {}
+
+	~MysqlPool() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(acquire);
+	CLEVER_METHOD(release);
+	CLEVER_METHOD(size);
+	CLEVER_METHOD(available);
+
+private:
+	const Mysql* m_mysql_type;
+
+	DISALLOW_COPY_AND_ASSIGN(MysqlPool);
+};
+
 }}} // clever::modules::db
 
 #endif // CLEVER_DB_MYSQL_H
@@ -5,13 +5,173 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include <algorithm>
 #include "core/cexception.h"
 #include "modules/db/sqlite3/sqlite3.h"
+#include "modules/std/core/array.h"
 #include "modules/std/core/map.h"
 #include "modules/std/core/str.h"
 
 namespace clever { namespace modules { namespace db {
 
+static bool _sqlite_column_less(const SQLite3Column& a, const SQLite3Column& b)
+{
+	return a.first < b.first;
+}
+
+static bool _sqlite_column_equal(const SQLite3Column& a, const SQLite3Column& b)
+{
+	return a.first == b.first;
+}
+
+sqlite3_stmt* SQLite3StmtCache::acquire(const std::string& sql)
+{
+	EntryMap::iterator it = m_index.find(sql);
+
+	if (it == m_index.end()) {
+		return NULL;
+	}
+
+	sqlite3_stmt* stmt = it->second->second;
+
+	m_entries.erase(it->second);
+	m_index.erase(it);
+
+	return stmt;
+}
+
+void SQLite3StmtCache::release(const std::string& sql, sqlite3_stmt* stmt)
+{
+	if (m_capacity == 0 || m_index.find(sql) != m_index.end()) {
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	m_entries.push_front(Entry(sql, stmt));
+	m_index.insert(EntryMap::value_type(sql, m_entries.begin()));
+
+	if (m_entries.size() > m_capacity) {
+		m_index.erase(m_entries.back().first);
+		sqlite3_finalize(m_entries.back().second);
+		m_entries.pop_back();
+	}
+}
+
+void SQLite3StmtCache::clear()
+{
+	EntryList::const_iterator it(m_entries.begin()), end(m_entries.end());
+
+	for (; it != end; ++it) {
+		sqlite3_finalize(it->second);
+	}
+	m_entries.clear();
+	m_index.clear();
+}
+
+void SQLite3StmtCache::setCapacity(size_t capacity)
+{
+	m_capacity = capacity;
+
+	while (m_entries.size() > m_capacity) {
+		m_index.erase(m_entries.back().first);
+		sqlite3_finalize(m_entries.back().second);
+		m_entries.pop_back();
+	}
+}
+
+sqlite3_stmt* SQLite3Conn::prepare(const std::string& sql)
+{
+	if (!handle) {
+		return NULL;
+	}
+
+	sqlite3_stmt* stmt = cache.acquire(sql);
+
+	if (stmt == NULL
+		&& sqlite3_prepare_v2(handle, sql.c_str(), sql.size(), &stmt, NULL) != SQLITE_OK) {
+		return NULL;
+	}
+
+	return stmt;
+}
+
+void SQLite3Conn::release(const std::string& sql, sqlite3_stmt* stmt)
+{
+	if (handle) {
+		cache.release(sql, stmt);
+	} else {
+		sqlite3_finalize(stmt);
+	}
+}
+
+int SQLite3Stmt::getParamIndex(long num)
+{
+	if (!has_positions) {
+		int count = sqlite3_bind_parameter_count(stmt);
+		long limit = sqlite3_limit(conn->handle, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+
+		positions.assign(count + 1, 0);
+
+		// Numbered parameters (?N, :N, @N, $N) map N to their index, the
+		// anonymous ones (?) keep their own position
+		for (int i = 1; i <= count; ++i) {
+			const char* name = sqlite3_bind_parameter_name(stmt, i);
+			long pos = 0;
+
+			if (name == NULL) {
+				pos = i;
+			} else if (name[1] != '\0') {
+				const char* p = name + 1;
+
+				for (; *p >= '0' && *p <= '9' && pos <= limit; ++p) {
+					pos = pos * 10 + (*p - '0');
+				}
+				if (*p != '\0' || pos > limit) {
+					pos = 0;
+				}
+			}
+
+			if (pos > 0) {
+				if (size_t(pos) >= positions.size()) {
+					positions.resize(pos + 1, 0);
+				}
+				if (positions[pos] == 0) {
+					positions[pos] = i;
+				}
+			}
+		}
+		has_positions = true;
+	}
+
+	if (num > 0 && size_t(num) < positions.size() && positions[num]) {
+		return positions[num];
+	}
+
+	return num;
+}
+
+const std::vector<SQLite3Column>& SQLite3Stmt::getColumns()
+{
+	if (!has_columns) {
+		for (int i = 0, n = sqlite3_column_count(stmt); i < n; ++i) {
+			columns.push_back(SQLite3Column(sqlite3_column_name(stmt, i), i));
+		}
+
+		// The first column wins when names are repeated, as in a plain
+		// sequence of Map inserts
+		std::stable_sort(columns.begin(), columns.end(), _sqlite_column_less);
+		columns.erase(std::unique(columns.begin(), columns.end(),
+			_sqlite_column_equal), columns.end());
+
+		has_columns = true;
+	}
+
+	return columns;
+}
+
 static Value* _sqlite_to_value(sqlite3_stmt* stmt, int column)
 {
 	Value* value = new Value;
@@ -28,13 +188,21 @@ static Value* _sqlite_to_value(sqlite3_stmt* stmt, int column)
 		case SQLITE_TEXT:
 			{
 				const char* str = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
-				value->setStr(new StrObject(str));
+				StrObject* obj = new StrObject;
+
+				obj->getBuffer().assign(str, sqlite3_column_bytes(stmt, column));
+				value->setStr(obj);
 			}
 			break;
 		case SQLITE_BLOB:
 			{
 				const char* buf = static_cast<const char*>(sqlite3_column_blob(stmt, column));
-				value->setStr(new StrObject(buf));
+				StrObject* obj = new StrObject;
+
+				if (buf) {
+					obj->getBuffer().assign(buf, sqlite3_column_bytes(stmt, column));
+				}
+				value->setStr(obj);
 			}
 			break;
 	}
@@ -42,6 +210,80 @@ static Value* _sqlite_to_value(sqlite3_stmt* stmt, int column)
 	return value;
 }
 
+// Builds a Map from the current row; the keys are already sorted, so each
+// insertion is done at the end of the tree without a full lookup
+static MapObject* _sqlite_fetch_row(SQLite3Stmt* stmt)
+{
+	const std::vector<SQLite3Column>& columns = stmt->getColumns();
+	MapObject* map = new MapObject;
+	std::map<std::string, Value*>& data = map->getData();
+
+	for (size_t i = 0, n = columns.size(); i < n; ++i) {
+		data.insert(data.end(), std::map<std::string, Value*>::value_type(
+			columns[i].first, _sqlite_to_value(stmt->stmt, columns[i].second)));
+	}
+
+	return map;
+}
+
+// Moves the result to its next row, returning false when it is exhausted
+static bool _sqlite_next_row(SQLite3Result* res)
+{
+	if (res->has_row) {
+		res->has_row = false;
+		return true;
+	}
+
+	if (res->done || !res->isCurrent() || !res->stmt->conn->handle) {
+		res->done = true;
+		return false;
+	}
+
+	if (sqlite3_step(res->stmt->stmt) == SQLITE_ROW) {
+		return true;
+	}
+
+	res->done = true;
+	return false;
+}
+
+static bool _sqlite_bind(sqlite3_stmt* stmt, int index, const Value* value,
+	Clever* clever)
+{
+	if (value->isInt()) {
+		sqlite3_bind_int64(stmt, index, value->getInt());
+	} else if (value->isStr()) {
+		sqlite3_bind_text(stmt, index,
+			value->getStr()->c_str(),
+			value->getStr()->size(), SQLITE_TRANSIENT);
+	} else if (value->isDouble()) {
+		sqlite3_bind_double(stmt, index, value->getDouble());
+	} else if (value->isNull()) {
+		sqlite3_bind_null(stmt, index);
+	} else {
+		clever_throw("Unknown parameter type `%T'", value->getType());
+		return false;
+	}
+
+	return true;
+}
+
+// Runs a statement that produces no rows through the statement cache
+static bool _sqlite_run(SQLite3Conn* conn, const std::string& sql)
+{
+	sqlite3_stmt* stmt = conn->prepare(sql);
+
+	if (stmt == NULL) {
+		return false;
+	}
+
+	int ret_code = sqlite3_step(stmt);
+
+	conn->release(sql, stmt);
+
+	return ret_code == SQLITE_DONE || ret_code == SQLITE_ROW;
+}
+
 // SQLite3 constructor
 CLEVER_METHOD(SQLite3Type::ctor)
 {
@@ -97,34 +339,30 @@ CLEVER_METHOD(SQLite3Type::query)
 	}
 
 	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
-	sqlite3_stmt* stmt;
+	sqlite3_stmt* stmt = conn->prepare(*args[0]->getStr());
 
-	if (sqlite3_prepare_v2(conn->handle,
-		args[0]->getStr()->c_str(),
-		args[0]->getStr()->size(),
-		&stmt,
-		NULL) != SQLITE_OK) {
+	if (stmt == NULL) {
 		clever_throw("An error occurred when preparing query: %s",
 			sqlite3_errmsg(conn->handle));
 		return;
 	}
 
+	SQLite3Stmt* stmt_obj = new SQLite3Stmt(stmt, conn, *args[0]->getStr());
+	bool has_row = false;
+
 	switch (sqlite3_step(stmt)) {
-		case SQLITE_DONE:
 		case SQLITE_ROW:
-			sqlite3_reset(stmt);
+			has_row = true;
+			break;
+		case SQLITE_DONE:
 			break;
-		case SQLITE_ERROR:
+		default:
 			clever_throw("%s", sqlite3_errmsg(conn->handle));
+			clever_delref(stmt_obj);
 			return;
 	}
 
-	SQLite3Result* res = new SQLite3Result(stmt);
-
-	conn->results.push_back(res);
-	clever_addref(res);
-
-	result->setObj(result_type, res);
+	result->setObj(result_type, new SQLite3Result(stmt_obj, has_row));
 }
 
 // SQLite3::getLastId()
@@ -147,24 +385,15 @@ CLEVER_METHOD(SQLite3Type::prepare)
 	}
 
 	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
-	sqlite3_stmt* stmt;
+	sqlite3_stmt* stmt = conn->prepare(*args[0]->getStr());
 
-	if (sqlite3_prepare_v2(conn->handle,
-		args[0]->getStr()->c_str(),
-		args[0]->getStr()->size(),
-		&stmt,
-		NULL) != SQLITE_OK) {
+	if (stmt == NULL) {
 		clever_throw("An error occurred when preparing query: %s",
 			sqlite3_errmsg(conn->handle));
 		return;
 	}
 
-	SQLite3Stmt* stmt_obj = new SQLite3Stmt(stmt, conn);
-
-	conn->results.push_back(stmt_obj);
-	clever_addref(stmt_obj);
-
-	result->setObj(stmt_type, stmt_obj);
+	result->setObj(stmt_type, new SQLite3Stmt(stmt, conn, *args[0]->getStr()));
 }
 
 // SQLite3::close()
@@ -179,77 +408,141 @@ CLEVER_METHOD(SQLite3Type::close)
 	result->setBool(conn->close() == SQLITE_OK);
 }
 
-// SQLite3Stmt::bindValue(Int num, Objet value)
-CLEVER_METHOD(SQLite3TypeStmt::bindValue)
+// SQLite3::begin()
+CLEVER_METHOD(SQLite3Type::begin)
 {
-	if (!clever_check_args("i.")) {
+	if (!clever_check_no_args()) {
 		return;
 	}
 
-	SQLite3Stmt* stmt = clever_get_this(SQLite3Stmt*);
+	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
+
+	result->setBool(_sqlite_run(conn, "BEGIN"));
+}
+
+// SQLite3::commit()
+CLEVER_METHOD(SQLite3Type::commit)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
 
-	std::stringstream ss;
+	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
 
-	ss << ":" << args[0]->getInt();
+	result->setBool(_sqlite_run(conn, "COMMIT"));
+}
 
-	int nparam = sqlite3_bind_parameter_index(stmt->stmt, ss.str().c_str());
+// SQLite3::rollback()
+CLEVER_METHOD(SQLite3Type::rollback)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
 
-	stmt->bound_params.push_back(BoundParamPair(nparam, args[1]));
+	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
 
-	clever_addref(args[1]);
+	result->setBool(_sqlite_run(conn, "ROLLBACK"));
 }
 
-// SQLite3Stmt::execute()
-CLEVER_METHOD(SQLite3TypeStmt::execute)
+// SQLite3::inTransaction()
+CLEVER_METHOD(SQLite3Type::inTransaction)
 {
 	if (!clever_check_no_args()) {
 		return;
 	}
 
+	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
+
+	result->setBool(conn->handle && !sqlite3_get_autocommit(conn->handle));
+}
+
+// SQLite3::setCacheSize(Int size)
+CLEVER_METHOD(SQLite3Type::setCacheSize)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() < 0) {
+		clever_throw("Cache size must be a non-negative number");
+		return;
+	}
+
+	SQLite3Conn* conn = clever_get_this(SQLite3Conn*);
+
+	conn->cache.setCapacity(args[0]->getInt());
+}
+
+// SQLite3Stmt::bindValue(Int num, Objet value)
+CLEVER_METHOD(SQLite3TypeStmt::bindValue)
+{
+	if (!clever_check_args("ip")) {
+		return;
+	}
+
 	SQLite3Stmt* stmt = clever_get_this(SQLite3Stmt*);
 
-	std::vector<BoundParamPair>::const_iterator it(stmt->bound_params.begin()),
-		end(stmt->bound_params.end());
+	// Results of the last execution stop there, as with execute()
+	if (sqlite3_stmt_busy(stmt->stmt)) {
+		sqlite3_reset(stmt->stmt);
+		++stmt->generation;
+	}
 
-	for (; it != end; ++it) {
-		if (it->second->isInt()) {
-			sqlite3_bind_int64(stmt->stmt, it->first, it->second->getInt());
-		} else if (it->second->isStr()) {
-			sqlite3_bind_text(stmt->stmt, it->first,
-				it->second->getStr()->c_str(),
-				it->second->getStr()->size(), SQLITE_STATIC);
-		} else if (it->second->isDouble()) {
-			sqlite3_bind_double(stmt->stmt, it->first, it->second->getDouble());
-		} else if (it->second->isNull()) {
-			sqlite3_bind_null(stmt->stmt, it->first);
-		} else {
-			clever_throw("Unknown parameter type `%T'",
-				it->second->getType());
+	_sqlite_bind(stmt->stmt, stmt->getParamIndex(args[0]->getInt()),
+		args[1], clever);
+}
+
+// SQLite3Stmt::execute(...)
+CLEVER_METHOD(SQLite3TypeStmt::execute)
+{
+	if (!clever_check_args("*")) {
+		return;
+	}
+
+	SQLite3Stmt* stmt = clever_get_this(SQLite3Stmt*);
+
+	sqlite3_reset(stmt->stmt);
+	++stmt->generation;
+
+	// Arguments are bound to the parameters 1..N
+	for (size_t i = 0, n = args.size(); i < n; ++i) {
+		if (!_sqlite_bind(stmt->stmt, stmt->getParamIndex(i + 1), args[i], clever)) {
 			return;
 		}
 	}
 
+	bool has_row = false;
+
 	switch (sqlite3_step(stmt->stmt)) {
 		case SQLITE_ROW:
+			has_row = true;
+			break;
 		case SQLITE_DONE:
-			{
-				sqlite3_reset(stmt->stmt);
-				SQLite3Result* res = new SQLite3Result(stmt->stmt);
-
-				stmt->conn->results.push_back(res);
-				clever_addref(stmt);
-				clever_addref(res);
-
-				stmt->clear();
-
-				result->setObj(getParentType()->getResultType(), res);
-			}
 			break;
 		default:
 			sqlite3_reset(stmt->stmt);
 			result->setBool(false);
 			return;
 	}
+
+	clever_addref(stmt);
+
+	result->setObj(getParentType()->getResultType(),
+		new SQLite3Result(stmt, has_row));
+}
+
+// SQLite3Stmt::reset()
+CLEVER_METHOD(SQLite3TypeStmt::reset)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	SQLite3Stmt* stmt = clever_get_this(SQLite3Stmt*);
+
+	sqlite3_reset(stmt->stmt);
+	sqlite3_clear_bindings(stmt->stmt);
+	++stmt->generation;
 }
 
 // SQLite3Result::fetch()
@@ -260,21 +553,65 @@ CLEVER_METHOD(SQLite3TypeResult::fetch)
 	}
 
 	SQLite3Result* res = clever_get_this(SQLite3Result*);
-	int ret_code = sqlite3_step(res->stmt);
 
-	if (ret_code != SQLITE_ROW) {
+	if (!_sqlite_next_row(res)) {
 		result->setBool(false);
 		return;
 	}
 
-	MapObject* map = new MapObject;
+	result->setObj(CLEVER_MAP_TYPE, _sqlite_fetch_row(res->stmt));
+}
 
-	for (int i = 0, n = sqlite3_data_count(res->stmt); i < n; ++i) {
-		map->getData().insert(MapObjectPair(
-			sqlite3_column_name(res->stmt, i), _sqlite_to_value(res->stmt, i)));
+// SQLite3Result::fetchAll()
+CLEVER_METHOD(SQLite3TypeResult::fetchAll)
+{
+	if (!clever_check_no_args()) {
+		return;
 	}
 
-	result->setObj(CLEVER_MAP_TYPE, map);
+	SQLite3Result* res = clever_get_this(SQLite3Result*);
+	ArrayObject* array = new ArrayObject;
+
+	while (_sqlite_next_row(res)) {
+		Value* row = new Value;
+
+		row->setObj(CLEVER_MAP_TYPE, _sqlite_fetch_row(res->stmt));
+		array->getData().push_back(row);
+	}
+
+	result->setObj(CLEVER_ARRAY_TYPE, array);
+}
+
+// SQLite3Result::fetchBatch(Int size)
+CLEVER_METHOD(SQLite3TypeResult::fetchBatch)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() <= 0) {
+		clever_throw("Batch size must be a positive number");
+		return;
+	}
+
+	SQLite3Result* res = clever_get_this(SQLite3Result*);
+
+	if (!_sqlite_next_row(res)) {
+		result->setBool(false);
+		return;
+	}
+
+	ArrayObject* array = new ArrayObject;
+	long size = args[0]->getInt();
+
+	do {
+		Value* row = new Value;
+
+		row->setObj(CLEVER_MAP_TYPE, _sqlite_fetch_row(res->stmt));
+		array->getData().push_back(row);
+	} while (--size > 0 && _sqlite_next_row(res));
+
+	result->setObj(CLEVER_ARRAY_TYPE, array);
 }
 
 // SQLite3Result::finalize()
@@ -286,7 +623,11 @@ CLEVER_METHOD(SQLite3TypeResult::finalize)
 
 	SQLite3Result* res = clever_get_this(SQLite3Result*);
 
-	sqlite3_reset(res->stmt);
+	if (res->isCurrent()) {
+		sqlite3_reset(res->stmt->stmt);
+	}
+	res->has_row = false;
+	res->done = true;
 }
 
 // SQLite3 type initialization
@@ -294,11 +635,16 @@ CLEVER_TYPE_INIT(SQLite3Type::init)
 {
 	setConstructor((MethodPtr)&SQLite3Type::ctor);
 
-	addMethod(new Function("exec",      (MethodPtr)&SQLite3Type::exec));
-	addMethod(new Function("query",     (MethodPtr)&SQLite3Type::query));
-	addMethod(new Function("prepare",   (MethodPtr)&SQLite3Type::prepare));
-	addMethod(new Function("getLastId", (MethodPtr)&SQLite3Type::getLastId));
-	addMethod(new Function("close",     (MethodPtr)&SQLite3Type::close));
+	addMethod(new Function("exec",          (MethodPtr)&SQLite3Type::exec));
+	addMethod(new Function("query",         (MethodPtr)&SQLite3Type::query));
+	addMethod(new Function("prepare",       (MethodPtr)&SQLite3Type::prepare));
+	addMethod(new Function("getLastId",     (MethodPtr)&SQLite3Type::getLastId));
+	addMethod(new Function("close",         (MethodPtr)&SQLite3Type::close));
+	addMethod(new Function("begin",         (MethodPtr)&SQLite3Type::begin));
+	addMethod(new Function("commit",        (MethodPtr)&SQLite3Type::commit));
+	addMethod(new Function("rollback",      (MethodPtr)&SQLite3Type::rollback));
+	addMethod(new Function("inTransaction", (MethodPtr)&SQLite3Type::inTransaction));
+	addMethod(new Function("setCacheSize",  (MethodPtr)&SQLite3Type::setCacheSize));
 }
 
 // SQLite3Stmt type initialization
@@ -306,13 +652,16 @@ CLEVER_TYPE_INIT(SQLite3TypeStmt::init)
 {
 	addMethod(new Function("bindValue", (MethodPtr)&SQLite3TypeStmt::bindValue));
 	addMethod(new Function("execute",   (MethodPtr)&SQLite3TypeStmt::execute));
+	addMethod(new Function("reset",     (MethodPtr)&SQLite3TypeStmt::reset));
 }
 
 // SQLite3Stmt type initialization
 CLEVER_TYPE_INIT(SQLite3TypeResult::init)
 {
-	addMethod(new Function("fetch",    (MethodPtr)&SQLite3TypeResult::fetch));
-	addMethod(new Function("finalize", (MethodPtr)&SQLite3TypeResult::finalize));
+	addMethod(new Function("fetch",      (MethodPtr)&SQLite3TypeResult::fetch));
+	addMethod(new Function("fetchAll",   (MethodPtr)&SQLite3TypeResult::fetchAll));
+	addMethod(new Function("fetchBatch", (MethodPtr)&SQLite3TypeResult::fetchBatch));
+	addMethod(new Function("finalize",   (MethodPtr)&SQLite3TypeResult::finalize));
 }
 
 }}} // clever::modules::std
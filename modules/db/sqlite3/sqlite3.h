@@ -8,8 +8,15 @@
 #ifndef CLEVER_DB_SQLITE3_H
 #define CLEVER_DB_SQLITE3_H
 
+#include <list>
 #include <utility>
 #include <string>
+#include <vector>
+#ifdef CLEVER_MSVC
+#include <unordered_map>
+#else
+#include <tr1/unordered_map>
+#endif
 #include <sqlite3.h>
 #include "core/type.h"
 #include "core/module.h"
@@ -18,42 +25,49 @@
 namespace clever { namespace modules { namespace db {
 
 class SQLite3Type;
-struct SQLite3Conn;
 
-struct SQLite3Result : public TypeObject {
-	SQLite3Result(sqlite3_stmt* stmt_)
-		: stmt(stmt_) {}
+// Default number of idle prepared statements kept per connection
+#define CLEVER_SQLITE3_STMT_CACHE_SIZE 32
 
-	~SQLite3Result() {
-		sqlite3_finalize(stmt);
+/**
+ * LRU cache of idle prepared statements, keyed by their SQL text
+ */
+class SQLite3StmtCache {
+public:
+	typedef std::pair<std::string, sqlite3_stmt*> Entry;
+	typedef std::list<Entry> EntryList;
+#ifdef CLEVER_MSVC
+	typedef std::unordered_map<std::string, EntryList::iterator> EntryMap;
+#else
+	typedef std::tr1::unordered_map<std::string, EntryList::iterator> EntryMap;
+#endif
+
+	SQLite3StmtCache()
+		: m_capacity(CLEVER_SQLITE3_STMT_CACHE_SIZE) {}
+
+	~SQLite3StmtCache() {
+		clear();
 	}
 
-	sqlite3_stmt* stmt;
-};
+	/// Removes and returns the cached statement for sql, or NULL
+	sqlite3_stmt* acquire(const std::string& sql);
 
-typedef std::pair<int, Value*> BoundParamPair;
+	/// Gives back a statement; it is finalized when it cannot be cached
+	void release(const std::string& sql, sqlite3_stmt* stmt);
 
-struct SQLite3Stmt : public TypeObject {
-	SQLite3Stmt(sqlite3_stmt* stmt_, SQLite3Conn* conn_)
-		: stmt(stmt_), conn(conn_) {}
-
-	~SQLite3Stmt() {
-		sqlite3_finalize(stmt);
-	}
+	/// Finalizes every cached statement
+	void clear();
 
-	void clear() {
-		std::vector<BoundParamPair>::const_iterator it(bound_params.begin()),
-			end(bound_params.end());
+	void setCapacity(size_t capacity);
 
-		for (; it != end; ++it) {
-			clever_delref(it->second);
-		}
-		bound_params.clear();
-	}
+	size_t getCapacity() const { return m_capacity; }
+	size_t size() const { return m_entries.size(); }
+private:
+	EntryList m_entries;
+	EntryMap m_index;
+	size_t m_capacity;
 
-	sqlite3_stmt* stmt;
-	SQLite3Conn* conn;
-	std::vector<BoundParamPair> bound_params;
+	DISALLOW_COPY_AND_ASSIGN(SQLite3StmtCache);
 };
 
 struct SQLite3Conn : public TypeObject {
@@ -64,12 +78,20 @@ struct SQLite3Conn : public TypeObject {
 		close();
 	}
 
+	/// Returns a ready-to-run statement for sql, reusing a cached one if any
+	sqlite3_stmt* prepare(const std::string& sql);
+
+	/// Returns a statement obtained from prepare() back to the cache
+	void release(const std::string& sql, sqlite3_stmt* stmt);
+
 	int close() {
 		int result = SQLITE_OK;
 
 		if (handle) {
-			std::for_each(results.begin(), results.end(), clever_delref);
-			result = sqlite3_close(handle);
+			cache.clear();
+			// Statements still referenced by script objects keep the
+			// handle alive until they are finalized
+			result = sqlite3_close_v2(handle);
 			handle = NULL;
 		}
 
@@ -80,8 +102,63 @@ struct SQLite3Conn : public TypeObject {
 	std::string fname;
 	// SQLite3 db handle
 	sqlite3* handle;
-	// Vector of results
-	std::vector<TypeObject*> results;
+	// Idle prepared statements
+	SQLite3StmtCache cache;
+};
+
+// Column name and index, sorted by name so rows can be built in order
+typedef std::pair<std::string, int> SQLite3Column;
+
+struct SQLite3Stmt : public TypeObject {
+	SQLite3Stmt(sqlite3_stmt* stmt_, SQLite3Conn* conn_, const std::string& sql_)
+		: stmt(stmt_), conn(conn_), sql(sql_), generation(0),
+			has_positions(false), has_columns(false) {
+		clever_addref(conn);
+	}
+
+	~SQLite3Stmt() {
+		conn->release(sql, stmt);
+		clever_delref(conn);
+	}
+
+	/// Maps the positional parameter number to its bind index
+	int getParamIndex(long num);
+
+	/// Returns the result columns, computed once per statement
+	const std::vector<SQLite3Column>& getColumns();
+
+	sqlite3_stmt* stmt;
+	SQLite3Conn* conn;
+	std::string sql;
+	// Bumped on every execution, invalidating older results
+	size_t generation;
+	std::vector<int> positions;
+	std::vector<SQLite3Column> columns;
+	bool has_positions;
+	bool has_columns;
+};
+
+struct SQLite3Result : public TypeObject {
+	SQLite3Result(SQLite3Stmt* stmt_, bool has_row_)
+		: stmt(stmt_), generation(stmt_->generation),
+			has_row(has_row_), done(!has_row_) {}
+
+	~SQLite3Result() {
+		if (isCurrent()) {
+			sqlite3_reset(stmt->stmt);
+		}
+		clever_delref(stmt);
+	}
+
+	/// Whether the statement was not executed again since this result
+	bool isCurrent() const { return generation == stmt->generation; }
+
+	SQLite3Stmt* stmt;
+	size_t generation;
+	// A row was already stepped to and not fetched yet
+	bool has_row;
+	// No more rows to fetch
+	bool done;
 };
 
 class SQLite3TypeResult : public Type {
@@ -97,6 +174,8 @@ public:
 
 	// Methods
 	CLEVER_METHOD(fetch);
+	CLEVER_METHOD(fetchAll);
+	CLEVER_METHOD(fetchBatch);
 	CLEVER_METHOD(finalize);
 private:
 	const SQLite3Type* m_sqlite3_type;
@@ -116,6 +195,7 @@ public:
 	// Methods
 	CLEVER_METHOD(bindValue);
 	CLEVER_METHOD(execute);
+	CLEVER_METHOD(reset);
 private:
 	const SQLite3Type* m_sqlite3_type;
 };
@@ -142,6 +222,11 @@ public:
 	CLEVER_METHOD(prepare);
 	CLEVER_METHOD(getLastId);
 	CLEVER_METHOD(close);
+	CLEVER_METHOD(begin);
+	CLEVER_METHOD(commit);
+	CLEVER_METHOD(rollback);
+	CLEVER_METHOD(inTransaction);
+	CLEVER_METHOD(setCacheSize);
 };
 
 }}} // clever::modules::db
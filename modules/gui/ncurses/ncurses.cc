@@ -13,7 +13,7 @@
 namespace clever { namespace modules { namespace gui {
 
 // Simple constructor for now
-TypeObject* NCurses::allocData(const ::std::vector<Value*>* args) const
+TypeObject* NCurses::allocData(const ValueSpan* args) const
 {
 	size_t n_args = args->size();
 
@@ -287,7 +287,7 @@ CLEVER_METHOD(NCurses::getKeyName)
 	if (!clever_check_args("i")) {
 		return;
 	}
-	result->setStr(&m_keys[args.at(0)->getInt()]);
+	result->setStr(CSTRING(m_keys[args.at(0)->getInt()]));
 }
 
 CLEVER_METHOD(NCurses::box)
@@ -76,7 +76,7 @@ public:
 
 	virtual void init();
 
-	TypeObject* allocData(const ::std::vector<Value*>*) const;
+	TypeObject* allocData(const ValueSpan*) const;
 
 	CLEVER_METHOD(ctor);
 
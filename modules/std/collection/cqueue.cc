@@ -8,6 +8,7 @@
 
 #include "core/vm.h"
 #include "core/value.h"
+#include "core/cexception.h"
 #include "modules/std/core/function.h"
 #include "modules/std/collection/cqueue.h"
 
@@ -121,44 +122,91 @@ CLEVER_TYPE_INIT(CQueue::init)
 
 /**************************PriorityQueue***************************************/
 
-bool ComparisonFunctor::operator()(Value* lhs, Value* rhs) const
+void CPQObject::push(const OrderedEntry& entry)
 {
-	clever_addref(lhs);
-	clever_addref(rhs);
+	size_t pos = heap.size();
 
-	// Prepares the function call
-	::std::vector<Value*> args;
-	args.push_back(lhs);
-	args.push_back(rhs);
+	heap.push_back(entry);
 
-	// Makes the function call and store its return value
-	Value* result = const_cast<VM*>(m_vm)->runFunction(m_function, args);
-	bool ret = result ? result->asBool() : false;
+	// Moves the parents ordered before the entry down
+	while (pos > 0) {
+		size_t parent = (pos - 1) / CLEVER_PQ_ARITY;
 
-	// result isn't needed anymore
-	clever_delref(result);
-	clever_delref(lhs);
-	clever_delref(rhs);
+		if (!order.less(heap[parent].key, entry.key)) {
+			break;
+		}
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
 
-	return ret;
+	heap[pos] = entry;
+}
+
+OrderedEntry CPQObject::pop()
+{
+	OrderedEntry top = heap.front();
+	OrderedEntry last = heap.back();
+	size_t size = heap.size() - 1;
+	size_t pos = 0;
+
+	heap.pop_back();
+
+	if (size == 0) {
+		return top;
+	}
+
+	// Moves the greatest child up until last fits
+	while (true) {
+		size_t child = pos * CLEVER_PQ_ARITY + 1;
+
+		if (child >= size) {
+			break;
+		}
+
+		size_t end = child + CLEVER_PQ_ARITY < size ? child + CLEVER_PQ_ARITY : size;
+		size_t greatest = child;
+
+		for (++child; child < end; ++child) {
+			if (order.less(heap[greatest].key, heap[child].key)) {
+				greatest = child;
+			}
+		}
+
+		if (!order.less(last.key, heap[greatest].key)) {
+			break;
+		}
+		heap[pos] = heap[greatest];
+		pos = greatest;
+	}
+
+	heap[pos] = last;
+
+	return top;
 }
 
 // PriorityQueue.new()
+// PriorityQueue.new(Function compare)
+// PriorityQueue.new(Function key, PriorityQueue.KEY)
+// The top is the greatest element: natively ordered without arguments,
+// ordered by the results of the key function, or as told by compare(a, b)
+// returning whether a goes before b
 CLEVER_METHOD(CPQueue::ctor)
 {
-	if (!clever_check_args("f")) {
+	if (!clever_check_args("|fi")) {
 		return;
 	}
 
-	const Function* comp = static_cast<Function*>(args[0]->getObj());
+	if (args.empty()) {
+		result->setObj(this, new CPQObject);
+		return;
+	}
 
-	if (comp->getNumRequiredArgs() < 2) {
-		clever_throw("Compare function must expect at least two arguments");
+	if (!check_order_args(args, clever)) {
 		return;
 	}
 
-	result->setObj(this,
-		new CPQObject(static_cast<Function*>(args[0]->getObj()), clever->vm));
+	result->setObj(this, new CPQObject(static_cast<Function*>(args[0]->getObj()),
+		args.size() > 1 ? ValueOrder::Mode(args[1]->getInt()) : ValueOrder::COMPARE));
 }
 
 // PriorityQueue.empty()
@@ -169,7 +217,17 @@ CLEVER_METHOD(CPQueue::empty)
 	}
 
 	const CPQObject* cobj = clever_get_this(CPQObject*);
-	result->setBool(cobj->m_pq.empty());
+	result->setBool(cobj->heap.empty());
+}
+
+// PriorityQueue.size()
+CLEVER_METHOD(CPQueue::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(CPQObject*)->heap.size());
 }
 
 // PriorityQueue.push(Object element)
@@ -180,7 +238,30 @@ CLEVER_METHOD(CPQueue::push)
 	}
 
 	CPQObject* cobj = clever_get_this(CPQObject*);
-	cobj->m_pq.push(args[0]->clone());
+	Value* element = args[0]->clone();
+
+	cobj->order.setVM(clever->vm);
+
+	Value* key = cobj->order.makeKey(element);
+
+	if (key == NULL) {
+		clever_delref(element);
+
+		if (cobj->order.getMode() == ValueOrder::KEY) {
+			clever_throw("Key function must return null, a Bool, a number or a String");
+		} else {
+			clever_throw("Cannot order values of type %T without a compare function",
+				args[0]->getType());
+		}
+		return;
+	}
+
+	if (key == element) {
+		// makeKey() returned another reference to the element
+		clever_delref(element);
+	}
+
+	cobj->push(OrderedEntry(key, element));
 }
 
 // PriorityQueue.pop()
@@ -192,9 +273,9 @@ CLEVER_METHOD(CPQueue::pop)
 
 	CPQObject* cobj = clever_get_this(CPQObject*);
 
-	if (!cobj->m_pq.empty()) {
-		clever_delref(cobj->m_pq.top());
-		cobj->m_pq.pop();
+	if (!cobj->heap.empty()) {
+		cobj->order.setVM(clever->vm);
+		cobj->pop().release();
 	}
 }
 
@@ -209,8 +290,8 @@ CLEVER_METHOD(CPQueue::top)
 
 	result->setNull();
 
-	if (!cobj->m_pq.empty()) {
-		result->copy(cobj->m_pq.top());
+	if (!cobj->heap.empty()) {
+		result->copy(cobj->heap.front().element);
 	}
 }
 
@@ -222,9 +303,13 @@ CLEVER_TYPE_INIT(CPQueue::init)
 	setConstructor((MethodPtr)&CPQueue::ctor);
 
 	addMethod(new Function("empty", (MethodPtr)&CPQueue::empty));
+	addMethod(new Function("size",  (MethodPtr)&CPQueue::size));
 	addMethod(new Function("push",  (MethodPtr)&CPQueue::push));
 	addMethod(new Function("pop",   (MethodPtr)&CPQueue::pop));
 	addMethod(new Function("top",   (MethodPtr)&CPQueue::top));
+
+	addProperty("KEY",     new Value(long(ValueOrder::KEY),     true));
+	addProperty("COMPARE", new Value(long(ValueOrder::COMPARE), true));
 }
 
 }}} // clever::modules::std
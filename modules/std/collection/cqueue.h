@@ -9,56 +9,42 @@
 #define CLEVER_STD_QUEUE_H
 
 #include <queue>
+#include <vector>
 #include "core/type.h"
+#include "modules/std/collection/order.h"
 
 namespace clever { namespace modules { namespace std {
 
-/**
- * This class is used by the PQ to perform comparisons its between elements.
- */
-struct ComparisonFunctor {
-public:
-	ComparisonFunctor(Function* function, const VM* vm)
-	: m_function(function), m_vm(vm) {
-		clever_addref(m_function);
-	}
+// Children per node of the priority queue heap; a wider heap is shallower
+// and its children share cache lines
+#define CLEVER_PQ_ARITY 4
 
-	ComparisonFunctor(const ComparisonFunctor& other)
-	: m_function(other.m_function), m_vm(other.m_vm) {
-		clever_addref(m_function);
-	}
+struct CPQObject : public TypeObject {
+	CPQObject() {}
 
-	bool operator()(Value* lhs, Value* rhs) const;
+	CPQObject(Function* func, ValueOrder::Mode mode)
+		: order(func, mode) {}
 
-	~ComparisonFunctor() {
-		clever_delref(m_function);
+	~CPQObject() {
+		for (size_t i = 0, n = heap.size(); i < n; ++i) {
+			heap[i].release();
+		}
 	}
-private:
-	Function* m_function;
-	const VM* m_vm;
-};
 
-struct CPQObject : public TypeObject {
-	typedef ::std::priority_queue<Value*, ::std::vector<Value*>,
-		ComparisonFunctor> PQType;
+	/// Adds the entry, taking its references
+	void push(const OrderedEntry& entry);
 
-	CPQObject(Function* func, const VM* vm)
-	: m_pq(ComparisonFunctor(func, vm)) {}
+	/// Removes the top entry, returning it with its references
+	OrderedEntry pop();
 
-	~CPQObject() {
-		// TODO(muriloadriano): investigate why this causes SIGSEGV
-		//while (!m_pq.empty()) {
-		//  clever_delref(m_pq.top());
-		//	m_pq.pop();
-		//}
-	}
+	ValueOrder order;
 
-	PQType m_pq;
+	// d-ary max-heap: the top is the element no other orders after
+	::std::vector<OrderedEntry> heap;
 private:
 	DISALLOW_COPY_AND_ASSIGN(CPQObject);
 };
 
-
 class CPQueue : public Type {
 public:
 	CPQueue()
@@ -71,6 +57,7 @@ public:
 	// Methods
 	CLEVER_METHOD(ctor);
 	CLEVER_METHOD(empty);
+	CLEVER_METHOD(size);
 	CLEVER_METHOD(push);
 	CLEVER_METHOD(pop);
 	CLEVER_METHOD(top);
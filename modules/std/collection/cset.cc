@@ -6,8 +6,7 @@
  */
 
 #include <ostream>
-#include <vector>
-#include <algorithm>
+#include <sstream>
 #include "core/vm.h"
 #include "core/cexception.h"
 #include "modules/std/core/function.h"
@@ -18,7 +17,7 @@ namespace clever { namespace modules { namespace std {
 ::std::string CSet::toString(TypeObject* value) const
 {
 	CSetObject* cobj = static_cast<CSetObject*>(value);
-	::std::set<CSetValue>::const_iterator it(cobj->set.begin()), end(cobj->set.end());
+	CSetObject::SetType::const_iterator it(cobj->set.begin()), end(cobj->set.end());
 	::std::ostringstream out;
 
 	out << "Set<";
@@ -36,60 +35,53 @@ namespace clever { namespace modules { namespace std {
 	return out.str();
 }
 
-bool CSetObjectCompare::operator()(const CSetValue& a, const CSetValue& b) const
+// Creates an empty set ordered like model
+CSetObject* CSet::newResult(const CSetObject* model) const
 {
-	::std::vector<Value*> args;
-
-	args.push_back(a.element);
-	args.push_back(b.element);
-
-	Value* result = const_cast<VM*>(a.vm)->runFunction(a.comp, args);
-
-	bool ret = result ? result->asBool() : false;
-
-	clever_delref(result);
-
-	return ret;
+	if (model->order.getMode() == ValueOrder::NATURAL) {
+		return new CSetObject;
+	}
+	return new CSetObject(model->order.getFunction(), model->order.getMode());
 }
 
-bool operator<(const CSetValue& a, const CSetValue& b)
+// Checks that a and b are ordered alike, as the set operations look up the
+// entries of one set in the other by its keys
+static bool _check_same_order(const CSetObject* a, const CSetObject* b,
+	Clever* clever)
 {
-	::std::vector<Value*> args;
-
-	args.push_back(a.element);
-	args.push_back(b.element);
-
-	Value* result = const_cast<VM*>(a.vm)->runFunction(a.comp, args);
-
-	bool ret = result ? result->asBool() : false;
-
-	clever_delref(result);
-
-	return ret;
+	if (!a->order.sameAs(b->order)) {
+		clever_throw("Cannot combine sets with different orderings");
+		return false;
+	}
+	return true;
 }
 
 // Set.union(a, b)
 CLEVER_TYPE_OPERATOR(CSet::add)
 {
+	if (UNEXPECTED(rhs->getType() != this)) {
+		return;
+	}
+
 	CSetObject* a = clever_get_object(CSetObject*, lhs);
 	CSetObject* b = clever_get_object(CSetObject*, rhs);
-	CSetObject* c = new CSetObject(a->comp);
 
-	::std::set<CSetValue, CSetObjectCompare>::iterator
-			it = a->set.begin(), end = a->set.end();
-
-	while (it != end) {
-		c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
-		++it;
+	if (!_check_same_order(a, b, clever)) {
+		return;
 	}
 
-	it = b->set.begin(), end = b->set.end();
+	CSetObject* c = newResult(a);
 
-	while (it != end) {
-		if (c->set.find(CSetValue(it->element, it->comp, it->vm)) == c->set.end()) {
-			c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
-		}
-		++it;
+	c->order.setVM(clever->vm);
+
+	CSetObject::SetType::const_iterator it = a->set.begin(), end = a->set.end();
+
+	for (; it != end; ++it) {
+		c->share(*it);
+	}
+
+	for (it = b->set.begin(), end = b->set.end(); it != end; ++it) {
+		c->share(*it);
 	}
 
 	result->setObj(this, c);
@@ -98,18 +90,28 @@ CLEVER_TYPE_OPERATOR(CSet::add)
 // Set.intersection(a, b)
 CLEVER_TYPE_OPERATOR(CSet::mul)
 {
+	if (UNEXPECTED(rhs->getType() != this)) {
+		return;
+	}
+
 	CSetObject* a = clever_get_object(CSetObject*, lhs);
 	CSetObject* b = clever_get_object(CSetObject*, rhs);
-	CSetObject* c = new CSetObject(a->comp);
 
-	::std::set<CSetValue, CSetObjectCompare>::iterator
-			it = a->set.begin(), end = a->set.end();
+	if (!_check_same_order(a, b, clever)) {
+		return;
+	}
 
-	while (it != end) {
-		if (b->set.find(CSetValue(it->element, it->comp, it->vm)) != b->set.end()) {
-			c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
+	CSetObject* c = newResult(a);
+
+	b->order.setVM(clever->vm);
+	c->order.setVM(clever->vm);
+
+	CSetObject::SetType::const_iterator it = a->set.begin(), end = a->set.end();
+
+	for (; it != end; ++it) {
+		if (b->set.find(*it) != b->set.end()) {
+			c->share(*it);
 		}
-		++it;
 	}
 
 	result->setObj(this, c);
@@ -118,18 +120,28 @@ CLEVER_TYPE_OPERATOR(CSet::mul)
 // Set.diference(a, b)
 CLEVER_TYPE_OPERATOR(CSet::sub)
 {
+	if (UNEXPECTED(rhs->getType() != this)) {
+		return;
+	}
+
 	CSetObject* a = clever_get_object(CSetObject*, lhs);
 	CSetObject* b = clever_get_object(CSetObject*, rhs);
-	CSetObject* c = new CSetObject(a->comp);
 
-	::std::set<CSetValue, CSetObjectCompare>::iterator
-			it = a->set.begin(), end = a->set.end();
+	if (!_check_same_order(a, b, clever)) {
+		return;
+	}
 
-	while (it != end) {
-		if (b->set.find(CSetValue(it->element, it->comp, it->vm)) == b->set.end()) {
-			c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
+	CSetObject* c = newResult(a);
+
+	b->order.setVM(clever->vm);
+	c->order.setVM(clever->vm);
+
+	CSetObject::SetType::const_iterator it = a->set.begin(), end = a->set.end();
+
+	for (; it != end; ++it) {
+		if (b->set.find(*it) == b->set.end()) {
+			c->share(*it);
 		}
-		++it;
 	}
 
 	result->setObj(this, c);
@@ -138,59 +150,97 @@ CLEVER_TYPE_OPERATOR(CSet::sub)
 // Set.symetrical_diference(a, b) [(a-b) U (b-a)]
 CLEVER_TYPE_OPERATOR(CSet::div)
 {
+	if (UNEXPECTED(rhs->getType() != this)) {
+		return;
+	}
+
 	CSetObject* a = clever_get_object(CSetObject*, lhs);
 	CSetObject* b = clever_get_object(CSetObject*, rhs);
-	CSetObject* c = new CSetObject(a->comp);
 
-	::std::set<CSetValue, CSetObjectCompare>::iterator
-			it = a->set.begin(), end = a->set.end();
+	if (!_check_same_order(a, b, clever)) {
+		return;
+	}
 
-	while (it != end) {
-		if (b->set.find(CSetValue(it->element, it->comp, it->vm)) == b->set.end()) {
-			c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
+	CSetObject* c = newResult(a);
+
+	a->order.setVM(clever->vm);
+	b->order.setVM(clever->vm);
+	c->order.setVM(clever->vm);
+
+	CSetObject::SetType::const_iterator it = a->set.begin(), end = a->set.end();
+
+	for (; it != end; ++it) {
+		if (b->set.find(*it) == b->set.end()) {
+			c->share(*it);
 		}
-		++it;
 	}
 
-	it = b->set.begin(), end = b->set.end();
-
-	while (it != end) {
-		if (a->set.find(CSetValue(it->element, it->comp, it->vm)) == a->set.end()) {
-			c->set.insert(CSetValue(it->element->clone(), it->comp, it->vm));
+	for (it = b->set.begin(), end = b->set.end(); it != end; ++it) {
+		if (a->set.find(*it) == a->set.end()) {
+			c->share(*it);
 		}
-		++it;
 	}
 
 	result->setObj(this, c);
 }
 
-// Set.Set(Function compare)
+// Set.new()
+// Set.new(Function compare)
+// Set.new(Function key, Set.KEY)
+// Without arguments null, booleans, numbers and strings are ordered natively;
+// a key function is called once per element and its results are ordered
+// natively; a compare function is called for every comparison
 CLEVER_METHOD(CSet::ctor)
 {
-	if (!clever_check_args("f")) {
+	if (!clever_check_args("|fi")) {
 		return;
 	}
 
-	const Function* comp = static_cast<Function*>(args[0]->getObj());
+	if (args.empty()) {
+		result->setObj(this, new CSetObject);
+		return;
+	}
 
-	if (comp->getNumRequiredArgs() < 2) {
-		clever_throw("Compare function must expect at least two arguments");
+	if (!check_order_args(args, clever)) {
 		return;
 	}
 
-	result->setObj(this, new CSetObject(comp));
+	result->setObj(this, new CSetObject(static_cast<Function*>(args[0]->getObj()),
+		args.size() > 1 ? ValueOrder::Mode(args[1]->getInt()) : ValueOrder::COMPARE));
 }
 
 // Set.insert(Object element)
 CLEVER_METHOD(CSet::insert)
 {
-	if (!clever_check_args(".")) {
+	if (!clever_check_args("p")) {
 		return;
 	}
 
 	CSetObject* cobj = clever_get_this(CSetObject*);
+	Value* element = args[0]->clone();
 
-	cobj->set.insert(CSetValue(args[0]->clone(), cobj->comp, clever->vm));
+	cobj->order.setVM(clever->vm);
+
+	Value* key = cobj->order.makeKey(element);
+
+	if (key == NULL) {
+		clever_delref(element);
+
+		if (cobj->order.getMode() == ValueOrder::KEY) {
+			clever_throw("Key function must return null, a Bool, a number or a String");
+		} else {
+			clever_throw("Cannot order values of type %T without a compare function",
+				args[0]->getType());
+		}
+		return;
+	}
+
+	if (key == element) {
+		// makeKey() returned another reference to the element
+		clever_delref(element);
+	}
+
+	cobj->insert(OrderedEntry(key, element));
 }
 
 // Set.size()
@@ -218,16 +268,28 @@ CLEVER_METHOD(CSet::empty)
 }
 
 // Set.find(Object value)
+// Returns the element equivalent to value, or false; with a key function,
+// value is looked up by its key
 CLEVER_METHOD(CSet::find)
 {
-	if (!clever_check_args(".")) {
+	if (!clever_check_args("p")) {
 		return;
 	}
 
-	const CSetObject* cobj = clever_get_this(CSetObject*);
+	CSetObject* cobj = clever_get_this(CSetObject*);
+
+	cobj->order.setVM(clever->vm);
 
-	::std::set<CSetValue, CSetObjectCompare>::const_iterator it(
-		cobj->set.find(CSetValue(args[0], cobj->comp, clever->vm)));
+	Value* key = cobj->order.makeKey(args[0]);
+
+	if (key == NULL) {
+		result->setBool(false);
+		return;
+	}
+
+	CSetObject::SetType::const_iterator it(cobj->set.find(OrderedEntry(key, key)));
+
+	clever_delref(key);
 
 	if (it != cobj->set.end()) {
 		result->copy(it->element);
@@ -245,6 +307,155 @@ CLEVER_TYPE_INIT(CSet::init)
 	addMethod(new Function("size",   (MethodPtr)&CSet::size));
 	addMethod(new Function("empty",  (MethodPtr)&CSet::empty));
 	addMethod(new Function("find",   (MethodPtr)&CSet::find));
+
+	addProperty("KEY",     new Value(long(ValueOrder::KEY),     true));
+	addProperty("COMPARE", new Value(long(ValueOrder::COMPARE), true));
+}
+
+/**************************HashSet*********************************************/
+
+::std::string CHashSet::toString(TypeObject* value) const
+{
+	CHashSetObject* cobj = static_cast<CHashSetObject*>(value);
+	CHashSetObject::SetType::const_iterator it(cobj->set.begin()), end(cobj->set.end());
+	::std::ostringstream out;
+
+	out << "HashSet<";
+
+	while (it != end) {
+		(*it)->dump(out);
+
+		if (++it != end) {
+			out<< ", ";
+		}
+	}
+
+	out << ">";
+
+	return out.str();
+}
+
+// HashSet.new()
+// Set of null, booleans, numbers and strings compared by equality only
+CLEVER_METHOD(CHashSet::ctor)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setObj(this, new CHashSetObject);
+}
+
+// Bool HashSet.insert(Object element)
+// Returns false when an equal element was already in the set
+CLEVER_METHOD(CHashSet::insert)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	if (!ValueOrder::isComparable(args[0])) {
+		clever_throw("Cannot hash values of type %T", args[0]->getType());
+		return;
+	}
+
+	CHashSetObject* cobj = clever_get_this(CHashSetObject*);
+
+	if (cobj->set.find(args[0]) != cobj->set.end()) {
+		result->setBool(false);
+		return;
+	}
+
+	cobj->set.insert(args[0]->clone());
+	result->setBool(true);
+}
+
+// Bool HashSet.contains(Object value)
+CLEVER_METHOD(CHashSet::contains)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	const CHashSetObject* cobj = clever_get_this(CHashSetObject*);
+
+	result->setBool(ValueOrder::isComparable(args[0])
+		&& cobj->set.find(args[0]) != cobj->set.end());
+}
+
+// HashSet.find(Object value)
+// Returns the element equal to value, or false
+CLEVER_METHOD(CHashSet::find)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	const CHashSetObject* cobj = clever_get_this(CHashSetObject*);
+	CHashSetObject::SetType::const_iterator it;
+
+	if (ValueOrder::isComparable(args[0])
+		&& (it = cobj->set.find(args[0])) != cobj->set.end()) {
+		result->copy(*it);
+	} else {
+		result->setBool(false);
+	}
+}
+
+// Bool HashSet.remove(Object value)
+// Returns whether the element was in the set
+CLEVER_METHOD(CHashSet::remove)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	CHashSetObject* cobj = clever_get_this(CHashSetObject*);
+	CHashSetObject::SetType::iterator it;
+
+	if (ValueOrder::isComparable(args[0])
+		&& (it = cobj->set.find(args[0])) != cobj->set.end()) {
+		Value* element = *it;
+
+		cobj->set.erase(it);
+		clever_delref(element);
+		result->setBool(true);
+	} else {
+		result->setBool(false);
+	}
+}
+
+// Int HashSet.size()
+CLEVER_METHOD(CHashSet::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(CHashSetObject*)->set.size());
+}
+
+// Bool HashSet.empty()
+CLEVER_METHOD(CHashSet::empty)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setBool(clever_get_this(CHashSetObject*)->set.empty());
+}
+
+// HashSet type initialization
+CLEVER_TYPE_INIT(CHashSet::init)
+{
+	setConstructor((MethodPtr)&CHashSet::ctor);
+
+	addMethod(new Function("insert",   (MethodPtr)&CHashSet::insert));
+	addMethod(new Function("contains", (MethodPtr)&CHashSet::contains));
+	addMethod(new Function("find",     (MethodPtr)&CHashSet::find));
+	addMethod(new Function("remove",   (MethodPtr)&CHashSet::remove));
+	addMethod(new Function("size",     (MethodPtr)&CHashSet::size));
+	addMethod(new Function("empty",    (MethodPtr)&CHashSet::empty));
 }
 
 }}} // clever::modules::std
@@ -9,40 +9,52 @@
 #define CLEVER_STD_SET_H
 
 #include <set>
+#include <tr1/unordered_set>
 #include "core/type.h"
+#include "modules/std/collection/order.h"
 
 namespace clever { namespace modules { namespace std {
 
-struct CSetValue {
-	CSetValue(Value* elem, const Function* func_, const VM* vm_)
-		: element(elem), comp(func_), vm(vm_) {}
-
-	~CSetValue() {}
-
-	Value* element;
-	const Function* comp;
-	const VM* vm;
-};
+struct CSetObject : public TypeObject {
+	typedef ::std::set<OrderedEntry, OrderedEntryLess> SetType;
 
-struct CSetObjectCompare {
-	bool operator()(const CSetValue& a, const CSetValue& b) const;
-};
+	CSetObject()
+		: set(OrderedEntryLess(&order)) {}
 
-struct CSetObject : public TypeObject {
-	CSetObject(const Function* func)
-		: comp(func) {}
+	CSetObject(Function* func, ValueOrder::Mode mode)
+		: order(func, mode), set(OrderedEntryLess(&order)) {}
 
 	~CSetObject() {
-		::std::set<CSetValue, CSetObjectCompare>::const_iterator it(set.begin()),
-			end(set.end());
+		SetType::const_iterator it(set.begin()), end(set.end());
 
 		for (; it != end; ++it) {
-			clever_delref(it->element);
+			it->release();
+		}
+	}
+
+	/// Inserts the entry, taking its references; returns false and releases
+	/// them when an equivalent element is already there
+	bool insert(const OrderedEntry& entry) {
+		if (!set.insert(entry).second) {
+			entry.release();
+			return false;
+		}
+		return true;
+	}
+
+	/// Inserts another reference to an entry of a set with the same ordering
+	void share(const OrderedEntry& entry) {
+		if (entry.key != entry.element) {
+			clever_addref(entry.key);
 		}
+		clever_addref(entry.element);
+		insert(entry);
 	}
 
-	::std::set<CSetValue, CSetObjectCompare> set;
-	const Function* comp;
+	ValueOrder order;
+	SetType set;
+private:
+	DISALLOW_COPY_AND_ASSIGN(CSetObject);
 };
 
 class CSet : public Type {
@@ -69,9 +81,53 @@ public:
 	CLEVER_TYPE_OPERATOR(div);
 
 private:
+	CSetObject* newResult(const CSetObject* model) const;
+
 	DISALLOW_COPY_AND_ASSIGN(CSet);
 };
 
+/* HashSet */
+
+struct CHashSetObject : public TypeObject {
+	typedef ::std::tr1::unordered_set<Value*, ValueHash, ValueEqual> SetType;
+
+	CHashSetObject() {}
+
+	~CHashSetObject() {
+		SetType::const_iterator it(set.begin()), end(set.end());
+
+		for (; it != end; ++it) {
+			clever_delref(*it);
+		}
+	}
+
+	SetType set;
+private:
+	DISALLOW_COPY_AND_ASSIGN(CHashSetObject);
+};
+
+class CHashSet : public Type {
+public:
+	CHashSet()
+		: Type("HashSet") {}
+
+	~CHashSet() {}
+
+	virtual void init();
+	virtual ::std::string toString(TypeObject*) const;
+
+	// Methods
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(insert);
+	CLEVER_METHOD(contains);
+	CLEVER_METHOD(find);
+	CLEVER_METHOD(remove);
+	CLEVER_METHOD(size);
+	CLEVER_METHOD(empty);
+private:
+	DISALLOW_COPY_AND_ASSIGN(CHashSet);
+};
+
 }}} // clever::modules::std
 
 #endif // CLEVER_STD_SET_H
@@ -18,6 +18,7 @@ CLEVER_MODULE_INIT(CollectionModule)
 	addType(new CQueue);
 	addType(new CPQueue);
 	addType(new CSet);
+	addType(new CHashSet);
 }
 
 }}} // clever::modules::std
@@ -0,0 +1,168 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <climits>
+#include <tr1/functional>
+#include "core/cexception.h"
+#include "modules/std/core/str.h"
+#include "modules/std/collection/order.h"
+
+namespace clever { namespace modules { namespace std {
+
+Value* ValueOrder::makeKey(Value* element) const
+{
+	if (m_mode == KEY) {
+		Value* key = const_cast<VM*>(m_vm)->runFunction(m_func, ValueSpan(&element, 1));
+
+		if (!isComparable(key)) {
+			clever_delref(key);
+			return NULL;
+		}
+		return key;
+	}
+
+	if (m_mode == NATURAL && !isComparable(element)) {
+		return NULL;
+	}
+
+	clever_addref(element);
+
+	return element;
+}
+
+bool ValueOrder::callCompare(const Value* a, const Value* b) const
+{
+	m_args[0] = const_cast<Value*>(a);
+	m_args[1] = const_cast<Value*>(b);
+
+	const_cast<VM*>(m_vm)->runFunction(m_func, ValueSpan(m_args, 2), m_result);
+
+	return m_result->asBool();
+}
+
+// Position of each kind of value in the natural ordering
+static inline int _value_rank(const Value* value)
+{
+	if (value->isNull()) {
+		return 0;
+	} else if (value->isBool()) {
+		return 1;
+	} else if (value->isStr()) {
+		return 3;
+	}
+	return 2;
+}
+
+// Compares x with y exactly: converting x to double would make distinct
+// Ints above 2^53 equal to the same Double, disagreeing with hash()
+static int _compare_int_double(long x, double y)
+{
+	if (y != y) {
+		return -1;
+	} else if (y >= -double(LONG_MIN)) {
+		return -1;
+	} else if (y < double(LONG_MIN)) {
+		return 1;
+	}
+
+	long t = static_cast<long>(y);
+
+	if (x != t) {
+		return x < t ? -1 : 1;
+	}
+	// Only the dropped fraction is left
+	return double(t) < y ? -1 : (double(t) > y ? 1 : 0);
+}
+
+int ValueOrder::compare(const Value* a, const Value* b)
+{
+	int rank = _value_rank(a);
+
+	if (rank != _value_rank(b)) {
+		return rank < _value_rank(b) ? -1 : 1;
+	}
+
+	switch (rank) {
+		case 1:
+			return int(a->getBool()) - int(b->getBool());
+
+		case 2:
+			if (a->isInt() && b->isInt()) {
+				long x = a->getInt(), y = b->getInt();
+
+				return x < y ? -1 : (x > y ? 1 : 0);
+			} else if (a->isInt()) {
+				return _compare_int_double(a->getInt(), b->getDouble());
+			} else if (b->isInt()) {
+				return -_compare_int_double(b->getInt(), a->getDouble());
+			} else {
+				double x = a->getDouble(), y = b->getDouble();
+
+				// NaN is after every other number, so that the order stays
+				// total (NaN never compares less, greater or equal)
+				if (x != x || y != y) {
+					return int(x != x) - int(y != y);
+				}
+				return x < y ? -1 : (x > y ? 1 : 0);
+			}
+
+		case 3:
+			return a->getStr()->compare(*b->getStr());
+	}
+
+	return 0;
+}
+
+size_t ValueOrder::hash(const Value* value)
+{
+	if (value->isInt()) {
+		return ::std::tr1::hash<long>()(value->getInt());
+	} else if (value->isDouble()) {
+		double num = value->getDouble();
+
+		// Every NaN is the same key
+		if (num != num) {
+			return 3;
+		}
+		// Integral doubles hash as the equal Int
+		if (num >= double(LONG_MIN) && num < double(LONG_MAX)
+			&& static_cast<long>(num) == num) {
+			return ::std::tr1::hash<long>()(static_cast<long>(num));
+		}
+		return ::std::tr1::hash<double>()(num);
+	} else if (value->isStr()) {
+		return static_cast<const StrObject*>(value->getObj())->hash();
+	} else if (value->isBool()) {
+		return value->getBool() ? 2 : 1;
+	}
+	return 0;
+}
+
+bool check_order_args(ValueSpan args, Clever* clever)
+{
+	const Function* func = static_cast<Function*>(args[0]->getObj());
+	long mode = args.size() > 1 ? args[1]->getInt() : ValueOrder::COMPARE;
+
+	if (mode == ValueOrder::KEY) {
+		if (func->getNumRequiredArgs() > 1) {
+			clever_throw("Key function must expect a single argument");
+			return false;
+		}
+	} else if (mode == ValueOrder::COMPARE) {
+		if (func->getNumRequiredArgs() < 2) {
+			clever_throw("Compare function must expect at least two arguments");
+			return false;
+		}
+	} else {
+		clever_throw("Invalid ordering mode");
+		return false;
+	}
+
+	return true;
+}
+
+}}} // clever::modules::std
@@ -0,0 +1,139 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_ORDER_H
+#define CLEVER_STD_ORDER_H
+
+#include "core/value.h"
+#include "core/vm.h"
+#include "modules/std/core/function.h"
+
+namespace clever { namespace modules { namespace std {
+
+/**
+ * Element stored by the ordered collections
+ *
+ * key is what the element is ordered by; it is the element itself unless a
+ * key function is used. Both references are owned by the entry holder.
+ */
+struct OrderedEntry {
+	OrderedEntry(Value* key_, Value* element_)
+		: key(key_), element(element_) {}
+
+	/// Releases the references held by the entry
+	void release() const {
+		if (key != element) {
+			clever_delref(key);
+		}
+		clever_delref(element);
+	}
+
+	Value* key;
+	Value* element;
+};
+
+/**
+ * Ordering used by Set and PriorityQueue
+ *
+ * NATURAL compares null, booleans, numbers and strings natively; KEY calls a
+ * script function once per element and compares the results natively;
+ * COMPARE calls a script comparator for every comparison.
+ */
+class ValueOrder {
+public:
+	enum Mode { NATURAL, KEY, COMPARE };
+
+	ValueOrder()
+		: m_mode(NATURAL), m_func(NULL), m_vm(NULL), m_result(NULL) {}
+
+	ValueOrder(Function* func, Mode mode)
+		: m_mode(mode), m_func(func), m_vm(NULL), m_result(new Value) {
+		clever_addref(m_func);
+	}
+
+	~ValueOrder() {
+		if (m_func) {
+			clever_delref(m_func);
+			clever_delref(m_result);
+		}
+	}
+
+	Mode getMode() const { return m_mode; }
+	Function* getFunction() const { return m_func; }
+
+	/// Whether both orderings use the same mode and function
+	bool sameAs(const ValueOrder& other) const {
+		return m_mode == other.m_mode && m_func == other.m_func;
+	}
+
+	/// Sets the VM running the script functions
+	void setVM(const VM* vm) { m_vm = vm; }
+
+	/// Returns a new reference to the key of element, or NULL when it
+	/// cannot be ordered
+	Value* makeKey(Value* element) const;
+
+	bool less(const Value* a, const Value* b) const {
+		return m_mode == COMPARE ? callCompare(a, b) : compare(a, b) < 0;
+	}
+
+	/// Whether value can be compared by compare()
+	static bool isComparable(const Value* value) {
+		return value->isNull() || value->isBool() || value->isInt()
+			|| value->isDouble() || value->isStr();
+	}
+
+	/// Natural ordering: null, then booleans, numbers (NaN last) and strings
+	static int compare(const Value* a, const Value* b);
+
+	/// Hash consistent with compare() equality
+	static size_t hash(const Value* value);
+private:
+	bool callCompare(const Value* a, const Value* b) const;
+
+	Mode m_mode;
+	Function* m_func;
+	const VM* m_vm;
+
+	/// Comparator arguments and result, reused by every call
+	mutable Value* m_args[2];
+	Value* m_result;
+
+	DISALLOW_COPY_AND_ASSIGN(ValueOrder);
+};
+
+/// Strict weak ordering of entries by their keys
+struct OrderedEntryLess {
+	OrderedEntryLess(const ValueOrder* order_)
+		: order(order_) {}
+
+	bool operator()(const OrderedEntry& a, const OrderedEntry& b) const {
+		return order->less(a.key, b.key);
+	}
+
+	const ValueOrder* order;
+};
+
+/// Checks the (Function, mode) arguments of an ordered collection
+/// constructor, throwing and returning false when they are invalid
+bool check_order_args(ValueSpan args, Clever* clever);
+
+struct ValueHash {
+	size_t operator()(const Value* value) const {
+		return ValueOrder::hash(value);
+	}
+};
+
+struct ValueEqual {
+	bool operator()(const Value* a, const Value* b) const {
+		return ValueOrder::compare(a, b) == 0;
+	}
+};
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_ORDER_H
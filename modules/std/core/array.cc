@@ -9,6 +9,7 @@
 #include "core/vm.h"
 #include "modules/std/core/array.h"
 #include "modules/std/core/function.h"
+#include "modules/std/core/str.h"
 
 namespace clever {
 
@@ -195,6 +196,56 @@ CLEVER_METHOD(ArrayType::reverse)
 	result->setObj(this, new ArrayObject(rev));
 }
 
+// String Array::join([String separator])
+// Returns the elements of this array joined by separator
+CLEVER_METHOD(ArrayType::join)
+{
+	if (!clever_check_args("|s")) {
+		return;
+	}
+
+	const ValueVector& vec = clever_get_this(ArrayObject*)->getData();
+	const CString* sep = args.empty() ? NULL : args[0]->getStr();
+	size_t total = 0;
+
+	// Pre-computes the final size when the array only holds strings
+	for (size_t i = 0, n = vec.size(); i < n; ++i) {
+		if (vec[i] && vec[i]->isStr()) {
+			total += vec[i]->getStr()->size();
+		}
+	}
+	if (sep && !vec.empty()) {
+		total += sep->size() * (vec.size() - 1);
+	}
+
+	StrObject* str = new StrObject;
+	CString& buffer = str->getBuffer();
+
+	buffer.reserve(total);
+
+	for (size_t i = 0, n = vec.size(); i < n; ++i) {
+		const Value* val = vec[i];
+
+		if (i && sep) {
+			buffer.append(*sep);
+		}
+
+		if (val == NULL || val->isNull()) {
+			buffer.append("null", 4);
+		} else if (val->isStr()) {
+			buffer.append(*val->getStr());
+		} else if (val->isInt()) {
+			append_number(buffer, val->getInt());
+		} else if (val->isDouble()) {
+			append_number(buffer, val->getDouble());
+		} else {
+			buffer.append(val->toString());
+		}
+	}
+
+	result->setStr(str);
+}
+
 // mixed Array.shift()
 // Removes and returns the first element of the array
 CLEVER_METHOD(ArrayType::shift)
@@ -286,19 +337,272 @@ CLEVER_METHOD(ArrayType::each)
 
 	Function* func = static_cast<Function*>(args[0]->getObj());
 	ValueVector& vec = clever_get_this(ArrayObject*)->getData();
+	ArrayObject* arr = new ArrayObject;
+	ValueVector& results = arr->getData();
+
+	results.reserve(vec.size());
+
+	for (size_t i = 0, j = vec.size(); i < j; ++i) {
+		Value* arg = vec[i];
+
+		results.push_back(new Value);
+
+		const_cast<VM*>(clever->vm)->runFunction(func, ValueSpan(&arg, 1), results.back());
+	}
+
+	result->setObj(this, arr);
+}
+
+// State shared by the threads of a parallel operation: chunks of the array
+// are handed out in order and each one writes only its own result slots
+struct ParallelTask {
+	enum Kind { MAP, FILTER, REDUCE };
+
+	ParallelTask(Kind kind_, const ValueVector& data_)
+		: kind(kind_), func(NULL), data(data_), chunk(0), next(0) {}
+
+	Kind kind;
+	const Function* func;
+	const ValueVector& data;
+	size_t chunk;
+	size_t next;
+	CMutex lock;
+	Value null_value;
+
+	/// Callback results of MAP, one per element, or of REDUCE, one per chunk
 	ValueVector results;
 
+	/// Whether each element passed the FILTER callback
+	::std::vector<char> keep;
+};
+
+struct ParallelWorker {
+	ParallelTask* task;
+	VM* vm;
+	CThread thread;
+};
+
+// Evaluates chunks of the task on vm until there are none left
+static void _run_chunks(VM* vm, ParallelTask* task)
+{
+	const ValueVector& data = task->data;
+	size_t size = data.size();
+	Value* args[2];
+	Value* retval = new Value;
+
+	while (true) {
+		task->lock.lock();
+		size_t start = task->next;
+
+		if (start < size) {
+			task->next += task->chunk;
+		}
+		task->lock.unlock();
+
+		if (start >= size) {
+			break;
+		}
+
+		size_t end = ::std::min(start + task->chunk, size);
+
+		switch (task->kind) {
+			case ParallelTask::MAP:
+				for (size_t i = start; i < end; ++i) {
+					args[0] = data[i] ? data[i] : &task->null_value;
+
+					task->results[i] = vm->runFunction(task->func, ValueSpan(args, 1));
+				}
+				break;
+
+			case ParallelTask::FILTER:
+				for (size_t i = start; i < end; ++i) {
+					args[0] = data[i] ? data[i] : &task->null_value;
+
+					vm->runFunction(task->func, ValueSpan(args, 1), retval);
+					task->keep[i] = retval->asBool();
+				}
+				break;
+
+			case ParallelTask::REDUCE:
+				{
+					// The accumulator and retval swap roles after each call
+					Value* acc = (data[start] ? data[start] : &task->null_value)->clone();
+
+					for (size_t i = start + 1; i < end; ++i) {
+						args[0] = acc;
+						args[1] = data[i] ? data[i] : &task->null_value;
+
+						vm->runFunction(task->func, ValueSpan(args, 2), retval);
+						::std::swap(acc, retval);
+					}
+					task->results[start / task->chunk] = acc;
+				}
+				break;
+		}
+	}
+
+	clever_delref(retval);
+}
+
+static CLEVER_THREAD_FUNC(_parallel_worker)
+{
+	ParallelWorker* worker = static_cast<ParallelWorker*>(arg);
+
+	_run_chunks(worker->vm, worker->task);
+
+	return 0;
+}
+
+// Runs the task with the callback in args[0] on the calling VM plus up to
+// threads-1 copies of it, each in its own thread; optional (Int chunk,
+// Int threads) arguments start at args[first] and default to four chunks
+// per available processor
+static bool _run_parallel(ParallelTask& task, ValueSpan args, size_t first,
+	Clever* clever)
+{
+	size_t size = task.data.size();
+	size_t threads = CThread::getNumCPUs();
+	size_t chunk = 0;
+
+	if (args.size() > first) {
+		if (args[first]->getInt() <= 0) {
+			clever_throw("Chunk size must be greater than zero");
+			return false;
+		}
+		chunk = args[first]->getInt();
+	}
+
+	if (args.size() > first + 1) {
+		if (args[first + 1]->getInt() <= 0) {
+			clever_throw("Number of threads must be greater than zero");
+			return false;
+		}
+		threads = args[first + 1]->getInt();
+	}
+
+	if (chunk == 0) {
+		chunk = ::std::max(size / (threads * 4), size_t(1));
+	}
+
+	size_t nchunks = (size + chunk - 1) / chunk;
+
+	task.func = static_cast<Function*>(args[0]->getObj());
+	task.chunk = chunk;
+
+	switch (task.kind) {
+		case ParallelTask::MAP:    task.results.resize(size);    break;
+		case ParallelTask::FILTER: task.keep.resize(size);       break;
+		case ParallelTask::REDUCE: task.results.resize(nchunks); break;
+	}
+
+	::std::vector<ParallelWorker*> workers;
+
+#ifdef CLEVER_THREADS
+	for (size_t i = 1, n = ::std::min(threads, nchunks); i < n; ++i) {
+		ParallelWorker* worker = new ParallelWorker;
+
+		worker->task = &task;
+		worker->vm = new VM(*clever->vm);
+		worker->thread.create(_parallel_worker, worker);
+
+		workers.push_back(worker);
+	}
+#endif
+
+	_run_chunks(const_cast<VM*>(clever->vm), &task);
+
+	for (size_t i = 0, n = workers.size(); i < n; ++i) {
+		workers[i]->thread.wait();
+
+		delete workers[i]->vm;
+		delete workers[i];
+	}
+
+	return true;
+}
+
+// Array Array::parallelMap(Function callback [, Int chunk [, Int threads]])
+// Like each(), but the array is split into chunks of consecutive elements
+// that are evaluated concurrently on copies of the VM; the results keep the
+// order of the array, which must not be changed by callback
+CLEVER_METHOD(ArrayType::parallelMap)
+{
+	if (!clever_check_args("f|ii")) {
+		return;
+	}
+
+	ParallelTask task(ParallelTask::MAP, clever_get_this(ArrayObject*)->getData());
+
+	if (!_run_parallel(task, args, 1, clever)) {
+		return;
+	}
+
+	ArrayObject* arr = new ArrayObject;
+
+	arr->getData().swap(task.results);
+
+	result->setObj(this, arr);
+}
+
+// Array Array::parallelFilter(Function callback [, Int chunk [, Int threads]])
+// Returns the elements for which callback returns a true value, in the
+// order of the array; callback is evaluated as in parallelMap()
+CLEVER_METHOD(ArrayType::parallelFilter)
+{
+	if (!clever_check_args("f|ii")) {
+		return;
+	}
+
+	ValueVector& vec = clever_get_this(ArrayObject*)->getData();
+	ParallelTask task(ParallelTask::FILTER, vec);
+
+	if (!_run_parallel(task, args, 1, clever)) {
+		return;
+	}
+
+	ArrayObject* arr = new ArrayObject;
+
 	for (size_t i = 0, j = vec.size(); i < j; ++i) {
-		ValueVector tmp_args;
+		if (task.keep[i]) {
+			arr->pushValue(vec[i]);
+		}
+	}
+
+	result->setObj(this, arr);
+}
+
+// mixed Array::parallelReduce(Function callback, mixed initial [, Int chunk [, Int threads]])
+// Folds each chunk with callback(accumulator, element) concurrently, then
+// folds initial and the chunk results in order on the calling VM; callback
+// must therefore be associative
+CLEVER_METHOD(ArrayType::parallelReduce)
+{
+	if (!clever_check_args("fp|ii")) {
+		return;
+	}
 
-		tmp_args.push_back(vec[i]);
+	ParallelTask task(ParallelTask::REDUCE, clever_get_this(ArrayObject*)->getData());
 
-		results.push_back(const_cast<VM*>(clever->vm)->runFunction(func, tmp_args));
+	if (!_run_parallel(task, args, 2, clever)) {
+		return;
 	}
 
-	result->setObj(this, new ArrayObject(results));
+	const ValueVector& results = task.results;
+	Value* call_args[2];
+
+	result->copy(args[1]);
+
+	for (size_t i = 0, j = results.size(); i < j; ++i) {
+		Value* acc = result->clone();
 
-	std::for_each(results.begin(), results.end(), clever_delref);
+		call_args[0] = acc;
+		call_args[1] = results[i];
+
+		const_cast<VM*>(clever->vm)->runFunction(task.func, ValueSpan(call_args, 2), result);
+
+		clever_delref(acc);
+		clever_delref(results[i]);
+	}
 }
 
 // mixed Array.erase(Int position)
@@ -361,10 +665,14 @@ CLEVER_TYPE_INIT(ArrayType::init)
 	addMethod(new Function("reserve", (MethodPtr)&ArrayType::reserve));
 	addMethod(new Function("reverse", (MethodPtr)&ArrayType::reverse));
 	addMethod(new Function("each",    (MethodPtr)&ArrayType::each));
+	addMethod(new Function("parallelMap",    (MethodPtr)&ArrayType::parallelMap));
+	addMethod(new Function("parallelFilter", (MethodPtr)&ArrayType::parallelFilter));
+	addMethod(new Function("parallelReduce", (MethodPtr)&ArrayType::parallelReduce));
 	addMethod(new Function("shift",   (MethodPtr)&ArrayType::shift));
 	addMethod(new Function("pop",     (MethodPtr)&ArrayType::pop));
 	addMethod(new Function("range",   (MethodPtr)&ArrayType::range));
 	addMethod(new Function("erase",	  (MethodPtr)&ArrayType::erase));
+	addMethod(new Function("join",    (MethodPtr)&ArrayType::join));
 
 	addMethod(new Function("begin",	  (MethodPtr)&ArrayType::begin));
 	addMethod(new Function("end",	  (MethodPtr)&ArrayType::end));
@@ -20,7 +20,7 @@ class ArrayObject : public TypeObject {
 public:
 	ArrayObject() {}
 
-	explicit ArrayObject(const std::vector<Value*>& args) {
+	explicit ArrayObject(ValueSpan args) {
 		append(args);
 	}
 
@@ -28,7 +28,7 @@ public:
 		std::for_each(m_data.begin(), m_data.end(), clever_delref);
 	}
 
-	void append(const std::vector<Value*>& args) {
+	void append(ValueSpan args) {
 		for (size_t i = 0, n = args.size(); i < n; ++i) {
 			pushValue(args[i]);
 		}
@@ -131,10 +131,14 @@ public:
 	CLEVER_METHOD(reserve);
 	CLEVER_METHOD(reverse);
 	CLEVER_METHOD(each);
+	CLEVER_METHOD(parallelMap);
+	CLEVER_METHOD(parallelFilter);
+	CLEVER_METHOD(parallelReduce);
 	CLEVER_METHOD(shift);
 	CLEVER_METHOD(pop);
 	CLEVER_METHOD(range);
 	CLEVER_METHOD(erase);
+	CLEVER_METHOD(join);
 
 	CLEVER_METHOD(begin);
 	CLEVER_METHOD(end);
@@ -40,6 +40,8 @@ CLEVER_MODULE_INIT(CoreModule)
 	addType(CLEVER_ARRAY_TYPE  = new ArrayType);
 	addType(CLEVER_MAP_TYPE    = new MapType);
 
+	addType(new StrBuilderType);
+
 	// Iterators
 	addType(CLEVER_ARRAYITER_TYPE = new ArrayIterator);
 }
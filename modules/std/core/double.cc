@@ -18,11 +18,13 @@ CLEVER_TYPE_OPERATOR(DoubleType::add)
 	} else if (rhs->isInt()) {
 		result->setDouble(lhs->getDouble() + rhs->getInt());
 	} else if (rhs->isStr()) {
-		std::stringstream ss;
+		StrObject* sobj = new StrObject;
+		CString& str = sobj->getBuffer();
 
-		ss << lhs->getDouble();
+		append_number(str, lhs->getDouble());
+		str.append(*rhs->getStr());
 
-		result->setStr(new StrObject(ss.str() + *rhs->getStr()));
+		result->setStr(sobj);
 	}
 }
 
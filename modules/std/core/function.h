@@ -19,7 +19,7 @@ namespace clever {
 class Value;
 class Scope;
 
-#define CLEVER_FUNCTION_ARGS      Value* result, const ValueVector& args, Clever* clever
+#define CLEVER_FUNCTION_ARGS      Value* result, ValueSpan args, Clever* clever
 #define CLEVER_FUNC_NAME(name)    clv_f_##name
 #define CLEVER_NS_FNAME(ns, name) ns::CLEVER_FUNC_NAME(name)
 #define CLEVER_FUNCTION(name)     void CLEVER_FASTCALL CLEVER_FUNC_NAME(name)(CLEVER_FUNCTION_ARGS)
@@ -20,11 +20,13 @@ CLEVER_TYPE_OPERATOR(IntType::add)
 	} else if (rhs->isDouble()) {
 		result->setDouble(lhs->getInt() + rhs->getDouble());
 	} else if (rhs->isStr()) {
-		std::stringstream ss;
+		StrObject* sobj = new StrObject;
+		CString& str = sobj->getBuffer();
 
-		ss << lhs->getInt();
+		append_number(str, lhs->getInt());
+		str.append(*rhs->getStr());
 
-		result->setStr(new StrObject(ss.str() + *rhs->getStr()));
+		result->setStr(sobj);
 	}
 }
 
@@ -27,9 +27,9 @@ public:
 	virtual void init();
 
 	virtual std::string toString(TypeObject* data) const {
-		std::ostringstream str;
-		str << static_cast<IntObject*>(data)->value;
-		return str.str();
+		std::string str;
+		append_number(str, static_cast<IntObject*>(data)->value);
+		return str;
 	}
 
 	CLEVER_TYPE_VIRTUAL_METHOD_DECLARATIONS;
@@ -117,18 +117,17 @@ CLEVER_METHOD(MapType::each)
 	ValueMap::const_iterator it(map.begin()), end(map.end());
 	ValueVector results;
 
+	results.reserve(map.size() * 2);
+
 	while (it != end) {
-		Value* call[3];
-		ValueVector fargs;
+		Value* call[2];
 
-		call[0] = new Value(CSTRING(it->first));
+		call[0] = new Value(CLEVER_STR_TYPE);
+		call[0]->setStr(new StrObject(it->first));
 		call[1] = it->second;
 
-		fargs.push_back(call[0]);
-		fargs.push_back(call[1]);
-
 		results.push_back(call[0]);
-		results.push_back(call[2] = const_cast<VM*>(clever->vm)->runFunction(func, fargs));
+		results.push_back(const_cast<VM*>(clever->vm)->runFunction(func, ValueSpan(call, 2)));
 
 		++it;
 	}
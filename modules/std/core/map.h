@@ -22,7 +22,7 @@ class MapObject : public TypeObject{
 public:
 	MapObject() {}
 
-	MapObject(const ::std::vector<Value*>& args) {
+	MapObject(ValueSpan args) {
 		for (size_t i = 0, j = args.size(); i < j; i += 2) {
 			Value* val = new Value();
 
@@ -7,30 +7,225 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 #include <cstdio>
+#include <cstring>
 #include "modules/std/core/str.h"
 #include "modules/std/core/array.h"
 #include "core/compiler.h"
 #include "core/vm.h"
 #include "core/clever.h"
+#include "core/cthread.h"
 
 namespace clever {
 
+namespace {
+
+/// Shared objects for single character strings
+struct CharTable {
+	CharTable() {
+		for (size_t i = 0; i < 256; ++i) {
+			chars[i] = new StrObject(std::string(1, static_cast<char>(i)));
+		}
+	}
+
+	StrObject* chars[256];
+};
+
+} // namespace
+
+StrObject* StrObject::getChar(unsigned char c)
+{
+	static CharTable table;
+
+	return table.chars[c];
+}
+
+/// Builds the flat string of a rope node
+///
+/// The first reader claims the node, fills its buffer and publishes it with
+/// a release store; readers arriving meanwhile wait for it. Operands only
+/// held by this node are walked here, as no other thread can reach them;
+/// shared ones are flattened on their own, so that each node is walked by
+/// one thread and its operands can be released once it is flat.
+void StrObject::flatten() const
+{
+	if (!__sync_bool_compare_and_swap(&m_state, ROPE, BUILDING)) {
+		while (__atomic_load_n(&m_state, __ATOMIC_ACQUIRE) != FLAT) {
+			CThread::yield();
+		}
+		return;
+	}
+
+	CString* str = &m_buffer;
+	std::vector<const StrObject*> stack;
+
+	str->reserve(m_size);
+
+	stack.push_back(m_rhs);
+	stack.push_back(m_lhs);
+
+	// Left-to-right traversal without recursion, as ropes built by
+	// repeated concatenation can be arbitrarily deep
+	while (!stack.empty()) {
+		const StrObject* node = stack.back();
+		stack.pop_back();
+
+		if (__atomic_load_n(&node->m_state, __ATOMIC_ACQUIRE) == FLAT) {
+			str->append(*node->value);
+		} else if (node->refCount() == 1) {
+			stack.push_back(node->m_rhs);
+			stack.push_back(node->m_lhs);
+		} else {
+			str->append(*node->getStr());
+		}
+	}
+
+	__atomic_store_n(&m_state, FLAT, __ATOMIC_RELEASE);
+
+	releaseRope();
+}
+
+/// Releases the rope operands, detaching uniquely owned nodes first to
+/// avoid a recursive destructor chain
+void StrObject::releaseRope() const
+{
+	std::vector<StrObject*> pending;
+
+	pending.push_back(m_lhs);
+	pending.push_back(m_rhs);
+
+	m_lhs = m_rhs = NULL;
+
+	while (!pending.empty()) {
+		StrObject* node = pending.back();
+		pending.pop_back();
+
+		if (node->m_lhs && node->refCount() == 1) {
+			pending.push_back(node->m_lhs);
+			pending.push_back(node->m_rhs);
+
+			node->m_lhs = node->m_rhs = NULL;
+		}
+		node->delRef();
+	}
+}
+
+/// Returns the lhs buffer when it can be appended in place (s += x)
+static CString* get_append_buffer(const Value* result, const Value* lhs)
+{
+	StrObject* obj = static_cast<StrObject*>(lhs->getObj());
+
+	if (result == lhs && obj->refCount() == 1 && (obj->isRope() || obj->isOwned())) {
+		obj->getStr();
+		return &obj->getBuffer();
+	}
+	return NULL;
+}
+
+// Returns the first occurrence of needle in [begin, end), or NULL
+static const char* str_search(const char* begin, const char* end,
+	const char* needle, size_t nlen)
+{
+	if (nlen == 0) {
+		return begin;
+	}
+	if (nlen == 1) {
+		return static_cast<const char*>(::memchr(begin, needle[0], end - begin));
+	}
+
+	while (size_t(end - begin) >= nlen) {
+		const char* hit = static_cast<const char*>(
+			::memchr(begin, needle[0], end - begin - nlen + 1));
+
+		if (hit == NULL) {
+			return NULL;
+		}
+		if (::memcmp(hit + 1, needle + 1, nlen - 1) == 0) {
+			return hit;
+		}
+		begin = hit + 1;
+	}
+
+	return NULL;
+}
+
+// Creates a non-interned String value holding [begin, begin + len)
+static Value* str_piece(const char* begin, size_t len)
+{
+	Value* value = new Value;
+	StrObject* str;
+
+	if (len == 1) {
+		str = StrObject::getChar(*begin);
+		str->addRef();
+	} else {
+		str = new StrObject;
+		str->getBuffer().assign(begin, len);
+	}
+
+	value->setStr(str);
+
+	return value;
+}
+
+// Replaces up to max occurrences (0 for all) of needle in haystack
+static void str_replace(CString& out, const CString& haystack,
+	const CString& needle, const CString& replacement, size_t max)
+{
+	const char* pos = haystack.data();
+	const char* end = pos + haystack.size();
+	const char* hit;
+	size_t count = 0;
+
+	while ((max == 0 || count < max)
+		&& (hit = str_search(pos, end, needle.data(), needle.size())) != NULL) {
+		if (count++ == 0) {
+			out.reserve(haystack.size() + replacement.size());
+		}
+		out.append(pos, hit - pos);
+		out.append(replacement);
+		pos = hit + needle.size();
+	}
+
+	out.append(pos, end - pos);
+}
+
 // + operator
 CLEVER_TYPE_OPERATOR(StrType::add)
 {
+	CString* buffer = get_append_buffer(result, lhs);
+
 	if (EXPECTED(rhs->isStr())) {
-		result->setStr(*lhs->getStr() + *rhs->getStr());
-	} else if (rhs->isInt()) {
-		std::stringstream ss;
+		StrObject* lobj = static_cast<StrObject*>(lhs->getObj());
+		StrObject* robj = static_cast<StrObject*>(rhs->getObj());
+
+		if (buffer) {
+			buffer->append(*robj->getStr());
+		} else if (lobj->size() + robj->size() >= StrObject::ROPE_THRESHOLD) {
+			result->setStr(new StrObject(lobj, robj));
+		} else {
+			StrObject* sobj = new StrObject;
+			CString& str = sobj->getBuffer();
+
+			str.reserve(lobj->size() + robj->size());
+			str.append(*lobj->getStr()).append(*robj->getStr());
 
-		ss << rhs->getInt();
-		result->setStr(*lhs->getStr() + ss.str());
-	} else if (rhs->isDouble()) {
-		std::stringstream ss;
+			result->setStr(sobj);
+		}
+	} else if (rhs->isInt() || rhs->isDouble()) {
+		StrObject* sobj = buffer ? NULL : new StrObject(*lhs->getStr());
+		CString& str = buffer ? *buffer : sobj->getBuffer();
 
-		ss << rhs->getDouble();
-		result->setStr(*lhs->getStr() + ss.str());
+		if (rhs->isInt()) {
+			append_number(str, rhs->getInt());
+		} else {
+			append_number(str, rhs->getDouble());
+		}
+
+		if (sobj) {
+			result->setStr(sobj);
+		}
 	}
 }
 
@@ -38,13 +233,19 @@ CLEVER_TYPE_OPERATOR(StrType::add)
 CLEVER_TYPE_OPERATOR(StrType::mul)
 {
 	if (rhs->isInt()) {
-		std::ostringstream os;
+		const CString* str = lhs->getStr();
+		StrObject* sobj = new StrObject;
+		CString& buffer = sobj->getBuffer();
+
+		if (rhs->getInt() > 0) {
+			buffer.reserve(str->size() * rhs->getInt());
 
-		for (long i = 0, j = rhs->getInt(); i < j; ++i) {
-			os << *lhs->getStr();
+			for (long i = 0, j = rhs->getInt(); i < j; ++i) {
+				buffer.append(*str);
+			}
 		}
 
-		result->setStr(os.str());
+		result->setStr(sobj);
 	}
 }
 
@@ -106,8 +307,6 @@ CLEVER_TYPE_UNARY_OPERATOR(StrType::not_op)
 CLEVER_TYPE_AT_OPERATOR(StrType::at_op)
 {
 	const CString* data = obj->getStr();
-	Value* value = new Value(CLEVER_STR_TYPE);
-	char pos[2] = {0};
 
 	if (!index->isInt()) {
 		clever_throw("Invalid index type!");
@@ -116,14 +315,16 @@ CLEVER_TYPE_AT_OPERATOR(StrType::at_op)
 
 	long key = index->getInt();
 
-	if (key < 0 || size_t(key) > data->size()) {
+	if (key < 0 || size_t(key) >= data->size()) {
 		clever_throw("String access out of bounds!");
 		return NULL;
 	}
 
-	pos[0] = data->at(key);
+	StrObject* chr = StrObject::getChar((*data)[key]);
+	Value* value = new Value(CLEVER_STR_TYPE);
 
-	value->setStr(std::string(pos));
+	chr->addRef();
+	value->setStr(chr);
 
 	return value;
 }
@@ -135,7 +336,16 @@ CLEVER_METHOD(StrType::ctor)
 		return;
 	}
 
-	result->setStr(args.empty() ? CSTRING("") : args[0]->getStr());
+	if (args.empty()) {
+		result->setStr(CSTRING(""));
+		return;
+	}
+
+	// Strings are immutable once shared, so the argument is shared too
+	StrObject* str = static_cast<StrObject*>(args[0]->getObj());
+
+	str->addRef();
+	result->setStr(str);
 }
 
 // String.subString(int start, [int count])
@@ -391,12 +601,20 @@ CLEVER_METHOD(StrType::setChar)
 		return;
 	}
 
-	CString* data = const_cast<CString*>(clever_this()->getStr());
+	StrObject* sobj = clever_get_this(StrObject*);
 	const CString* str = args[1]->getStr();
 	long position = args[0]->getInt();
 
-	for (size_t i = position, j = 0; j < str->size() && i < data->size(); ++i, ++j) {
-		data->at(i) = str->at(j);
+	// Copy on write: shared and interned strings are never changed in place
+	if (!sobj->isMutable()) {
+		sobj = new StrObject(*sobj->getStr());
+		const_cast<Value*>(clever_this())->setStr(sobj);
+	}
+
+	CString& data = sobj->getBuffer();
+
+	for (size_t i = position, j = 0; j < str->size() && i < data.size(); ++i, ++j) {
+		data[i] = (*str)[j];
 	}
 }
 
@@ -409,7 +627,6 @@ CLEVER_METHOD(StrType::charAt)
 
 	const CString* data = clever_this()->getStr();
 	long position = args[0]->getInt();
-	char found[2];
 
 	if (!data) {
 		result->setNull();
@@ -417,13 +634,12 @@ CLEVER_METHOD(StrType::charAt)
 	}
 
 	if (position > -1L) {
-		if (data->size() > (unsigned long) position) {
-			found[0] = data->at(position);
-			found[1] = '\0';
-			if (found[0]) {
-				result->setStr(found);
-				return;
-			}
+		if (data->size() > (unsigned long) position && (*data)[position]) {
+			StrObject* chr = StrObject::getChar((*data)[position]);
+
+			chr->addRef();
+			result->setStr(chr);
+			return;
 		}
 		result->setNull();
 	} else {
@@ -449,41 +665,65 @@ CLEVER_METHOD(StrType::split)
 		return;
 	}
 
-	unsigned long maximum = 0;
-	if (args.size() > 1) {
-		if (args[1]->getInt()) {
-			maximum = args[1]->getInt();
-		}
+	size_t maximum = 0;
+	if (args.size() > 1 && args[1]->getInt() > 0) {
+		maximum = args[1]->getInt();
 	}
 
-	::std::vector<Value*> list;
-	const ::std::string* self = clever_this()->getStr();
+	ArrayObject* arr = new ArrayObject;
+	::std::vector<Value*>& list = arr->getData();
+	const CString* self = clever_this()->getStr();
 
-	if (self && self->length()) {
-		const ::std::string* delimit = args[0]->getStr();
-		size_t offset = 0;
+	if (self->size()) {
+		const CString* delimit = args[0]->getStr();
 
-		if (delimit && (offset=delimit->length())) {
-			::std::string buffer;
-			size_t last = 0;
+		if (delimit->size()) {
+			const char* pos = self->data();
+			const char* end = pos + self->size();
+			const char* hit;
 
-			for (size_t position = 0; position < self->length(); position++) {
-				if ((!maximum || (list.size() < maximum))) {
-					if ((last = self->find(delimit->c_str(), position)) == position) {
-						list.push_back(new Value(CSTRING(buffer)));
-						position = last + (offset-1);
-						buffer.clear();
-						continue;
-					}
-				}
-				buffer += self->at(position);
+			while ((!maximum || list.size() < maximum)
+				&& (hit = str_search(pos, end, delimit->data(), delimit->size())) != NULL) {
+				list.push_back(str_piece(pos, hit - pos));
+				pos = hit + delimit->size();
 			}
-			list.push_back(new Value(CSTRING(buffer)));
+			list.push_back(str_piece(pos, end - pos));
 		} else {
-			list.push_back(new Value(self));
+			list.push_back(str_piece(self->data(), self->size()));
+		}
+	}
+	result->setObj(CLEVER_ARRAY_TYPE, arr);
+}
+
+// String.splitLines()
+// Returns the lines of the string, without their line terminators
+CLEVER_METHOD(StrType::splitLines)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	ArrayObject* arr = new ArrayObject;
+	::std::vector<Value*>& list = arr->getData();
+	const CString* self = clever_this()->getStr();
+	const char* pos = self->data();
+	const char* end = pos + self->size();
+
+	while (pos < end) {
+		const char* eol = static_cast<const char*>(::memchr(pos, '\n', end - pos));
+		const char* next = eol ? eol + 1 : end;
+
+		if (eol == NULL) {
+			eol = end;
+		}
+		if (eol > pos && eol[-1] == '\r') {
+			--eol;
 		}
+
+		list.push_back(str_piece(pos, eol - pos));
+		pos = next;
 	}
-	result->setObj(CLEVER_ARRAY_TYPE, new ArrayObject(list));
+	result->setObj(CLEVER_ARRAY_TYPE, arr);
 }
 
 // String.toUpper()
@@ -526,15 +766,31 @@ CLEVER_METHOD(StrType::replace)
 		return;
 	}
 
-	const CString* haystack = clever_this()->getStr();
-	const CString* needle = args[0]->getStr();
-	::std::string buffer = *haystack;
-	size_t pos = haystack->find(needle->c_str());
+	StrObject* str = new StrObject;
+
+	str_replace(str->getBuffer(), *clever_this()->getStr(),
+		*args[0]->getStr(), *args[1]->getStr(), 1);
+	result->setStr(str);
+}
+
+// String.replaceAll(needle, replace)
+// Returns string with every occurrence of needle replaced
+CLEVER_METHOD(StrType::replaceAll)
+{
+	if (!clever_check_args("ss")) {
+		return;
+	}
 
-	if (pos != ::std::string::npos) {
-		buffer.replace(pos, needle->length(), args[1]->getStr()->c_str());
+	if (args[0]->getStr()->empty()) {
+		clever_throw("String.replaceAll expects a non-empty needle");
+		return;
 	}
-	result->setStr(buffer);
+
+	StrObject* str = new StrObject;
+
+	str_replace(str->getBuffer(), *clever_this()->getStr(),
+		*args[0]->getStr(), *args[1]->getStr(), 0);
+	result->setStr(str);
 }
 
 // String.toString
@@ -545,7 +801,10 @@ CLEVER_METHOD(StrType::toString)
 		return;
 	}
 
-	result->setStr(new StrObject(clever_this()->getStr()));
+	StrObject* str = clever_get_this(StrObject*);
+
+	str->addRef();
+	result->setStr(str);
 }
 
 CLEVER_TYPE_INIT(StrType::init)
@@ -562,9 +821,11 @@ CLEVER_TYPE_INIT(StrType::init)
 	addMethod(new Function("charAt",		(MethodPtr)&StrType::charAt));
 	addMethod(new Function("setChar",		(MethodPtr)&StrType::setChar));
 	addMethod(new Function("split",			(MethodPtr)&StrType::split));
+	addMethod(new Function("splitLines",	(MethodPtr)&StrType::splitLines));
 	addMethod(new Function("toUpper",		(MethodPtr)&StrType::toUpper));
 	addMethod(new Function("toLower",		(MethodPtr)&StrType::toLower));
 	addMethod(new Function("replace",		(MethodPtr)&StrType::replace));
+	addMethod(new Function("replaceAll",	(MethodPtr)&StrType::replaceAll));
 	addMethod(new Function("ltrim",         (MethodPtr)&StrType::ltrim));
 	addMethod(new Function("trim",          (MethodPtr)&StrType::trim));
 	addMethod(new Function("rtrim",         (MethodPtr)&StrType::rtrim));
@@ -572,4 +833,106 @@ CLEVER_TYPE_INIT(StrType::init)
 		->setStatic();
 }
 
+// StrBuilder::StrBuilder([int capacity])
+CLEVER_METHOD(StrBuilderType::ctor)
+{
+	if (!clever_check_args("|i")) {
+		return;
+	}
+
+	StrBuilderObject* sbobj = new StrBuilderObject;
+
+	if (!args.empty() && args[0]->getInt() > 0) {
+		sbobj->buffer.reserve(args[0]->getInt());
+	}
+
+	result->setObj(this, sbobj);
+}
+
+// void StrBuilder.append(mixed value, [...])
+// Appends the string representation of the arguments to the buffer
+CLEVER_METHOD(StrBuilderType::append)
+{
+	if (!clever_check_args("*")) {
+		return;
+	}
+
+	CString& buffer = clever_get_this(StrBuilderObject*)->buffer;
+
+	for (size_t i = 0, j = args.size(); i < j; ++i) {
+		const Value* value = args[i];
+
+		if (value->isStr()) {
+			buffer.append(*value->getStr());
+		} else if (value->isInt()) {
+			append_number(buffer, value->getInt());
+		} else if (value->isDouble()) {
+			append_number(buffer, value->getDouble());
+		} else {
+			buffer.append(value->toString());
+		}
+	}
+
+	result->setNull();
+}
+
+// int StrBuilder.size()
+// Returns the length of the string built so far
+CLEVER_METHOD(StrBuilderType::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(StrBuilderObject*)->buffer.size());
+}
+
+// void StrBuilder.reserve(int capacity)
+CLEVER_METHOD(StrBuilderType::reserve)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() > 0) {
+		clever_get_this(StrBuilderObject*)->buffer.reserve(args[0]->getInt());
+	}
+
+	result->setNull();
+}
+
+// void StrBuilder.clear()
+CLEVER_METHOD(StrBuilderType::clear)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	clever_get_this(StrBuilderObject*)->buffer.clear();
+
+	result->setNull();
+}
+
+// String StrBuilder.toString()
+// Returns the built string
+CLEVER_METHOD(StrBuilderType::toString)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setStr(new StrObject(clever_get_this(StrBuilderObject*)->buffer));
+}
+
+CLEVER_TYPE_INIT(StrBuilderType::init)
+{
+	setConstructor((MethodPtr)&StrBuilderType::ctor);
+
+	addMethod(new Function("append",   (MethodPtr)&StrBuilderType::append));
+	addMethod(new Function("size",     (MethodPtr)&StrBuilderType::size));
+	addMethod(new Function("reserve",  (MethodPtr)&StrBuilderType::reserve));
+	addMethod(new Function("clear",    (MethodPtr)&StrBuilderType::clear));
+	addMethod(new Function("toString", (MethodPtr)&StrBuilderType::toString));
+}
+
 } // clever
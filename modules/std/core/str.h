@@ -14,29 +14,129 @@
 
 namespace clever {
 
+/**
+ * @brief String storage
+ *
+ * A StrObject either shares an interned CString, owns its characters in an
+ * inline buffer (no extra heap object; short strings fit in the buffer's
+ * own small-string storage) or, when created by concatenation of large
+ * strings, holds a pair of operands (a rope node) that is only flattened
+ * when its contents are first requested.
+ *
+ * StrObjects are shared by reference counting, so copying a string value
+ * is just a reference bump; owned buffers are only changed in place when
+ * the object has a single owner. A rope node can be read by several
+ * threads at once: the first one flattens it and publishes the buffer
+ * (see flatten()), reads of a flat string take no lock.
+ */
 struct StrObject : public TypeObject {
 public:
-	StrObject(const CString* str)
-		: value(str), interned(true) {}
+	/// Minimum length of a concatenation result to be kept as a rope node
+	static const size_t ROPE_THRESHOLD = 256;
+
+	/// Empty owned string, to be filled through getBuffer()
+	StrObject()
+		: value(&m_buffer), m_lhs(NULL), m_rhs(NULL), m_size(0), m_hash(0),
+			m_state(FLAT) {}
 
-	StrObject(const CString* str, bool is_interned)
-		: value(str), interned(is_interned) {}
+	/// Shares an interned string (CSTRING()), which outlives the object;
+	/// the string of another StrObject must be copied or the object shared
+	StrObject(const CString* str)
+		: value(str), m_lhs(NULL), m_rhs(NULL), m_size(0), m_hash(0),
+			m_state(FLAT) {}
 
+	/// Owned copy of str
 	StrObject(const std::string& str)
-		: value(new CString(str)), interned(false) {}
+		: m_buffer(str), value(&m_buffer), m_lhs(NULL), m_rhs(NULL), m_size(0),
+			m_hash(0), m_state(FLAT) {}
+
+	/// Lazy concatenation of lhs and rhs
+	StrObject(StrObject* lhs, StrObject* rhs)
+		: value(&m_buffer), m_lhs(lhs), m_rhs(rhs),
+			m_size(lhs->size() + rhs->size()), m_hash(0), m_state(ROPE) {
+		clever_addref(m_lhs);
+		clever_addref(m_rhs);
+	}
 
 	~StrObject() {
-		if (!interned) {
-			delete value;
+		if (m_lhs) {
+			releaseRope();
+		}
+	}
+
+	/// Returns the flat string, building it first when this is a rope node
+	const CString* getStr() const {
+		// Acquire load, paired with the release store of flatten()
+		if (UNEXPECTED(__atomic_load_n(&m_state, __ATOMIC_ACQUIRE) != FLAT)) {
+			flatten();
+		}
+		return value;
+	}
+
+	size_t size() const { return m_size ? m_size : value->size(); }
+
+	/// Returns the string hash, computed on first use
+	size_t hash() const {
+		if (m_hash == 0) {
+			m_hash = std::tr1::hash<std::string>()(*getStr()) | 1;
 		}
+		return m_hash;
+	}
+
+	bool isRope() const { return m_lhs != NULL; }
+
+	/// Whether the characters are stored in the object itself
+	bool isOwned() const { return m_lhs == NULL && value == &m_buffer; }
+
+	/// Whether the string can be modified in place by its only owner
+	bool isMutable() const { return isOwned() && refCount() == 1; }
+
+	/// Returns the owned buffer for modification (see isMutable())
+	CString& getBuffer() {
+		clever_assert(isOwned(), "Modifying a shared string");
+		m_hash = 0;
+		m_size = 0;
+		return m_buffer;
 	}
 
+	/// Returns the shared object representing the single character c
+	static StrObject* getChar(unsigned char c);
+private:
+	enum State { FLAT, ROPE, BUILDING };
+
+	void flatten() const;
+	void releaseRope() const;
+
+	mutable CString m_buffer;
 	const CString* value;
-	bool interned;
+
+	mutable StrObject* m_lhs;
+	mutable StrObject* m_rhs;
+
+	// Length of a rope node, kept once it is flattened (until its only
+	// owner changes the buffer); 0 for other strings
+	size_t m_size;
+	mutable size_t m_hash;
+
+	// State of a rope node's buffer; FLAT for other strings
+	mutable int m_state;
 
 	DISALLOW_COPY_AND_ASSIGN(StrObject);
 };
 
+/**
+ * @brief Mutable string buffer for incremental string building
+ */
+struct StrBuilderObject : public TypeObject {
+	StrBuilderObject() {}
+
+	~StrBuilderObject() {}
+
+	CString buffer;
+
+	DISALLOW_COPY_AND_ASSIGN(StrBuilderObject);
+};
+
 class StrType : public Type {
 public:
 	StrType()
@@ -47,7 +147,7 @@ public:
 	virtual void init();
 
 	virtual std::string toString(TypeObject* data) const {
-		return *static_cast<StrObject*>(data)->value;
+		return *static_cast<StrObject*>(data)->getStr();
 	}
 
 	virtual void CLEVER_FASTCALL add(CLEVER_TYPE_OPERATOR_ARGS)           const;
@@ -73,9 +173,11 @@ public:
 	CLEVER_METHOD(charAt);
 	CLEVER_METHOD(setChar);
 	CLEVER_METHOD(split);
+	CLEVER_METHOD(splitLines);
 	CLEVER_METHOD(toUpper);
 	CLEVER_METHOD(toLower);
 	CLEVER_METHOD(replace);
+	CLEVER_METHOD(replaceAll);
 	CLEVER_METHOD(ltrim);
 	CLEVER_METHOD(trim);
 	CLEVER_METHOD(rtrim);
@@ -84,6 +186,29 @@ private:
 	DISALLOW_COPY_AND_ASSIGN(StrType);
 };
 
+class StrBuilderType : public Type {
+public:
+	StrBuilderType()
+		: Type("StrBuilder") {}
+
+	~StrBuilderType() {}
+
+	virtual void init();
+
+	virtual std::string toString(TypeObject* data) const {
+		return static_cast<StrBuilderObject*>(data)->buffer;
+	}
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(append);
+	CLEVER_METHOD(size);
+	CLEVER_METHOD(reserve);
+	CLEVER_METHOD(clear);
+	CLEVER_METHOD(toString);
+private:
+	DISALLOW_COPY_AND_ASSIGN(StrBuilderType);
+};
+
 } // clever
 
 #endif // CLEVER_STR_H
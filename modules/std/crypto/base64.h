@@ -9,7 +9,6 @@
 #define CLEVER_BASE64_H
 
 #include <string>
-#include <vector>
 
 namespace clever {
 
@@ -17,96 +16,149 @@ namespace clever {
 const static char encodeLookup[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 const static char padCharacter = '=';
 
-inline std::string base64Encode(const std::string& inputBuffer)
+// Lookup table for decoding; -1 marks characters outside the alphabet
+const static signed char decodeLookup[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/// Appends the encoding of len bytes from input to out
+inline void base64Encode(const char* input, size_t len, std::string& out)
 {
-	std::string encodedString;
-	encodedString.reserve(((inputBuffer.size()/3) + (inputBuffer.size() % 3 > 0)) * 4);
-	long temp;
-	std::string::const_iterator cursor = inputBuffer.begin();
-
-	for (size_t idx = 0; idx < inputBuffer.size()/3; ++idx) {
-		temp  = (*cursor++) << 16; // Convert to big endian
-		temp += (*cursor++) << 8;
-		temp += (*cursor++);
-		encodedString.append(1, encodeLookup[(temp & 0x00FC0000) >> 18]);
-		encodedString.append(1, encodeLookup[(temp & 0x0003F000) >> 12]);
-		encodedString.append(1, encodeLookup[(temp & 0x00000FC0) >> 6 ]);
-		encodedString.append(1, encodeLookup[(temp & 0x0000003F)      ]);
+	const unsigned char* cursor = reinterpret_cast<const unsigned char*>(input);
+	const unsigned char* end = cursor + (len / 3) * 3;
+	size_t offset = out.size();
+
+	out.resize(offset + ((len + 2) / 3) * 4);
+
+	char* dest = &out[0] + offset;
+
+	for (; cursor != end; cursor += 3, dest += 4) {
+		unsigned long temp = (static_cast<unsigned long>(cursor[0]) << 16)
+			| (static_cast<unsigned long>(cursor[1]) << 8) | cursor[2];
+
+		dest[0] = encodeLookup[(temp >> 18) & 0x3F];
+		dest[1] = encodeLookup[(temp >> 12) & 0x3F];
+		dest[2] = encodeLookup[(temp >> 6) & 0x3F];
+		dest[3] = encodeLookup[temp & 0x3F];
 	}
 
-	switch (inputBuffer.size() % 3) {
+	switch (len % 3) {
 		case 1:
-			temp  = (*cursor++) << 16; // Convert to big endian
-			encodedString.append(1,encodeLookup[(temp & 0x00FC0000) >> 18]);
-			encodedString.append(1,encodeLookup[(temp & 0x0003F000) >> 12]);
-			encodedString.append(2,padCharacter);
+			dest[0] = encodeLookup[cursor[0] >> 2];
+			dest[1] = encodeLookup[(cursor[0] & 0x03) << 4];
+			dest[2] = padCharacter;
+			dest[3] = padCharacter;
 			break;
 
 		case 2:
-			temp  = (*cursor++) << 16; // Convert to big endian
-			temp += (*cursor++) << 8;
-			encodedString.append(1,encodeLookup[(temp & 0x00FC0000) >> 18]);
-			encodedString.append(1,encodeLookup[(temp & 0x0003F000) >> 12]);
-			encodedString.append(1,encodeLookup[(temp & 0x00000FC0) >> 6 ]);
-			encodedString.append(1,padCharacter);
+			dest[0] = encodeLookup[cursor[0] >> 2];
+			dest[1] = encodeLookup[((cursor[0] & 0x03) << 4) | (cursor[1] >> 4)];
+			dest[2] = encodeLookup[(cursor[1] & 0x0F) << 2];
+			dest[3] = padCharacter;
 			break;
 	}
+}
+
+inline std::string base64Encode(const std::string& inputBuffer)
+{
+	std::string encodedString;
+
+	base64Encode(inputBuffer.data(), inputBuffer.size(), encodedString);
+
 	return encodedString;
 }
 
-inline std::string base64Decode(const std::string& input)
+/// Appends the bytes encoded in input to out; the trailing padding is
+/// optional. Returns false when input is not valid base64
+inline bool base64Decode(const char* input, size_t len, std::string& out)
 {
-	size_t padding = 0;
+	const unsigned char* cursor = reinterpret_cast<const unsigned char*>(input);
 
-	if (input.length()) {
-		if (input[input.length()-1] == padCharacter) {
-			padding++;
+	if (len && cursor[len - 1] == padCharacter) {
+		--len;
+		if (len && cursor[len - 1] == padCharacter) {
+			--len;
 		}
-		if (input[input.length()-2] == padCharacter) {
-			padding++;
+	}
+
+	if (len % 4 == 1) {
+		return false;
+	}
+
+	const unsigned char* end = cursor + (len / 4) * 4;
+	size_t offset = out.size();
+
+	out.resize(offset + (len / 4) * 3 + (len % 4 ? len % 4 - 1 : 0));
+
+	char* dest = &out[0] + offset;
+
+	for (; cursor != end; cursor += 4, dest += 3) {
+		long a = decodeLookup[cursor[0]], b = decodeLookup[cursor[1]],
+			c = decodeLookup[cursor[2]], d = decodeLookup[cursor[3]];
+
+		if ((a | b | c | d) < 0) {
+			return false;
 		}
+
+		unsigned long temp = (a << 18) | (b << 12) | (c << 6) | d;
+
+		dest[0] = static_cast<char>(temp >> 16);
+		dest[1] = static_cast<char>(temp >> 8);
+		dest[2] = static_cast<char>(temp);
 	}
 
-	// Setup a vector to hold the result
-	std::string decodedBytes;
-	// Holds decoded quanta
-	long temp = 0;
-
-	decodedBytes.reserve(((input.length()/4)*3) - padding);
-
-	std::string::const_iterator cursor = input.begin();
-
-	while (cursor < input.end()) {
-		for (size_t quantumPosition = 0; quantumPosition < 4; ++quantumPosition) {
-			temp <<= 6;
-			if (*cursor >= 0x41 && *cursor <= 0x5A) { // This area will need tweaking if
-				temp |= *cursor - 0x41;                   // you are using an alternate alphabet
-			} else if (*cursor >= 0x61 && *cursor <= 0x7A) {
-				temp |= *cursor - 0x47;
-			} else if (*cursor >= 0x30 && *cursor <= 0x39) {
-				temp |= *cursor + 0x04;
-			} else if (*cursor == 0x2B) {
-				temp |= 0x3E; // change to 0x2D for URL alphabet
-			} else if (*cursor == 0x2F) {
-				temp |= 0x3F; // change to 0x5F for URL alphabet
-			} else if  (*cursor == padCharacter) { //pad
-				switch (input.end() - cursor) {
-					case 1: // One pad character
-						decodedBytes.push_back((temp >> 16) & 0x000000FF);
-						decodedBytes.push_back((temp >> 8 ) & 0x000000FF);
-						return decodedBytes;
-
-					case 2: // Two pad characters
-						decodedBytes.push_back((temp >> 10) & 0x000000FF);
-						return decodedBytes;
+	switch (len % 4) {
+		case 2:
+			{
+				long a = decodeLookup[cursor[0]], b = decodeLookup[cursor[1]];
+
+				if ((a | b) < 0) {
+					return false;
 				}
+				dest[0] = static_cast<char>((a << 2) | (b >> 4));
 			}
-			++cursor;
-		}
-		decodedBytes += ((temp >> 16) & 0x000000FF);
-		decodedBytes += ((temp >> 8 ) & 0x000000FF);
-		decodedBytes += ((temp      ) & 0x000000FF);
+			break;
+
+		case 3:
+			{
+				long a = decodeLookup[cursor[0]], b = decodeLookup[cursor[1]],
+					c = decodeLookup[cursor[2]];
+
+				if ((a | b | c) < 0) {
+					return false;
+				}
+				dest[0] = static_cast<char>((a << 2) | (b >> 4));
+				dest[1] = static_cast<char>((b << 4) | (c >> 2));
+			}
+			break;
+	}
+
+	return true;
+}
+
+inline std::string base64Decode(const std::string& input)
+{
+	std::string decodedBytes;
+
+	if (!base64Decode(input.data(), input.size(), decodedBytes)) {
+		decodedBytes.clear();
 	}
+
 	return decodedBytes;
 }
 
@@ -5,9 +5,11 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include "core/cexception.h"
 #include "modules/std/crypto/crypto.h"
 #include "modules/std/crypto/md5.h"
 #include "modules/std/crypto/base64.h"
+#include "modules/std/crypto/hasher.h"
 
 namespace clever { namespace modules { namespace std {
 
@@ -24,22 +26,68 @@ static CLEVER_FUNCTION(md5)
 	result->setStr(new StrObject(md5(*args[0]->getStr())));
 }
 
+// sha256(string)
+// Returns the SHA-256 hashing for the supplied string
+static CLEVER_FUNCTION(sha256)
+{
+	if (!clever_static_check_args("s")) {
+		return;
+	}
+
+	Sha256Context ctx;
+
+	ctx.update(args[0]->getStr()->data(), args[0]->getStr()->size());
+
+	result->setStr(new StrObject(ctx.digest()));
+}
+
+// xxhash64(string)
+// Returns the xxHash64 (non-cryptographic) hashing for the supplied string
+static CLEVER_FUNCTION(xxhash64)
+{
+	if (!clever_static_check_args("s")) {
+		return;
+	}
+
+	XXHash64Context ctx;
+
+	ctx.update(args[0]->getStr()->data(), args[0]->getStr()->size());
+
+	result->setStr(new StrObject(ctx.digest()));
+}
+
+// base64_encode(string)
 static CLEVER_FUNCTION(base64_encode)
 {
 	if (!clever_static_check_args("s")) {
 		return;
 	}
 
-	result->setStr(new StrObject(base64Encode(*args[0]->getStr())));
+	const CString* data = args[0]->getStr();
+	StrObject* str = new StrObject;
+
+	base64Encode(data->data(), data->size(), str->getBuffer());
+
+	result->setStr(str);
 }
 
+// base64_decode(string)
 static CLEVER_FUNCTION(base64_decode)
 {
 	if (!clever_static_check_args("s")) {
 		return;
 	}
 
-	result->setStr(new StrObject(base64Decode(*args[0]->getStr())));
+	const CString* data = args[0]->getStr();
+	StrObject* str = new StrObject;
+
+	if (!base64Decode(data->data(), data->size(), str->getBuffer())) {
+		str->delRef();
+		clever_throw("Invalid base64 data");
+		return;
+	}
+
+	result->setStr(str);
 }
 
 } // clever::modules::std::crypto
@@ -49,6 +97,10 @@ CLEVER_MODULE_INIT(CryptoModule)
 	addFunction(new Function("md5",           &CLEVER_NS_FNAME(crypto, md5)));
 	addFunction(new Function("base64_encode", &CLEVER_NS_FNAME(crypto, base64_encode)));
 	addFunction(new Function("base64_decode", &CLEVER_NS_FNAME(crypto, base64_decode)));
+	addFunction(new Function("sha256",        &CLEVER_NS_FNAME(crypto, sha256)));
+	addFunction(new Function("xxhash64",      &CLEVER_NS_FNAME(crypto, xxhash64)));
+
+	addType(new crypto::Hasher);
 }
 
 }}} // clever::modules::std
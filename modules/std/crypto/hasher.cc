@@ -0,0 +1,402 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cstring>
+#include "core/value.h"
+#include "core/cexception.h"
+#include "modules/std/core/function.h"
+#include "modules/std/crypto/hasher.h"
+
+namespace clever { namespace modules { namespace std { namespace crypto {
+
+::std::string hex_encode(const unsigned char* data, size_t len)
+{
+	static const char digits[] = "0123456789abcdef";
+	::std::string hex(len * 2, '\0');
+
+	for (size_t i = 0; i < len; ++i) {
+		hex[i * 2] = digits[data[i] >> 4];
+		hex[i * 2 + 1] = digits[data[i] & 0x0F];
+	}
+
+	return hex;
+}
+
+HashContext* HashContext::create(const ::std::string& algorithm)
+{
+	if (algorithm == "md5") {
+		return new Md5Context;
+	} else if (algorithm == "sha256") {
+		return new Sha256Context;
+	} else if (algorithm == "xxhash64") {
+		return new XXHash64Context;
+	}
+	return NULL;
+}
+
+// Md5Context //////////////////////////////////////////////////////////////////
+
+void Md5Context::update(const char* data, size_t len)
+{
+	// MD5::update() takes 32-bit lengths
+	while (len) {
+		MD5::size_type chunk = len > 0x40000000 ? 0x40000000 : len;
+
+		m_md5.update(data, chunk);
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+::std::string Md5Context::digest() const
+{
+	MD5 md5(m_md5);
+
+	return md5.finalize().hexdigest();
+}
+
+// Sha256Context ///////////////////////////////////////////////////////////////
+
+static const unsigned int sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline unsigned int rotr32(unsigned int x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+void Sha256Context::reset()
+{
+	m_state[0] = 0x6a09e667;
+	m_state[1] = 0xbb67ae85;
+	m_state[2] = 0x3c6ef372;
+	m_state[3] = 0xa54ff53a;
+	m_state[4] = 0x510e527f;
+	m_state[5] = 0x9b05688c;
+	m_state[6] = 0x1f83d9ab;
+	m_state[7] = 0x5be0cd19;
+	m_length = 0;
+}
+
+void Sha256Context::transform(const unsigned char* block)
+{
+	unsigned int w[64];
+
+	for (size_t i = 0; i < 16; ++i) {
+		w[i] = (static_cast<unsigned int>(block[i * 4]) << 24)
+			| (static_cast<unsigned int>(block[i * 4 + 1]) << 16)
+			| (static_cast<unsigned int>(block[i * 4 + 2]) << 8)
+			| block[i * 4 + 3];
+	}
+
+	for (size_t i = 16; i < 64; ++i) {
+		unsigned int s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		unsigned int s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	unsigned int a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3],
+		e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+
+	for (size_t i = 0; i < 64; ++i) {
+		unsigned int t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25))
+			+ ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		unsigned int t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22))
+			+ ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+	m_state[4] += e;
+	m_state[5] += f;
+	m_state[6] += g;
+	m_state[7] += h;
+}
+
+void Sha256Context::update(const char* data, size_t len)
+{
+	const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+	size_t used = m_length % 64;
+
+	m_length += len;
+
+	if (used) {
+		size_t fill = 64 - used;
+
+		if (len < fill) {
+			::memcpy(m_buffer + used, input, len);
+			return;
+		}
+
+		::memcpy(m_buffer + used, input, fill);
+		transform(m_buffer);
+		input += fill;
+		len -= fill;
+	}
+
+	// Whole blocks are hashed straight from the input
+	for (; len >= 64; input += 64, len -= 64) {
+		transform(input);
+	}
+
+	::memcpy(m_buffer, input, len);
+}
+
+::std::string Sha256Context::digest() const
+{
+	Sha256Context ctx(*this);
+	unsigned char tail[72] = {0x80};
+	unsigned long long bits = m_length * 8;
+	size_t pad = (m_length % 64 < 56 ? 56 : 120) - m_length % 64;
+
+	for (size_t i = 0; i < 8; ++i) {
+		tail[pad + i] = static_cast<unsigned char>(bits >> (56 - i * 8));
+	}
+
+	ctx.update(reinterpret_cast<const char*>(tail), pad + 8);
+
+	unsigned char out[32];
+
+	for (size_t i = 0; i < 8; ++i) {
+		out[i * 4] = static_cast<unsigned char>(ctx.m_state[i] >> 24);
+		out[i * 4 + 1] = static_cast<unsigned char>(ctx.m_state[i] >> 16);
+		out[i * 4 + 2] = static_cast<unsigned char>(ctx.m_state[i] >> 8);
+		out[i * 4 + 3] = static_cast<unsigned char>(ctx.m_state[i]);
+	}
+
+	return hex_encode(out, sizeof(out));
+}
+
+// XXHash64Context /////////////////////////////////////////////////////////////
+
+static const unsigned long long xxh_prime1 = 11400714785074694791ULL;
+static const unsigned long long xxh_prime2 = 14029467366897019727ULL;
+static const unsigned long long xxh_prime3 = 1609587929392839161ULL;
+static const unsigned long long xxh_prime4 = 9650029242287828579ULL;
+static const unsigned long long xxh_prime5 = 2870177450012600261ULL;
+
+static inline unsigned long long rotl64(unsigned long long x, int n)
+{
+	return (x << n) | (x >> (64 - n));
+}
+
+static inline unsigned long long read64(const unsigned char* p)
+{
+	return static_cast<unsigned long long>(p[0])
+		| (static_cast<unsigned long long>(p[1]) << 8)
+		| (static_cast<unsigned long long>(p[2]) << 16)
+		| (static_cast<unsigned long long>(p[3]) << 24)
+		| (static_cast<unsigned long long>(p[4]) << 32)
+		| (static_cast<unsigned long long>(p[5]) << 40)
+		| (static_cast<unsigned long long>(p[6]) << 48)
+		| (static_cast<unsigned long long>(p[7]) << 56);
+}
+
+static inline unsigned long long xxh_round(unsigned long long acc,
+	unsigned long long input)
+{
+	return rotl64(acc + input * xxh_prime2, 31) * xxh_prime1;
+}
+
+static inline unsigned long long xxh_merge(unsigned long long hash,
+	unsigned long long acc)
+{
+	return (hash ^ xxh_round(0, acc)) * xxh_prime1 + xxh_prime4;
+}
+
+void XXHash64Context::reset()
+{
+	m_acc[0] = xxh_prime1 + xxh_prime2;
+	m_acc[1] = xxh_prime2;
+	m_acc[2] = 0;
+	m_acc[3] = -xxh_prime1;
+	m_length = 0;
+}
+
+void XXHash64Context::update(const char* data, size_t len)
+{
+	const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+	size_t used = m_length % 32;
+
+	m_length += len;
+
+	if (used) {
+		size_t fill = 32 - used;
+
+		if (len < fill) {
+			::memcpy(m_buffer + used, input, len);
+			return;
+		}
+
+		::memcpy(m_buffer + used, input, fill);
+
+		for (size_t i = 0; i < 4; ++i) {
+			m_acc[i] = xxh_round(m_acc[i], read64(m_buffer + i * 8));
+		}
+		input += fill;
+		len -= fill;
+	}
+
+	// Stripes of 32 bytes run in four independent lanes
+	unsigned long long v1 = m_acc[0], v2 = m_acc[1], v3 = m_acc[2], v4 = m_acc[3];
+
+	for (; len >= 32; input += 32, len -= 32) {
+		v1 = xxh_round(v1, read64(input));
+		v2 = xxh_round(v2, read64(input + 8));
+		v3 = xxh_round(v3, read64(input + 16));
+		v4 = xxh_round(v4, read64(input + 24));
+	}
+
+	m_acc[0] = v1;
+	m_acc[1] = v2;
+	m_acc[2] = v3;
+	m_acc[3] = v4;
+
+	::memcpy(m_buffer, input, len);
+}
+
+::std::string XXHash64Context::digest() const
+{
+	unsigned long long hash;
+
+	if (m_length >= 32) {
+		hash = rotl64(m_acc[0], 1) + rotl64(m_acc[1], 7)
+			+ rotl64(m_acc[2], 12) + rotl64(m_acc[3], 18);
+
+		for (size_t i = 0; i < 4; ++i) {
+			hash = xxh_merge(hash, m_acc[i]);
+		}
+	} else {
+		hash = xxh_prime5;
+	}
+
+	hash += m_length;
+
+	const unsigned char* p = m_buffer;
+	const unsigned char* end = p + m_length % 32;
+
+	for (; p + 8 <= end; p += 8) {
+		hash = rotl64(hash ^ xxh_round(0, read64(p)), 27) * xxh_prime1 + xxh_prime4;
+	}
+
+	if (p + 4 <= end) {
+		unsigned long long word = static_cast<unsigned long long>(p[0])
+			| (static_cast<unsigned long long>(p[1]) << 8)
+			| (static_cast<unsigned long long>(p[2]) << 16)
+			| (static_cast<unsigned long long>(p[3]) << 24);
+
+		hash = rotl64(hash ^ (word * xxh_prime1), 23) * xxh_prime2 + xxh_prime3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		hash = rotl64(hash ^ (*p * xxh_prime5), 11) * xxh_prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= xxh_prime2;
+	hash ^= hash >> 29;
+	hash *= xxh_prime3;
+	hash ^= hash >> 32;
+
+	unsigned char out[8];
+
+	for (size_t i = 0; i < 8; ++i) {
+		out[i] = static_cast<unsigned char>(hash >> (56 - i * 8));
+	}
+
+	return hex_encode(out, sizeof(out));
+}
+
+// Hasher //////////////////////////////////////////////////////////////////////
+
+// Hasher Hasher.new(String algorithm)
+// Starts an incremental hash: "md5", "sha256" or "xxhash64"
+CLEVER_METHOD(Hasher::ctor)
+{
+	if (!clever_check_args("s")) {
+		return;
+	}
+
+	HashContext* context = HashContext::create(*args[0]->getStr());
+
+	if (context == NULL) {
+		clever_throw("Unknown hash algorithm `%S'", args[0]->getStr());
+		return;
+	}
+
+	result->setObj(this, new HasherObject(context));
+}
+
+// void Hasher.update(String data)
+// Feeds data to the hash; the string is read in place
+CLEVER_METHOD(Hasher::update)
+{
+	if (!clever_check_args("s")) {
+		return;
+	}
+
+	const CString* data = args[0]->getStr();
+
+	clever_get_this(HasherObject*)->getContext()->update(data->data(), data->size());
+}
+
+// String Hasher.digest()
+// Returns the hex digest of the data fed so far
+CLEVER_METHOD(Hasher::digest)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setStr(new StrObject(clever_get_this(HasherObject*)->getContext()->digest()));
+}
+
+// void Hasher.reset()
+// Discards the data fed so far
+CLEVER_METHOD(Hasher::reset)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	clever_get_this(HasherObject*)->getContext()->reset();
+}
+
+CLEVER_TYPE_INIT(Hasher::init)
+{
+	setConstructor((MethodPtr)&Hasher::ctor);
+
+	addMethod(new Function("update", (MethodPtr)&Hasher::update));
+	addMethod(new Function("digest", (MethodPtr)&Hasher::digest));
+	addMethod(new Function("reset",  (MethodPtr)&Hasher::reset));
+}
+
+}}}} // clever::modules::std::crypto
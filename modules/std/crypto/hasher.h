@@ -0,0 +1,113 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_CRYPTO_HASHER_H
+#define CLEVER_STD_CRYPTO_HASHER_H
+
+#include <string>
+#include "core/cstring.h"
+#include "core/type.h"
+#include "modules/std/crypto/md5.h"
+
+namespace clever { namespace modules { namespace std { namespace crypto {
+
+/**
+ * Incremental hash computation
+ *
+ * Data is fed in any number of update() calls; digest() returns the hex
+ * digest of everything so far without finishing the context, so hashing
+ * can go on afterwards.
+ */
+class HashContext {
+public:
+	virtual ~HashContext() {}
+
+	virtual void update(const char* data, size_t len) = 0;
+	virtual ::std::string digest() const = 0;
+	virtual void reset() = 0;
+
+	/// Returns a context for "md5", "sha256" or "xxhash64", or NULL
+	static HashContext* create(const ::std::string& algorithm);
+};
+
+class Md5Context : public HashContext {
+public:
+	Md5Context() {}
+
+	void update(const char* data, size_t len);
+	::std::string digest() const;
+	void reset() { m_md5 = MD5(); }
+private:
+	MD5 m_md5;
+};
+
+class Sha256Context : public HashContext {
+public:
+	Sha256Context() { reset(); }
+
+	void update(const char* data, size_t len);
+	::std::string digest() const;
+	void reset();
+private:
+	void transform(const unsigned char* block);
+
+	unsigned int m_state[8];
+	unsigned char m_buffer[64];
+	unsigned long long m_length;
+};
+
+/// xxHash64 with seed 0, digest in the canonical (big endian) form
+class XXHash64Context : public HashContext {
+public:
+	XXHash64Context() { reset(); }
+
+	void update(const char* data, size_t len);
+	::std::string digest() const;
+	void reset();
+private:
+	unsigned long long m_acc[4];
+	unsigned char m_buffer[32];
+	unsigned long long m_length;
+};
+
+/// Returns the lowercase hex form of len bytes
+::std::string hex_encode(const unsigned char* data, size_t len);
+
+class HasherObject : public TypeObject {
+public:
+	HasherObject(HashContext* context)
+		: m_context(context) {}
+
+	~HasherObject() { delete m_context; }
+
+	HashContext* getContext() const { return m_context; }
+private:
+	HashContext* m_context;
+
+	DISALLOW_COPY_AND_ASSIGN(HasherObject);
+};
+
+class Hasher : public Type {
+public:
+	Hasher()
+		: Type("Hasher") {}
+
+	~Hasher() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(update);
+	CLEVER_METHOD(digest);
+	CLEVER_METHOD(reset);
+private:
+	DISALLOW_COPY_AND_ASSIGN(Hasher);
+};
+
+}}}} // clever::modules::std::crypto
+
+#endif // CLEVER_STD_CRYPTO_HASHER_H
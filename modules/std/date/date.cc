@@ -23,7 +23,7 @@ namespace clever { namespace modules { namespace std {
 	return out.str();
 }
 
-static inline void clever_date_format(const ::std::vector<Value*>* args,
+static inline void clever_date_format(const ValueSpan* args,
 	const Value* obj, Value* result, bool utc)
 {
 	DateObject* dobj = clever_get_this(DateObject*);
@@ -49,7 +49,7 @@ static inline void clever_date_format(const ::std::vector<Value*>* args,
 		char buffer[size];
 
 		if (strftime(buffer, size, format, local)) {
-			result->setStr(new StrObject(new CString(buffer), false));
+			result->setStr(new StrObject(CString(buffer)));
 			return;
 		}
 
@@ -29,6 +29,8 @@ namespace clever { namespace modules { namespace std {
 CLEVER_THREAD_FUNC(_events_handler)
 {
 	EventData* intern = static_cast<EventData*>(arg);
+	// Holds the value returned by each action, which is discarded
+	Value* retval = new Value;
 
 	while (true) {
 		intern->mutex.lock();
@@ -40,11 +42,12 @@ CLEVER_THREAD_FUNC(_events_handler)
 			Actions& a = intern->m_event_map[u.first];
 
 			for (Actions::iterator it = a.begin(); it != a.end(); ++it) {
-				intern->m_vm->runFunction(*it, u.second)->delRef();
+				intern->m_vm->runFunction(*it, u.second, retval);
 			}
 
 			if (u.first == "exit") {
 				intern->mutex.unlock();
+				clever_delref(retval);
 				return NULL;
 			} else if (u.first == "set") {
 				/*Get current state of the requisitions*/
@@ -85,7 +88,7 @@ CLEVER_THREAD_FUNC(_events_handler)
 							}
 
 							if (exec) {
-								intern->m_vm->runFunction(func, args)->delRef();
+								intern->m_vm->runFunction(func, args, retval);
 							}
 						}
 					}
@@ -22,12 +22,6 @@ extern char** environ;
 
 #define CLEVER_FCGI_PAIR(k, v) ::std::pair< ::std::string, ::std::string>(k, v)
 #define CLEVER_FCGI_MAP	       ::std::map< ::std::string, ::std::string>
-#define CLEVER_FCGI_ITERATOR   CLEVER_FCGI_MAP::const_iterator
-#define CLEVER_FCGI_NULL(k)    CLEVER_FCGI_PAIR(k, ::std::string(""))
-#define CLEVER_FCGI_FIND(m, k) m->find(k)
-#define CLEVER_FCGI_BEGIN(m)   m->begin()
-#define CLEVER_FCGI_END(m)     m->end()
-#define CLEVER_FCGI_FETCH(f)   CSTRING(f->second)
 
 namespace clever { namespace modules { namespace std {
 
@@ -0,0 +1,443 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include "modules/std/fcgi/request.h"
+
+namespace clever { namespace modules { namespace std {
+
+// FNV-1a
+static inline size_t _field_hash(const char* str, size_t size)
+{
+	size_t hash = 2166136261u;
+
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ static_cast<unsigned char>(str[i])) * 16777619u;
+	}
+	return hash;
+}
+
+static inline int _hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// Whether str starts with prefix, ignoring the case of ASCII letters
+static bool _starts_with(const char* str, const char* end, const char* prefix)
+{
+	for (; *prefix; ++str, ++prefix) {
+		if (str == end || ::tolower(static_cast<unsigned char>(*str)) != *prefix) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static inline const char* _search(const char* begin, const char* end,
+	const char* needle, size_t size)
+{
+	const char* found = ::std::search(begin, end, needle, needle + size);
+
+	return found == end ? NULL : found;
+}
+
+static inline const char* _skip_spaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		++p;
+	}
+	return p;
+}
+
+// Returns the value of a header parameter (eg the name in
+// `form-data; name="field"'), without quotes
+static RequestString _header_param(const char* p, const char* end, const char* param)
+{
+	size_t size = ::strlen(param);
+
+	while (p < end) {
+		p = _skip_spaces(p, end);
+
+		if (_starts_with(p, end, param) && end - p > long(size) && p[size] == '=') {
+			const char* value = p + size + 1;
+
+			if (value < end && *value == '"') {
+				const char* quote = static_cast<const char*>(
+					::memchr(value + 1, '"', end - value - 1));
+
+				return RequestString(value + 1, (quote ? quote : end) - value - 1);
+			}
+
+			const char* semicolon = static_cast<const char*>(::memchr(value, ';', end - value));
+
+			return RequestString(value, (semicolon ? semicolon : end) - value);
+		}
+
+		const char* semicolon = static_cast<const char*>(::memchr(p, ';', end - p));
+
+		if (!semicolon) {
+			break;
+		}
+		p = semicolon + 1;
+	}
+
+	return RequestString();
+}
+
+void RequestFieldList::buildIndex() const
+{
+	size_t capacity = 8;
+
+	while (capacity < m_fields.size() * 2) {
+		capacity <<= 1;
+	}
+
+	m_index.assign(capacity, 0);
+
+	for (size_t i = 0; i < m_fields.size(); ++i) {
+		const RequestString& name = m_fields[i].name;
+		size_t slot = _field_hash(name.data, name.size) & (capacity - 1);
+
+		while (m_index[slot]
+			&& !m_fields[m_index[slot] - 1].name.equals(name.data, name.size)) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+
+		if (!m_index[slot]) {
+			m_index[slot] = i + 1;
+		}
+	}
+
+	m_indexed = true;
+}
+
+const RequestField* RequestFieldList::find(const char* name, size_t size) const
+{
+	if (m_fields.empty()) {
+		return NULL;
+	}
+
+	if (!m_indexed) {
+		buildIndex();
+	}
+
+	size_t mask = m_index.size() - 1;
+	size_t slot = _field_hash(name, size) & mask;
+
+	while (m_index[slot]) {
+		const RequestField& field = m_fields[m_index[slot] - 1];
+
+		if (field.name.equals(name, size)) {
+			return &field;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+void RequestData::parse(Section section)
+{
+	switch (section) {
+		case ENV:
+		case HEAD:
+			scanEnvironment();
+			break;
+
+		case COOKIE:
+			parseCookies();
+			break;
+
+		case PARAMS:
+			parseQuery();
+			break;
+
+		default:
+			// No body was parsed
+			m_sections[section].clear();
+			m_parsed |= 1 << section;
+			break;
+	}
+}
+
+void RequestData::scanEnvironment()
+{
+	m_sections[ENV].clear();
+	m_sections[HEAD].clear();
+	m_cookie = m_query = RequestString();
+
+	for (const char* const* n = m_envp; n && *n; ++n) {
+		const char* sep = ::strchr(*n, '=');
+
+		if (!sep) {
+			continue;
+		}
+
+		RequestString name(*n, sep - *n);
+		RequestString value(sep + 1, ::strlen(sep + 1));
+
+		if (name.size > 5 && ::memcmp(name.data, "HTTP_", 5) == 0) {
+			if (name.equals("HTTP_COOKIE", 11)) {
+				m_cookie = value;
+			} else {
+				m_sections[HEAD].add(RequestString(name.data + 5, name.size - 5), value);
+			}
+		} else if (name.equals("QUERY_STRING", 12)) {
+			m_query = value;
+		} else {
+			m_sections[ENV].add(name, value);
+		}
+	}
+
+	m_parsed |= (1 << ENV) | (1 << HEAD);
+}
+
+// Cookie: name=value; name2=value2
+void RequestData::parseCookies()
+{
+	if (!(m_parsed & (1 << ENV))) {
+		scanEnvironment();
+	}
+
+	m_sections[COOKIE].clear();
+
+	const char* p = m_cookie.data;
+	const char* end = p + m_cookie.size;
+
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == ';')) {
+			++p;
+		}
+
+		const char* start = p;
+
+		while (p < end && *p != ';') {
+			++p;
+		}
+
+		const char* sep = static_cast<const char*>(::memchr(start, '=', p - start));
+		const char* vend = p;
+
+		while (sep && vend > sep + 1 && vend[-1] == ' ') {
+			--vend;
+		}
+
+		if (sep && sep > start && vend > sep + 1) {
+			m_sections[COOKIE].add(RequestString(start, sep - start),
+				RequestString(sep + 1, vend - sep - 1));
+		}
+	}
+
+	m_parsed |= 1 << COOKIE;
+}
+
+void RequestData::parseQuery()
+{
+	if (!(m_parsed & (1 << ENV))) {
+		scanEnvironment();
+	}
+
+	parseUrlEncoded(m_query, m_sections[PARAMS], m_decoded);
+
+	m_parsed |= 1 << PARAMS;
+}
+
+void RequestData::parseForm(const RequestString& body, const RequestString& content_type)
+{
+	const char* type = content_type.data;
+	const char* end = type + content_type.size;
+
+	m_sections[FORM].clear();
+	m_files.clear();
+
+	if (_starts_with(type, end, "application/x-www-form-urlencoded")) {
+		parseUrlEncoded(body, m_sections[FORM], m_form_decoded);
+	} else if (_starts_with(type, end, "multipart/form-data")) {
+		RequestString boundary = _header_param(type, end, "boundary");
+
+		if (boundary.size) {
+			parseMultipart(body, boundary);
+		}
+	}
+
+	m_parsed |= 1 << FORM;
+}
+
+// --boundary\r\n
+// Content-Disposition: form-data; name="field"\r\n
+// \r\n
+// value\r\n
+// --boundary\r\n
+// Content-Disposition: form-data; name="upload"; filename="a.txt"\r\n
+// Content-Type: text/plain\r\n
+// \r\n
+// contents\r\n
+// --boundary--
+void RequestData::parseMultipart(const RequestString& body, const RequestString& boundary)
+{
+	::std::string delimiter("\r\n--");
+
+	delimiter.append(boundary.data, boundary.size);
+
+	const char* end = body.data + body.size;
+
+	// The first delimiter is usually not preceded by a line break
+	const char* p = _search(body.data, end, delimiter.data() + 2, delimiter.size() - 2);
+
+	if (!p) {
+		return;
+	}
+
+	p += delimiter.size() - 2;
+
+	while (end - p >= 2 && !(p[0] == '-' && p[1] == '-')) {
+		const char* headers_end = _search(p, end, "\r\n\r\n", 4);
+
+		if (!headers_end) {
+			break;
+		}
+
+		const char* data = headers_end + 4;
+		const char* next = _search(data, end, delimiter.data(), delimiter.size());
+
+		if (!next) {
+			break;
+		}
+
+		addPart(p, headers_end, RequestString(data, next - data));
+
+		p = next + delimiter.size();
+	}
+}
+
+void RequestData::addPart(const char* headers, const char* headers_end,
+	const RequestString& data)
+{
+	RequestFile part;
+	bool is_file = false;
+
+	part.data = data;
+
+	while (headers < headers_end) {
+		const char* line_end = _search(headers, headers_end, "\r\n", 2);
+
+		if (!line_end) {
+			line_end = headers_end;
+		}
+
+		if (_starts_with(headers, line_end, "content-disposition:")) {
+			const char* params = headers + sizeof("content-disposition:") - 1;
+			const char* filename = _search(params, line_end, "filename=", 9);
+
+			part.name = _header_param(params, line_end, "name");
+
+			if (filename) {
+				part.filename = _header_param(params, line_end, "filename");
+				is_file = true;
+			}
+		} else if (_starts_with(headers, line_end, "content-type:")) {
+			const char* type = _skip_spaces(headers + sizeof("content-type:") - 1, line_end);
+
+			part.type = RequestString(type, line_end - type);
+		}
+
+		headers = line_end + 2;
+	}
+
+	if (!part.name.size) {
+		return;
+	}
+
+	if (is_file) {
+		m_files.push_back(part);
+	} else {
+		m_sections[FORM].add(part.name, part.data);
+	}
+}
+
+// name=value&name2=value2&flag
+void RequestData::parseUrlEncoded(const RequestString& str, RequestFieldList& fields,
+	::std::vector<char>& buffer)
+{
+	fields.clear();
+
+	// Decoding never makes a field longer, so the buffer is not reallocated
+	// while fields point into it
+	buffer.resize(str.size);
+
+	const char* p = str.data;
+	const char* end = p + str.size;
+	char* out = buffer.empty() ? NULL : &buffer[0];
+
+	while (p < end) {
+		const char* start = p;
+
+		while (p < end && *p != '&') {
+			++p;
+		}
+
+		const char* sep = static_cast<const char*>(::memchr(start, '=', p - start));
+		RequestString name(start, (sep ? sep : p) - start);
+		RequestString value(sep ? sep + 1 : p, sep ? p - sep - 1 : 0);
+
+		if (name.size) {
+			RequestString decoded_name = decode(name, out);
+
+			fields.add(decoded_name, decode(value, out));
+		}
+
+		if (p < end) {
+			++p;
+		}
+	}
+}
+
+RequestString RequestData::decode(const RequestString& str, char*& out)
+{
+	const char* p = str.data;
+	const char* end = p + str.size;
+
+	while (p < end && *p != '%' && *p != '+') {
+		++p;
+	}
+
+	if (p == end) {
+		return str;
+	}
+
+	char* start = out;
+
+	::memcpy(out, str.data, p - str.data);
+	out += p - str.data;
+
+	while (p < end) {
+		int high, low;
+
+		if (*p == '+') {
+			*out++ = ' ';
+			++p;
+		} else if (*p == '%' && end - p > 2
+			&& (high = _hex_digit(p[1])) >= 0 && (low = _hex_digit(p[2])) >= 0) {
+			*out++ = static_cast<char>(high * 16 + low);
+			p += 3;
+		} else {
+			*out++ = *p++;
+		}
+	}
+
+	return RequestString(start, out - start);
+}
+
+}}} // clever::modules::std
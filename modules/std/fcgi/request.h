@@ -0,0 +1,167 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_FCGI_REQUEST_H
+#define CLEVER_STD_FCGI_REQUEST_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "core/clever.h"
+#include "core/cstring.h"
+
+namespace clever { namespace modules { namespace std {
+
+/// Characters of a request field; they live in the FastCGI environment
+/// block, or in the request's decoding buffer when they had to be decoded
+struct RequestString {
+	RequestString()
+		: data(NULL), size(0) {}
+
+	RequestString(const char* data_, size_t size_)
+		: data(data_), size(size_) {}
+
+	bool equals(const char* str, size_t len) const {
+		return size == len && ::memcmp(data, str, len) == 0;
+	}
+
+	const char* data;
+	size_t size;
+};
+
+/// File part of a multipart/form-data body
+struct RequestFile {
+	RequestString name;
+	RequestString filename;
+	RequestString type;
+	RequestString data;
+};
+
+struct RequestField {
+	RequestField(const RequestString& name_, const RequestString& value_)
+		: name(name_), value(value_) {}
+
+	RequestString name;
+	RequestString value;
+};
+
+/**
+ * Fields of one kind (environment, headers, cookies or parameters)
+ *
+ * A hash index is built on the first lookup; the first of several fields
+ * with the same name is the one found. Storage is kept between requests.
+ */
+class RequestFieldList {
+public:
+	typedef ::std::vector<RequestField>::const_iterator Iterator;
+
+	RequestFieldList()
+		: m_indexed(false) {}
+
+	void clear() {
+		m_fields.clear();
+		m_indexed = false;
+	}
+
+	void add(const RequestString& name, const RequestString& value) {
+		m_fields.push_back(RequestField(name, value));
+	}
+
+	/// Returns the field named name, or NULL
+	const RequestField* find(const char* name, size_t size) const;
+
+	size_t size() const { return m_fields.size(); }
+	Iterator begin() const { return m_fields.begin(); }
+	Iterator end() const { return m_fields.end(); }
+private:
+	void buildIndex() const;
+
+	::std::vector<RequestField> m_fields;
+
+	/// Open addressing table of field positions plus one; zero is empty
+	mutable ::std::vector<size_t> m_index;
+	mutable bool m_indexed;
+};
+
+/**
+ * Incoming request, parsed on demand
+ *
+ * reset() only records the FastCGI environment block; the block is split
+ * into environment variables and headers the first time either is read,
+ * and the cookie and query strings are split the first time cookies or
+ * parameters are read. Fields point into the environment block, which
+ * stays valid until the request is finished; names and values of
+ * parameters are URL-decoded, copying only the ones containing escapes.
+ * The FORM section is filled from the request body by parseForm().
+ */
+class RequestData {
+public:
+	enum Section { ENV, HEAD, COOKIE, PARAMS, FORM, NUM_SECTIONS };
+
+	RequestData()
+		: m_envp(NULL), m_parsed(0) {}
+
+	void reset(const char* const* envp) {
+		m_envp = envp;
+		m_parsed = 0;
+		m_files.clear();
+	}
+
+	const char* const* getEnvironmentBlock() const { return m_envp; }
+
+	const RequestFieldList& get(Section section) {
+		if (!(m_parsed & (1 << section))) {
+			parse(section);
+		}
+		return m_sections[section];
+	}
+
+	const RequestField* find(Section section, const CString& name) {
+		return get(section).find(name.data(), name.size());
+	}
+
+	bool isParsed(Section section) const { return m_parsed & (1 << section); }
+
+	/// Splits an application/x-www-form-urlencoded or multipart/form-data
+	/// body into FORM fields and files; fields point into body
+	void parseForm(const RequestString& body, const RequestString& content_type);
+
+	const ::std::vector<RequestFile>& getFiles() const { return m_files; }
+private:
+	void parse(Section);
+
+	/// Splits the environment block into ENV and HEAD
+	void scanEnvironment();
+	void parseCookies();
+	void parseQuery();
+	void parseMultipart(const RequestString& body, const RequestString& boundary);
+	void addPart(const char* headers, const char* headers_end, const RequestString& data);
+
+	/// Splits name=value pairs separated by '&' into fields, decoding them
+	/// into buffer as needed
+	static void parseUrlEncoded(const RequestString& str, RequestFieldList& fields,
+		::std::vector<char>& buffer);
+
+	/// Returns str with %XX escapes and '+' decoded; when it has any, the
+	/// decoded characters are written at out, which is advanced past them
+	static RequestString decode(const RequestString& str, char*& out);
+
+	const char* const* m_envp;
+	unsigned m_parsed;
+	RequestFieldList m_sections[NUM_SECTIONS];
+	RequestString m_cookie;
+	RequestString m_query;
+	::std::vector<char> m_decoded;
+	::std::vector<char> m_form_decoded;
+	::std::vector<RequestFile> m_files;
+
+	DISALLOW_COPY_AND_ASSIGN(RequestData);
+};
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_FCGI_REQUEST_H
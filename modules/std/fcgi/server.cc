@@ -4,11 +4,21 @@
  *
  * This file is distributed under the MIT license. See LICENSE for details.
  */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <sys/stat.h>
 #include "core/type.h"
 #include "core/native_types.h"
 #include "core/value.h"
 #include "core/clever.h"
 #include "core/cexception.h"
+#include "core/cthread.h"
+#include "core/vm.h"
+#include "modules/std/core/function.h"
+#include "modules/std/core/str.h"
+#include "modules/std/core/map.h"
 #include "modules/std/fcgi/fcgi.h"
 #include "modules/std/fcgi/server.h"
 
@@ -16,23 +26,247 @@ namespace clever { namespace modules { namespace std {
 
 const size_t CLEVER_FCGI_STDIN_MAX = 1000000;
 
-// Server constructor
+/// Size of the reads done by bodyStream() and sendFile() by default
+const size_t CLEVER_FCGI_CHUNK_SIZE = 65536;
+
+ServerObject::~ServerObject()
+{
+	endResponse();
+	FCGX_Finish_r(&request);
+
+	if (owns_socket) {
+		close(socket);
+	}
+}
+
+bool ServerObject::accept()
+{
+	endResponse();
+
+	if (FCGX_Accept_r(&request) != 0 || !request.envp) {
+		in.reset(NULL);
+		out.clear();
+		return false;
+	}
+
+	startRequest();
+
+	return true;
+}
+
+static bool _is_content_type(const ::std::string& name)
+{
+	static const char type[] = "content-type";
+
+	if (name.size() != sizeof(type) - 1) {
+		return false;
+	}
+
+	for (size_t i = 0; i < name.size(); ++i) {
+		if (::tolower(static_cast<unsigned char>(name[i])) != type[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ServerObject::writeHeaders()
+{
+	CLEVER_FCGI_MAP::const_iterator it(out.head->begin()), end(out.head->end());
+	bool has_type = false;
+
+	for (; it != end; ++it) {
+		out.buffer.append(it->first).append(": ").append(it->second).append("\r\n");
+
+		if (_is_content_type(it->first)) {
+			has_type = true;
+		}
+	}
+
+	if (!has_type) {
+		out.buffer.append("Content-Type: text/html\r\n");
+	}
+
+	for (it = out.cookie->begin(), end = out.cookie->end(); it != end; ++it) {
+		out.buffer.append("Set-Cookie: ").append(it->first).append("=")
+			.append(it->second).append("\r\n");
+	}
+
+	out.buffer.append("\r\n");
+	out.setBody(true);
+}
+
+void ServerObject::write(const char* data, size_t size)
+{
+	if (!out.inBody()) {
+		writeHeaders();
+	}
+
+	if (out.buffer.size() + size < out.threshold) {
+		out.buffer.append(data, size);
+		return;
+	}
+
+	// Large writes go straight to the stream instead of through the buffer
+	flushOutput();
+
+	if (size) {
+		FCGX_PutStr(data, size, request.out);
+	}
+}
+
+bool ServerObject::flushOutput()
+{
+	if (!request.out) {
+		return false;
+	}
+
+	bool ok = true;
+
+	if (!out.buffer.empty()) {
+		ok = FCGX_PutStr(out.buffer.data(), out.buffer.size(), request.out) >= 0;
+		out.buffer.clear();
+	}
+
+	return ok;
+}
+
+void ServerObject::endResponse()
+{
+	if (!request.out) {
+		return;
+	}
+
+	if (!out.inBody()) {
+		writeHeaders();
+	}
+
+	flushOutput();
+}
+
+size_t ServerObject::readInput(char* data, size_t size)
+{
+	if (!request.in) {
+		return 0;
+	}
+
+	int n = FCGX_GetStr(data, size, request.in);
+
+	return n > 0 ? n : 0;
+}
+
+bool ServerObject::readForm(size_t max)
+{
+	size_t size = 0, n;
+
+	do {
+		// Reading one byte past max tells whether the body is too long
+		form_body.resize(::std::min(max + 1, size + CLEVER_FCGI_CHUNK_SIZE));
+		n = readInput(&form_body[size], form_body.size() - size);
+		size += n;
+	} while (n && size <= max);
+
+	form_body.resize(size);
+
+	return size <= max;
+}
+
+static inline void _set_string(Value* value, const char* data, size_t size)
+{
+	if (value->isStr() && static_cast<StrObject*>(value->getObj())->isMutable()) {
+		static_cast<StrObject*>(value->getObj())->getBuffer().assign(data, size);
+		return;
+	}
+
+	StrObject* obj = new StrObject;
+
+	obj->getBuffer().assign(data, size);
+	value->setStr(obj);
+}
+
+static inline void _set_string(Value* value, const RequestString& str)
+{
+	_set_string(value, str.data, str.size);
+}
+
+// Sets result to the value of the field named name, or null
+static void _get_field(RequestData& in, RequestData::Section section,
+	const Value* name, Value* result)
+{
+	const RequestField* field = in.find(section, *name->getStr());
+
+	if (field) {
+		_set_string(result, field->value);
+	} else {
+		result->setNull();
+	}
+}
+
+// Inserts value into map unless name is taken
+static void _map_insert(MapObject* map, const RequestString& name, Value* value)
+{
+	if (!map->getData().insert(ValuePair(
+			::std::string(name.data, name.size), value)).second) {
+		// The first of several fields with the same name wins
+		clever_delref(value);
+	}
+}
+
+static inline void _map_insert(MapObject* map, const RequestString& name,
+	const RequestString& str)
+{
+	Value* value = new Value;
+
+	_set_string(value, str);
+	_map_insert(map, name, value);
+}
+
+static MapObject* _fields_map(const RequestFieldList& fields)
+{
+	MapObject* map = new MapObject;
+	RequestFieldList::Iterator it(fields.begin()), end(fields.end());
+
+	for (; it != end; ++it) {
+		_map_insert(map, it->name, it->value);
+	}
+
+	return map;
+}
+
+// Sets result to a Map of the fields of a section
+static void _get_fields(RequestData& in, RequestData::Section section, Value* result)
+{
+	result->setObj(CLEVER_MAP_TYPE, _fields_map(in.get(section)));
+}
+
+// Server.new([String address [, Int backlog]])
+// Without arguments requests are accepted on the socket the web server
+// passed as standard input; otherwise a socket is opened on address, eg
+// ":9000" or "/tmp/clever.sock"
 CLEVER_METHOD(Server::ctor)
 {
-	if (!clever_check_no_args()) {
+	if (!clever_check_args("|si")) {
 		return;
 	}
 
-	ServerObject* server = new ServerObject;
+	if (FCGX_Init() != 0) {
+		clever_throw("Cannot start server!");
+		return;
+	}
 
-	if (server->request) {
-		if (FCGX_InitRequest(server->request, 0, 0) == 0) {
-			result->setObj(this, server);
+	int socket = 0;
+
+	if (!args.empty()) {
+		socket = FCGX_OpenSocket(args[0]->getStr()->c_str(),
+			args.size() > 1 ? args[1]->getInt() : 128);
+
+		if (socket < 0) {
+			clever_throw("Cannot listen on `%S'", args[0]->getStr());
 			return;
 		}
-		delete server;
 	}
-	clever_throw("Cannot start server!");
+
+	result->setObj(this, new ServerObject(socket, !args.empty()));
 }
 
 // Server.accept()
@@ -43,115 +277,117 @@ CLEVER_METHOD(Server::accept)
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
+	result->setBool(clever_get_this(ServerObject*)->accept());
+}
 
-	if (!request) {
-		result->setBool(false);
-		return;
+struct ServerWorker {
+	ServerObject* sobj;
+	Value* request;
+	const Function* handler;
+	CMutex* accept_lock;
+	VM* vm;
+	CThread thread;
+};
+
+// Serves requests on the worker until accepting fails
+static void _serve_requests(ServerWorker* worker)
+{
+	Value* retval = new Value;
+
+	while (true) {
+		// Not every platform supports concurrent accept() calls on a socket
+		worker->accept_lock->lock();
+		bool accepted = FCGX_Accept_r(&worker->sobj->request) == 0
+			&& worker->sobj->request.envp;
+		worker->accept_lock->unlock();
+
+		if (!accepted) {
+			break;
+		}
+
+		worker->sobj->startRequest();
+
+		worker->vm->runFunction(worker->handler, ValueSpan(&worker->request, 1), retval);
+
+		worker->sobj->endResponse();
+		FCGX_Finish_r(&worker->sobj->request);
+		worker->sobj->in.reset(NULL);
 	}
 
-	if (!clever_check_no_args()) {
+	clever_delref(retval);
+}
+
+static CLEVER_THREAD_FUNC(_server_worker)
+{
+	_serve_requests(static_cast<ServerWorker*>(arg));
+
+	return 0;
+}
+
+// Server.serve(Function handler [, Int workers])
+// Serves requests on worker threads until accepting fails; each worker has
+// its own request object and copy of the VM, and calls handler(request) for
+// every request it accepts, finishing the request when handler returns.
+// The calling thread is one of the workers, which default to the number of
+// processors
+CLEVER_METHOD(Server::serve)
+{
+	if (!clever_check_args("f|i")) {
 		return;
 	}
 
-	in->clear();
-	out->clear();
+	size_t nworkers = CThread::getNumCPUs();
 
-	if (FCGX_Accept(&request->in, &request->out, &request->err, &request->envp) != 0) {
-		result->setBool(false);
-		return;
+	if (args.size() > 1) {
+		if (args[1]->getInt() <= 0) {
+			clever_throw("Number of workers must be greater than zero");
+			return;
+		}
+		nworkers = args[1]->getInt();
 	}
 
-	const char* const* n = request->envp;
-	if (!n) {
-		result->setBool(false);
-		return;
+#ifndef CLEVER_THREADS
+	nworkers = 1;
+#endif
+
+	const ServerObject* sobj = clever_get_this(ServerObject*);
+	const Function* handler = static_cast<Function*>(args[0]->getObj());
+	::std::vector<ServerWorker*> workers;
+	CMutex accept_lock;
+
+	for (size_t i = 0; i < nworkers; ++i) {
+		ServerWorker* worker = new ServerWorker;
+
+		worker->sobj = new ServerObject(sobj->socket, false);
+		worker->sobj->out.threshold = sobj->out.threshold;
+		worker->request = new Value;
+		worker->request->setObj(this, worker->sobj);
+		worker->handler = handler;
+		worker->accept_lock = &accept_lock;
+		worker->vm = i ? new VM(*clever->vm) : const_cast<VM*>(clever->vm);
+
+		workers.push_back(worker);
 	}
 
-	while (*n) {
-		::std::string l(*n);
-		::std::string k(l.substr(0, l.find_first_of("=")));
-		::std::string v(l.substr(k.length()+1));
-
-		switch (k.at(0)) {
-			case 'X':
-			case 'H':
-				if (k.find("HTTP_COOKIE") == 0) {
-					::std::string name;
-					::std::string data;
-					bool inv = false;
-
-					for (size_t position = 0; position < v.length(); position++) {
-						switch(v.at(position)){
-							case '=': inv=true; break;
-
-							case ' ':
-							case ';': {
-								inv=false;
-								if (name.size() && data.size()) {
-									in->cookie->insert(CLEVER_FCGI_PAIR(name, data));
-								}
-								name.clear();
-								data.clear();
-							} break;
-
-							default:
-								if(inv) {
-									data += v.at(position);
-								} else {
-									name += v.at(position);
-								}
-							break;
-						}
-					}
-
-					if (name.size() && data.size()) {
-						in->cookie->insert(CLEVER_FCGI_PAIR(name, data));
-					}
-				} else {
-					if (k.find("HTTP") == 0) {
-						in->head->insert(CLEVER_FCGI_PAIR(k.substr(5), v));
-					} else {
-						in->head->insert(CLEVER_FCGI_PAIR(k, v));
-					}
-				}
-				break;
-
-			default:
-				if (k.find("QUERY_STRING") == 0) {
-					size_t next = v.find("&"), last = 0;
-
-					if (next) {
-						do {
-							::std::string chunk(v.substr(last, next));
-							if (chunk.size()) {
-								size_t split = chunk.find("=");
-
-								if (split) {
-									::std::string l(chunk.substr(0, split));
-									::std::string r(chunk.substr(split+1, chunk.size()));
-									in->params->insert(CLEVER_FCGI_PAIR(l, r));
-								} else {
-									in->params->insert(CLEVER_FCGI_NULL(chunk));
-								}
-							}
-						} while((last=(next+1)) && (next = v.find("&", next+1)));
-					} else {
-						in->env->insert(CLEVER_FCGI_PAIR(k, v));
-					}
-				} else {
-					in->env->insert(CLEVER_FCGI_PAIR(k, v));
-				}
-				break;
+	for (size_t i = 1; i < nworkers; ++i) {
+		workers[i]->thread.create(_server_worker, workers[i]);
+	}
+
+	_serve_requests(workers[0]);
+
+	for (size_t i = 0; i < nworkers; ++i) {
+		if (i) {
+			workers[i]->thread.wait();
+			delete workers[i]->vm;
 		}
-		++n;
+		clever_delref(workers[i]->request);
+		delete workers[i];
 	}
-	result->setBool(true);
 }
 
 // Server.print(string text, [...])
-// Prints to the FCGI standard output
+// Prints to the FCGI standard output; output is buffered (see
+// setBufferSize()) and the response headers are sent before the first output
 CLEVER_METHOD(Server::print)
 {
 	if (!clever_check_args("s*")) {
@@ -159,18 +395,13 @@ CLEVER_METHOD(Server::print)
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (request) {
-		if (!out->inBody()) {
-			FCGX_PutStr("Content-Type: text/html\n\n", sizeof("Content-Type: text/html\n\n"), request->out);
-			out->setBody(true);
-		}
 
+	if (sobj->request.out) {
 		for (size_t arg = 0; arg < args.size(); arg++) {
 			if (args[arg]->isStr()) {
-				FCGX_PutStr(args[arg]->getStr()->c_str(),
-					args[arg]->getStr()->size(), request->out);
+				const CString* str = args[arg]->getStr();
+
+				sobj->write(str->data(), str->size());
 			}
 		}
 	}
@@ -178,7 +409,7 @@ CLEVER_METHOD(Server::print)
 }
 
 // Server.flush()
-// Flushes the FCGI standard output buffer
+// Sends the buffered output and flushes the FCGI standard output buffer
 CLEVER_METHOD(Server::flush)
 {
 	if (!clever_check_no_args()) {
@@ -186,14 +417,9 @@ CLEVER_METHOD(Server::flush)
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!clever_check_no_args()) {
-		return;
-	}
 
-	if (request) {
-		result->setBool((FCGX_FFlush(request->out) == 0));
+	if (sobj->request.out) {
+		result->setBool(sobj->flushOutput() && FCGX_FFlush(sobj->request.out) == 0);
 	} else {
 		result->setNull();
 	}
@@ -208,142 +434,257 @@ CLEVER_METHOD(Server::finish)
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
 
-	if (!clever_check_no_args()) {
+	if (sobj->request.out) {
+		sobj->endResponse();
+		result->setBool((FCGX_FClose(sobj->request.out) == 0));
+	} else {
+		result->setNull();
+	}
+}
+
+// Server.setBufferSize(Int bytes)
+// Sets how many bytes of output are buffered before being sent to the web
+// server; 0 sends every print() right away
+CLEVER_METHOD(Server::setBufferSize)
+{
+	if (!clever_check_args("i")) {
 		return;
 	}
 
-	if (request) {
-		result->setBool((FCGX_FClose(request->out) == 0));
-	} else {
-		result->setNull();
+	if (args[0]->getInt() < 0) {
+		clever_throw("Buffer size must not be negative");
+		return;
+	}
+
+	ServerObject* sobj = clever_get_this(ServerObject*);
+
+	sobj->out.threshold = args[0]->getInt();
+
+	if (sobj->out.buffer.size() >= sobj->out.threshold) {
+		sobj->flushOutput();
 	}
 }
 
-// Server.getEnvironment([string param])
-// Fetches environment information, returns map when no param specified
-CLEVER_METHOD(Server::getEnvironment)
+// Server.sendFile(String path)
+// Streams a file as the rest of the response body; when the headers were
+// not sent yet and no Content-Length was set, it is set to the file size.
+// Returns false when the file cannot be read
+CLEVER_METHOD(Server::sendFile)
 {
-	if (!clever_check_args("|s")) {
+	if (!clever_check_args("s")) {
 		return;
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
+	FILE* fp = sobj->request.out ? ::fopen(args[0]->getStr()->c_str(), "rb") : NULL;
 
-	if (!request) {
+	if (!fp) {
+		result->setBool(false);
 		return;
 	}
 
-	if (args.size()) {
-		CLEVER_FCGI_ITERATOR it = CLEVER_FCGI_FIND(in->env, args[0]->getStr()->c_str());
+	struct stat info;
 
-		if (it != CLEVER_FCGI_END(in->env)) {
-			result->setStr(CLEVER_FCGI_FETCH(it));
-			return;
-		}
-		result->setNull();
-	} else {
-		::std::vector<Value*> mapping;
+	if (!sobj->out.inBody() && ::fstat(::fileno(fp), &info) == 0
+		&& sobj->out.head->find("Content-Length") == sobj->out.head->end()) {
+		::std::ostringstream size;
 
-		CLEVER_FCGI_ITERATOR item(in->env->begin());
-		CLEVER_FCGI_ITERATOR last(in->env->end());
+		size << info.st_size;
+		sobj->out.head->insert(CLEVER_FCGI_PAIR("Content-Length", size.str()));
+	}
 
-		while (item != last) {
-			mapping.push_back(new Value(CSTRING(item->first)));
-			mapping.push_back(new Value(CSTRING(item->second)));
-			++item;
-		}
+	sobj->endResponse();
+	sobj->chunk.resize(CLEVER_FCGI_CHUNK_SIZE);
 
-		result->setObj(CLEVER_MAP_TYPE, new MapObject(mapping));
+	bool ok = true;
+	size_t n;
 
-		::std::for_each(mapping.begin(), mapping.end(), clever_delref);
+	while (ok && (n = ::fread(&sobj->chunk[0], 1, sobj->chunk.size(), fp)) > 0) {
+		ok = FCGX_PutStr(&sobj->chunk[0], n, sobj->request.out) >= 0;
 	}
+
+	ok = ok && !::ferror(fp);
+
+	::fclose(fp);
+
+	result->setBool(ok);
 }
 
-// Server.getParam(string param)
-// Fetches a request parameter
-CLEVER_METHOD(Server::getParam)
+// Server.readBody([Int maxBytes])
+// Reads up to maxBytes (default 1000000) of the request body not read yet;
+// returns an empty String at the end of the body
+CLEVER_METHOD(Server::readBody)
 {
-	if (!clever_check_args("s")) {
+	if (!clever_check_args("|i")) {
+		return;
+	}
+
+	if (!args.empty() && args[0]->getInt() <= 0) {
+		clever_throw("Number of bytes must be greater than zero");
 		return;
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
+	size_t max = args.empty() ? CLEVER_FCGI_STDIN_MAX : args[0]->getInt();
+	size_t size = 0, n;
 
-	if (!request) {
-		result->setNull();
+	sobj->chunk.resize(max);
+
+	while (size < max && (n = sobj->readInput(&sobj->chunk[size], max - size)) > 0) {
+		size += n;
+	}
+
+	_set_string(result, &sobj->chunk[0], size);
+}
+
+// Server.bodyStream(Function callback [, Int chunkSize])
+// Reads the rest of the request body in chunks of up to chunkSize bytes
+// (default 65536), calling callback with each one; reading stops early
+// when callback returns false. Returns the number of bytes read
+CLEVER_METHOD(Server::bodyStream)
+{
+	if (!clever_check_args("f|i")) {
 		return;
 	}
 
-	if (in->params->size()) {
-		CLEVER_FCGI_ITERATOR it = CLEVER_FCGI_FIND(in->params, args[0]->getStr()->c_str());
+	if (args.size() > 1 && args[1]->getInt() <= 0) {
+		clever_throw("Chunk size must be greater than zero");
+		return;
+	}
 
-		if (it != CLEVER_FCGI_END(in->params)) {
-			result->setStr(CLEVER_FCGI_FETCH(it));
-			return;
+	ServerObject* sobj = clever_get_this(ServerObject*);
+	const Function* callback = static_cast<Function*>(args[0]->getObj());
+	size_t chunk_size = args.size() > 1 ? args[1]->getInt() : CLEVER_FCGI_CHUNK_SIZE;
+	Value* chunk = new Value;
+	Value* retval = new Value;
+	size_t total = 0, n;
+
+	sobj->chunk.resize(chunk_size);
+
+	while ((n = sobj->readInput(&sobj->chunk[0], chunk_size)) > 0) {
+		total += n;
+
+		// The string is reused for the next chunk unless callback kept it
+		_set_string(chunk, &sobj->chunk[0], n);
+
+		const_cast<VM*>(clever->vm)->runFunction(callback, ValueSpan(&chunk, 1), retval);
+
+		if (retval->isBool() && !retval->getBool()) {
+			break;
 		}
 	}
 
-	result->setNull();
+	clever_delref(chunk);
+	clever_delref(retval);
+
+	result->setInt(total);
 }
 
-// Server.getParam(string param)
-// Fetches a request header (all upper-case, eg HOST not host, CONTENT_TYPE not content-type)
-CLEVER_METHOD(Server::getHeader)
+// Server.getForm([Int maxBytes])
+// Returns a Map of the fields of an application/x-www-form-urlencoded or
+// multipart/form-data request body; uploaded files are Maps with the
+// filename, type and data keys. The body, which must not be longer than
+// maxBytes (default 1000000), is read on the first call
+CLEVER_METHOD(Server::getForm)
 {
-	if (!clever_check_args("s")) {
+	if (!clever_check_args("|i")) {
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!request) {
-		result->setNull();
+	if (!args.empty() && args[0]->getInt() <= 0) {
+		clever_throw("Number of bytes must be greater than zero");
 		return;
 	}
 
-	if (in->head->size()) {
-		CLEVER_FCGI_ITERATOR it = CLEVER_FCGI_FIND(in->head, args[0]->getStr()->c_str());
-		if (it != CLEVER_FCGI_END(in->head)) {
-			result->setStr(CLEVER_FCGI_FETCH(it));
+	ServerObject* sobj = clever_get_this(ServerObject*);
+	RequestData& in = sobj->in;
+
+	if (!in.isParsed(RequestData::FORM)) {
+		size_t max = args.empty() ? CLEVER_FCGI_STDIN_MAX : args[0]->getInt();
+
+		if (!sobj->readForm(max)) {
+			clever_throw("Request body is longer than %N bytes", max);
 			return;
 		}
+
+		const RequestField* type = in.get(RequestData::ENV).find("CONTENT_TYPE", 12);
+		::std::vector<char>& body = sobj->form_body;
+
+		in.parseForm(RequestString(body.empty() ? NULL : &body[0], body.size()),
+			type ? type->value : RequestString());
 	}
-	result->setNull();
+
+	MapObject* map = _fields_map(in.get(RequestData::FORM));
+	const ::std::vector<RequestFile>& files = in.getFiles();
+
+	for (size_t i = 0; i < files.size(); ++i) {
+		MapObject* file = new MapObject;
+		Value* value = new Value;
+
+		_map_insert(file, RequestString("filename", 8), files[i].filename);
+		_map_insert(file, RequestString("type", 4), files[i].type);
+		_map_insert(file, RequestString("data", 4), files[i].data);
+
+		value->setObj(CLEVER_MAP_TYPE, file);
+		_map_insert(map, files[i].name, value);
+	}
+
+	result->setObj(CLEVER_MAP_TYPE, map);
 }
 
-// Server.getCookie(string param)
-// Fetches a request cookie
-CLEVER_METHOD(Server::getCookie)
+// Server.getEnvironment([string param])
+// Fetches environment information, returns map when no param specified
+CLEVER_METHOD(Server::getEnvironment)
+{
+	if (!clever_check_args("|s")) {
+		return;
+	}
+
+	RequestData& in = clever_get_this(ServerObject*)->in;
+
+	if (args.size()) {
+		_get_field(in, RequestData::ENV, args[0], result);
+	} else {
+		_get_fields(in, RequestData::ENV, result);
+	}
+}
+
+// Server.getParam(string param)
+// Fetches a request parameter
+CLEVER_METHOD(Server::getParam)
 {
 	if (!clever_check_args("s")) {
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
+	_get_field(clever_get_this(ServerObject*)->in, RequestData::PARAMS, args[0], result);
+}
 
-	if (!request) {
+// Server.getParam(string param)
+// Fetches a request header (all upper-case, eg HOST not host, CONTENT_TYPE not content-type)
+CLEVER_METHOD(Server::getHeader)
+{
+	if (!clever_check_args("s")) {
 		return;
 	}
 
-	if (in->cookie->size()) {
-		CLEVER_FCGI_ITERATOR it = CLEVER_FCGI_FIND(in->cookie, args[0]->getStr()->c_str());
+	_get_field(clever_get_this(ServerObject*)->in, RequestData::HEAD, args[0], result);
+}
 
-		if ((it != CLEVER_FCGI_END(in->cookie))) {
-			result->setStr(CLEVER_FCGI_FETCH(it));
-			return;
-		}
+// Server.getCookie(string param)
+// Fetches a request cookie
+CLEVER_METHOD(Server::getCookie)
+{
+	if (!clever_check_args("s")) {
+		return;
 	}
-	result->setNull();
+
+	_get_field(clever_get_this(ServerObject*)->in, RequestData::COOKIE, args[0], result);
 }
 
 // Server.debug()
-// Prints the request environment to the FCGI standard output
+// Prints the request environment to the response, like print()
 CLEVER_METHOD(Server::debug)
 {
 	if (!clever_check_no_args()) {
@@ -351,22 +692,16 @@ CLEVER_METHOD(Server::debug)
 	}
 
 	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!request) {
-		return;
-	}
+	const char* const* next = sobj->request.envp;
 
-	const char* const* next = request->envp;
-
-	if (next) {
-		FCGX_PutStr("<pre>\n", sizeof("<pre>\n"), request->out);
+	if (next && sobj->request.out) {
+		sobj->write("<pre>\n", sizeof("<pre>\n") - 1);
 		while (*next) {
-			FCGX_PutStr(*next, strlen(*next), request->out);
-			FCGX_PutStr("\n", sizeof("\n"), request->out);
+			sobj->write(*next, strlen(*next));
+			sobj->write("\n", 1);
 			++next;
 		}
-		FCGX_PutStr("</pre>\n", sizeof("</pre>\n"), request->out);
+		sobj->write("</pre>\n", sizeof("</pre>\n") - 1);
 	}
 }
 
@@ -378,27 +713,7 @@ CLEVER_METHOD(Server::getParams)
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!request) {
-		return;
-	}
-
-	::std::vector<Value*> mapping;
-
-	CLEVER_FCGI_ITERATOR item(in->params->begin());
-	CLEVER_FCGI_ITERATOR last(in->params->end());
-
-	while (item != last) {
-		mapping.push_back(new Value(CSTRING(item->first)));
-		mapping.push_back(new Value(CSTRING(item->second)));
-		++item;
-	}
-
-	result->setObj(CLEVER_MAP_TYPE, new MapObject(mapping));
-
-	::std::for_each(mapping.begin(), mapping.end(), clever_delref);
+	_get_fields(clever_get_this(ServerObject*)->in, RequestData::PARAMS, result);
 }
 
 // Server.getHeaders()
@@ -409,27 +724,7 @@ CLEVER_METHOD(Server::getHeaders)
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!request) {
-		return;
-	}
-
-	::std::vector<Value*> mapping;
-
-	CLEVER_FCGI_ITERATOR item(in->head->begin());
-	CLEVER_FCGI_ITERATOR last(in->head->end());
-
-	while (item != last) {
-		mapping.push_back(new Value(CSTRING(item->first)));
-		mapping.push_back(new Value(CSTRING(item->second)));
-		++item;
-	}
-
-	result->setObj(CLEVER_MAP_TYPE, new MapObject(mapping));
-
-	::std::for_each(mapping.begin(), mapping.end(), clever_delref);
+	_get_fields(clever_get_this(ServerObject*)->in, RequestData::HEAD, result);
 }
 
 // Server.getCookies()
@@ -440,27 +735,7 @@ CLEVER_METHOD(Server::getCookies)
 		return;
 	}
 
-	ServerObject* sobj = clever_get_this(ServerObject*);
-	FCGX_Request* request = sobj->request;
-
-	if (!request) {
-		return;
-	}
-
-	::std::vector<Value*> mapping;
-
-	CLEVER_FCGI_ITERATOR item(in->cookie->begin());
-	CLEVER_FCGI_ITERATOR last(in->cookie->end());
-
-	while (item != last) {
-		mapping.push_back(new Value(CSTRING(item->first)));
-		mapping.push_back(new Value(CSTRING(item->second)));
-		++item;
-	}
-
-	result->setObj(CLEVER_MAP_TYPE, new MapObject(mapping));
-
-	::std::for_each(mapping.begin(), mapping.end(), clever_delref);
+	_get_fields(clever_get_this(ServerObject*)->in, RequestData::COOKIE, result);
 }
 
 // Server.setHeader(string key, string value)
@@ -471,7 +746,7 @@ CLEVER_METHOD(Server::setHeader)
 		return;
 	}
 
-	out->head->insert(CLEVER_FCGI_PAIR(args[0]->getStr()->c_str(), args[1]->getStr()->c_str()));
+	clever_get_this(ServerObject*)->out.head->insert(CLEVER_FCGI_PAIR(args[0]->getStr()->c_str(), args[1]->getStr()->c_str()));
 }
 
 // Server.setCookie(string key, string value, [string path, [string expires]])
@@ -482,7 +757,7 @@ CLEVER_METHOD(Server::setCookie)
 		return;
 	}
 
-	out->cookie->insert(CLEVER_FCGI_PAIR(args[0]->getStr()->c_str(), args[1]->getStr()->c_str()));
+	clever_get_this(ServerObject*)->out.cookie->insert(CLEVER_FCGI_PAIR(args[0]->getStr()->c_str(), args[1]->getStr()->c_str()));
 }
 
 CLEVER_TYPE_INIT(Server::init)
@@ -491,10 +766,17 @@ CLEVER_TYPE_INIT(Server::init)
 
 	// IO
 	addMethod(new Function("accept", (MethodPtr)&Server::accept));
+	addMethod(new Function("serve",  (MethodPtr)&Server::serve));
 	addMethod(new Function("print",  (MethodPtr)&Server::print));
 	addMethod(new Function("flush",  (MethodPtr)&Server::flush));
 	addMethod(new Function("finish", (MethodPtr)&Server::finish));
 
+	addMethod(new Function("setBufferSize", (MethodPtr)&Server::setBufferSize));
+	addMethod(new Function("sendFile",      (MethodPtr)&Server::sendFile));
+	addMethod(new Function("readBody",      (MethodPtr)&Server::readBody));
+	addMethod(new Function("bodyStream",    (MethodPtr)&Server::bodyStream));
+	addMethod(new Function("getForm",       (MethodPtr)&Server::getForm));
+
 	// Util
 	addMethod(new Function("getEnvironment", (MethodPtr)&Server::getEnvironment));
 	addMethod(new Function("getParam",       (MethodPtr)&Server::getParam));
@@ -9,99 +9,130 @@
 #define CLEVER_STD_FCGI_SERVER_H
 
 #include <map>
+#include <string>
+#include <vector>
 #include <iostream>
 #include "core/cstring.h"
 #include "core/type.h"
+#include "modules/std/fcgi/request.h"
 
 namespace clever { namespace modules { namespace std {
 
+class ResponseData {
+public:
+	/// Default number of buffered bytes that causes a flush
+	static const size_t BUFFER_SIZE = 8192;
+
+	CLEVER_FCGI_MAP* head;
+	CLEVER_FCGI_MAP* cookie;
+	bool body;
+
+	/// Output not yet sent to the web server; headers are written here too
+	::std::string buffer;
+	size_t threshold;
+
+	ResponseData() {
+		head = new CLEVER_FCGI_MAP();
+		cookie = new CLEVER_FCGI_MAP();
+		body = false;
+		threshold = BUFFER_SIZE;
+	}
+
+	~ResponseData() {
+		delete head;
+		delete cookie;
+	}
+
+	void setBody(bool flag) 	{ body = flag; }
+	bool inBody()				{ return body; }
+
+	void clear() {
+		head->clear();
+		cookie->clear();
+		setBody(false);
+		buffer.clear();
+	}
+};
+
+/**
+ * A FastCGI request slot
+ *
+ * Each object owns its FCGX_Request and the state of the request being
+ * served, so objects sharing a listening socket can serve requests on
+ * different threads.
+ */
 struct ServerObject : public TypeObject {
-	ServerObject()
-		: request(new FCGX_Request) {}
+	ServerObject(int socket_, bool owns_socket_)
+		: socket(socket_), owns_socket(owns_socket_) {
+		FCGX_InitRequest(&request, socket, 0);
+	}
 
-	~ServerObject() {
-		delete request;
+	~ServerObject();
+
+	/// Waits for the next request; the previous request is finished first
+	bool accept();
+
+	/// Appends to the response, sending the headers before the first output
+	void write(const char* data, size_t size);
+
+	/// Sends the buffered output to the web server
+	bool flushOutput();
+
+	/// Sends the headers, if not sent yet, and the buffered output
+	void endResponse();
+
+	/// Reads up to size bytes of the request body; returns 0 at its end
+	size_t readInput(char* data, size_t size);
+
+	/// Reads the rest of the request body into form_body; returns false
+	/// when it is longer than max bytes
+	bool readForm(size_t max);
+
+	/// Resets the request state for the request just accepted
+	void startRequest() {
+		in.reset(request.envp);
+		out.clear();
+		form_body.clear();
 	}
 
-	FCGX_Request* request;
+	FCGX_Request request;
+	int socket;
+	bool owns_socket;
+	RequestData in;
+	ResponseData out;
+
+	/// Body read by getForm(), which the form fields point into
+	::std::vector<char> form_body;
+
+	/// Buffer reused by readBody(), bodyStream() and sendFile()
+	::std::vector<char> chunk;
+private:
+	void writeHeaders();
+
+	DISALLOW_COPY_AND_ASSIGN(ServerObject);
 };
 
 class Server : public Type {
 public:
-	class RequestData {
-	public:
-		CLEVER_FCGI_MAP* env;
-		CLEVER_FCGI_MAP* head;
-		CLEVER_FCGI_MAP* cookie;
-		CLEVER_FCGI_MAP* params;
-
-		RequestData() {
-			env = new CLEVER_FCGI_MAP();
-			head = new CLEVER_FCGI_MAP();
-			cookie = new CLEVER_FCGI_MAP();
-			params = new CLEVER_FCGI_MAP();
-		}
-
-		~RequestData() {
-			delete env;
-			delete head;
-			delete cookie;
-			delete params;
-		}
-
-		void clear() {
-			env->clear();
-			head->clear();
-			cookie->clear();
-			params->clear();
-		}
-	};
-
-	class ResponseData {
-	public:
-		CLEVER_FCGI_MAP* head;
-		CLEVER_FCGI_MAP* cookie;
-		bool body;
-
-		ResponseData() {
-			head = new CLEVER_FCGI_MAP();
-			cookie = new CLEVER_FCGI_MAP();
-			body = false;
-		}
-
-		~ResponseData() {
-			delete head;
-			delete cookie;
-		}
-
-		void setBody(bool flag) 	{ body = flag; }
-		bool inBody()				{ return body; }
-
-		void clear() {
-			head->clear();
-			cookie->clear();
-			setBody(false);
-		}
-	};
-
-	RequestData* in;
-	ResponseData* out;
-
 	Server()
-		: Type("Server"), in(new RequestData()), out(new ResponseData()) {}
+		: Type("Server") {}
 
-	~Server() {
-		delete in;
-		delete out;
-	}
+	~Server() {}
 
 	virtual void init();
 
 	CLEVER_METHOD(ctor);
 	CLEVER_METHOD(accept);
+	CLEVER_METHOD(serve);
 	CLEVER_METHOD(finish);
 	CLEVER_METHOD(print);
 	CLEVER_METHOD(flush);
+	CLEVER_METHOD(setBufferSize);
+	CLEVER_METHOD(sendFile);
+
+	CLEVER_METHOD(readBody);
+	CLEVER_METHOD(bodyStream);
+	CLEVER_METHOD(getForm);
 
 	CLEVER_METHOD(getEnvironment);
 	CLEVER_METHOD(getParam);
@@ -116,6 +147,8 @@ public:
 	CLEVER_METHOD(setCookie);
 
 	CLEVER_METHOD(debug);
+private:
+	DISALLOW_COPY_AND_ASSIGN(Server);
 };
 
 }}} // clever::modules::std
@@ -25,15 +25,23 @@
 #include "modules/std/core/function.h"
 #include "core/type.h"
 #include "core/value.h"
+#include "core/cexception.h"
+#include "modules/std/core/str.h"
 #include "modules/std/ffi/ffi.h"
 #include "modules/std/ffi/ffistruct.h"
 #include "modules/std/ffi/ffitypes.h"
 
 namespace clever { namespace modules { namespace std {
 
-extern "C" {
-typedef void (*ffi_call_func)();
-}
+// Arguments stored on the stack by FFIFunction.call()
+#define CLEVER_FFI_LOCAL_ARGS 8
+
+union FFIArgValue {
+	int i;
+	double d;
+	char b;
+	void* p;
+};
 
 #if defined(CLEVER_WIN32)
 static const char* CLEVER_DYLIB_EXT = ".dll";
@@ -105,7 +113,7 @@ static inline ffi_call_func _ffi_get_pf(void* lib_handler, const CString* func)
 }
 
 static void _ffi_call(Value* result, ffi_call_func pf, size_t n_args,
-					  FFIType rt, const ::std::vector<Value*>& args, size_t offset,
+					  FFIType rt, ValueSpan args, size_t offset,
 					  ExtMemberType* ext_args_types = 0)
 {
 	ffi_cif cif;
@@ -412,6 +420,233 @@ CLEVER_METHOD(FFI::unload)
 	}
 }
 
+FFIFunctionData::~FFIFunctionData()
+{
+	if (m_lib_handler) {
+		dlclose(m_lib_handler);
+	}
+}
+
+// FFIFunction.new(FFILib|String lib, String name, Int return_type, [Int arg_type, ...])
+CLEVER_METHOD(FFIFunction::ctor)
+{
+	if (!clever_check_args(".si*")) {
+		return;
+	}
+
+	::std::string lib_name;
+
+	if (args[0]->isStr()) {
+		lib_name = *args[0]->getStr();
+	} else if (args[0]->getType() == m_ffi) {
+		lib_name = static_cast<FFIData*>(args[0]->getObj())->m_lib_name;
+	} else {
+		clever_throw("Argument #1 expects a String or FFILib, but %T was supplied",
+			args[0]->getType());
+		return;
+	}
+
+	FFIFunctionData* fn = new FFIFunctionData;
+
+	fn->m_func_name = *args[1]->getStr();
+	fn->m_rtype = static_cast<FFIType>(args[2]->getInt());
+
+	if (fn->m_rtype == FFIPOINTER || fn->m_rtype == FFISTRUCT
+		|| _find_ffi_type(fn->m_rtype) == NULL) {
+		clever_throw("Unsupported return type for function `%s'",
+			fn->m_func_name.c_str());
+		clever_delref(fn);
+		return;
+	}
+
+	for (size_t i = 3, n = args.size(); i < n; ++i) {
+		if (!args[i]->isInt()) {
+			clever_throw("Argument #%N expects an Int, but %T was supplied",
+				i + 1, args[i]->getType());
+			clever_delref(fn);
+			return;
+		}
+
+		FFIType type = static_cast<FFIType>(args[i]->getInt());
+		ffi_type* ftype = _find_ffi_type(type);
+
+		if (type == FFIVOID || ftype == NULL) {
+			clever_throw("Invalid type for argument #%N of function `%s'",
+				i - 2, fn->m_func_name.c_str());
+			clever_delref(fn);
+			return;
+		}
+
+		fn->m_arg_types.push_back(type);
+		fn->m_ffi_args.push_back(ftype);
+	}
+
+	// The library handle is kept for as long as the function is alive,
+	// independently of any FFILib object
+	fn->m_lib_handler = dlopen((lib_name + CLEVER_DYLIB_EXT).c_str(), RTLD_LAZY);
+
+	if (fn->m_lib_handler == NULL) {
+		clever_throw("Failed to open %s!", lib_name.c_str());
+		clever_delref(fn);
+		return;
+	}
+
+	fn->m_func = _ffi_dlsym(fn->m_lib_handler, fn->m_func_name.c_str());
+
+	if (fn->m_func == NULL) {
+		clever_throw("function `%s' don't exist!", fn->m_func_name.c_str());
+		clever_delref(fn);
+		return;
+	}
+
+	if (ffi_prep_cif(&fn->m_cif, FFI_DEFAULT_ABI, fn->m_ffi_args.size(),
+		_find_ffi_type(fn->m_rtype),
+		fn->m_ffi_args.empty() ? NULL : &fn->m_ffi_args[0]) != FFI_OK) {
+		clever_throw("Failed to prepare the call interface of `%s'",
+			fn->m_func_name.c_str());
+		clever_delref(fn);
+		return;
+	}
+
+	result->setObj(this, fn);
+}
+
+// FFIFunction.call(...)
+CLEVER_METHOD(FFIFunction::call)
+{
+	const FFIFunctionData* fn = clever_get_this(FFIFunctionData*);
+	size_t n_args = fn->m_arg_types.size();
+
+	if (args.size() != n_args) {
+		clever_throw("Function `%s' expects %N argument(s), but %N were supplied",
+			fn->m_func_name.c_str(), n_args, args.size());
+		return;
+	}
+
+	FFIArgValue local_values[CLEVER_FFI_LOCAL_ARGS];
+	void* local_ptrs[CLEVER_FFI_LOCAL_ARGS];
+	::std::vector<FFIArgValue> heap_values;
+	::std::vector<void*> heap_ptrs;
+	FFIArgValue* values = local_values;
+	void** ptrs = local_ptrs;
+
+	if (n_args > CLEVER_FFI_LOCAL_ARGS) {
+		heap_values.resize(n_args);
+		heap_ptrs.resize(n_args);
+		values = &heap_values[0];
+		ptrs = &heap_ptrs[0];
+	}
+
+	for (size_t i = 0; i < n_args; ++i) {
+		const Value* v = args[i];
+
+		switch (fn->m_arg_types[i]) {
+			case FFIINT:
+				if (!v->isInt()) {
+					clever_throw("Argument #%N expects an Int, but %T was supplied",
+						i + 1, v->getType());
+					return;
+				}
+				values[i].i = v->getInt();
+				break;
+			case FFIDOUBLE:
+				if (v->isDouble()) {
+					values[i].d = v->getDouble();
+				} else if (v->isInt()) {
+					values[i].d = v->getInt();
+				} else {
+					clever_throw("Argument #%N expects a Double, but %T was supplied",
+						i + 1, v->getType());
+					return;
+				}
+				break;
+			case FFIBOOL:
+				if (!v->isBool()) {
+					clever_throw("Argument #%N expects a Bool, but %T was supplied",
+						i + 1, v->getType());
+					return;
+				}
+				values[i].b = v->getBool();
+				break;
+			case FFISTRING:
+				if (!v->isStr()) {
+					clever_throw("Argument #%N expects a String, but %T was supplied",
+						i + 1, v->getType());
+					return;
+				}
+				values[i].p = const_cast<char*>(v->getStr()->c_str());
+				break;
+			default:
+				if (v->isNull()) {
+					values[i].p = NULL;
+				} else if (v->isInt() || v->isDouble() || v->isBool() || v->isStr()) {
+					clever_throw("Argument #%N expects a pointer, but %T was supplied",
+						i + 1, v->getType());
+					return;
+				} else {
+					values[i].p = static_cast<FFIStructData*>(v->getObj())->data;
+				}
+				break;
+		}
+
+		ptrs[i] = &values[i];
+	}
+
+	ffi_cif* cif = const_cast<ffi_cif*>(&fn->m_cif);
+
+	switch (fn->m_rtype) {
+		case FFIINT:
+			{
+				ffi_arg rv;
+
+				ffi_call(cif, fn->m_func, &rv, ptrs);
+				result->setInt(static_cast<int>(rv));
+			}
+			break;
+		case FFIBOOL:
+			{
+				ffi_arg rv;
+
+				ffi_call(cif, fn->m_func, &rv, ptrs);
+				result->setBool(static_cast<char>(rv) != 0);
+			}
+			break;
+		case FFIDOUBLE:
+			{
+				double rv;
+
+				ffi_call(cif, fn->m_func, &rv, ptrs);
+				result->setDouble(rv);
+			}
+			break;
+		case FFISTRING:
+			{
+				char* rv;
+
+				ffi_call(cif, fn->m_func, &rv, ptrs);
+
+				// As with FFILib, returned strings are owned by the caller
+				if (rv) {
+					result->setStr(new StrObject(rv));
+					free(rv);
+				}
+			}
+			break;
+		default:
+			ffi_call(cif, fn->m_func, NULL, ptrs);
+			result->setBool(true);
+			break;
+	}
+}
+
+// FFIFunction type initialization
+CLEVER_TYPE_INIT(FFIFunction::init)
+{
+	setConstructor((MethodPtr) &FFIFunction::ctor);
+
+	addMethod(new Function("call", (MethodPtr)&FFIFunction::call));
+}
+
 // FFI type initialization
 CLEVER_TYPE_INIT(FFI::init)
 {
@@ -431,7 +666,10 @@ CLEVER_TYPE_INIT(FFI::init)
 // FFI module initialization
 CLEVER_MODULE_INIT(FFIModule)
 {
-	addType(new FFI);
+	FFI* ffi = new FFI;
+
+	addType(ffi);
+	addType(new FFIFunction(ffi));
 	addType(new FFIStruct);
 	addType(new FFITypes);
 }
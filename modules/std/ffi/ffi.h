@@ -12,10 +12,17 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
+#ifndef __APPLE__
+# include <ffi.h>
+#else
+# include <ffi/ffi.h>
+#endif
 #include "core/cstring.h"
 #include "core/type.h"
 #include "core/vm.h"
 #include "core/module.h"
+#include "modules/std/ffi/ffistruct.h"
 
 #ifdef CLEVER_APPLE
 # define MACOSX
@@ -26,6 +33,10 @@ namespace clever { namespace modules { namespace std {
 class FFI;
 typedef void* LibHandler;
 
+extern "C" {
+typedef void (*ffi_call_func)();
+}
+
 typedef ::std::map<CString, Function*> FFIMethodsMap;
 typedef ::std::map<CString, bool> FFIMethodsStatus;
 
@@ -68,6 +79,39 @@ private:
 	DISALLOW_COPY_AND_ASSIGN(FFI);
 };
 
+// A C function bound once with a fixed signature
+struct FFIFunctionData : public TypeObject {
+	FFIFunctionData()
+		: m_lib_handler(NULL), m_func(NULL), m_rtype(FFIVOID) {}
+
+	~FFIFunctionData();
+
+	::std::string m_func_name;
+	LibHandler m_lib_handler;
+	ffi_call_func m_func;
+	ffi_cif m_cif;
+	FFIType m_rtype;
+	ExtMemberType m_arg_types;
+	::std::vector<ffi_type*> m_ffi_args;
+};
+
+class FFIFunction : public Type {
+public:
+	FFIFunction(const FFI* ffi)
+		: Type("FFIFunction"), m_ffi(ffi) {}
+
+	~FFIFunction() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(call);
+private:
+	const FFI* m_ffi;
+
+	DISALLOW_COPY_AND_ASSIGN(FFIFunction);
+};
+
 class FFIModule : public Module {
 public:
 	FFIModule()
@@ -67,10 +67,10 @@ CLEVER_METHOD(CFile::read)
 
 	CFileStream* file = clever_get_this(CFileStream*);
 
-	CString* token = new CString;
-	file->getStream() >> *token;
+	StrObject* token = new StrObject;
+	file->getStream() >> token->getBuffer();
 
-	result->setStr(new StrObject(token, false));
+	result->setStr(token);
 }
 
 // string File.readLine()
@@ -83,15 +83,15 @@ CLEVER_METHOD(CFile::readLine)
 
 	CFileStream* file = clever_get_this(CFileStream*);
 
-	CString* token = new CString;
-
     if (file->getStream().eof()) {
         result->setBool(false);
         return;
     }
 
-	::std::getline(file->getStream(), *token);
-	result->setStr(new StrObject(token, false));
+	StrObject* token = new StrObject;
+
+	::std::getline(file->getStream(), token->getBuffer());
+	result->setStr(token);
 }
 
 // boolean File.eof()
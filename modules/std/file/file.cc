@@ -18,6 +18,7 @@
 #include "core/vm.h"
 #include "core/type.h"
 #include "modules/std/file/cfile.h"
+#include "modules/std/file/mappedfile.h"
 #include "modules/std/file/file.h"
 #include "modules/std/core/function.h"
 #include "modules/std/core/array.h"
@@ -186,6 +187,11 @@ CLEVER_MODULE_INIT(FileModule)
 	addFunction(new Function("dirname",     &CLEVER_NS_FNAME(file, dirname)));
 
 	addType(new CFile);
+
+	MappedLines* lines_type = new MappedLines;
+
+	addType(lines_type);
+	addType(new MappedFile(lines_type));
 }
 
 }}} // clever::modules::std
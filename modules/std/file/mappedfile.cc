@@ -0,0 +1,433 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "core/value.h"
+#include "core/clever.h"
+#include "core/cexception.h"
+#include "modules/std/file/mappedfile.h"
+#include "modules/std/core/function.h"
+
+namespace clever { namespace modules { namespace std {
+
+// MappedFileObject ////////////////////////////////////////////////////////////
+
+bool MappedFileObject::open(const char* path)
+{
+	int fd = ::open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+
+	if (::fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	m_size = info.st_size;
+	m_pos = 0;
+
+	// Empty files cannot be mapped, but are valid
+	if (m_size) {
+		void* addr = ::mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (addr == MAP_FAILED) {
+			::close(fd);
+			m_size = 0;
+			return false;
+		}
+		m_data = static_cast<const char*>(addr);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+	m_open = true;
+
+	advise(MADV_SEQUENTIAL);
+
+	return true;
+}
+
+void MappedFileObject::close()
+{
+	if (m_data) {
+		::munmap(const_cast<char*>(m_data), m_size);
+		m_data = NULL;
+	}
+
+	m_size = m_pos = 0;
+	m_open = false;
+
+	for (size_t i = 0; i < 2; ++i) {
+		if (m_chunks[i]) {
+			m_chunks[i]->delRef();
+			m_chunks[i] = NULL;
+		}
+	}
+}
+
+bool MappedFileObject::advise(int advice)
+{
+	if (m_data == NULL) {
+		return m_open;
+	}
+
+	return ::madvise(const_cast<char*>(m_data), m_size, advice) == 0;
+}
+
+StrObject* MappedFileObject::readChunk(size_t len)
+{
+	if (len > m_size - m_pos) {
+		len = m_size - m_pos;
+	}
+
+	// The older chunk was released by the script when it stored the newer
+	// one in the same variable
+	StrObject*& slot = m_chunks[m_next];
+
+	m_next ^= 1;
+
+	if (slot == NULL || slot->refCount() != 1) {
+		if (slot) {
+			slot->delRef();
+		}
+		slot = new StrObject;
+	}
+
+	slot->getBuffer().assign(m_data + m_pos, len);
+	slot->addRef();
+
+	m_pos += len;
+
+	return slot;
+}
+
+// MappedLinesObject ///////////////////////////////////////////////////////////
+
+void MappedLinesObject::find()
+{
+	size_t size = m_file->size();
+
+	if (m_pos >= size) {
+		m_eol = m_pos;
+		return;
+	}
+
+	const char* begin = m_file->data() + m_pos;
+	const char* eol = static_cast<const char*>(
+		::memchr(begin, '\n', size - m_pos));
+
+	m_eol = eol ? m_pos + (eol - begin) : size;
+}
+
+StrObject* MappedLinesObject::get() const
+{
+	size_t len = m_eol - m_pos;
+	StrObject* str;
+
+	// As String.splitLines(), \r\n ends a line too
+	if (len && m_file->data()[m_pos + len - 1] == '\r') {
+		--len;
+	}
+
+	if (len == 1) {
+		str = StrObject::getChar(m_file->data()[m_pos]);
+		str->addRef();
+	} else {
+		str = new StrObject;
+		str->getBuffer().assign(m_file->data() + m_pos, len);
+	}
+
+	return str;
+}
+
+// MappedLines /////////////////////////////////////////////////////////////////
+
+// MappedLines MappedLines.begin()
+// Returns the iterator itself, for use in foreach loops
+CLEVER_METHOD(MappedLines::begin)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MappedLinesObject* lines = clever_get_this(MappedLinesObject*);
+
+	lines->addRef();
+	result->setObj(this, lines);
+}
+
+// MappedLines MappedLines.end()
+// Returns an iterator past the last line
+CLEVER_METHOD(MappedLines::end)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MappedFileObject* file = clever_get_this(MappedLinesObject*)->getFile();
+
+	result->setObj(this, new MappedLinesObject(file, file->size()));
+}
+
+// String MappedLines.get()
+// Returns the current line without the line terminator, or null past the end
+CLEVER_METHOD(MappedLines::get)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MappedLinesObject* lines = clever_get_this(MappedLinesObject*);
+
+	if (!lines->isValid()) {
+		result->setNull();
+		return;
+	}
+
+	result->setStr(lines->get());
+}
+
+// MappedLines MappedLines.next()
+// Advances to the next line, returning the same iterator
+CLEVER_METHOD(MappedLines::next)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MappedLinesObject* lines = clever_get_this(MappedLinesObject*);
+
+	if (lines->isValid()) {
+		lines->next();
+	}
+
+	lines->addRef();
+	result->setObj(this, lines);
+}
+
+// Bool MappedLines.valid()
+// Returns false once every line was read
+CLEVER_METHOD(MappedLines::valid)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setBool(clever_get_this(MappedLinesObject*)->isValid());
+}
+
+// == operator
+CLEVER_TYPE_OPERATOR(MappedLines::equal)
+{
+	if (EXPECTED(rhs->getType() == this)) {
+		const MappedLinesObject* l_iter =
+			static_cast<MappedLinesObject*>(lhs->getObj());
+		const MappedLinesObject* r_iter =
+			static_cast<MappedLinesObject*>(rhs->getObj());
+
+		result->setBool(l_iter->getFile() == r_iter->getFile()
+			&& l_iter->getPos() == r_iter->getPos());
+	}
+}
+
+// != operator
+CLEVER_TYPE_OPERATOR(MappedLines::not_equal)
+{
+	if (EXPECTED(rhs->getType() == this)) {
+		const MappedLinesObject* l_iter =
+			static_cast<MappedLinesObject*>(lhs->getObj());
+		const MappedLinesObject* r_iter =
+			static_cast<MappedLinesObject*>(rhs->getObj());
+
+		result->setBool(l_iter->getFile() != r_iter->getFile()
+			|| l_iter->getPos() != r_iter->getPos());
+	}
+}
+
+CLEVER_TYPE_INIT(MappedLines::init)
+{
+	addMethod(new Function("begin", (MethodPtr)&MappedLines::begin));
+	addMethod(new Function("end",   (MethodPtr)&MappedLines::end));
+	addMethod(new Function("get",   (MethodPtr)&MappedLines::get));
+	addMethod(new Function("next",  (MethodPtr)&MappedLines::next));
+	addMethod(new Function("valid", (MethodPtr)&MappedLines::valid));
+}
+
+// MappedFile //////////////////////////////////////////////////////////////////
+
+// MappedFile MappedFile.new(String path)
+// Maps the whole file for reading, advised for sequential access
+CLEVER_METHOD(MappedFile::ctor)
+{
+	if (!clever_check_args("s")) {
+		return;
+	}
+
+	MappedFileObject* file = new MappedFileObject;
+
+	if (!file->open(args[0]->getStr()->c_str())) {
+		clever_throw("Could not map file `%S'", args[0]->getStr());
+		file->delRef();
+		return;
+	}
+
+	result->setObj(this, file);
+}
+
+// Int MappedFile.size()
+CLEVER_METHOD(MappedFile::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(MappedFileObject*)->size());
+}
+
+// Int MappedFile.tell()
+// Returns the position used by readChunk() and readLine()
+CLEVER_METHOD(MappedFile::tell)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(MappedFileObject*)->tell());
+}
+
+// void MappedFile.seek(Int pos)
+CLEVER_METHOD(MappedFile::seek)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	long pos = args[0]->getInt();
+
+	clever_get_this(MappedFileObject*)->seek(pos < 0 ? 0 : pos);
+}
+
+// Bool MappedFile.eof()
+CLEVER_METHOD(MappedFile::eof)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	const MappedFileObject* file = clever_get_this(MappedFileObject*);
+
+	result->setBool(file->tell() >= file->size());
+}
+
+// Bool MappedFile.advise(Int advice)
+// Hints the expected access: MappedFile.NORMAL, SEQUENTIAL or RANDOM
+CLEVER_METHOD(MappedFile::advise)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	result->setBool(clever_get_this(MappedFileObject*)->advise(args[0]->getInt()));
+}
+
+// String MappedFile.readChunk(Int len)
+// Returns the next len bytes, or false at the end of the file
+CLEVER_METHOD(MappedFile::readChunk)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	MappedFileObject* file = clever_get_this(MappedFileObject*);
+
+	if (args[0]->getInt() <= 0) {
+		clever_throw("Chunk length must be positive");
+		return;
+	}
+
+	if (file->tell() >= file->size()) {
+		result->setBool(false);
+		return;
+	}
+
+	result->setStr(file->readChunk(args[0]->getInt()));
+}
+
+// String MappedFile.readLine()
+// Returns the contents until the next line, or false at the end of the file
+CLEVER_METHOD(MappedFile::readLine)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	MappedFileObject* file = clever_get_this(MappedFileObject*);
+
+	if (file->tell() >= file->size()) {
+		result->setBool(false);
+		return;
+	}
+
+	MappedLinesObject line(file, file->tell());
+
+	result->setStr(line.get());
+
+	line.next();
+	file->seek(line.getPos());
+}
+
+// MappedLines MappedFile.lines()
+// Returns an iterator over the lines of the whole file
+CLEVER_METHOD(MappedFile::lines)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setObj(m_lines_type,
+		new MappedLinesObject(clever_get_this(MappedFileObject*), 0));
+}
+
+// void MappedFile.close()
+// Unmaps the file; strings already read remain valid
+CLEVER_METHOD(MappedFile::close)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	clever_get_this(MappedFileObject*)->close();
+}
+
+CLEVER_TYPE_INIT(MappedFile::init)
+{
+	setConstructor((MethodPtr)&MappedFile::ctor);
+
+	addMethod(new Function("size",      (MethodPtr)&MappedFile::size));
+	addMethod(new Function("tell",      (MethodPtr)&MappedFile::tell));
+	addMethod(new Function("seek",      (MethodPtr)&MappedFile::seek));
+	addMethod(new Function("eof",       (MethodPtr)&MappedFile::eof));
+	addMethod(new Function("advise",    (MethodPtr)&MappedFile::advise));
+	addMethod(new Function("readChunk", (MethodPtr)&MappedFile::readChunk));
+	addMethod(new Function("readLine",  (MethodPtr)&MappedFile::readLine));
+	addMethod(new Function("lines",     (MethodPtr)&MappedFile::lines));
+	addMethod(new Function("close",     (MethodPtr)&MappedFile::close));
+
+	addProperty("NORMAL",     new Value(long(MADV_NORMAL),     true));
+	addProperty("SEQUENTIAL", new Value(long(MADV_SEQUENTIAL), true));
+	addProperty("RANDOM",     new Value(long(MADV_RANDOM),     true));
+}
+
+}}} // clever::modules::std
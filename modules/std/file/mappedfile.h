@@ -0,0 +1,151 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_MAPPEDFILE_H
+#define CLEVER_STD_MAPPEDFILE_H
+
+#include "core/type.h"
+#include "modules/std/core/str.h"
+
+namespace clever { namespace modules { namespace std {
+
+/**
+ * Read-only memory mapping of a whole file
+ */
+class MappedFileObject : public TypeObject {
+public:
+	MappedFileObject()
+		: m_data(NULL), m_size(0), m_pos(0), m_open(false), m_next(0) {
+		m_chunks[0] = m_chunks[1] = NULL;
+	}
+
+	~MappedFileObject() {
+		close();
+	}
+
+	/// Maps the file; returns false when it cannot be opened or mapped
+	bool open(const char* path);
+
+	void close();
+
+	/// Hints the kernel about the access pattern (see MappedFile.SEQUENTIAL)
+	bool advise(int advice);
+
+	bool isOpen() const { return m_open; }
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+	size_t tell() const { return m_pos; }
+	void seek(size_t pos) { m_pos = pos < m_size ? pos : m_size; }
+
+	/// Returns a string holding the next len bytes, reusing the storage of a
+	/// previously returned chunk when the script no longer references it
+	StrObject* readChunk(size_t len);
+private:
+	const char* m_data;
+	size_t m_size;
+	size_t m_pos;
+	bool m_open;
+	// The last two chunks returned; a loop reading into the same variable
+	// still holds the newest one when asking for the next
+	StrObject* m_chunks[2];
+	size_t m_next;
+
+	DISALLOW_COPY_AND_ASSIGN(MappedFileObject);
+};
+
+/**
+ * Single-pass iterator over the lines of a mapped file
+ *
+ * next() advances the iterator in place, so foreach loops do not allocate an
+ * iterator per line.
+ */
+class MappedLinesObject : public TypeObject {
+public:
+	MappedLinesObject(MappedFileObject* file, size_t pos)
+		: m_file(file), m_pos(pos), m_eol(pos) {
+		clever_addref(m_file);
+		find();
+	}
+
+	~MappedLinesObject() {
+		clever_delref(m_file);
+	}
+
+	bool isValid() const { return m_pos < m_file->size(); }
+
+	/// Returns the current line without its terminator
+	StrObject* get() const;
+
+	void next() {
+		m_pos = m_eol + 1;
+		find();
+	}
+
+	size_t getPos() const { return isValid() ? m_pos : m_file->size(); }
+
+	MappedFileObject* getFile() const { return m_file; }
+private:
+	void find();
+
+	MappedFileObject* m_file;
+	size_t m_pos;
+	size_t m_eol;
+
+	DISALLOW_COPY_AND_ASSIGN(MappedLinesObject);
+};
+
+class MappedLines : public Type {
+public:
+	MappedLines()
+		: Type("MappedLines") {}
+
+	~MappedLines() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(begin);
+	CLEVER_METHOD(end);
+	CLEVER_METHOD(get);
+	CLEVER_METHOD(next);
+	CLEVER_METHOD(valid);
+
+	virtual void CLEVER_FASTCALL equal(CLEVER_TYPE_OPERATOR_ARGS)     const;
+	virtual void CLEVER_FASTCALL not_equal(CLEVER_TYPE_OPERATOR_ARGS) const;
+private:
+	DISALLOW_COPY_AND_ASSIGN(MappedLines);
+};
+
+class MappedFile : public Type {
+public:
+	MappedFile(const MappedLines* lines_type)
+		: Type("MappedFile"), m_lines_type(lines_type) {}
+
+	~MappedFile() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(size);
+	CLEVER_METHOD(tell);
+	CLEVER_METHOD(seek);
+	CLEVER_METHOD(eof);
+	CLEVER_METHOD(advise);
+	CLEVER_METHOD(readChunk);
+	CLEVER_METHOD(readLine);
+	CLEVER_METHOD(lines);
+	CLEVER_METHOD(close);
+private:
+	const MappedLines* m_lines_type;
+
+	DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_MAPPEDFILE_H
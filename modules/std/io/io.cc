@@ -8,8 +8,11 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "core/cthread.h"
 #include "core/value.h"
+#include "core/output.h"
+#include "core/cexception.h"
 #include "modules/std/core/function.h"
 #include "core/modmanager.h"
 #include "modules/std/io/io.h"
@@ -19,6 +22,21 @@ namespace clever { namespace modules { namespace std {
 
 namespace io {
 
+// Appends the value as print() shows it, avoiding temporary strings for
+// the primitive types
+static void append_value(OutputBuffer& out, const Value* value)
+{
+	if (value->isStr()) {
+		out.append(*value->getStr());
+	} else if (value->isInt()) {
+		append_number(out.getBuffer(), value->getInt());
+	} else if (value->isDouble()) {
+		append_number(out.getBuffer(), value->getDouble());
+	} else {
+		out.append(value->toString());
+	}
+}
+
 // flush(void)
 // Flushes output buffer (forcefully)
 static CLEVER_FUNCTION(flush)
@@ -27,15 +45,38 @@ static CLEVER_FUNCTION(flush)
 		return;
 	}
 
+	OutputBuffer::getStdout().flush();
 	::fflush(stdout);
 }
 
+// setOutputBuffering(int mode)
+// Sets when the output is written: IO_BUFFER_NONE, IO_BUFFER_LINE or IO_BUFFER_FULL
+static CLEVER_FUNCTION(setOutputBuffering)
+{
+	if (!clever_static_check_args("i")) {
+		return;
+	}
+
+	long mode = args[0]->getInt();
+
+	if (mode < OutputBuffer::FLUSH_NONE || mode > OutputBuffer::FLUSH_FULL) {
+		clever_throw("Invalid output buffering mode");
+		return;
+	}
+
+	OutputBuffer::getStdout().setPolicy(
+		static_cast<OutputBuffer::FlushPolicy>(mode));
+}
+
 // print(object a, [ ...])
 // Prints the object values without trailing newline
 static CLEVER_FUNCTION(print)
 {
+	OutputBuffer& out = OutputBuffer::getStdout();
+	OutputLock guard(out);
+
 	for (size_t i = 0, size = args.size(); i < size; ++i) {
-		::std::cout << args[i]->toString();
+		append_value(out, args[i]);
 	}
 }
 
@@ -43,8 +84,12 @@ static CLEVER_FUNCTION(print)
 // Prints the object values with trailing newline
 static CLEVER_FUNCTION(println)
 {
+	OutputBuffer& out = OutputBuffer::getStdout();
+	OutputLock guard(out);
+
 	for (size_t i = 0, size = args.size(); i < size; ++i) {
-		::std::cout << args[i]->toString() << '\n';
+		append_value(out, args[i]);
+		out.append('\n');
 	}
 }
 
@@ -53,25 +98,36 @@ static CLEVER_FUNCTION(println)
 static CLEVER_FUNCTION(printf)
 {
 	const CString* format = args[0]->getStr();
-	const char* start = format->c_str();
-
-	for (const char* point = start; point < (start + format->size());) {
-		if (*point && (*point == (char)'\\')) {
-			unsigned long arg;
-			char* skip;
-
-			if ((arg=::std::strtoul(++point, &skip, 10))) {
-				if (args.size() > arg) {
-					args[arg]->dump();
-				}
-				point = skip;
-			} else {
-				::std::cout << *(--point);
-				point++;
-			}
-		} else {
-			::std::cout << *point;
-			point++;
+	const char* point = format->data();
+	const char* end = point + format->size();
+	OutputBuffer& out = OutputBuffer::getStdout();
+	OutputLock guard(out);
+
+	// Text between the \N directives is copied in a single append
+	while (point < end) {
+		const char* slash = static_cast<const char*>(
+			::memchr(point, '\\', end - point));
+
+		if (slash == NULL) {
+			out.append(point, end - point);
+			break;
+		}
+
+		out.append(point, slash - point);
+		point = slash + 1;
+
+		unsigned long arg = 0;
+
+		while (point < end && *point >= '0' && *point <= '9') {
+			arg = arg * 10 + (*point++ - '0');
+		}
+
+		if (arg == 0) {
+			// Not a directive; \0 is kept as the original did
+			out.append('\\');
+			point = slash + 1;
+		} else if (args.size() > arg) {
+			append_value(out, args[arg]);
 		}
 	}
 }
@@ -85,6 +141,8 @@ static CLEVER_FUNCTION(read)
 		return;
 	}
 
+	OutputBuffer::getStdout().flush();
+
 	::std::string var;
 	::std::cin >> var;
 
@@ -100,6 +158,8 @@ static CLEVER_FUNCTION(readi)
 		return;
 	}
 
+	OutputBuffer::getStdout().flush();
+
 	long var;
 	::std::cin >> var;
 
@@ -115,6 +175,8 @@ static CLEVER_FUNCTION(readd)
 		return;
 	}
 
+	OutputBuffer::getStdout().flush();
+
 	double var;
 	::std::cin >> var;
 
@@ -132,9 +194,15 @@ CLEVER_MODULE_INIT(IOModule)
 	addFunction(new Function("println", &CLEVER_NS_FNAME(io, println)))->setVariadic();
 	addFunction(new Function("printf",  &CLEVER_NS_FNAME(io, printf)))->setVariadic();
 	addFunction(new Function("flush",   &CLEVER_NS_FNAME(io, flush)));
+	addFunction(new Function("setOutputBuffering",
+		&CLEVER_NS_FNAME(io, setOutputBuffering)));
 	addFunction(new Function("read",    &CLEVER_NS_FNAME(io, read)));
 	addFunction(new Function("readi",   &CLEVER_NS_FNAME(io, readi)));
 	addFunction(new Function("readd",   &CLEVER_NS_FNAME(io, readd)));
+
+	addVariable("IO_BUFFER_NONE", new Value(long(OutputBuffer::FLUSH_NONE), true));
+	addVariable("IO_BUFFER_LINE", new Value(long(OutputBuffer::FLUSH_LINE), true));
+	addVariable("IO_BUFFER_FULL", new Value(long(OutputBuffer::FLUSH_FULL), true));
 }
 
 }}} // clever::modules::std
@@ -5,56 +5,516 @@
  * This file is distributed under the MIT license. See LICENSE for details.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <ostream>
 #include <vector>
 #include <utility>
 #include "core/cexception.h"
+#include "modules/std/core/array.h"
 #include "modules/std/core/function.h"
+#include "modules/std/core/map.h"
+#include "modules/std/core/str.h"
+#include "modules/std/file/cfile.h"
 #include "modules/std/io/serializer.h"
 
+// Bytes read at a time when decoding from a stream
+#define CLEVER_SERIALIZER_BLOCK_SIZE 65536
+
 namespace clever { namespace modules { namespace std {
 
-::std::string Serializer::toString(TypeObject* obj) const
+// ValueEncoder ////////////////////////////////////////////////////////////////
+
+bool ValueEncoder::encode(const Value* value)
+{
+	m_error = NULL;
+	m_depth = 0;
+
+	m_out.push_back(static_cast<char>(CLEVER_SERIALIZER_VERSION));
+
+	writeValue(value);
+
+	if (m_error == NULL) {
+		flush();
+	}
+
+	return m_error == NULL;
+}
+
+void ValueEncoder::flush()
+{
+	if (m_sink && !m_out.empty()) {
+		m_sink->write(m_out.data(), m_out.size());
+		m_out.clear();
+	}
+}
+
+void ValueEncoder::writeVarint(unsigned long num)
+{
+	char buf[10];
+	size_t len = 0;
+
+	while (num >= 0x80) {
+		buf[len++] = static_cast<char>((num & 0x7F) | 0x80);
+		num >>= 7;
+	}
+	buf[len++] = static_cast<char>(num);
+
+	m_out.append(buf, len);
+}
+
+void ValueEncoder::writeString(const char* str, size_t len)
+{
+	writeVarint(len);
+	m_out.append(str, len);
+}
+
+void ValueEncoder::writeValue(const Value* value)
+{
+	if (m_error) {
+		return;
+	}
+
+	if (value == NULL || value->isNull()) {
+		m_out.push_back(TAG_NULL);
+	} else if (value->isBool()) {
+		m_out.push_back(value->getBool() ? TAG_TRUE : TAG_FALSE);
+	} else if (value->isInt()) {
+		long num = value->getInt();
+
+		m_out.push_back(TAG_INT);
+		// Zigzag keeps small negative numbers short
+		writeVarint((static_cast<unsigned long>(num) << 1)
+			^ static_cast<unsigned long>(num >> (sizeof(long) * 8 - 1)));
+	} else if (value->isDouble()) {
+		double num = value->getDouble();
+		unsigned long long bits;
+		char buf[8];
+
+		::memcpy(&bits, &num, sizeof(bits));
+
+		for (size_t i = 0; i < 8; ++i) {
+			buf[i] = static_cast<char>(bits >> (i * 8));
+		}
+
+		m_out.push_back(TAG_DOUBLE);
+		m_out.append(buf, 8);
+	} else if (value->isStr()) {
+		const CString* str = value->getStr();
+
+		m_out.push_back(TAG_STR);
+		writeString(str->data(), str->size());
+	} else if (value->isArray() || value->isMap() || value->getType()->isUserDefined()) {
+		if (++m_depth > CLEVER_SERIALIZER_MAX_DEPTH) {
+			m_error = "Nesting too deep (circular reference?)";
+			return;
+		}
+
+		if (value->isArray()) {
+			const ValueVector& vec = clever_get_object(ArrayObject*, value)->getData();
+
+			m_out.push_back(TAG_ARRAY);
+			writeVarint(vec.size());
+
+			for (size_t i = 0, n = vec.size(); i < n; ++i) {
+				writeValue(vec[i]);
+			}
+		} else if (value->isMap()) {
+			const ::std::map< ::std::string, Value*>& data =
+				clever_get_object(MapObject*, value)->getData();
+			::std::map< ::std::string, Value*>::const_iterator it(data.begin()),
+				end(data.end());
+
+			m_out.push_back(TAG_MAP);
+			writeVarint(data.size());
+
+			for (; it != end; ++it) {
+				writeString(it->first.data(), it->first.size());
+				writeValue(it->second);
+			}
+		} else {
+			const MemberMap& members = value->getObj()->getMembers();
+			MemberMap::const_iterator it(members.begin()), end(members.end());
+			const ::std::string& name = value->getType()->getName();
+			size_t count = 0;
+
+			for (; it != end; ++it) {
+				if (!it->second.value->isFunction()) {
+					++count;
+				}
+			}
+
+			m_out.push_back(TAG_OBJECT);
+			writeString(name.data(), name.size());
+			writeVarint(count);
+
+			for (it = members.begin(); it != end; ++it) {
+				if (!it->second.value->isFunction()) {
+					writeString(it->first->data(), it->first->size());
+					writeValue(it->second.value);
+				}
+			}
+		}
+
+		--m_depth;
+
+		if (m_sink && m_out.size() >= CLEVER_SERIALIZER_SINK_SIZE) {
+			flush();
+		}
+	} else {
+		m_error = "Cannot serialize values of this type";
+	}
+}
+
+// ValueDecoder ////////////////////////////////////////////////////////////////
+
+Value* ValueDecoder::decode()
+{
+	m_error = NULL;
+	m_depth = 0;
+
+	Value* value = NULL;
+
+	if (!need(1)) {
+		fail("Unexpected end of data");
+	} else if (static_cast<unsigned char>(*m_cur++) != CLEVER_SERIALIZER_VERSION) {
+		fail("Unsupported format version");
+	} else {
+		value = readValue();
+	}
+
+	if (m_stream) {
+		// Gives back what was read past the value
+		::std::streamoff unread = m_end - m_cur;
+
+		m_stream->clear();
+		m_stream->seekg(-unread, ::std::ios_base::cur);
+		m_stream->peek();
+	} else if (value && m_cur != m_end) {
+		clever_delref(value);
+		return fail("Unexpected data after the value");
+	}
+
+	return value;
+}
+
+bool ValueDecoder::fill(size_t len)
+{
+	if (m_stream == NULL) {
+		return false;
+	}
+
+	// Drops the bytes already decoded
+	m_buffer.erase(0, m_cur - m_buffer.data());
+
+	while (m_buffer.size() < len) {
+		size_t old = m_buffer.size();
+
+		m_buffer.resize(old + CLEVER_SERIALIZER_BLOCK_SIZE);
+		m_stream->read(&m_buffer[old], CLEVER_SERIALIZER_BLOCK_SIZE);
+		m_buffer.resize(old + m_stream->gcount());
+
+		if (m_buffer.size() == old) {
+			break;
+		}
+	}
+
+	m_cur = m_buffer.data();
+	m_end = m_cur + m_buffer.size();
+
+	return m_buffer.size() >= len;
+}
+
+bool ValueDecoder::readVarint(unsigned long& num)
+{
+	num = 0;
+
+	for (size_t shift = 0; shift < sizeof(num) * 8; shift += 7) {
+		if (!need(1)) {
+			return false;
+		}
+
+		unsigned char byte = static_cast<unsigned char>(*m_cur++);
+
+		num |= static_cast<unsigned long>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ValueDecoder::readString(CString& str)
+{
+	unsigned long len;
+
+	if (!readVarint(len) || !need(len)) {
+		return false;
+	}
+
+	str.assign(m_cur, len);
+	m_cur += len;
+
+	return true;
+}
+
+Value* ValueDecoder::readValue()
+{
+	if (!need(1)) {
+		return fail("Unexpected end of data");
+	}
+
+	unsigned char tag = static_cast<unsigned char>(*m_cur++);
+	Value* value = new Value;
+
+	switch (tag) {
+		case ValueEncoder::TAG_NULL:
+			break;
+
+		case ValueEncoder::TAG_FALSE:
+		case ValueEncoder::TAG_TRUE:
+			value->setBool(tag == ValueEncoder::TAG_TRUE);
+			break;
+
+		case ValueEncoder::TAG_INT:
+			{
+				unsigned long num;
+
+				if (!readVarint(num)) {
+					clever_delref(value);
+					return fail("Truncated integer");
+				}
+
+				value->setInt(static_cast<long>(num >> 1) ^ -static_cast<long>(num & 1));
+			}
+			break;
+
+		case ValueEncoder::TAG_DOUBLE:
+			{
+				if (!need(8)) {
+					clever_delref(value);
+					return fail("Truncated double");
+				}
+
+				unsigned long long bits = 0;
+				double num;
+
+				for (size_t i = 0; i < 8; ++i) {
+					bits |= static_cast<unsigned long long>(
+						static_cast<unsigned char>(m_cur[i])) << (i * 8);
+				}
+				m_cur += 8;
+
+				::memcpy(&num, &bits, sizeof(num));
+				value->setDouble(num);
+			}
+			break;
+
+		case ValueEncoder::TAG_STR:
+			{
+				StrObject* str = new StrObject;
+
+				value->setStr(str);
+
+				if (!readString(str->getBuffer())) {
+					clever_delref(value);
+					return fail("Truncated string");
+				}
+			}
+			break;
+
+		case ValueEncoder::TAG_ARRAY:
+		case ValueEncoder::TAG_MAP:
+		case ValueEncoder::TAG_OBJECT:
+			{
+				if (++m_depth > CLEVER_SERIALIZER_MAX_DEPTH) {
+					clever_delref(value);
+					return fail("Nesting too deep");
+				}
+
+				::std::string key;
+				unsigned long count;
+
+				// The class name is not kept; objects become maps
+				if (tag == ValueEncoder::TAG_OBJECT && !readString(key)) {
+					clever_delref(value);
+					return fail("Truncated object");
+				}
+
+				if (!readVarint(count)) {
+					clever_delref(value);
+					return fail("Truncated container");
+				}
+
+				if (tag == ValueEncoder::TAG_ARRAY) {
+					ArrayObject* array = new ArrayObject;
+					ValueVector& vec = array->getData();
+
+					value->setObj(CLEVER_ARRAY_TYPE, array);
+
+					// Every element takes at least a byte
+					if (m_stream == NULL) {
+						vec.reserve(::std::min(count,
+							static_cast<unsigned long>(m_end - m_cur)));
+					}
+
+					for (unsigned long i = 0; i < count; ++i) {
+						Value* elem = readValue();
+
+						if (elem == NULL) {
+							clever_delref(value);
+							return NULL;
+						}
+						vec.push_back(elem);
+					}
+				} else {
+					MapObject* map = new MapObject;
+					::std::map< ::std::string, Value*>& data = map->getData();
+
+					value->setObj(CLEVER_MAP_TYPE, map);
+
+					for (unsigned long i = 0; i < count; ++i) {
+						if (!readString(key)) {
+							clever_delref(value);
+							return fail("Truncated key");
+						}
+
+						Value* elem = readValue();
+
+						if (elem == NULL) {
+							clever_delref(value);
+							return NULL;
+						}
+
+						// Maps are encoded in key order
+						Value*& slot = data.insert(data.end(),
+							::std::map< ::std::string, Value*>::value_type(key, NULL))->second;
+
+						if (slot) {
+							clever_delref(slot);
+						}
+						slot = elem;
+					}
+				}
+
+				--m_depth;
+			}
+			break;
+
+		default:
+			clever_delref(value);
+			return fail("Unknown tag");
+	}
+
+	return value;
+}
+
+// Serializer //////////////////////////////////////////////////////////////////
+
+// Returns the stream of a File argument, or NULL when it is not a File
+static ::std::fstream* _serializer_get_stream(const Value* value)
 {
-	SerializerData* sobj = static_cast<SerializerData*>(obj);
+	if (value->isNull() || value->getType()->getName() != "File") {
+		return NULL;
+	}
 
-	return sobj->type->toString(sobj->info.second);
+	return &clever_get_object(CFileStream*, value)->getStream();
 }
 
-// Serializer.serialize()
+// String Serializer.serialize(value)
+// Returns the binary encoding of value
 CLEVER_METHOD(Serializer::doSerialize)
 {
 	if (!clever_static_check_args(".")) {
 		return;
 	}
 
-	SerializerData* sobj = new SerializerData(args[0]->getType());
-
-	sobj->info = args[0]->getType()->serialize(args[0]);
+	StrObject* str = new StrObject;
+	ValueEncoder encoder(str->getBuffer());
 
-	clever_addref(args[0]->getObj());
+	if (!encoder.encode(args[0])) {
+		str->delRef();
+		clever_throw("%s", encoder.getError());
+		return;
+	}
 
-	result->setObj(this, sobj);
+	result->setStr(str);
 }
 
-// Serializer.unserialize()
+// Serializer.unserialize(String data)
+// Rebuilds the value encoded in data
 CLEVER_METHOD(Serializer::doUnserialize)
+{
+	if (!clever_static_check_args("s")) {
+		return;
+	}
+
+	const CString* data = args[0]->getStr();
+	ValueDecoder decoder(data->data(), data->size());
+	Value* value = decoder.decode();
+
+	if (value == NULL) {
+		clever_throw("Invalid serialized data: %s", decoder.getError());
+		return;
+	}
+
+	result->copy(value);
+	clever_delref(value);
+}
+
+// Bool Serializer.serializeTo(value, File file)
+// Writes the binary encoding of value to file
+CLEVER_METHOD(Serializer::serializeTo)
+{
+	if (!clever_static_check_args("..")) {
+		return;
+	}
+
+	::std::fstream* stream = _serializer_get_stream(args[1]);
+
+	if (stream == NULL) {
+		clever_throw("serializeTo() expects a File as second argument");
+		return;
+	}
+
+	CString buffer;
+	ValueEncoder encoder(buffer, stream);
+
+	if (!encoder.encode(args[0])) {
+		clever_throw("%s", encoder.getError());
+		return;
+	}
+
+	result->setBool(stream->good());
+}
+
+// Serializer.unserializeFrom(File file)
+// Reads the next value written by serializeTo() from file
+CLEVER_METHOD(Serializer::unserializeFrom)
 {
 	if (!clever_static_check_args(".")) {
 		return;
 	}
 
-	if (args[0]->getType() != this) {
-		clever_throw("Parameter must be of SerializerData type");
+	::std::fstream* stream = _serializer_get_stream(args[0]);
+
+	if (stream == NULL) {
+		clever_throw("unserializeFrom() expects a File");
 		return;
 	}
-	SerializerData* sobj = clever_get_object(SerializerData*, args[0]);
-	Value* res = unserialize(sobj->type, sobj->info);
 
-	if (res) {
-		result->copy(res);
-		clever_delref(res);
+	ValueDecoder decoder(*stream);
+	Value* value = decoder.decode();
+
+	if (value == NULL) {
+		clever_throw("Invalid serialized data: %s", decoder.getError());
+		return;
 	}
+
+	result->copy(value);
+	clever_delref(value);
 }
 
 // Serializer type initialization
@@ -65,6 +525,12 @@ CLEVER_TYPE_INIT(Serializer::init)
 
 	addMethod(new Function("unserialize", (MethodPtr)&Serializer::doUnserialize))
 		->setStatic();
+
+	addMethod(new Function("serializeTo", (MethodPtr)&Serializer::serializeTo))
+		->setStatic();
+
+	addMethod(new Function("unserializeFrom", (MethodPtr)&Serializer::unserializeFrom))
+		->setStatic();
 }
 
 }}} // clever::modules::std
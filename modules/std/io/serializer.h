@@ -8,22 +8,118 @@
 #ifndef CLEVER_MOD_IO_SERIALIZER
 #define CLEVER_MOD_IO_SERIALIZER
 
+#include <istream>
+#include <ostream>
+#include "core/cstring.h"
 #include "core/type.h"
 
 namespace clever { namespace modules { namespace std {
 
-struct SerializerData : public TypeObject {
-	SerializerData(const Type* type_)
-		: type(type_) {}
+// Version byte starting every serialized value
+#define CLEVER_SERIALIZER_VERSION 1
 
-	~SerializerData() {
-		if (info.second) {
-			clever_delref(info.second);
-		}
+// Maximum nesting of arrays, maps and objects
+#define CLEVER_SERIALIZER_MAX_DEPTH 512
+
+// Buffered bytes before a streaming encoder hands them to its sink
+#define CLEVER_SERIALIZER_SINK_SIZE 65536
+
+/**
+ * Binary encoding of values
+ *
+ * A serialized value is the version byte followed by the value, encoded as
+ * a tag byte and:
+ *
+ *   NULL, FALSE, TRUE  nothing
+ *   INT                zigzag varint
+ *   DOUBLE             8 bytes, little endian
+ *   STR                varint length and the bytes
+ *   ARRAY              varint count and the elements
+ *   MAP                varint count and (key string, value) pairs
+ *   OBJECT             class name string, varint count and the
+ *                      (property name, value) pairs
+ */
+class ValueEncoder {
+public:
+	enum Tag {
+		TAG_NULL, TAG_FALSE, TAG_TRUE, TAG_INT, TAG_DOUBLE, TAG_STR,
+		TAG_ARRAY, TAG_MAP, TAG_OBJECT
+	};
+
+	/// When a sink is given the buffer is written to it whenever it grows
+	/// past CLEVER_SERIALIZER_SINK_SIZE, so large values are streamed
+	ValueEncoder(CString& out, ::std::ostream* sink = NULL)
+		: m_out(out), m_sink(sink), m_depth(0), m_error(NULL) {}
+
+	~ValueEncoder() {}
+
+	/// Encodes value; returns false and sets getError() on failure
+	bool encode(const Value* value);
+
+	const char* getError() const { return m_error; }
+private:
+	void writeValue(const Value* value);
+	void writeVarint(unsigned long num);
+	void writeString(const char* str, size_t len);
+	void flush();
+
+	CString& m_out;
+	::std::ostream* m_sink;
+	size_t m_depth;
+	const char* m_error;
+
+	DISALLOW_COPY_AND_ASSIGN(ValueEncoder);
+};
+
+/**
+ * Decodes values produced by ValueEncoder
+ *
+ * User objects are decoded as a Map of their properties.
+ */
+class ValueDecoder {
+public:
+	/// Decodes from memory; the data must hold exactly one value
+	ValueDecoder(const char* data, size_t len)
+		: m_stream(NULL), m_cur(data), m_end(data + len), m_depth(0),
+			m_error(NULL) {}
+
+	/// Decodes the next value from stream, reading it in blocks; the stream
+	/// is left positioned right after the value
+	ValueDecoder(::std::istream& stream)
+		: m_stream(&stream), m_cur(NULL), m_end(NULL), m_depth(0),
+			m_error(NULL) {}
+
+	~ValueDecoder() {}
+
+	/// Returns the decoded value, or NULL and sets getError() on failure
+	Value* decode();
+
+	const char* getError() const { return m_error; }
+private:
+	Value* readValue();
+	bool readVarint(unsigned long& num);
+	bool readString(CString& str);
+
+	/// Makes at least len bytes available, reading from the stream if needed
+	bool need(size_t len) {
+		return static_cast<size_t>(m_end - m_cur) >= len || fill(len);
 	}
 
-	const Type* type;
-	::std::pair<size_t, TypeObject*> info;
+	bool fill(size_t len);
+
+	Value* fail(const char* error) {
+		m_error = error;
+		return NULL;
+	}
+
+	::std::istream* m_stream;
+	CString m_buffer;
+	const char* m_cur;
+	const char* m_end;
+	size_t m_depth;
+	const char* m_error;
+
+	DISALLOW_COPY_AND_ASSIGN(ValueDecoder);
 };
 
 class Serializer : public Type {
@@ -34,10 +130,11 @@ public:
 	~Serializer() {}
 
 	virtual void init();
-	virtual ::std::string toString(TypeObject*) const;
 
 	CLEVER_METHOD(doSerialize);
 	CLEVER_METHOD(doUnserialize);
+	CLEVER_METHOD(serializeTo);
+	CLEVER_METHOD(unserializeFrom);
 
 private:
 	DISALLOW_COPY_AND_ASSIGN(Serializer);
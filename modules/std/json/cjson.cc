@@ -0,0 +1,667 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "core/type.h"
+#include "modules/std/core/array.h"
+#include "modules/std/core/map.h"
+#include "modules/std/core/str.h"
+#include "modules/std/json/cjson.h"
+
+namespace clever { namespace modules { namespace std {
+
+// JsonWriter //////////////////////////////////////////////////////////////////
+
+bool JsonWriter::write(const Value* value)
+{
+	m_error = NULL;
+	m_depth = 0;
+
+	writeValue(value);
+
+	if (m_sink && m_error == NULL) {
+		flush();
+	}
+
+	return m_error == NULL;
+}
+
+void JsonWriter::flush()
+{
+	if (m_sink && !m_out.empty()) {
+		m_sink->write(m_out.data(), m_out.size());
+		m_out.clear();
+	}
+}
+
+bool JsonWriter::enter()
+{
+	if (++m_depth > CLEVER_JSON_MAX_DEPTH) {
+		m_error = "Nesting too deep (circular reference?)";
+		return false;
+	}
+	return true;
+}
+
+void JsonWriter::writeValue(const Value* value)
+{
+	if (m_error) {
+		return;
+	}
+
+	if (value == NULL || value->isNull()) {
+		m_out.append("null", 4);
+	} else if (value->isStr()) {
+		const CString* str = value->getStr();
+		writeString(str->data(), str->size());
+	} else if (value->isInt()) {
+		append_number(m_out, value->getInt());
+	} else if (value->isDouble()) {
+		writeDouble(value->getDouble());
+	} else if (value->isBool()) {
+		if (value->getBool()) {
+			m_out.append("true", 4);
+		} else {
+			m_out.append("false", 5);
+		}
+	} else if (value->isArray()) {
+		writeArray(value);
+	} else if (value->isMap()) {
+		writeMap(value);
+	} else if (value->isFunction()) {
+		m_out.append("null", 4);
+	} else {
+		writeObject(value);
+	}
+}
+
+void JsonWriter::writeString(const char* str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char* end = str + len;
+	const char* run = str;
+
+	m_out.reserve(m_out.size() + len + 2);
+	m_out.push_back('"');
+
+	// Characters not needing escapes are appended in runs
+	for (const char* p = str; p < end; ++p) {
+		unsigned char c = static_cast<unsigned char>(*p);
+
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		m_out.append(run, p - run);
+		run = p + 1;
+
+		switch (c) {
+			case '"':  m_out.append("\\\"", 2); break;
+			case '\\': m_out.append("\\\\", 2); break;
+			case '\b': m_out.append("\\b", 2);  break;
+			case '\f': m_out.append("\\f", 2);  break;
+			case '\n': m_out.append("\\n", 2);  break;
+			case '\r': m_out.append("\\r", 2);  break;
+			case '\t': m_out.append("\\t", 2);  break;
+			default:
+				{
+					char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+					m_out.append(esc, 6);
+				}
+				break;
+		}
+	}
+
+	m_out.append(run, end - run);
+	m_out.push_back('"');
+}
+
+void JsonWriter::writeDouble(double num)
+{
+	// JSON has no representation for them
+	if (num != num || num - num != 0) {
+		m_out.append("null", 4);
+		return;
+	}
+
+	char buf[32];
+	int len = ::snprintf(buf, sizeof(buf), "%.15g", num);
+
+	// Uses the shortest form that reads back as the same number
+	if (::strtod(buf, NULL) != num) {
+		len = ::snprintf(buf, sizeof(buf), "%.17g", num);
+	}
+
+	m_out.append(buf, len);
+}
+
+void JsonWriter::writeArray(const Value* value)
+{
+	if (!enter()) {
+		return;
+	}
+
+	const ValueVector& vec = clever_get_object(ArrayObject*, value)->getData();
+	bool first = true;
+
+	m_out.push_back('[');
+
+	for (size_t i = 0, n = vec.size(); i < n; ++i) {
+		if (vec[i] && vec[i]->isFunction()) {
+			continue;
+		}
+		if (!first) {
+			m_out.push_back(',');
+		}
+		first = false;
+
+		writeValue(vec[i]);
+	}
+
+	m_out.push_back(']');
+
+	leave();
+}
+
+void JsonWriter::writeMap(const Value* value)
+{
+	if (!enter()) {
+		return;
+	}
+
+	const ::std::map< ::std::string, Value*>& data =
+		clever_get_object(MapObject*, value)->getData();
+	::std::map< ::std::string, Value*>::const_iterator it(data.begin()),
+		end(data.end());
+	bool first = true;
+
+	m_out.push_back('{');
+
+	for (; it != end; ++it) {
+		if (it->second && it->second->isFunction()) {
+			continue;
+		}
+		if (!first) {
+			m_out.push_back(',');
+		}
+		first = false;
+
+		writeString(it->first.data(), it->first.size());
+		m_out.push_back(':');
+		writeValue(it->second);
+	}
+
+	m_out.push_back('}');
+
+	leave();
+}
+
+void JsonWriter::writeObject(const Value* value)
+{
+	if (!enter()) {
+		return;
+	}
+
+	const MemberMap& members = value->getObj()->getMembers();
+	MemberMap::const_iterator it(members.begin()), end(members.end());
+	bool first = true;
+
+	m_out.push_back('{');
+
+	for (; it != end; ++it) {
+		const Value* member = it->second.value;
+
+		if (member->isFunction()) {
+			continue;
+		}
+		if (!first) {
+			m_out.push_back(',');
+		}
+		first = false;
+
+		writeString(it->first->data(), it->first->size());
+		m_out.push_back(':');
+		writeValue(member);
+	}
+
+	m_out.push_back('}');
+
+	leave();
+}
+
+// JsonParser //////////////////////////////////////////////////////////////////
+
+Value* JsonParser::parse()
+{
+	m_error = NULL;
+	m_depth = 0;
+
+	Value* value = parseValue();
+
+	if (value == NULL) {
+		return NULL;
+	}
+
+	skipSpace();
+
+	if (m_cur != m_end) {
+		clever_delref(value);
+		return fail("Unexpected data after the JSON value");
+	}
+
+	return value;
+}
+
+Value* JsonParser::parseValue()
+{
+	skipSpace();
+
+	if (m_cur == m_end) {
+		return fail("Unexpected end of input");
+	}
+
+	switch (*m_cur) {
+		case '{': return parseObject();
+		case '[': return parseArray();
+		case '"':
+			{
+				StrObject* str = new StrObject;
+
+				if (!parseString(str->getBuffer())) {
+					str->delRef();
+					return NULL;
+				}
+
+				Value* value = new Value;
+				value->setStr(str);
+				return value;
+			}
+		case 't': return parseLiteral("true", 4);
+		case 'f': return parseLiteral("false", 5);
+		case 'n': return parseLiteral("null", 4);
+		default:  return parseNumber();
+	}
+}
+
+Value* JsonParser::parseObject()
+{
+	if (++m_depth > CLEVER_JSON_MAX_DEPTH) {
+		return fail("Nesting too deep");
+	}
+
+	MapObject* map = new MapObject;
+	::std::map< ::std::string, Value*>& data = map->getData();
+	Value* result = new Value;
+
+	result->setObj(CLEVER_MAP_TYPE, map);
+
+	++m_cur;
+	skipSpace();
+
+	if (m_cur < m_end && *m_cur == '}') {
+		++m_cur;
+		--m_depth;
+		return result;
+	}
+
+	::std::string key;
+
+	while (true) {
+		skipSpace();
+
+		if (m_cur == m_end || *m_cur != '"') {
+			clever_delref(result);
+			return fail("Expected a string as object key");
+		}
+
+		key.clear();
+
+		if (!parseString(key)) {
+			clever_delref(result);
+			return NULL;
+		}
+
+		skipSpace();
+
+		if (m_cur == m_end || *m_cur != ':') {
+			clever_delref(result);
+			return fail("Expected ':' after object key");
+		}
+		++m_cur;
+
+		Value* value = parseValue();
+
+		if (value == NULL) {
+			clever_delref(result);
+			return NULL;
+		}
+
+		// Repeated keys keep the last value
+		Value*& slot = data[key];
+
+		if (slot) {
+			clever_delref(slot);
+		}
+		slot = value;
+
+		skipSpace();
+
+		if (m_cur < m_end && *m_cur == ',') {
+			++m_cur;
+		} else if (m_cur < m_end && *m_cur == '}') {
+			++m_cur;
+			break;
+		} else {
+			clever_delref(result);
+			return fail("Expected ',' or '}' in object");
+		}
+	}
+
+	--m_depth;
+
+	return result;
+}
+
+Value* JsonParser::parseArray()
+{
+	if (++m_depth > CLEVER_JSON_MAX_DEPTH) {
+		return fail("Nesting too deep");
+	}
+
+	ArrayObject* array = new ArrayObject;
+	ValueVector& vec = array->getData();
+	Value* result = new Value;
+
+	result->setObj(CLEVER_ARRAY_TYPE, array);
+
+	++m_cur;
+	skipSpace();
+
+	if (m_cur < m_end && *m_cur == ']') {
+		++m_cur;
+		--m_depth;
+		return result;
+	}
+
+	while (true) {
+		Value* value = parseValue();
+
+		if (value == NULL) {
+			clever_delref(result);
+			return NULL;
+		}
+
+		vec.push_back(value);
+
+		skipSpace();
+
+		if (m_cur < m_end && *m_cur == ',') {
+			++m_cur;
+		} else if (m_cur < m_end && *m_cur == ']') {
+			++m_cur;
+			break;
+		} else {
+			clever_delref(result);
+			return fail("Expected ',' or ']' in array");
+		}
+	}
+
+	--m_depth;
+
+	return result;
+}
+
+Value* JsonParser::parseNumber()
+{
+	const char* start = m_cur;
+	bool is_double = false;
+
+	if (m_cur < m_end && *m_cur == '-') {
+		++m_cur;
+	}
+
+	if (m_cur == m_end || *m_cur < '0' || *m_cur > '9') {
+		return fail("Unexpected character");
+	}
+
+	if (*m_cur == '0') {
+		++m_cur;
+	} else {
+		while (m_cur < m_end && *m_cur >= '0' && *m_cur <= '9') {
+			++m_cur;
+		}
+	}
+
+	if (m_cur < m_end && *m_cur == '.') {
+		is_double = true;
+		++m_cur;
+
+		if (m_cur == m_end || *m_cur < '0' || *m_cur > '9') {
+			return fail("Expected digits after the decimal point");
+		}
+		while (m_cur < m_end && *m_cur >= '0' && *m_cur <= '9') {
+			++m_cur;
+		}
+	}
+
+	if (m_cur < m_end && (*m_cur == 'e' || *m_cur == 'E')) {
+		is_double = true;
+		++m_cur;
+
+		if (m_cur < m_end && (*m_cur == '+' || *m_cur == '-')) {
+			++m_cur;
+		}
+		if (m_cur == m_end || *m_cur < '0' || *m_cur > '9') {
+			return fail("Expected digits in the exponent");
+		}
+		while (m_cur < m_end && *m_cur >= '0' && *m_cur <= '9') {
+			++m_cur;
+		}
+	}
+
+	size_t len = m_cur - start;
+	Value* value = new Value;
+
+	// Integers that surely fit in a long are accumulated directly
+	if (!is_double && len <= 18) {
+		const char* p = start;
+		bool negative = *p == '-';
+		long num = 0;
+
+		if (negative) {
+			++p;
+		}
+		for (; p < m_cur; ++p) {
+			num = num * 10 + (*p - '0');
+		}
+
+		value->setInt(negative ? -num : num);
+		return value;
+	}
+
+	// strtod needs a terminated copy of the validated token
+	char buf[64];
+	::std::string big;
+	const char* token = buf;
+
+	if (len < sizeof(buf)) {
+		::memcpy(buf, start, len);
+		buf[len] = '\0';
+	} else {
+		big.assign(start, len);
+		token = big.c_str();
+	}
+
+	if (is_double) {
+		value->setDouble(::strtod(token, NULL));
+	} else {
+		char* end;
+
+		errno = 0;
+		long num = ::strtol(token, &end, 10);
+
+		// Integers out of range are kept as doubles
+		if (errno == ERANGE) {
+			value->setDouble(::strtod(token, NULL));
+		} else {
+			value->setInt(num);
+		}
+	}
+
+	return value;
+}
+
+Value* JsonParser::parseLiteral(const char* word, size_t len)
+{
+	if (static_cast<size_t>(m_end - m_cur) < len
+		|| ::memcmp(m_cur, word, len) != 0) {
+		return fail("Unexpected character");
+	}
+
+	m_cur += len;
+
+	Value* value = new Value;
+
+	if (word[0] == 't') {
+		value->setBool(true);
+	} else if (word[0] == 'f') {
+		value->setBool(false);
+	}
+
+	return value;
+}
+
+bool JsonParser::parseString(CString& out)
+{
+	// Skips the opening quote
+	const char* run = ++m_cur;
+
+	while (m_cur < m_end) {
+		unsigned char c = static_cast<unsigned char>(*m_cur);
+
+		if (c == '"') {
+			out.append(run, m_cur - run);
+			++m_cur;
+			return true;
+		}
+
+		if (c < 0x20) {
+			fail("Control character in string");
+			return false;
+		}
+
+		if (c != '\\') {
+			++m_cur;
+			continue;
+		}
+
+		out.append(run, m_cur - run);
+
+		if (++m_cur == m_end) {
+			break;
+		}
+
+		switch (*m_cur++) {
+			case '"':  out.push_back('"');  break;
+			case '\\': out.push_back('\\'); break;
+			case '/':  out.push_back('/');  break;
+			case 'b':  out.push_back('\b'); break;
+			case 'f':  out.push_back('\f'); break;
+			case 'n':  out.push_back('\n'); break;
+			case 'r':  out.push_back('\r'); break;
+			case 't':  out.push_back('\t'); break;
+			case 'u':
+				if (!parseUnicode(out)) {
+					return false;
+				}
+				break;
+			default:
+				--m_cur;
+				fail("Invalid escape sequence");
+				return false;
+		}
+
+		run = m_cur;
+	}
+
+	fail("Unterminated string");
+	return false;
+}
+
+static bool _json_hex4(const char* p, unsigned long& code)
+{
+	code = 0;
+
+	for (size_t i = 0; i < 4; ++i) {
+		char c = p[i];
+
+		code <<= 4;
+
+		if (c >= '0' && c <= '9') {
+			code |= c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			code |= c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			code |= c - 'A' + 10;
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Decodes the \uXXXX sequence (and its low surrogate, if any) into UTF-8
+bool JsonParser::parseUnicode(CString& out)
+{
+	unsigned long code;
+
+	if (m_end - m_cur < 4 || !_json_hex4(m_cur, code)) {
+		fail("Invalid unicode escape");
+		return false;
+	}
+	m_cur += 4;
+
+	if (code >= 0xD800 && code <= 0xDBFF) {
+		unsigned long low;
+
+		if (m_end - m_cur < 6 || m_cur[0] != '\\' || m_cur[1] != 'u'
+			|| !_json_hex4(m_cur + 2, low) || low < 0xDC00 || low > 0xDFFF) {
+			fail("Invalid unicode surrogate pair");
+			return false;
+		}
+		m_cur += 6;
+
+		code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+	} else if (code >= 0xDC00 && code <= 0xDFFF) {
+		fail("Invalid unicode surrogate pair");
+		return false;
+	}
+
+	if (code < 0x80) {
+		out.push_back(static_cast<char>(code));
+	} else if (code < 0x800) {
+		out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+		out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	} else if (code < 0x10000) {
+		out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+		out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	} else {
+		out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+		out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+	}
+
+	return true;
+}
+
+}}} // clever::modules::std
@@ -0,0 +1,125 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_CJSON_H
+#define CLEVER_STD_CJSON_H
+
+#include <ostream>
+#include "core/cstring.h"
+#include "core/value.h"
+
+namespace clever { namespace modules { namespace std {
+
+// Maximum nesting of arrays and objects, guarding against cycles and
+// unbounded recursion
+#define CLEVER_JSON_MAX_DEPTH 512
+
+// Buffered bytes before a streaming writer hands them to its sink
+#define CLEVER_JSON_SINK_SIZE 65536
+
+/**
+ * Single-pass JSON encoder appending to a string buffer
+ *
+ * Numbers, booleans and null are written as their JSON types; maps and
+ * objects become JSON objects, skipping function members. When a sink is
+ * given the buffer is written to it whenever it grows past
+ * CLEVER_JSON_SINK_SIZE, so large documents are streamed.
+ */
+class JsonWriter {
+public:
+	JsonWriter(CString& out, ::std::ostream* sink = NULL)
+		: m_out(out), m_sink(sink), m_depth(0), m_error(NULL) {}
+
+	~JsonWriter() {}
+
+	/// Encodes value; returns false and sets getError() on failure
+	bool write(const Value* value);
+
+	/// Writes any data still buffered to the sink
+	void flush();
+
+	const char* getError() const { return m_error; }
+private:
+	void writeValue(const Value* value);
+	void writeString(const char* str, size_t len);
+	void writeDouble(double num);
+	void writeArray(const Value* value);
+	void writeMap(const Value* value);
+	void writeObject(const Value* value);
+
+	bool enter();
+
+	void leave() {
+		--m_depth;
+		if (m_sink && m_out.size() >= CLEVER_JSON_SINK_SIZE) {
+			flush();
+		}
+	}
+
+	CString& m_out;
+	::std::ostream* m_sink;
+	size_t m_depth;
+	const char* m_error;
+
+	DISALLOW_COPY_AND_ASSIGN(JsonWriter);
+};
+
+/**
+ * Recursive descent JSON parser producing Map, Array and primitive values
+ *
+ * The input is scanned in place; strings without escape sequences are
+ * copied straight from the input and numbers are converted without
+ * building intermediate tokens.
+ */
+class JsonParser {
+public:
+	JsonParser(const char* data, size_t len)
+		: m_begin(data), m_cur(data), m_end(data + len), m_depth(0),
+			m_error(NULL) {}
+
+	~JsonParser() {}
+
+	/// Parses the whole input; returns NULL and sets getError() on failure
+	Value* parse();
+
+	const char* getError() const { return m_error; }
+
+	/// Offset of the input where the error was found
+	size_t getErrorOffset() const { return m_cur - m_begin; }
+private:
+	Value* parseValue();
+	Value* parseObject();
+	Value* parseArray();
+	Value* parseNumber();
+	Value* parseLiteral(const char* word, size_t len);
+	bool parseString(CString& out);
+	bool parseUnicode(CString& out);
+
+	void skipSpace() {
+		while (m_cur < m_end && (*m_cur == ' ' || *m_cur == '\n'
+			|| *m_cur == '\r' || *m_cur == '\t')) {
+			++m_cur;
+		}
+	}
+
+	Value* fail(const char* error) {
+		m_error = error;
+		return NULL;
+	}
+
+	const char* m_begin;
+	const char* m_cur;
+	const char* m_end;
+	size_t m_depth;
+	const char* m_error;
+
+	DISALLOW_COPY_AND_ASSIGN(JsonParser);
+};
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_CJSON_H
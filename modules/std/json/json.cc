@@ -8,113 +8,95 @@
 #include "core/clever.h"
 #include "core/value.h"
 #include "core/type.h"
-#include "modules/std/core/array.h"
+#include "core/cexception.h"
+#include "modules/std/core/function.h"
+#include "modules/std/file/cfile.h"
+#include "modules/std/json/cjson.h"
 #include "modules/std/json/json.h"
 
 namespace clever { namespace modules { namespace std {
 
 namespace json {
 
-namespace detail {
-
-::std::string escape(const ::std::string& str) {
-	::std::ostringstream oss;
-
-	for (int i = 0, sz = str.size(); i < sz; ++i) {
-		switch (str[i]) {
-			case '\b': oss << "\\b";  break;
-			case '\f': oss << "\\f";  break;
-			case '\n': oss << "\\n";  break;
-			case '\r': oss << "\\r";  break;
-			case '\t': oss << "\\t";  break;
-			case '\'': oss << "\\'";  break;
-			case '"':  oss << "\\\""; break;
-			case '\\': oss << "\\\\"; break;
-			default:   oss << str[i];
-		}
+// to_json(Object object)
+// Encodes the object members as a JSON object
+static CLEVER_FUNCTION(to_json)
+{
+	if (!clever_static_check_args(".")) {
+		return;
 	}
 
-	return oss.str();
-}
+	StrObject* str = new StrObject;
+	JsonWriter writer(str->getBuffer());
 
-void array_to_json(::std::ostringstream& oss, const Value* array);
-
-void to_json_impl(::std::ostringstream& oss, const Value* object) {
-	const MemberMap& members = object->getObj()->getMembers();
-	MemberMap::const_iterator it(members.begin()), end(members.end());
-	const Value* value;
-	const CString* key;
-	bool first = true;
-
-	while (it != end) {
-		key = it->first;
-		value = it->second.value;
-		if (!value->isFunction()) {
-			if (!first) {
-				oss << ", ";
-			}
-			first = false;
-
-			oss << *key << ": ";
-			if (value->isInt() || value->isStr() || value->isDouble()
-				|| value->isBool() || value->isMap()) {
-				oss << "\"" << detail::escape(value->toString()) << "\"";
-			} else if (value->isArray()) {
-				oss << "[";
-				array_to_json(oss, value);
-				oss << "]";
-			} else {
-				oss << "{";
-				to_json_impl(oss, value);
-				oss << "}";
-			}
-		}
-		++it;
+	if (!writer.write(args[0])) {
+		str->delRef();
+		clever_throw("%s", writer.getError());
+		return;
 	}
+
+	result->setStr(str);
 }
 
-void array_to_json(::std::ostringstream& oss, const Value* array) {
-	ValueVector& arr = clever_get_object(ArrayObject*, array)->getData();
-	bool first = true;
-
-	for (int i = 0, sz = arr.size(); i < sz; ++i) {
-		if (!arr[i]->isFunction()) {
-			if (!first) {
-				oss << ", ";
-			}
-			if (arr[i]->isInt() || arr[i]->isStr() || arr[i]->isDouble()
-				|| arr[i]->isBool() || arr[i]->isMap()) {
-				oss << "\"" << detail::escape(arr[i]->toString()) << "\"";
-			} else if (arr[i]->isArray()) {
-				oss << "[";
-				array_to_json(oss, arr[i]);
-				oss << "]";
-			} else {
-				oss << "{";
-				to_json_impl(oss, arr[i]);
-				oss << "}";
-			}
-			first = false;
+// stringify(value, [File file])
+// Encodes the value as JSON, returning the string or streaming it to file
+static CLEVER_FUNCTION(stringify)
+{
+	if (!clever_static_check_args(".|.")) {
+		return;
+	}
+
+	if (args.size() == 1) {
+		StrObject* str = new StrObject;
+		JsonWriter writer(str->getBuffer());
+
+		if (!writer.write(args[0])) {
+			str->delRef();
+			clever_throw("%s", writer.getError());
+			return;
 		}
+
+		result->setStr(str);
+		return;
+	}
+
+	if (args[1]->isNull() || args[1]->getType()->getName() != "File") {
+		clever_throw("stringify() expects a File as second argument");
+		return;
 	}
-}
 
-} // clever::modules::std::json::detail
+	CString buffer;
+	JsonWriter writer(buffer,
+		&clever_get_object(CFileStream*, args[1])->getStream());
 
-// to_json(Object object)
-static CLEVER_FUNCTION(to_json)
+	if (!writer.write(args[0])) {
+		clever_throw("%s", writer.getError());
+		return;
+	}
+
+	result->setBool(true);
+}
+
+// parse(String json)
+// Decodes JSON text into Map, Array and primitive values
+static CLEVER_FUNCTION(parse)
 {
-	if (!clever_static_check_args(".")) {
+	if (!clever_static_check_args("s")) {
 		return;
 	}
 
-	::std::ostringstream oss;
+	const CString* text = args[0]->getStr();
+	JsonParser parser(text->data(), text->size());
+	Value* value = parser.parse();
 
-	oss << "{";
-	detail::to_json_impl(oss, args[0]);
-	oss << "}";
+	if (value == NULL) {
+		clever_throw("JSON parse error: %s at offset %N", parser.getError(),
+			parser.getErrorOffset());
+		return;
+	}
 
-	result->setStr(new StrObject(oss.str()));
+	result->copy(value);
+	clever_delref(value);
 }
 
 } // clever::modules::std::json
@@ -122,7 +104,9 @@ static CLEVER_FUNCTION(to_json)
 /// Initializes Standard Json module
 CLEVER_MODULE_INIT(JsonModule)
 {
-	addFunction(new Function("to_json", &CLEVER_NS_FNAME(json, to_json)));
+	addFunction(new Function("to_json",   &CLEVER_NS_FNAME(json, to_json)));
+	addFunction(new Function("stringify", &CLEVER_NS_FNAME(json, stringify)));
+	addFunction(new Function("parse",     &CLEVER_NS_FNAME(json, parse)));
 }
 
 }}} // clever::modules::std
@@ -0,0 +1,130 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include "core/output.h"
+#include "core/value.h"
+#include "core/cexception.h"
+#include "modules/std/core/function.h"
+#include "modules/std/log/log.h"
+#include "modules/std/log/logger.h"
+#include "modules/std/log/writer.h"
+
+namespace clever { namespace modules { namespace std {
+
+namespace log {
+
+// open(String path [, Int max_bytes [, Int max_seconds [, Int keep]]])
+// Sends the records to the file, rotating it when it would exceed max_bytes
+// or has been open for max_seconds (0 is no limit) and keeping that many
+// old files (default 5)
+static CLEVER_FUNCTION(open)
+{
+	if (!clever_static_check_args("s|iii")) {
+		return;
+	}
+
+	long max_bytes = args.size() > 1 ? args[1]->getInt() : 0;
+	long max_seconds = args.size() > 2 ? args[2]->getInt() : 0;
+	long keep = args.size() > 3 ? args[3]->getInt() : 5;
+
+	if (max_bytes < 0 || max_seconds < 0 || keep < 0) {
+		clever_throw("Rotation limits cannot be negative");
+		return;
+	}
+
+	if (!LogWriter::get()->open(*args[0]->getStr(), max_bytes, max_seconds, keep)) {
+		clever_throw("Cannot open log file `%S': %s", args[0]->getStr(),
+			::strerror(errno));
+	}
+}
+
+// close()
+// Sends the records back to the standard output
+static CLEVER_FUNCTION(close)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+	LogWriter::get()->close();
+}
+
+// flush()
+// Waits until the records logged so far are written
+static CLEVER_FUNCTION(flush)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+	LogWriter::get()->flush();
+	OutputBuffer::getStdout().flush();
+}
+
+// Int dropped()
+// Returns how many records were dropped because the queue was full
+static CLEVER_FUNCTION(dropped)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+	result->setInt(LogWriter::get()->getDropped());
+}
+
+// setQueueSize(Int records)
+// Sets how many records may wait for the writer; only before logging
+static CLEVER_FUNCTION(setQueueSize)
+{
+	if (!clever_static_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() <= 0) {
+		clever_throw("Queue size must be greater than zero");
+		return;
+	}
+
+	if (!LogWriter::get()->setCapacity(args[0]->getInt())) {
+		clever_throw("Queue size cannot be changed after logging");
+	}
+}
+
+} // clever::modules::std::log
+
+LogModule::~LogModule()
+{
+	if (log::LogWriter* writer = log::LogWriter::get()) {
+		log::LogWriter::set(NULL);
+		delete writer;
+	}
+}
+
+// Initializes Standard Log module
+CLEVER_MODULE_INIT(LogModule)
+{
+	log::LogWriter::set(new log::LogWriter);
+
+	addVariable("DEBUG",   new Value(long(CLEVER_LOG_DEBUG), true));
+	addVariable("INFO",    new Value(long(CLEVER_LOG_INFO), true));
+	addVariable("WARNING", new Value(long(CLEVER_LOG_WARNING), true));
+	addVariable("ERROR",   new Value(long(CLEVER_LOG_ERROR), true));
+	addVariable("FATAL",   new Value(long(CLEVER_LOG_FATAL), true));
+	addVariable("ALL",     new Value(long(CLEVER_LOG_ALL), true));
+
+	addFunction(new Function("open",         &CLEVER_NS_FNAME(log, open)));
+	addFunction(new Function("close",        &CLEVER_NS_FNAME(log, close)));
+	addFunction(new Function("flush",        &CLEVER_NS_FNAME(log, flush)));
+	addFunction(new Function("dropped",      &CLEVER_NS_FNAME(log, dropped)));
+	addFunction(new Function("setQueueSize", &CLEVER_NS_FNAME(log, setQueueSize)));
+
+	addType(new log::Logger);
+}
+
+}}} // clever::modules::std
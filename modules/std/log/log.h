@@ -0,0 +1,31 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_LOG_H
+#define CLEVER_STD_LOG_H
+
+#include "core/module.h"
+
+namespace clever { namespace modules { namespace std {
+
+/// Standard Log Module
+class LogModule : public Module {
+public:
+	LogModule()
+		: Module("std.log") {}
+
+	/// Writes out the pending records
+	~LogModule();
+
+	CLEVER_MODULE_VIRTUAL_METHODS_DECLARATION;
+private:
+	DISALLOW_COPY_AND_ASSIGN(LogModule);
+};
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_LOG_H
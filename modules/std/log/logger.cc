@@ -0,0 +1,182 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include "core/value.h"
+#include "core/cexception.h"
+#include "modules/std/core/function.h"
+#include "modules/std/log/logger.h"
+
+namespace clever { namespace modules { namespace std { namespace log {
+
+// Writes or queues the message; disabled levels return before touching it
+static inline void _log(const Value* obj, long level, const Value* message,
+	Value* result)
+{
+	const LoggerObject* lobj = clever_get_this(LoggerObject*);
+
+	if (!lobj->isEnabled(level)) {
+		result->setBool(false);
+		return;
+	}
+
+	if (message->isStr()) {
+		const CString* str = message->getStr();
+
+		result->setBool(LogWriter::get()->push(lobj->getFormat(), level,
+			str->data(), str->size()));
+	} else {
+		::std::string str = message->toString();
+
+		result->setBool(LogWriter::get()->push(lobj->getFormat(), level,
+			str.data(), str.size()));
+	}
+}
+
+// Logger.new(String name [, String format [, String date_format]])
+// The format has the %{date}, %{level}, %{name} and %{message} fields; the
+// date format is the one of strftime()
+CLEVER_METHOD(Logger::ctor)
+{
+	if (!clever_check_args("s|ss")) {
+		return;
+	}
+
+	LogFormat* format = new LogFormat(*args[0]->getStr(),
+		args.size() > 1 ? *args[1]->getStr() : "%{date} (%{level}): %{message}",
+		args.size() > 2 ? *args[2]->getStr() : "%Y-%m-%d %H:%M:%S");
+
+	result->setObj(this, new LoggerObject(format));
+}
+
+// Bool Logger.log(Int level, message)
+// Writes the message, or queues it for the log file; returns false when the
+// level is disabled or the queue is full
+CLEVER_METHOD(Logger::log)
+{
+	if (!clever_check_args("ip")) {
+		return;
+	}
+
+	_log(obj, args[0]->getInt(), args[1], result);
+}
+
+// Bool Logger.debug(message)
+CLEVER_METHOD(Logger::debug)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	_log(obj, CLEVER_LOG_DEBUG, args[0], result);
+}
+
+// Bool Logger.info(message)
+CLEVER_METHOD(Logger::info)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	_log(obj, CLEVER_LOG_INFO, args[0], result);
+}
+
+// Bool Logger.warning(message)
+CLEVER_METHOD(Logger::warning)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	_log(obj, CLEVER_LOG_WARNING, args[0], result);
+}
+
+// Bool Logger.error(message)
+CLEVER_METHOD(Logger::error)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	_log(obj, CLEVER_LOG_ERROR, args[0], result);
+}
+
+// Bool Logger.fatal(message)
+CLEVER_METHOD(Logger::fatal)
+{
+	if (!clever_check_args("p")) {
+		return;
+	}
+
+	_log(obj, CLEVER_LOG_FATAL, args[0], result);
+}
+
+// Bool Logger.isEnabled(Int level)
+// Lets callers skip building messages of disabled levels
+CLEVER_METHOD(Logger::isEnabled)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	result->setBool(clever_get_this(LoggerObject*)->isEnabled(args[0]->getInt()));
+}
+
+// void Logger.setEnabledLevels(Int mask)
+// Sets the levels logged, e.g. WARNING | ERROR | FATAL
+CLEVER_METHOD(Logger::setEnabledLevels)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	long mask = args[0]->getInt();
+
+	if (mask <= 0 || mask > CLEVER_LOG_ALL) {
+		clever_throw("Invalid level mask");
+		return;
+	}
+
+	clever_get_this(LoggerObject*)->setLevels(mask);
+}
+
+// Int Logger.getEnabledLevels()
+CLEVER_METHOD(Logger::getEnabledLevels)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(LoggerObject*)->getLevels());
+}
+
+// String Logger.getName()
+CLEVER_METHOD(Logger::getName)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setStr(new StrObject(clever_get_this(LoggerObject*)->getFormat()->getName()));
+}
+
+CLEVER_TYPE_INIT(Logger::init)
+{
+	setConstructor((MethodPtr)&Logger::ctor);
+
+	addMethod(new Function("log",              (MethodPtr)&Logger::log));
+	addMethod(new Function("debug",            (MethodPtr)&Logger::debug));
+	addMethod(new Function("info",             (MethodPtr)&Logger::info));
+	addMethod(new Function("warning",          (MethodPtr)&Logger::warning));
+	addMethod(new Function("error",            (MethodPtr)&Logger::error));
+	addMethod(new Function("fatal",            (MethodPtr)&Logger::fatal));
+	addMethod(new Function("isEnabled",        (MethodPtr)&Logger::isEnabled));
+	addMethod(new Function("setEnabledLevels", (MethodPtr)&Logger::setEnabledLevels));
+	addMethod(new Function("getEnabledLevels", (MethodPtr)&Logger::getEnabledLevels));
+	addMethod(new Function("getName",          (MethodPtr)&Logger::getName));
+}
+
+}}}} // clever::modules::std::log
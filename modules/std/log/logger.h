@@ -0,0 +1,62 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_LOG_LOGGER_H
+#define CLEVER_STD_LOG_LOGGER_H
+
+#include "core/type.h"
+#include "modules/std/log/writer.h"
+
+namespace clever { namespace modules { namespace std { namespace log {
+
+class LoggerObject : public TypeObject {
+public:
+	LoggerObject(LogFormat* format)
+		: m_format(format), m_levels(CLEVER_LOG_ALL) {}
+
+	~LoggerObject() { m_format->delRef(); }
+
+	LogFormat* getFormat() const { return m_format; }
+
+	long getLevels() const { return m_levels; }
+	void setLevels(long levels) { m_levels = levels; }
+
+	bool isEnabled(long level) const { return (m_levels & level) != 0; }
+private:
+	LogFormat* m_format;
+	long m_levels;
+
+	DISALLOW_COPY_AND_ASSIGN(LoggerObject);
+};
+
+class Logger : public Type {
+public:
+	Logger()
+		: Type("Logger") {}
+
+	~Logger() {}
+
+	virtual void init();
+
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(log);
+	CLEVER_METHOD(debug);
+	CLEVER_METHOD(info);
+	CLEVER_METHOD(warning);
+	CLEVER_METHOD(error);
+	CLEVER_METHOD(fatal);
+	CLEVER_METHOD(isEnabled);
+	CLEVER_METHOD(setEnabledLevels);
+	CLEVER_METHOD(getEnabledLevels);
+	CLEVER_METHOD(getName);
+private:
+	DISALLOW_COPY_AND_ASSIGN(Logger);
+};
+
+}}}} // clever::modules::std::log
+
+#endif // CLEVER_STD_LOG_LOGGER_H
@@ -0,0 +1,550 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef CLEVER_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+#include "core/output.h"
+#include "modules/std/log/writer.h"
+
+namespace clever { namespace modules { namespace std { namespace log {
+
+LogWriter* LogWriter::s_writer;
+
+static const char* _level_name(long level)
+{
+	switch (level) {
+		case CLEVER_LOG_DEBUG:   return "DEBUG";
+		case CLEVER_LOG_INFO:    return "INFO";
+		case CLEVER_LOG_WARNING: return "WARNING";
+		case CLEVER_LOG_ERROR:   return "ERROR";
+		case CLEVER_LOG_FATAL:   return "FATAL";
+	}
+	return NULL;
+}
+
+// Writes out what is queued when the script exits without unloading the
+// module (e.g. calling exit())
+static void _flush_at_exit()
+{
+	if (LogWriter* writer = LogWriter::get()) {
+		writer->flush();
+	}
+}
+
+static void _write_all(int fd, const char* data, size_t left)
+{
+	while (left) {
+#ifdef CLEVER_WIN32
+		int written = ::_write(fd, data, static_cast<unsigned int>(left));
+#else
+		ssize_t written = ::write(fd, data, left);
+#endif
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// Nowhere to report it; the records are lost
+			break;
+		}
+		data += written;
+		left -= written;
+	}
+}
+
+LogFormat::LogFormat(const ::std::string& name, const ::std::string& format,
+	const ::std::string& date_format)
+	: m_name(name), m_date_format(date_format), m_date_time(0)
+{
+	static const struct {
+		const char* name;
+		Field field;
+	} fields[] = {
+		{"%{date}",    DATE},
+		{"%{level}",   LEVEL},
+		{"%{name}",    NAME},
+		{"%{message}", MESSAGE}
+	};
+	size_t pos = 0, literal = 0;
+
+	while ((pos = format.find("%{", pos)) != ::std::string::npos) {
+		size_t i = 0, n = sizeof(fields) / sizeof(fields[0]);
+
+		while (i < n && format.compare(pos, ::std::strlen(fields[i].name),
+			fields[i].name) != 0) {
+			++i;
+		}
+
+		// Unknown fields are kept as text
+		if (i == n) {
+			pos += 2;
+			continue;
+		}
+
+		if (pos > literal) {
+			m_parts.push_back(Part(LITERAL, format.substr(literal, pos - literal)));
+		}
+		m_parts.push_back(Part(fields[i].field, ""));
+
+		pos += ::std::strlen(fields[i].name);
+		literal = pos;
+	}
+
+	if (literal < format.size()) {
+		m_parts.push_back(Part(LITERAL, format.substr(literal)));
+	}
+}
+
+void LogFormat::format(CString& out, long level, time_t time,
+	const ::std::string& message)
+{
+	for (size_t i = 0, n = m_parts.size(); i < n; ++i) {
+		const Part& part = m_parts[i];
+
+		switch (part.field) {
+			case LITERAL:
+				out.append(part.text);
+				break;
+			case DATE:
+				if (time != m_date_time || m_date.empty()) {
+					struct tm local;
+					char buffer[256];
+#ifdef CLEVER_WIN32
+					localtime_s(&local, &time);
+#else
+					localtime_r(&time, &local);
+#endif
+					size_t len = ::strftime(buffer, sizeof(buffer),
+						m_date_format.c_str(), &local);
+
+					m_date.assign(buffer, len);
+					m_date_time = time;
+				}
+				out.append(m_date);
+				break;
+			case LEVEL:
+				if (const char* name = _level_name(level)) {
+					out.append(name);
+				} else {
+					append_number(out, level);
+				}
+				break;
+			case NAME:
+				out.append(m_name);
+				break;
+			case MESSAGE:
+				out.append(message);
+				break;
+		}
+	}
+	out.push_back('\n');
+}
+
+LogRing::LogRing(size_t capacity)
+	: m_mask(1), m_head(0), m_tail(0)
+{
+	while (m_mask + 1 < capacity) {
+		m_mask = (m_mask << 1) | 1;
+	}
+
+	m_slots = new Slot[m_mask + 1];
+
+	for (size_t i = 0; i <= m_mask; ++i) {
+		m_slots[i].seq = i;
+	}
+}
+
+LogRing::~LogRing()
+{
+	// Records left behind still hold their template
+	for (size_t i = 0; i <= m_mask; ++i) {
+		if (m_slots[i].record.format) {
+			m_slots[i].record.format->delRef();
+		}
+	}
+	delete[] m_slots;
+}
+
+bool LogRing::push(LogFormat* format, long level, time_t time,
+	const char* data, size_t len)
+{
+	size_t pos = m_tail;
+	Slot* slot;
+
+	// A slot whose sequence equals the position is free for it; one
+	// behind means the consumer has not released it yet, i.e. the
+	// queue is full
+	for (;;) {
+		slot = &m_slots[pos & m_mask];
+
+		size_t seq = slot->seq;
+		long diff = static_cast<long>(seq - pos);
+
+		if (diff == 0) {
+			if (__sync_bool_compare_and_swap(&m_tail, pos, pos + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		}
+		pos = m_tail;
+	}
+
+	slot->record.format = format;
+	slot->record.level = level;
+	slot->record.time = time;
+	slot->record.message.assign(data, len);
+
+	__sync_synchronize();
+	slot->seq = pos + 1;
+
+	return true;
+}
+
+LogRecord* LogRing::front()
+{
+	Slot* slot = &m_slots[m_head & m_mask];
+
+	if (slot->seq != m_head + 1) {
+		return NULL;
+	}
+	__sync_synchronize();
+
+	return &slot->record;
+}
+
+void LogRing::pop()
+{
+	Slot* slot = &m_slots[m_head & m_mask];
+
+	slot->record.format = NULL;
+
+	__sync_synchronize();
+	slot->seq = m_head + m_mask + 1;
+	++m_head;
+}
+
+LogWriter::LogWriter()
+	: m_ring(NULL), m_capacity(CLEVER_LOG_QUEUE_SIZE), m_dropped(0),
+		m_sleeping(false), m_stop(false), m_written(0), m_to_file(false),
+		m_fd(2), m_size(0),
+		m_opened(0), m_max_bytes(0), m_max_seconds(0), m_keep(0)
+{
+}
+
+LogWriter::~LogWriter()
+{
+	if (m_ring) {
+		stop();
+		delete m_ring;
+	}
+	closeFile();
+}
+
+LogRing* LogWriter::start()
+{
+	m_mutex.lock();
+
+	if (m_ring == NULL) {
+		LogRing* ring = new LogRing(m_capacity);
+
+		// The queue is complete before other threads can see it
+		__sync_synchronize();
+		m_ring = ring;
+#ifdef CLEVER_THREADS
+		m_thread.create(run, this);
+#endif
+		::atexit(_flush_at_exit);
+	}
+
+	m_mutex.unlock();
+
+	return m_ring;
+}
+
+void LogWriter::stop()
+{
+#ifdef CLEVER_THREADS
+	m_mutex.lock();
+	m_stop = true;
+	m_wakeup.signal();
+	m_mutex.unlock();
+
+	m_thread.wait();
+#endif
+	drain();
+}
+
+CLEVER_THREAD_FUNC(LogWriter::run)
+{
+	LogWriter* writer = static_cast<LogWriter*>(arg);
+
+	for (;;) {
+		writer->drain();
+
+		writer->m_mutex.lock();
+
+		// Producers signal the writer when they see it sleeping, which
+		// is set before checking for records that came in meanwhile
+		writer->m_sleeping = true;
+		__sync_synchronize();
+
+		bool idle = writer->m_ring->front() == NULL;
+
+		if (idle && writer->m_stop) {
+			writer->m_sleeping = false;
+			writer->m_mutex.unlock();
+			break;
+		}
+		if (idle) {
+			writer->m_wakeup.wait(writer->m_mutex);
+		}
+
+		writer->m_sleeping = false;
+		writer->m_mutex.unlock();
+	}
+
+	return 0;
+}
+
+void LogWriter::writeStdout(LogFormat* format, long level, const char* data,
+	size_t len)
+{
+	// Also keeps the formats used by a single thread at a time
+	m_sink_mutex.lock();
+
+	m_line.clear();
+	format->format(m_line, level, ::time(NULL), ::std::string(data, len));
+
+	OutputBuffer::getStdout().write(m_line);
+
+	m_sink_mutex.unlock();
+}
+
+bool LogWriter::push(LogFormat* format, long level, const char* data,
+	size_t len)
+{
+	if (!m_to_file) {
+		writeStdout(format, level, data, len);
+		return true;
+	}
+
+	LogRing* ring = m_ring;
+
+	if (ring == NULL) {
+		ring = start();
+	}
+
+	format->addRef();
+
+	if (!ring->push(format, level, ::time(NULL), data, len)) {
+		format->delRef();
+		__sync_add_and_fetch(&m_dropped, 1);
+		return false;
+	}
+
+#ifdef CLEVER_THREADS
+	__sync_synchronize();
+
+	if (m_sleeping) {
+		m_mutex.lock();
+		m_wakeup.signal();
+		m_mutex.unlock();
+	}
+#else
+	drain();
+#endif
+	return true;
+}
+
+bool LogWriter::needsRotation(size_t pending, time_t time) const
+{
+	// Nothing to rotate on the standard error or in an empty file
+	if (m_path.empty() || m_size + pending == 0) {
+		return false;
+	}
+
+	return (m_max_bytes && m_size + m_buffer.size() > m_max_bytes)
+		|| (m_max_seconds && time - m_opened >= m_max_seconds);
+}
+
+void LogWriter::drain()
+{
+	LogRecord* record;
+
+	m_sink_mutex.lock();
+
+	while ((record = m_ring->front()) != NULL) {
+		size_t pending = m_buffer.size();
+
+		record->format->format(m_buffer, record->level, record->time,
+			record->message);
+
+		// The record goes to the next file when it does not fit
+		if (needsRotation(pending, record->time)) {
+			writeOut(m_buffer, pending);
+			rotate();
+		}
+
+		record->format->delRef();
+		m_ring->pop();
+
+		if (m_buffer.size() >= CLEVER_OUTPUT_BUFFER_SIZE) {
+			writeOut(m_buffer, m_buffer.size());
+		}
+	}
+
+	if (!m_buffer.empty()) {
+		writeOut(m_buffer, m_buffer.size());
+	}
+
+	m_sink_mutex.unlock();
+
+	m_mutex.lock();
+	m_written = m_ring->getPopped();
+	m_written_cond.broadcast();
+	m_mutex.unlock();
+}
+
+void LogWriter::writeOut(CString& buffer, size_t len)
+{
+	_write_all(m_fd, buffer.data(), len);
+
+	m_size += len;
+
+	if (len == buffer.size()) {
+		buffer.clear();
+	} else {
+		buffer.erase(0, len);
+	}
+}
+
+void LogWriter::rotate()
+{
+	::close(m_fd);
+
+	if (m_keep == 0) {
+		::remove(m_path.c_str());
+	} else {
+		char from[32], to[32];
+
+		for (size_t i = m_keep - 1; i > 0; --i) {
+			::sprintf(from, ".%lu", static_cast<unsigned long>(i));
+			::sprintf(to, ".%lu", static_cast<unsigned long>(i + 1));
+
+			::rename((m_path + from).c_str(), (m_path + to).c_str());
+		}
+		::rename(m_path.c_str(), (m_path + ".1").c_str());
+	}
+
+	m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+	m_size = 0;
+	m_opened = ::time(NULL);
+
+	// The records go to the standard error rather than nowhere
+	if (m_fd < 0) {
+		m_fd = 2;
+		m_path.clear();
+	}
+}
+
+void LogWriter::closeFile()
+{
+	if (!m_path.empty()) {
+		::close(m_fd);
+		m_fd = 2;
+		m_path.clear();
+	}
+}
+
+bool LogWriter::open(const ::std::string& path, size_t max_bytes,
+	time_t max_seconds, size_t keep)
+{
+	flush();
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+
+	m_sink_mutex.lock();
+
+	closeFile();
+
+	m_to_file = true;
+	m_fd = fd;
+	m_path = path;
+	m_size = ::fstat(fd, &st) == 0 ? st.st_size : 0;
+	m_opened = ::time(NULL);
+	m_max_bytes = max_bytes;
+	m_max_seconds = max_seconds;
+	m_keep = keep;
+
+	m_sink_mutex.unlock();
+
+	return true;
+}
+
+void LogWriter::close()
+{
+	flush();
+
+	m_sink_mutex.lock();
+	m_to_file = false;
+	closeFile();
+	m_sink_mutex.unlock();
+}
+
+void LogWriter::flush()
+{
+	LogRing* ring = m_ring;
+
+	if (ring == NULL) {
+		return;
+	}
+
+#ifdef CLEVER_THREADS
+	size_t pushed = ring->getPushed();
+
+	m_mutex.lock();
+
+	while (m_written < pushed) {
+		m_wakeup.signal();
+		m_written_cond.wait(m_mutex);
+	}
+
+	m_mutex.unlock();
+#endif
+}
+
+bool LogWriter::setCapacity(size_t capacity)
+{
+	m_mutex.lock();
+
+	bool started = m_ring != NULL;
+
+	if (!started) {
+		m_capacity = capacity;
+	}
+
+	m_mutex.unlock();
+
+	return !started;
+}
+
+}}}} // clever::modules::std::log
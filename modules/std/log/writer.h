@@ -0,0 +1,218 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_LOG_WRITER_H
+#define CLEVER_STD_LOG_WRITER_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "core/cstring.h"
+#include "core/cthread.h"
+#include "core/refcounted.h"
+
+namespace clever { namespace modules { namespace std { namespace log {
+
+// Log levels
+#define CLEVER_LOG_DEBUG   (1 << 0)
+#define CLEVER_LOG_INFO    (1 << 1)
+#define CLEVER_LOG_WARNING (1 << 2)
+#define CLEVER_LOG_ERROR   (1 << 3)
+#define CLEVER_LOG_FATAL   (1 << 4)
+#define CLEVER_LOG_ALL     ((1 << 5) - 1)
+
+// Records queued by default before new ones are dropped
+#define CLEVER_LOG_QUEUE_SIZE 8192
+
+/**
+ * Message template of a logger, parsed once
+ *
+ * The template is a literal text with the %{date}, %{level}, %{name} and
+ * %{message} fields. Records keep a reference to it, so that the writer
+ * thread formats them after the logger is gone; only the writer thread
+ * calls format().
+ */
+class LogFormat : public RefCounted {
+public:
+	LogFormat(const ::std::string& name, const ::std::string& format,
+		const ::std::string& date_format);
+
+	~LogFormat() {}
+
+	const ::std::string& getName() const { return m_name; }
+
+	/// Appends the formatted record to out
+	void format(CString& out, long level, time_t time,
+		const ::std::string& message);
+private:
+	enum Field { LITERAL, DATE, LEVEL, NAME, MESSAGE };
+
+	struct Part {
+		Part(Field field_, const ::std::string& text_)
+			: field(field_), text(text_) {}
+
+		Field field;
+		::std::string text;
+	};
+
+	::std::vector<Part> m_parts;
+	::std::string m_name;
+	::std::string m_date_format;
+
+	// Date of the last formatted record, as records of the same second
+	// share it
+	time_t m_date_time;
+	::std::string m_date;
+
+	DISALLOW_COPY_AND_ASSIGN(LogFormat);
+};
+
+struct LogRecord {
+	LogRecord()
+		: format(NULL), level(0), time(0) {}
+
+	LogFormat* format;
+	long level;
+	time_t time;
+	::std::string message;
+};
+
+/**
+ * Bounded multi-producer, single-consumer queue of log records
+ *
+ * Producers claim a slot with a compare-and-swap on the tail and publish
+ * it by bumping the slot sequence, so logging never takes a lock; a full
+ * queue makes push() fail instead of waiting. The message buffers of the
+ * slots are reused, so steady logging does not allocate.
+ */
+class LogRing {
+public:
+	explicit LogRing(size_t capacity);
+
+	~LogRing();
+
+	/// Copies the record into the queue; false when it is full
+	bool push(LogFormat*, long level, time_t, const char*, size_t);
+
+	/// Oldest published record, or NULL; only the consumer calls it
+	LogRecord* front();
+
+	/// Releases the record returned by front()
+	void pop();
+
+	/// Number of records pushed and popped so far
+	size_t getPushed() const { return m_tail; }
+	size_t getPopped() const { return m_head; }
+
+	size_t getCapacity() const { return m_mask + 1; }
+private:
+	struct Slot {
+		volatile size_t seq;
+		LogRecord record;
+	};
+
+	Slot* m_slots;
+	size_t m_mask;
+	volatile size_t m_head;
+	volatile size_t m_tail;
+
+	DISALLOW_COPY_AND_ASSIGN(LogRing);
+};
+
+/**
+ * Process-wide log writer
+ *
+ * Until a file is opened, records are formatted by the caller and written
+ * to the standard output through its OutputBuffer, keeping their order
+ * with the rest of the output. Records for a file are formatted and
+ * written by a background thread, started on the first one, so a stalled
+ * disk only delays the writer; when it falls behind by a full queue, new
+ * records are dropped and counted. Files are rotated when they would
+ * exceed a size or have been open for a time, keeping a number of old
+ * files as path.1, path.2, ...
+ */
+class LogWriter {
+public:
+	LogWriter();
+
+	/// Writes the pending records out and stops the thread
+	~LogWriter();
+
+	/// The writer of the module, created when it is loaded
+	static LogWriter* get() { return s_writer; }
+	static void set(LogWriter* writer) { s_writer = writer; }
+
+	/// Writes or queues a record; false when it was dropped
+	bool push(LogFormat*, long level, const char*, size_t);
+
+	/// Sends the records to the file, after writing the pending ones
+	/// \returns false and sets errno when the file cannot be opened
+	bool open(const ::std::string& path, size_t max_bytes,
+		time_t max_seconds, size_t keep);
+
+	/// Sends the records back to the standard output
+	void close();
+
+	/// Waits until the records queued so far are written
+	void flush();
+
+	/// Sets the queue size; only before the first record
+	bool setCapacity(size_t);
+
+	/// Number of records dropped since the start
+	size_t getDropped() const { return m_dropped; }
+private:
+	static CLEVER_THREAD_FUNC(run);
+
+	LogRing* start();
+	void stop();
+	void writeStdout(LogFormat*, long level, const char*, size_t);
+	void drain();
+	void writeOut(CString&, size_t len);
+	bool needsRotation(size_t pending, time_t) const;
+	void rotate();
+	void closeFile();
+
+	static LogWriter* s_writer;
+
+	// Created by the first record
+	LogRing* volatile m_ring;
+	size_t m_capacity;
+	volatile size_t m_dropped;
+
+	// Thread state, guarded by m_mutex
+	CThread m_thread;
+	CMutex m_mutex;
+	CCondition m_wakeup;
+	CCondition m_written_cond;
+	volatile bool m_sleeping;
+	bool m_stop;
+	size_t m_written;
+
+	// Sink state, guarded by m_sink_mutex (held while draining)
+	CMutex m_sink_mutex;
+	volatile bool m_to_file;
+	int m_fd;
+	::std::string m_path;
+	size_t m_size;
+	time_t m_opened;
+	size_t m_max_bytes;
+	time_t m_max_seconds;
+	size_t m_keep;
+
+	// Formatted records waiting to be written, used by the writer only
+	CString m_buffer;
+
+	// Record being written to the standard output
+	CString m_line;
+
+	DISALLOW_COPY_AND_ASSIGN(LogWriter);
+};
+
+}}}} // clever::modules::std::log
+
+#endif // CLEVER_STD_LOG_WRITER_H
@@ -13,6 +13,7 @@
 #include "core/native_types.h"
 #include "core/modmanager.h"
 #include "modules/std/math/math.h"
+#include "modules/std/math/typedarray.h"
 
 #ifndef M_PI
 #define M_PI    3.14159265358979323846
@@ -306,6 +307,9 @@ CLEVER_MODULE_INIT(Math)
 	addFunction(new Function("srand",  &CLEVER_NS_FNAME(math, srand)));
 
 	addVariable("PI", new Value(M_PI, true));
+
+	addType(new Int64ArrayType("Int64Array"));
+	addType(new Float64ArrayType("Float64Array"));
 }
 
 }}} // clever::modules::std
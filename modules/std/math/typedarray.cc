@@ -0,0 +1,587 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include "core/value.h"
+#include "core/cexception.h"
+#include "modules/std/core/array.h"
+#include "modules/std/core/function.h"
+#include "modules/std/math/typedarray.h"
+
+namespace clever { namespace modules { namespace std {
+
+// Kernels /////////////////////////////////////////////////////////////////////
+//
+// Plain loops over contiguous storage, left for the compiler to vectorize.
+// Integer arithmetic wraps around like the unsigned equivalent instead of
+// overflowing; double reductions keep four partial results so the additions
+// do not form a single dependency chain.
+
+static inline long _typed_sum(const long* data, size_t size)
+{
+	unsigned long total = 0;
+
+	for (size_t i = 0; i < size; ++i) {
+		total += static_cast<unsigned long>(data[i]);
+	}
+
+	return static_cast<long>(total);
+}
+
+static inline double _typed_sum(const double* data, size_t size)
+{
+	double part[4] = {0.0, 0.0, 0.0, 0.0};
+	size_t i = 0;
+
+	for (; i + 4 <= size; i += 4) {
+		part[0] += data[i];
+		part[1] += data[i + 1];
+		part[2] += data[i + 2];
+		part[3] += data[i + 3];
+	}
+
+	for (; i < size; ++i) {
+		part[0] += data[i];
+	}
+
+	return (part[0] + part[1]) + (part[2] + part[3]);
+}
+
+static inline long _typed_dot(const long* a, const long* b, size_t size)
+{
+	unsigned long total = 0;
+
+	for (size_t i = 0; i < size; ++i) {
+		total += static_cast<unsigned long>(a[i]) * static_cast<unsigned long>(b[i]);
+	}
+
+	return static_cast<long>(total);
+}
+
+static inline double _typed_dot(const double* a, const double* b, size_t size)
+{
+	double part[4] = {0.0, 0.0, 0.0, 0.0};
+	size_t i = 0;
+
+	for (; i + 4 <= size; i += 4) {
+		part[0] += a[i] * b[i];
+		part[1] += a[i + 1] * b[i + 1];
+		part[2] += a[i + 2] * b[i + 2];
+		part[3] += a[i + 3] * b[i + 3];
+	}
+
+	for (; i < size; ++i) {
+		part[0] += a[i] * b[i];
+	}
+
+	return (part[0] + part[1]) + (part[2] + part[3]);
+}
+
+static inline void _typed_scale(long* data, size_t size, long factor)
+{
+	unsigned long ufactor = static_cast<unsigned long>(factor);
+
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = static_cast<long>(static_cast<unsigned long>(data[i]) * ufactor);
+	}
+}
+
+static inline void _typed_scale(double* data, size_t size, double factor)
+{
+	for (size_t i = 0; i < size; ++i) {
+		data[i] *= factor;
+	}
+}
+
+static inline void _typed_add(long* data, const long* other, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = static_cast<long>(static_cast<unsigned long>(data[i])
+			+ static_cast<unsigned long>(other[i]));
+	}
+}
+
+static inline void _typed_add(double* data, const double* other, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		data[i] += other[i];
+	}
+}
+
+static inline void _typed_add_scalar(long* data, size_t size, long num)
+{
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = static_cast<long>(static_cast<unsigned long>(data[i])
+			+ static_cast<unsigned long>(num));
+	}
+}
+
+static inline void _typed_add_scalar(double* data, size_t size, double num)
+{
+	for (size_t i = 0; i < size; ++i) {
+		data[i] += num;
+	}
+}
+
+// Element conversion //////////////////////////////////////////////////////////
+
+template <>
+bool TypedArray<long>::toElement(const Value* value, long& elem)
+{
+	if (!value->isInt()) {
+		return false;
+	}
+	elem = value->getInt();
+	return true;
+}
+
+template <>
+bool TypedArray<double>::toElement(const Value* value, double& elem)
+{
+	if (value->isDouble()) {
+		elem = value->getDouble();
+	} else if (value->isInt()) {
+		elem = value->getInt();
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// TypedArray //////////////////////////////////////////////////////////////////
+
+template <typename T>
+::std::string TypedArray<T>::toString(TypeObject* value) const
+{
+	const ::std::vector<T>& vec = static_cast<TypedArrayObject<T>*>(value)->getData();
+	::std::ostringstream out;
+	Value* elem = new Value;
+
+	out << "[";
+
+	for (size_t i = 0, n = vec.size(); i < n; ++i) {
+		TypedArrayObject<T>::setNumber(elem, vec[i]);
+		elem->dump(out);
+
+		if (i < n - 1) {
+			out << ", ";
+		}
+	}
+
+	out << "]";
+
+	clever_delref(elem);
+
+	return out.str();
+}
+
+// Subscript operator
+// Only reads are supported, since elements are not values; use set()
+template <typename T>
+CLEVER_TYPE_AT_OPERATOR(TypedArray<T>::at_op)
+{
+	TypedArrayObject<T>* arr = clever_get_this(TypedArrayObject<T>*);
+
+	if (is_write) {
+		clever_throw("%T elements must be changed with set()", this);
+		return NULL;
+	}
+
+	if (!index->isInt()) {
+		clever_throw("Invalid array index type");
+		return NULL;
+	}
+
+	if (index->getInt() < 0
+		|| static_cast<unsigned long>(index->getInt()) >= arr->getData().size()) {
+		clever_throw("Array index out of bound!");
+		return NULL;
+	}
+
+	return arr->read(index->getInt());
+}
+
+// Int64Array.new([Int size | Array values])
+// Float64Array.new([Int size | Array values])
+// Creates an empty array, size zeroes, or a copy of the numbers in values
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::ctor)
+{
+	if (!clever_check_args("|.")) {
+		return;
+	}
+
+	if (args.empty()) {
+		result->setObj(this, new TypedArrayObject<T>);
+		return;
+	}
+
+	if (args[0]->isInt()) {
+		if (args[0]->getInt() < 0) {
+			clever_throw("Array size cannot be negative");
+			return;
+		}
+		result->setObj(this, new TypedArrayObject<T>(args[0]->getInt()));
+		return;
+	}
+
+	if (!args[0]->isArray()) {
+		clever_throw("%T.new() expects a size or an Array", this);
+		return;
+	}
+
+	const ValueVector& values = clever_get_object(ArrayObject*, args[0])->getData();
+	TypedArrayObject<T>* arr = new TypedArrayObject<T>(values.size());
+	::std::vector<T>& data = arr->getData();
+
+	for (size_t i = 0, n = values.size(); i < n; ++i) {
+		if (values[i] == NULL || !toElement(values[i], data[i])) {
+			arr->delRef();
+			clever_throw("Element #%N cannot be stored in a %T", i, this);
+			return;
+		}
+	}
+
+	result->setObj(this, arr);
+}
+
+// Int size()
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::size)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	result->setInt(clever_get_this(TypedArrayObject<T>*)->getData().size());
+}
+
+// void resize(Int size)
+// New elements are zero
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::resize)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	if (args[0]->getInt() < 0) {
+		clever_throw("Array size cannot be negative");
+		return;
+	}
+
+	clever_get_this(TypedArrayObject<T>*)->getData().resize(args[0]->getInt());
+}
+
+// void append(Number value)
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::append)
+{
+	if (!clever_check_args("n")) {
+		return;
+	}
+
+	T elem;
+
+	if (!toElement(args[0], elem)) {
+		clever_throw("%T cannot be stored in a %T", args[0]->getType(), this);
+		return;
+	}
+
+	clever_get_this(TypedArrayObject<T>*)->getData().push_back(elem);
+}
+
+// Number get(Int index)
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::get)
+{
+	if (!clever_check_args("i")) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+	long index = args[0]->getInt();
+
+	if (index < 0 || static_cast<unsigned long>(index) >= data.size()) {
+		clever_throw("Array index out of bound!");
+		return;
+	}
+
+	TypedArrayObject<T>::setNumber(result, data[index]);
+}
+
+// void set(Int index, Number value)
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::set)
+{
+	if (!clever_check_args("in")) {
+		return;
+	}
+
+	::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+	long index = args[0]->getInt();
+
+	if (index < 0 || static_cast<unsigned long>(index) >= data.size()) {
+		clever_throw("Array index out of bound!");
+		return;
+	}
+
+	if (!toElement(args[1], data[index])) {
+		clever_throw("%T cannot be stored in a %T", args[1]->getType(), this);
+	}
+}
+
+// void fill(Number value)
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::fill)
+{
+	if (!clever_check_args("n")) {
+		return;
+	}
+
+	T elem;
+
+	if (!toElement(args[0], elem)) {
+		clever_throw("%T cannot be stored in a %T", args[0]->getType(), this);
+		return;
+	}
+
+	::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	::std::fill(data.begin(), data.end(), elem);
+}
+
+// Number sum()
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::sum)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	TypedArrayObject<T>::setNumber(result,
+		_typed_sum(data.empty() ? NULL : &data[0], data.size()));
+}
+
+// Number min()
+// Returns null for an empty array
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::min)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	if (data.empty()) {
+		result->setNull();
+		return;
+	}
+
+	TypedArrayObject<T>::setNumber(result,
+		*::std::min_element(data.begin(), data.end()));
+}
+
+// Number max()
+// Returns null for an empty array
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::max)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	if (data.empty()) {
+		result->setNull();
+		return;
+	}
+
+	TypedArrayObject<T>::setNumber(result,
+		*::std::max_element(data.begin(), data.end()));
+}
+
+// Number dot(other)
+// Returns the dot product with an array of the same type and size
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::dot)
+{
+	if (!clever_check_args("c")) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+	const ::std::vector<T>& other =
+		clever_get_object(TypedArrayObject<T>*, args[0])->getData();
+
+	if (data.size() != other.size()) {
+		clever_throw("Arrays must have the same size");
+		return;
+	}
+
+	TypedArrayObject<T>::setNumber(result, data.empty() ? T(0)
+		: _typed_dot(&data[0], &other[0], data.size()));
+}
+
+// void scale(Number factor)
+// Multiplies every element by factor
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::scale)
+{
+	if (!clever_check_args("n")) {
+		return;
+	}
+
+	T factor;
+
+	if (!toElement(args[0], factor)) {
+		clever_throw("%T cannot be stored in a %T", args[0]->getType(), this);
+		return;
+	}
+
+	::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	if (!data.empty()) {
+		_typed_scale(&data[0], data.size(), factor);
+	}
+}
+
+// void add(Number value | other)
+// Adds value to every element, or the elements of an array of the same type
+// and size element-wise
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::add)
+{
+	if (!clever_check_args(".")) {
+		return;
+	}
+
+	::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	if (args[0]->getType() == this) {
+		const ::std::vector<T>& other =
+			clever_get_object(TypedArrayObject<T>*, args[0])->getData();
+
+		if (data.size() != other.size()) {
+			clever_throw("Arrays must have the same size");
+			return;
+		}
+
+		if (!data.empty()) {
+			_typed_add(&data[0], &other[0], data.size());
+		}
+		return;
+	}
+
+	T num;
+
+	if (!toElement(args[0], num)) {
+		clever_throw("%T cannot be added to a %T", args[0]->getType(), this);
+		return;
+	}
+
+	if (!data.empty()) {
+		_typed_add_scalar(&data[0], data.size(), num);
+	}
+}
+
+// void sort()
+// Sorts the elements in ascending order
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::sort)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+
+	::std::sort(data.begin(), data.end());
+}
+
+// Number polyval(Number x)
+// Evaluates the polynomial whose coefficients are the elements, from the
+// highest degree down, at x
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::polyval)
+{
+	if (!clever_check_args("n")) {
+		return;
+	}
+
+	T x;
+
+	if (!toElement(args[0], x)) {
+		clever_throw("%T cannot be stored in a %T", args[0]->getType(), this);
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+	T total = T(0);
+
+	for (size_t i = 0, n = data.size(); i < n; ++i) {
+		total = total * x + data[i];
+	}
+
+	TypedArrayObject<T>::setNumber(result, total);
+}
+
+// Array toArray()
+template <typename T>
+CLEVER_METHOD(TypedArray<T>::toArray)
+{
+	if (!clever_check_no_args()) {
+		return;
+	}
+
+	const ::std::vector<T>& data = clever_get_this(TypedArrayObject<T>*)->getData();
+	ArrayObject* arr = new ArrayObject;
+	ValueVector& values = arr->getData();
+
+	values.reserve(data.size());
+
+	for (size_t i = 0, n = data.size(); i < n; ++i) {
+		Value* elem = new Value;
+
+		TypedArrayObject<T>::setNumber(elem, data[i]);
+		values.push_back(elem);
+	}
+
+	result->setObj(CLEVER_ARRAY_TYPE, arr);
+}
+
+template <typename T>
+CLEVER_TYPE_INIT(TypedArray<T>::init)
+{
+	setConstructor((MethodPtr)&TypedArray<T>::ctor);
+
+	addMethod(new Function("size",    (MethodPtr)&TypedArray<T>::size));
+	addMethod(new Function("resize",  (MethodPtr)&TypedArray<T>::resize));
+	addMethod(new Function("append",  (MethodPtr)&TypedArray<T>::append));
+	addMethod(new Function("get",     (MethodPtr)&TypedArray<T>::get));
+	addMethod(new Function("set",     (MethodPtr)&TypedArray<T>::set));
+	addMethod(new Function("fill",    (MethodPtr)&TypedArray<T>::fill));
+	addMethod(new Function("sum",     (MethodPtr)&TypedArray<T>::sum));
+	addMethod(new Function("min",     (MethodPtr)&TypedArray<T>::min));
+	addMethod(new Function("max",     (MethodPtr)&TypedArray<T>::max));
+	addMethod(new Function("dot",     (MethodPtr)&TypedArray<T>::dot));
+	addMethod(new Function("scale",   (MethodPtr)&TypedArray<T>::scale));
+	addMethod(new Function("add",     (MethodPtr)&TypedArray<T>::add));
+	addMethod(new Function("sort",    (MethodPtr)&TypedArray<T>::sort));
+	addMethod(new Function("polyval", (MethodPtr)&TypedArray<T>::polyval));
+	addMethod(new Function("toArray", (MethodPtr)&TypedArray<T>::toArray));
+}
+
+template class TypedArray<long>;
+template class TypedArray<double>;
+
+}}} // clever::modules::std
@@ -0,0 +1,106 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#ifndef CLEVER_STD_MATH_TYPEDARRAY_H
+#define CLEVER_STD_MATH_TYPEDARRAY_H
+
+#include <vector>
+#include "core/type.h"
+#include "core/value.h"
+
+namespace clever { namespace modules { namespace std {
+
+/**
+ * Contiguous array of raw numbers
+ *
+ * Elements are stored unboxed; reads through the subscript operator box
+ * the element into a new value, so the array is never changed by a read.
+ */
+template <typename T>
+class TypedArrayObject : public TypeObject {
+public:
+	TypedArrayObject() {}
+
+	explicit TypedArrayObject(size_t size)
+		: m_data(size) {}
+
+	~TypedArrayObject() {}
+
+	::std::vector<T>& getData() { return m_data; }
+
+	/// Returns a new value holding the element at index
+	Value* read(size_t index) const {
+		Value* value = new Value;
+
+		setNumber(value, m_data[index]);
+
+		return value;
+	}
+
+	static void setNumber(Value* value, long num) { value->setInt(num); }
+	static void setNumber(Value* value, double num) { value->setDouble(num); }
+private:
+	::std::vector<T> m_data;
+
+	DISALLOW_COPY_AND_ASSIGN(TypedArrayObject);
+};
+
+typedef TypedArrayObject<long> Int64ArrayObject;
+typedef TypedArrayObject<double> Float64ArrayObject;
+
+/**
+ * Int64Array and Float64Array
+ *
+ * T is the element type; elements are converted from script values by
+ * toElement(), which accepts Int for Int64Array and any number for
+ * Float64Array.
+ */
+template <typename T>
+class TypedArray : public Type {
+public:
+	TypedArray(const char* name)
+		: Type(name) {}
+
+	~TypedArray() {}
+
+	virtual void init();
+	virtual ::std::string toString(TypeObject*) const;
+
+	// Methods
+	CLEVER_METHOD(ctor);
+	CLEVER_METHOD(size);
+	CLEVER_METHOD(resize);
+	CLEVER_METHOD(append);
+	CLEVER_METHOD(get);
+	CLEVER_METHOD(set);
+	CLEVER_METHOD(fill);
+	CLEVER_METHOD(sum);
+	CLEVER_METHOD(min);
+	CLEVER_METHOD(max);
+	CLEVER_METHOD(dot);
+	CLEVER_METHOD(scale);
+	CLEVER_METHOD(add);
+	CLEVER_METHOD(sort);
+	CLEVER_METHOD(polyval);
+	CLEVER_METHOD(toArray);
+
+	// Operators
+	Value* CLEVER_FASTCALL at_op(CLEVER_TYPE_AT_OPERATOR_ARGS) const;
+private:
+	/// Converts value to an element, or returns false when it is not a
+	/// number of the element kind
+	static bool toElement(const Value* value, T& elem);
+
+	DISALLOW_COPY_AND_ASSIGN(TypedArray);
+};
+
+typedef TypedArray<long> Int64ArrayType;
+typedef TypedArray<double> Float64ArrayType;
+
+}}} // clever::modules::std
+
+#endif // CLEVER_STD_MATH_TYPEDARRAY_H
@@ -12,6 +12,9 @@
 #ifdef HAVE_MOD_STD_EVENTS
 # include "modules/std/events/events.h"
 #endif
+#ifdef HAVE_MOD_STD_LOG
+# include "modules/std/log/log.h"
+#endif
 #ifdef HAVE_MOD_STD_SYS
 # include "modules/std/sys/sys.h"
 #endif
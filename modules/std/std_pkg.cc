@@ -22,6 +22,9 @@ void Std::init()
 #ifdef HAVE_MOD_STD_EVENTS
 	addModule(new std::EventsModule);
 #endif
+#ifdef HAVE_MOD_STD_LOG
+	addModule(new std::LogModule);
+#endif
 #ifdef HAVE_MOD_STD_DATE
 	addModule(new std::DateModule);
 #endif
@@ -25,6 +25,9 @@
 #include "core/native_types.h"
 #include "core/modmanager.h"
 #include "core/cexception.h"
+#include "core/output.h"
+#include "core/vmstats.h"
+#include "modules/std/core/map.h"
 #include "modules/std/sys/sys.h"
 
 #ifndef PATH_MAX
@@ -43,6 +46,9 @@ static CLEVER_FUNCTION(system)
 		return;
 	}
 
+	// The command writes to the same stdout
+	OutputBuffer::getStdout().flush();
+
 	result->setInt(::system(args[0]->getStr()->c_str()));
 }
 
@@ -68,7 +74,7 @@ static CLEVER_FUNCTION(get_env)
 	const char* ret = ::getenv(const_cast<char*>(args[0]->getStr()->c_str()));
 
 	if (ret) {
-		result->setStr(CSTRINGT(ret));
+		result->setStr(::std::string(ret));
 	} else {
 		result->setStr(CSTRING(""));
 	}
@@ -220,6 +226,12 @@ static CLEVER_FUNCTION(info)
 #else
 	oss << "No\n";
 #endif
+	oss << "VM Stats: ";
+#ifdef CLEVER_VM_STATS
+	oss << "Yes\n";
+#else
+	oss << "No\n";
+#endif
 
 	oss << "OS: ";
 #ifdef CLEVER_WIN32
@@ -247,6 +259,68 @@ static CLEVER_FUNCTION(info)
 	return result->setStr(new StrObject(oss.str()));
 }
 
+// vm_stats()
+// Returns a map with the totals of the VM statistics, or null when the
+// interpreter was built without them (-DVM_STATS=1)
+static CLEVER_FUNCTION(vm_stats)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+#ifdef CLEVER_VM_STATS
+	VMStats::Totals totals = VMStats::getTotals();
+	MapObject* map = new MapObject;
+
+	map->insertValue("instructions", new Value(long(totals.instructions)));
+	map->insertValue("calls", new Value(long(totals.calls)));
+
+	for (size_t i = 0; i < VMStats::NUM_COUNTERS; ++i) {
+		VMStats::Counter counter = static_cast<VMStats::Counter>(i);
+
+		map->insertValue(VMStats::getCounterName(counter),
+			new Value(long(totals.counters[i])));
+	}
+
+	result->setObj(CLEVER_MAP_TYPE, map);
+#else
+	result->setNull();
+#endif
+}
+
+// vm_stats_report()
+// Returns the VM statistics report, a tab-separated row per counter,
+// opcode, instruction and function, or null when they are not built in
+static CLEVER_FUNCTION(vm_stats_report)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+#ifdef CLEVER_VM_STATS
+	::std::ostringstream oss;
+
+	VMStats::report(oss);
+
+	result->setStr(new StrObject(oss.str()));
+#else
+	result->setNull();
+#endif
+}
+
+// vm_stats_reset()
+// Sets the VM statistics back to zero
+static CLEVER_FUNCTION(vm_stats_reset)
+{
+	if (!clever_static_check_no_args()) {
+		return;
+	}
+
+#ifdef CLEVER_VM_STATS
+	VMStats::reset();
+#endif
+}
+
 // Returns a Value ptr containing the OS name
 static Value* get_os()
 {
@@ -301,6 +375,10 @@ CLEVER_MODULE_INIT(SYSModule)
 	addFunction(new Function("info",      &CLEVER_NS_FNAME(sys, info)));
 	addFunction(new Function("exit",      &CLEVER_NS_FNAME(sys, exit)));
 
+	addFunction(new Function("vm_stats",        &CLEVER_NS_FNAME(sys, vm_stats)));
+	addFunction(new Function("vm_stats_report", &CLEVER_NS_FNAME(sys, vm_stats_report)));
+	addFunction(new Function("vm_stats_reset",  &CLEVER_NS_FNAME(sys, vm_stats_reset)));
+
 	addVariable("OS",   sys::get_os());
 	addVariable("argc", new Value(long(*g_clever_argc), true));
 	addVariable("argv", sys::get_argv());
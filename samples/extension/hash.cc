@@ -0,0 +1,88 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+#include "core/extension.h"
+#include "core/value.h"
+#include "core/cstring.h"
+
+namespace clever { namespace ext {
+
+namespace hash {
+
+// fnv1a(string)
+// Returns the 32-bit FNV-1a hash of the string
+static CLEVER_FUNCTION(fnv1a)
+{
+	if (!clever_static_check_args("s")) {
+		return;
+	}
+
+	const CString* str = args[0]->getStr();
+	unsigned long hash = 2166136261UL;
+
+	for (size_t i = 0; i < str->size(); ++i) {
+		hash = ((hash ^ static_cast<unsigned char>((*str)[i])) * 16777619UL) & 0xffffffffUL;
+	}
+
+	result->setInt(hash);
+}
+
+// crc32(string)
+// Returns the CRC-32 (as used by zlib) of the string
+static CLEVER_FUNCTION(crc32)
+{
+	if (!clever_static_check_args("s")) {
+		return;
+	}
+
+	static unsigned long table[256];
+
+	if (!table[1]) {
+		for (unsigned long n = 0; n < 256; ++n) {
+			unsigned long c = n;
+
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+	}
+
+	const CString* str = args[0]->getStr();
+	unsigned long crc = 0xffffffffUL;
+
+	for (size_t i = 0; i < str->size(); ++i) {
+		crc = table[(crc ^ static_cast<unsigned char>((*str)[i])) & 0xff] ^ (crc >> 8);
+	}
+
+	result->setInt(crc ^ 0xffffffffUL);
+}
+
+} // clever::ext::hash
+
+/// Sample extension module (import sample.hash)
+class Hash : public Module {
+public:
+	Hash()
+		: Module("sample.hash") {}
+
+	~Hash() {}
+
+	CLEVER_MODULE_VIRTUAL_METHODS_DECLARATION;
+private:
+	DISALLOW_COPY_AND_ASSIGN(Hash);
+};
+
+CLEVER_MODULE_INIT(Hash)
+{
+	addFunction(new Function("fnv1a", &CLEVER_NS_FNAME(hash, fnv1a)));
+	addFunction(new Function("crc32", &CLEVER_NS_FNAME(hash, crc32)));
+}
+
+}} // clever::ext
+
+CLEVER_EXTENSION(clever::ext::Hash)
@@ -0,0 +1,34 @@
+# Runs cache_main.clv twice with an empty compilation cache: the first run
+# compiles cache_lib.clv and caches it, the second one loads it from the
+# cache, unless $1 is "edit" (the library is changed in between) or
+# "damage" (the cache file is). Then tells whether the second run wrote
+# the cache file again.
+dir=$(mktemp -d "${TMPDIR:-/tmp}/clever-cache.XXXXXX") || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+cp tests/lang/cache_main.clv tests/lang/cache_lib.clv "$dir" || exit 1
+
+CLEVER_CACHE_DIR="$dir/cache"
+export CLEVER_CACHE_DIR
+
+./clever "$dir/cache_main.clv" || exit 1
+
+unit=$(ls "$dir"/cache/*.clvc) || exit 1
+
+case "$1" in
+	edit)
+		sed 's/", "/", dear "/' tests/lang/cache_lib.clv > "$dir/cache_lib.clv" ;;
+	damage)
+		printf 'x' | dd of="$unit" bs=1 seek=$(($(wc -c < "$unit") - 8)) \
+			conv=notrunc 2>/dev/null ;;
+esac
+
+before=$(ls -i "$unit")
+
+./clever "$dir/cache_main.clv" || exit 1
+
+if [ "$(ls -i "$unit")" = "$before" ]; then
+	echo "cache kept"
+else
+	echo "cache written"
+fi
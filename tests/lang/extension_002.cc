@@ -0,0 +1,12 @@
+/**
+ * Clever programming language
+ * Copyright (c) Clever Team
+ *
+ * This file is distributed under the MIT license. See LICENSE for details.
+ */
+
+// A shared library without the entry point of the extension modules
+int clever_test_plain()
+{
+	return 0;
+}